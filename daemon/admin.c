@@ -32,6 +32,7 @@
 #include "datatypes.h"
 #include "viralloc.h"
 #include "virerror.h"
+#include "virhoststats.h"
 #include "virlog.h"
 #include "virnetdaemon.h"
 #include "virnetserver.h"
@@ -346,6 +347,100 @@ adminDispatchServerGetClientLimits(virNetServerPtr server ATTRIBUTE_UNUSED,
     return rv;
 }
 
+static int
+adminDispatchServerGetRPCStats(virNetServerPtr server ATTRIBUTE_UNUSED,
+                               virNetServerClientPtr client,
+                               virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                               virNetMessageErrorPtr rerr ATTRIBUTE_UNUSED,
+                               admin_server_get_rpc_stats_args *args,
+                               admin_server_get_rpc_stats_ret *ret)
+{
+    int rv = -1;
+    virNetServerPtr srv = NULL;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    struct daemonAdmClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+
+    if (!(srv = virNetDaemonGetServer(priv->dmn, args->srv.name)))
+        goto cleanup;
+
+    if (adminServerGetRPCStats(srv, &params, &nparams, args->flags) < 0)
+        goto cleanup;
+
+    if (nparams > ADMIN_SERVER_RPC_STATS_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of RPC statistics parameters %d exceeds "
+                         "max allowed limit: %d"), nparams,
+                       ADMIN_SERVER_RPC_STATS_MAX);
+        goto cleanup;
+    }
+
+    if (virTypedParamsSerialize(params, nparams,
+                                (virTypedParameterRemotePtr *) &ret->params.params_val,
+                                &ret->params.params_len, 0) < 0)
+        goto cleanup;
+
+    rv = 0;
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+
+    virTypedParamsFree(params, nparams);
+    virObjectUnref(srv);
+    return rv;
+}
+
+static int
+adminDispatchConnectGetHostCPURates(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                    virNetServerClientPtr client ATTRIBUTE_UNUSED,
+                                    virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                    virNetMessageErrorPtr rerr,
+                                    admin_connect_get_host_cpu_rates_args *args,
+                                    admin_connect_get_host_cpu_rates_ret *ret)
+{
+    int rv = -1;
+    int rc;
+    unsigned int flags = args->flags;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    int maxparams = 0;
+
+    virCheckFlagsGoto(0, cleanup);
+
+    if ((rc = virHostStatsGetCPURates(args->cpuNum, &params,
+                                      &nparams, &maxparams)) < 0)
+        goto cleanup;
+
+    if (rc == 0) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("host CPU rates are not available, they require "
+                         "host_stats_interval to be set"));
+        goto cleanup;
+    }
+
+    if (nparams > ADMIN_HOST_CPU_RATES_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of host CPU rates parameters %d exceeds "
+                         "max allowed limit: %d"), nparams,
+                       ADMIN_HOST_CPU_RATES_MAX);
+        goto cleanup;
+    }
+
+    if (virTypedParamsSerialize(params, nparams,
+                                (virTypedParameterRemotePtr *) &ret->params.params_val,
+                                &ret->params.params_len, 0) < 0)
+        goto cleanup;
+
+    rv = 0;
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+
+    virTypedParamsFree(params, nparams);
+    return rv;
+}
+
 static int
 adminDispatchServerSetClientLimits(virNetServerPtr server ATTRIBUTE_UNUSED,
                                    virNetServerClientPtr client,
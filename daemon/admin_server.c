@@ -86,7 +86,19 @@ adminServerGetThreadPoolParameters(virNetServerPtr srv,
     size_t freeWorkers;
     size_t nPrioWorkers;
     size_t jobQueueDepth;
+    virThreadPoolStats stats;
     virTypedParameterPtr tmpparams = NULL;
+    size_t i;
+    const char *latencyFields[] = {
+        VIR_THREADPOOL_JOB_QUEUE_LATENCY_1MS,
+        VIR_THREADPOOL_JOB_QUEUE_LATENCY_10MS,
+        VIR_THREADPOOL_JOB_QUEUE_LATENCY_100MS,
+        VIR_THREADPOOL_JOB_QUEUE_LATENCY_1S,
+        VIR_THREADPOOL_JOB_QUEUE_LATENCY_10S,
+        VIR_THREADPOOL_JOB_QUEUE_LATENCY_INF,
+    };
+
+    verify(ARRAY_CARDINALITY(latencyFields) == VIR_THREAD_POOL_LATENCY_BUCKETS);
 
     virCheckFlags(0, -1);
 
@@ -129,6 +141,26 @@ adminServerGetThreadPoolParameters(virNetServerPtr srv,
                               jobQueueDepth) < 0)
         goto cleanup;
 
+    if (virNetServerGetThreadPoolStats(srv, &stats) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddULLong(&tmpparams, nparams,
+                                &maxparams, VIR_THREADPOOL_JOBS,
+                                stats.jobs) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddULLong(&tmpparams, nparams,
+                                &maxparams, VIR_THREADPOOL_JOB_QUEUE_LATENCY,
+                                stats.latencySum) < 0)
+        goto cleanup;
+
+    for (i = 0; i < VIR_THREAD_POOL_LATENCY_BUCKETS; i++) {
+        if (virTypedParamsAddULLong(&tmpparams, nparams,
+                                    &maxparams, latencyFields[i],
+                                    stats.latency[i]) < 0)
+            goto cleanup;
+    }
+
     *params = tmpparams;
     tmpparams = NULL;
     ret = 0;
@@ -354,6 +386,107 @@ adminServerGetClientLimits(virNetServerPtr srv,
     return ret;
 }
 
+static const char *adminServerRPCPhases[] = {
+    "queue", "dispatch", "driver", "reply",
+};
+verify(ARRAY_CARDINALITY(adminServerRPCPhases) ==
+       VIR_NET_SERVER_PROGRAM_PHASE_LAST);
+
+static const char *adminServerRPCBuckets[] = {
+    VIR_SERVER_RPC_STATS_LATENCY_100US,
+    VIR_SERVER_RPC_STATS_LATENCY_1MS,
+    VIR_SERVER_RPC_STATS_LATENCY_10MS,
+    VIR_SERVER_RPC_STATS_LATENCY_100MS,
+    VIR_SERVER_RPC_STATS_LATENCY_1S,
+    VIR_SERVER_RPC_STATS_LATENCY_INF,
+};
+verify(ARRAY_CARDINALITY(adminServerRPCBuckets) ==
+       VIR_NET_SERVER_PROGRAM_LATENCY_BUCKETS);
+
+static int
+adminServerAddProcStats(virTypedParameterPtr *params,
+                        int *nparams,
+                        int *maxparams,
+                        const char *name,
+                        virNetServerProgramProcStatsPtr stats)
+{
+    char field[VIR_TYPED_PARAM_FIELD_LENGTH];
+    size_t i;
+    size_t j;
+
+    snprintf(field, sizeof(field), "%s.%s", name, VIR_SERVER_RPC_STATS_CALLS);
+    if (virTypedParamsAddULLong(params, nparams, maxparams,
+                                field, stats->calls) < 0)
+        return -1;
+
+    for (i = 0; i < VIR_NET_SERVER_PROGRAM_PHASE_LAST; i++) {
+        snprintf(field, sizeof(field), "%s.%s.%s", name,
+                 adminServerRPCPhases[i], VIR_SERVER_RPC_STATS_TIME);
+        if (virTypedParamsAddULLong(params, nparams, maxparams,
+                                    field, stats->time[i]) < 0)
+            return -1;
+
+        for (j = 0; j < VIR_NET_SERVER_PROGRAM_LATENCY_BUCKETS; j++) {
+            snprintf(field, sizeof(field), "%s.%s.%s", name,
+                     adminServerRPCPhases[i], adminServerRPCBuckets[j]);
+            if (virTypedParamsAddULLong(params, nparams, maxparams,
+                                        field, stats->latency[i][j]) < 0)
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+int
+adminServerGetRPCStats(virNetServerPtr srv,
+                       virTypedParameterPtr *params,
+                       int *nparams,
+                       unsigned int flags)
+{
+    int ret = -1;
+    int maxparams = 0;
+    virTypedParameterPtr tmpparams = NULL;
+    virNetServerProgramPtr *progs = NULL;
+    int nprogs = 0;
+    size_t i;
+    size_t j;
+
+    virCheckFlags(0, -1);
+
+    *nparams = 0;
+
+    if ((nprogs = virNetServerGetPrograms(srv, &progs)) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nprogs; i++) {
+        size_t nprocs = virNetServerProgramGetNProcs(progs[i]);
+
+        for (j = 0; j < nprocs; j++) {
+            virNetServerProgramProcStats stats;
+            const char *name;
+
+            /* Don't bother with procedures which were never called */
+            if (!(name = virNetServerProgramGetProcStats(progs[i], j, &stats)) ||
+                !stats.calls)
+                continue;
+
+            if (adminServerAddProcStats(&tmpparams, nparams, &maxparams,
+                                        name, &stats) < 0)
+                goto cleanup;
+        }
+    }
+
+    *params = tmpparams;
+    tmpparams = NULL;
+    ret = 0;
+
+ cleanup:
+    virTypedParamsFree(tmpparams, *nparams);
+    virObjectListFreeCount(progs, nprogs);
+    return ret;
+}
+
 int
 adminServerSetClientLimits(virNetServerPtr srv,
                            virTypedParameterPtr params,
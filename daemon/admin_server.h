@@ -67,6 +67,11 @@ int adminServerGetClientLimits(virNetServerPtr srv,
                                int *nparams,
                                unsigned int flags);
 
+int adminServerGetRPCStats(virNetServerPtr srv,
+                           virTypedParameterPtr *params,
+                           int *nparams,
+                           unsigned int flags);
+
 int adminServerSetClientLimits(virNetServerPtr srv,
                                virTypedParameterPtr params,
                                int nparams,
@@ -349,6 +349,8 @@ daemonConfigLoadOptions(struct daemonConfig *data,
 
     if (virConfGetValueUInt(conf, "max_client_requests", &data->max_client_requests) < 0)
         goto error;
+    if (virConfGetValueUInt(conf, "max_client_requests_adaptive", &data->max_client_requests_adaptive) < 0)
+        goto error;
 
     if (virConfGetValueUInt(conf, "admin_min_workers", &data->admin_min_workers) < 0)
         goto error;
@@ -377,6 +379,8 @@ daemonConfigLoadOptions(struct daemonConfig *data,
         goto error;
     if (virConfGetValueString(conf, "log_outputs", &data->log_outputs) < 0)
         goto error;
+    if (virConfGetValueBool(conf, "log_async", &data->log_async) < 0)
+        goto error;
 
     if (virConfGetValueInt(conf, "keepalive_interval", &data->keepalive_interval) < 0)
         goto error;
@@ -391,6 +395,12 @@ daemonConfigLoadOptions(struct daemonConfig *data,
     if (virConfGetValueUInt(conf, "ovs_timeout", &data->ovs_timeout) < 0)
         goto error;
 
+    if (virConfGetValueBool(conf, "firewall_batch_rules", &data->firewall_batch_rules) < 0)
+        goto error;
+
+    if (virConfGetValueUInt(conf, "host_stats_interval", &data->host_stats_interval) < 0)
+        goto error;
+
     return 0;
 
  error:
@@ -72,10 +72,12 @@ struct daemonConfig {
     unsigned int prio_workers;
 
     unsigned int max_client_requests;
+    unsigned int max_client_requests_adaptive;
 
     unsigned int log_level;
     char *log_filters;
     char *log_outputs;
+    bool log_async;
 
     unsigned int audit_level;
     bool audit_logging;
@@ -93,6 +95,10 @@ struct daemonConfig {
     unsigned int admin_keepalive_count;
 
     unsigned int ovs_timeout;
+
+    bool firewall_batch_rules;
+
+    unsigned int host_stats_interval;
 };
 
 
@@ -59,6 +59,8 @@
 #include "virutil.h"
 #include "virgettext.h"
 #include "util/virnetdevopenvswitch.h"
+#include "util/virhoststats.h"
+#include "util/virfirewall.h"
 
 #include "driver.h"
 
@@ -597,6 +599,13 @@ daemonSetupNetDevOpenvswitch(struct daemonConfig *config)
 }
 
 
+static void
+daemonSetupFirewall(struct daemonConfig *config)
+{
+    virFirewallSetBatchRules(config->firewall_batch_rules);
+}
+
+
 /*
  * Set up the logging environment
  * By default if daemonized all errors go to the logfile libvirtd.log,
@@ -1213,6 +1222,7 @@ int main(int argc, char **argv) {
     }
 
     daemonSetupNetDevOpenvswitch(config);
+    daemonSetupFirewall(config);
 
     if (daemonSetupAccessManager(config) < 0) {
         VIR_ERROR(_("Can't initialize access manager"));
@@ -1314,6 +1324,10 @@ int main(int argc, char **argv) {
         goto cleanup;
     }
 
+    if (config->max_client_requests_adaptive)
+        virNetServerSetClientAdaptiveRequests(srv,
+                                              config->max_client_requests_adaptive);
+
     if (!(dmn = virNetDaemonNew()) ||
         virNetDaemonAddServer(dmn, srv) < 0) {
         ret = VIR_DAEMON_ERR_INIT;
@@ -1490,6 +1504,18 @@ int main(int argc, char **argv) {
     }
 #endif
 
+    /* Failing to sample host statistics in the background is not fatal,
+     * they are read on demand then. */
+    if (virHostStatsSamplerStart(config->host_stats_interval) < 0)
+        VIR_WARN("Unable to start host statistics sampler: %s",
+                 virGetLastErrorMessage());
+
+    /* The log output thread must only be started once we are
+     * running in the background. */
+    if (config->log_async && virLogSetAsync(true) < 0)
+        VIR_WARN("Unable to enable asynchronous logging: %s",
+                 virGetLastErrorMessage());
+
     /* Run event loop. */
     virNetDaemonRun(dmn);
 
@@ -1499,6 +1525,7 @@ int main(int argc, char **argv) {
                 0, "shutdown", NULL, NULL);
 
  cleanup:
+    virHostStatsSamplerStop();
     virNetlinkEventServiceStopAll();
     virObjectUnref(remoteProgram);
     virObjectUnref(lxcProgram);
@@ -1538,5 +1565,8 @@ int main(int argc, char **argv) {
      * 'dmn' as a parameter are done, we can finally unref 'dmn' */
     virObjectUnref(dmn);
 
+    /* Write out whatever is still queued */
+    ignore_value(virLogSetAsync(false));
+
     return ret;
 }
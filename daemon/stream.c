@@ -824,7 +824,7 @@ daemonStreamHandleRead(virNetServerClientPtr client,
 
     memset(&rerr, 0, sizeof(rerr));
 
-    if (VIR_ALLOC_N(buffer, bufferLen) < 0)
+    if (!(buffer = virNetMessagePayloadAlloc()))
         return -1;
 
     if (!(msg = virNetMessageNew(false)))
@@ -906,12 +906,12 @@ daemonStreamHandleRead(virNetServerClientPtr client,
         msg->cb = daemonStreamMessageFinished;
         msg->opaque = stream;
         stream->refs++;
-        if (virNetServerProgramSendStreamData(remoteProgram,
-                                              client,
-                                              msg,
-                                              stream->procedure,
-                                              stream->serial,
-                                              buffer, rv) < 0)
+        if (virNetServerProgramSendStreamDataPooled(remoteProgram,
+                                                    client,
+                                                    msg,
+                                                    stream->procedure,
+                                                    stream->serial,
+                                                    &buffer, rv) < 0)
             goto cleanup;
         msg = NULL;
     }
@@ -919,7 +919,7 @@ daemonStreamHandleRead(virNetServerClientPtr client,
  done:
     ret = 0;
  cleanup:
-    VIR_FREE(buffer);
+    virNetMessagePayloadFree(buffer);
     virNetMessageFree(msg);
     return ret;
 }
@@ -189,6 +189,53 @@ virAdmServerPtr virAdmConnectLookupServer(virAdmConnectPtr conn,
 
 # define VIR_THREADPOOL_JOB_QUEUE_DEPTH "jobQueueDepth"
 
+/**
+ * VIR_THREADPOOL_JOBS:
+ * Macro for the threadpool jobs attribute: represents the number of jobs
+ * taken from the queue by a worker since the daemon started, as
+ * VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_THREADPOOL_JOBS "jobs"
+
+/**
+ * VIR_THREADPOOL_JOB_QUEUE_LATENCY:
+ * Macro for the threadpool jobQueueLatency attribute: represents the total
+ * time in milliseconds the jobs counted in VIR_THREADPOOL_JOBS spent
+ * waiting in the queue for a worker, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_THREADPOOL_JOB_QUEUE_LATENCY "jobQueueLatency"
+
+/**
+ * VIR_THREADPOOL_JOB_QUEUE_LATENCY_1MS:
+ * VIR_THREADPOOL_JOB_QUEUE_LATENCY_10MS:
+ * VIR_THREADPOOL_JOB_QUEUE_LATENCY_100MS:
+ * VIR_THREADPOOL_JOB_QUEUE_LATENCY_1S:
+ * VIR_THREADPOOL_JOB_QUEUE_LATENCY_10S:
+ * VIR_THREADPOOL_JOB_QUEUE_LATENCY_INF:
+ * Macros for the threadpool queue latency histogram: each represents the
+ * number of jobs which waited in the queue less than the given time (and
+ * not less than the previous bucket's limit), as VIR_TYPED_PARAM_ULLONG.
+ * The last bucket counts jobs waiting 10 seconds or more.
+ *
+ * NOTE: These attributes are read-only and any attempt to set them will be
+ * denied by daemon
+ */
+
+# define VIR_THREADPOOL_JOB_QUEUE_LATENCY_1MS "jobQueueLatency.1ms"
+# define VIR_THREADPOOL_JOB_QUEUE_LATENCY_10MS "jobQueueLatency.10ms"
+# define VIR_THREADPOOL_JOB_QUEUE_LATENCY_100MS "jobQueueLatency.100ms"
+# define VIR_THREADPOOL_JOB_QUEUE_LATENCY_1S "jobQueueLatency.1s"
+# define VIR_THREADPOOL_JOB_QUEUE_LATENCY_10S "jobQueueLatency.10s"
+# define VIR_THREADPOOL_JOB_QUEUE_LATENCY_INF "jobQueueLatency.inf"
+
 /* Tunables for a server workerpool */
 int virAdmServerGetThreadPoolParameters(virAdmServerPtr srv,
                                         virTypedParameterPtr *params,
@@ -404,6 +451,75 @@ int virAdmServerSetClientLimits(virAdmServerPtr srv,
                                 int nparams,
                                 unsigned int flags);
 
+/* Per-procedure RPC statistics */
+
+/**
+ * VIR_SERVER_RPC_STATS_CALLS:
+ * Suffix of the per-procedure attribute holding the number of calls to
+ * the procedure the server has dispatched so far, as VIR_TYPED_PARAM_ULLONG.
+ * The full name of the attribute is "<program>.<Procedure>.calls", e.g.
+ * "remote.DomainGetInfo.calls".
+ */
+
+# define VIR_SERVER_RPC_STATS_CALLS "calls"
+
+/**
+ * VIR_SERVER_RPC_STATS_TIME:
+ * Suffix of the per-procedure, per-phase attribute holding the total time
+ * in microseconds spent in the phase, as VIR_TYPED_PARAM_ULLONG. The full
+ * name of the attribute is "<program>.<Procedure>.<phase>.time" where
+ * <phase> is one of:
+ *
+ *  - "queue": since the call was read until a worker picked it up,
+ *  - "dispatch": since the call was picked up until the reply was queued,
+ *  - "driver": part of "dispatch" spent in the driver API,
+ *  - "reply": since the reply was queued until it was fully written out.
+ */
+
+# define VIR_SERVER_RPC_STATS_TIME "time"
+
+/**
+ * VIR_SERVER_RPC_STATS_LATENCY_100US:
+ * Suffix of the per-procedure, per-phase histogram bucket counting phases
+ * which took less than 100 microseconds, as VIR_TYPED_PARAM_ULLONG, e.g.
+ * "remote.DomainGetInfo.driver.100us". The remaining buckets have the
+ * suffixes "1ms", "10ms", "100ms", "1s" each counting phases which took
+ * less than the given time but at least as long as the previous bucket, and
+ * "inf" counting the rest.
+ */
+
+# define VIR_SERVER_RPC_STATS_LATENCY_100US "100us"
+# define VIR_SERVER_RPC_STATS_LATENCY_1MS "1ms"
+# define VIR_SERVER_RPC_STATS_LATENCY_10MS "10ms"
+# define VIR_SERVER_RPC_STATS_LATENCY_100MS "100ms"
+# define VIR_SERVER_RPC_STATS_LATENCY_1S "1s"
+# define VIR_SERVER_RPC_STATS_LATENCY_INF "inf"
+
+int virAdmServerGetRPCStats(virAdmServerPtr srv,
+                            virTypedParameterPtr *params,
+                            int *nparams,
+                            unsigned int flags);
+
+/* Host CPU rates */
+
+/**
+ * VIR_ADMIN_HOST_CPU_RATE:
+ * Suffix of the attributes holding the rate at which a CPU time counter
+ * reported by virNodeGetCPUStats grew between the last two samples taken
+ * by the daemon, in nanoseconds per second, as VIR_TYPED_PARAM_ULLONG.
+ * The full name of the attribute is "<counter>.rate", e.g. "kernel.rate".
+ * Additionally, the share of kernel and user time in all of the CPU time
+ * is reported as "utilization" in percent, as VIR_TYPED_PARAM_UINT.
+ */
+
+# define VIR_ADMIN_HOST_CPU_RATE "rate"
+
+int virAdmConnectGetHostCPURates(virAdmConnectPtr conn,
+                                 int cpuNum,
+                                 virTypedParameterPtr *params,
+                                 int *nparams,
+                                 unsigned int flags);
+
 int virAdmConnectGetLoggingOutputs(virAdmConnectPtr conn,
                                    char **outputs,
                                    unsigned int flags);
@@ -3437,6 +3437,16 @@ typedef enum {
  */
 # define VIR_DOMAIN_JOB_AUTO_CONVERGE_THROTTLE  "auto_converge_throttle"
 
+/**
+ * VIR_DOMAIN_JOB_IMAGE_BPS:
+ *
+ * virDomainGetJobStats field: throughput achieved while writing or reading
+ * the image file of a save, restore or core dump job in Bytes per second,
+ * as VIR_TYPED_PARAM_ULLONG. Only available once the image was completely
+ * processed.
+ */
+# define VIR_DOMAIN_JOB_IMAGE_BPS                "image_bps"
+
 
 /**
  * virConnectDomainEventGenericCallback:
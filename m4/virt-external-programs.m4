@@ -99,4 +99,13 @@ AC_DEFUN([LIBVIRT_CHECK_EXTERNAL_PROGRAMS], [
 
   AC_PATH_PROG([EBTABLES_PATH], [ebtables], [/sbin/ebtables], [$LIBVIRT_SBIN_PATH])
   AC_DEFINE_UNQUOTED([EBTABLES_PATH], ["$EBTABLES_PATH"], [path to ebtables binary])
+
+  AC_PATH_PROG([IPTABLES_RESTORE_PATH], [iptables-restore], [/sbin/iptables-restore], [$LIBVIRT_SBIN_PATH])
+  AC_DEFINE_UNQUOTED([IPTABLES_RESTORE_PATH], ["$IPTABLES_RESTORE_PATH"], [path to iptables-restore binary])
+
+  AC_PATH_PROG([IP6TABLES_RESTORE_PATH], [ip6tables-restore], [/sbin/ip6tables-restore], [$LIBVIRT_SBIN_PATH])
+  AC_DEFINE_UNQUOTED([IP6TABLES_RESTORE_PATH], ["$IP6TABLES_RESTORE_PATH"], [path to ip6tables-restore binary])
+
+  AC_PATH_PROG([EBTABLES_RESTORE_PATH], [ebtables-restore], [/sbin/ebtables-restore], [$LIBVIRT_SBIN_PATH])
+  AC_DEFINE_UNQUOTED([EBTABLES_RESTORE_PATH], ["$EBTABLES_RESTORE_PATH"], [path to ebtables-restore binary])
 ])
@@ -48,6 +48,12 @@ const ADMIN_CLIENT_INFO_PARAMETERS_MAX = 64;
 /* Upper limit on number of client processing controls */
 const ADMIN_SERVER_CLIENT_LIMITS_MAX = 32;
 
+/* Upper limit on number of RPC statistics parameters */
+const ADMIN_SERVER_RPC_STATS_MAX = 16384;
+
+/* Upper limit on number of host CPU rates parameters */
+const ADMIN_HOST_CPU_RATES_MAX = 64;
+
 /* A long string, which may NOT be NULL. */
 typedef string admin_nonnull_string<ADMIN_STRING_MAX>;
 
@@ -183,6 +189,24 @@ struct admin_server_set_client_limits_args {
     unsigned int flags;
 };
 
+struct admin_server_get_rpc_stats_args {
+    admin_nonnull_server srv;
+    unsigned int flags;
+};
+
+struct admin_server_get_rpc_stats_ret {
+    admin_typed_param params<ADMIN_SERVER_RPC_STATS_MAX>;
+};
+
+struct admin_connect_get_host_cpu_rates_args {
+    int cpuNum;
+    unsigned int flags;
+};
+
+struct admin_connect_get_host_cpu_rates_ret {
+    admin_typed_param params<ADMIN_HOST_CPU_RATES_MAX>;
+};
+
 struct admin_connect_get_logging_outputs_args {
     unsigned int flags;
 };
@@ -316,5 +340,15 @@ enum admin_procedure {
     /**
      * @generate: both
      */
-    ADMIN_PROC_CONNECT_SET_LOGGING_FILTERS = 17
+    ADMIN_PROC_CONNECT_SET_LOGGING_FILTERS = 17,
+
+    /**
+     * @generate: none
+     */
+    ADMIN_PROC_SERVER_GET_RPC_STATS = 18,
+
+    /**
+     * @generate: none
+     */
+    ADMIN_PROC_CONNECT_GET_HOST_CPU_RATES = 19
 };
@@ -391,6 +391,85 @@ remoteAdminServerGetClientLimits(virAdmServerPtr srv,
     return rv;
 }
 
+static int
+remoteAdminServerGetRPCStats(virAdmServerPtr srv,
+                             virTypedParameterPtr *params,
+                             int *nparams,
+                             unsigned int flags)
+{
+    int rv = -1;
+    admin_server_get_rpc_stats_args args;
+    admin_server_get_rpc_stats_ret ret;
+    remoteAdminPrivPtr priv = srv->conn->privateData;
+    args.flags = flags;
+    make_nonnull_server(&args.srv, srv);
+
+    memset(&ret, 0, sizeof(ret));
+    virObjectLock(priv);
+
+    if (call(srv->conn, 0, ADMIN_PROC_SERVER_GET_RPC_STATS,
+             (xdrproc_t) xdr_admin_server_get_rpc_stats_args,
+             (char *) &args,
+             (xdrproc_t) xdr_admin_server_get_rpc_stats_ret,
+             (char *) &ret) == -1)
+        goto cleanup;
+
+    if (virTypedParamsDeserialize((virTypedParameterRemotePtr) ret.params.params_val,
+                                  ret.params.params_len,
+                                  ADMIN_SERVER_RPC_STATS_MAX,
+                                  params,
+                                  nparams) < 0)
+        goto cleanup;
+
+    rv = 0;
+    xdr_free((xdrproc_t) xdr_admin_server_get_rpc_stats_ret,
+             (char *) &ret);
+
+ cleanup:
+    virObjectUnlock(priv);
+    return rv;
+}
+
+static int
+remoteAdminConnectGetHostCPURates(virAdmConnectPtr conn,
+                                  int cpuNum,
+                                  virTypedParameterPtr *params,
+                                  int *nparams,
+                                  unsigned int flags)
+{
+    int rv = -1;
+    admin_connect_get_host_cpu_rates_args args;
+    admin_connect_get_host_cpu_rates_ret ret;
+    remoteAdminPrivPtr priv = conn->privateData;
+    args.cpuNum = cpuNum;
+    args.flags = flags;
+
+    memset(&ret, 0, sizeof(ret));
+    virObjectLock(priv);
+
+    if (call(conn, 0, ADMIN_PROC_CONNECT_GET_HOST_CPU_RATES,
+             (xdrproc_t) xdr_admin_connect_get_host_cpu_rates_args,
+             (char *) &args,
+             (xdrproc_t) xdr_admin_connect_get_host_cpu_rates_ret,
+             (char *) &ret) == -1)
+        goto cleanup;
+
+    if (virTypedParamsDeserialize((virTypedParameterRemotePtr) ret.params.params_val,
+                                  ret.params.params_len,
+                                  ADMIN_HOST_CPU_RATES_MAX,
+                                  params,
+                                  nparams) < 0)
+        goto cleanup;
+
+    rv = 0;
+    xdr_free((xdrproc_t) xdr_admin_connect_get_host_cpu_rates_ret,
+             (char *) &ret);
+
+ cleanup:
+    virObjectUnlock(priv);
+    return rv;
+}
+
 static int
 remoteAdminServerSetClientLimits(virAdmServerPtr srv,
                                  virTypedParameterPtr params,
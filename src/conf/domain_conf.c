@@ -3238,12 +3238,14 @@ virDomainObjWaitUntil(virDomainObjPtr vm,
  * @param caps pointer to capabilities info
  * @param xmlopt pointer to XML parser configuration object
  * @param domain domain object pointer
+ * @param parseOpaque opaque data passed to the post parse callbacks
  * @return 0 on success, -1 on failure
  */
 int
 virDomainObjSetDefTransient(virCapsPtr caps,
                             virDomainXMLOptionPtr xmlopt,
-                            virDomainObjPtr domain)
+                            virDomainObjPtr domain,
+                            void *parseOpaque)
 {
     int ret = -1;
 
@@ -3253,7 +3255,8 @@ virDomainObjSetDefTransient(virCapsPtr caps,
     if (domain->newDef)
         return 0;
 
-    if (!(domain->newDef = virDomainDefCopy(domain->def, caps, xmlopt, NULL, false)))
+    if (!(domain->newDef = virDomainDefCopy(domain->def, caps, xmlopt,
+                                            parseOpaque, false)))
         goto out;
 
     ret = 0;
@@ -3295,7 +3298,7 @@ virDomainObjGetPersistentDef(virCapsPtr caps,
                              virDomainObjPtr domain)
 {
     if (virDomainObjIsActive(domain) &&
-        virDomainObjSetDefTransient(caps, xmlopt, domain) < 0)
+        virDomainObjSetDefTransient(caps, xmlopt, domain, NULL) < 0)
         return NULL;
 
     if (domain->newDef)
@@ -26118,11 +26121,11 @@ virDomainSaveConfig(const char *configDir,
     return ret;
 }
 
-int
-virDomainSaveStatus(virDomainXMLOptionPtr xmlopt,
-                    const char *statusDir,
-                    virDomainObjPtr obj,
-                    virCapsPtr caps)
+/* Formats the status XML of @obj as stored in the driver state dir */
+char *
+virDomainObjFormatStatus(virDomainXMLOptionPtr xmlopt,
+                         virDomainObjPtr obj,
+                         virCapsPtr caps)
 {
     unsigned int flags = (VIR_DOMAIN_DEF_FORMAT_SECURE |
                           VIR_DOMAIN_DEF_FORMAT_STATUS |
@@ -26130,10 +26133,19 @@ virDomainSaveStatus(virDomainXMLOptionPtr xmlopt,
                           VIR_DOMAIN_DEF_FORMAT_PCI_ORIG_STATES |
                           VIR_DOMAIN_DEF_FORMAT_CLOCK_ADJUST);
 
+    return virDomainObjFormat(xmlopt, obj, caps, flags);
+}
+
+int
+virDomainSaveStatus(virDomainXMLOptionPtr xmlopt,
+                    const char *statusDir,
+                    virDomainObjPtr obj,
+                    virCapsPtr caps)
+{
     int ret = -1;
     char *xml;
 
-    if (!(xml = virDomainObjFormat(xmlopt, obj, caps, flags)))
+    if (!(xml = virDomainObjFormatStatus(xmlopt, obj, caps)))
         goto cleanup;
 
     if (virDomainSaveXML(statusDir, obj->def, xml))
@@ -26510,12 +26522,13 @@ virDomainDefCopy(virDomainDefPtr src,
 virDomainDefPtr
 virDomainObjCopyPersistentDef(virDomainObjPtr dom,
                               virCapsPtr caps,
-                              virDomainXMLOptionPtr xmlopt)
+                              virDomainXMLOptionPtr xmlopt,
+                              void *parseOpaque)
 {
     virDomainDefPtr cur;
 
     cur = virDomainObjGetPersistentDef(caps, xmlopt, dom);
-    return virDomainDefCopy(cur, caps, xmlopt, NULL, false);
+    return virDomainDefCopy(cur, caps, xmlopt, parseOpaque, false);
 }
 
 
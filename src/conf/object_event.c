@@ -34,6 +34,8 @@
 #include "virerror.h"
 #include "virobject.h"
 #include "virstring.h"
+#include "viratomic.h"
+#include "virhash.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -52,16 +54,51 @@ struct _virObjectEventCallback {
     virConnectObjectEventGenericCallback cb;
     void *opaque;
     virFreeCallback freecb;
-    bool deleted;
+    int deleted; /* read atomically by the dispatcher */
     bool legacy; /* true if end user does not know callbackID */
 };
 typedef struct _virObjectEventCallback virObjectEventCallback;
 typedef virObjectEventCallback *virObjectEventCallbackPtr;
 
+/* Callbacks sorted by callbackID, i.e. in the order of registration */
+struct _virObjectEventCallbackSet {
+    size_t count;
+    virObjectEventCallbackPtr *callbacks;
+};
+typedef struct _virObjectEventCallbackSet virObjectEventCallbackSet;
+typedef virObjectEventCallbackSet *virObjectEventCallbackSetPtr;
+
+/* Callbacks registered for a single event ID */
+struct _virObjectEventCallbackBucket {
+    virObjectEventCallbackSet global; /* callbacks without a key filter */
+    virHashTablePtr keyed; /* key -> virObjectEventCallbackSetPtr */
+};
+typedef struct _virObjectEventCallbackBucket virObjectEventCallbackBucket;
+typedef virObjectEventCallbackBucket *virObjectEventCallbackBucketPtr;
+
+struct _virObjectEventCallbackIndex {
+    size_t nbuckets;
+    virObjectEventCallbackBucketPtr buckets; /* indexed by event ID */
+};
+typedef struct _virObjectEventCallbackIndex virObjectEventCallbackIndex;
+typedef virObjectEventCallbackIndex *virObjectEventCallbackIndexPtr;
+
+/* An immutable copy of the index of callbacks which the dispatcher
+ * walks without holding the state lock. A new one is built the first
+ * time events are dispatched after callbacks were added or removed. */
+struct _virObjectEventCallbackTable {
+    virObject parent;
+    virObjectEventCallbackIndex index;
+};
+typedef struct _virObjectEventCallbackTable virObjectEventCallbackTable;
+typedef virObjectEventCallbackTable *virObjectEventCallbackTablePtr;
+
 struct _virObjectEventCallbackList {
     unsigned int nextID;
     size_t count;
-    virObjectEventCallbackPtr *callbacks;
+    virObjectEventCallbackPtr *callbacks; /* sorted by callbackID */
+    virObjectEventCallbackIndex index;
+    virObjectEventCallbackTablePtr table; /* NULL if outdated */
 };
 
 struct _virObjectEventQueue {
@@ -85,9 +122,11 @@ struct _virObjectEventState {
 
 static virClassPtr virObjectEventClass;
 static virClassPtr virObjectEventStateClass;
+static virClassPtr virObjectEventCallbackTableClass;
 
 static void virObjectEventDispose(void *obj);
 static void virObjectEventStateDispose(void *obj);
+static void virObjectEventCallbackTableDispose(void *obj);
 
 static int
 virObjectEventOnceInit(void)
@@ -106,6 +145,13 @@ virObjectEventOnceInit(void)
                       virObjectEventDispose)))
         return -1;
 
+    if (!(virObjectEventCallbackTableClass =
+          virClassNew(virClassForObject(),
+                      "virObjectEventCallbackTable",
+                      sizeof(virObjectEventCallbackTable),
+                      virObjectEventCallbackTableDispose)))
+        return -1;
+
     return 0;
 }
 
@@ -154,6 +200,242 @@ virObjectEventCallbackFree(virObjectEventCallbackPtr cb)
     VIR_FREE(cb);
 }
 
+static void
+virObjectEventCallbackSetFree(void *payload,
+                              const void *name ATTRIBUTE_UNUSED)
+{
+    virObjectEventCallbackSetPtr set = payload;
+
+    if (!set)
+        return;
+
+    VIR_FREE(set->callbacks);
+    VIR_FREE(set);
+}
+
+
+static void
+virObjectEventCallbackSetRemove(virObjectEventCallbackSetPtr set,
+                                virObjectEventCallbackPtr cb)
+{
+    size_t i;
+
+    for (i = 0; i < set->count; i++) {
+        if (set->callbacks[i] == cb) {
+            VIR_DELETE_ELEMENT(set->callbacks, i, set->count);
+            return;
+        }
+    }
+}
+
+
+static void
+virObjectEventCallbackIndexClear(virObjectEventCallbackIndexPtr index)
+{
+    size_t i;
+
+    for (i = 0; i < index->nbuckets; i++) {
+        VIR_FREE(index->buckets[i].global.callbacks);
+        virHashFree(index->buckets[i].keyed);
+    }
+    VIR_FREE(index->buckets);
+    index->nbuckets = 0;
+}
+
+
+static virObjectEventCallbackBucketPtr
+virObjectEventCallbackIndexBucket(virObjectEventCallbackIndexPtr index,
+                                  int eventID)
+{
+    if (eventID < 0 || eventID >= index->nbuckets)
+        return NULL;
+
+    return &index->buckets[eventID];
+}
+
+
+/**
+ * virObjectEventCallbackIndexFind:
+ * @index: the index
+ * @eventID: the event ID
+ * @key: the key of the object, or NULL
+ *
+ * Returns the set of callbacks registered for @eventID and filtering
+ * on @key, or those without a key filter if @key is NULL. Returns
+ * NULL if there are no such callbacks.
+ */
+static virObjectEventCallbackSetPtr
+virObjectEventCallbackIndexFind(virObjectEventCallbackIndexPtr index,
+                                int eventID,
+                                const char *key)
+{
+    virObjectEventCallbackBucketPtr bucket;
+
+    if (!(bucket = virObjectEventCallbackIndexBucket(index, eventID)))
+        return NULL;
+
+    if (!key)
+        return &bucket->global;
+
+    if (!bucket->keyed)
+        return NULL;
+
+    return virHashLookup(bucket->keyed, key);
+}
+
+
+static int
+virObjectEventCallbackIndexAdd(virObjectEventCallbackIndexPtr index,
+                               virObjectEventCallbackPtr cb)
+{
+    virObjectEventCallbackBucketPtr bucket;
+    virObjectEventCallbackSetPtr set;
+
+    if (cb->eventID >= index->nbuckets &&
+        VIR_EXPAND_N(index->buckets, index->nbuckets,
+                     cb->eventID + 1 - index->nbuckets) < 0)
+        return -1;
+
+    bucket = &index->buckets[cb->eventID];
+
+    if (!cb->key_filter)
+        return VIR_APPEND_ELEMENT_COPY(bucket->global.callbacks,
+                                       bucket->global.count, cb);
+
+    if (!bucket->keyed &&
+        !(bucket->keyed = virHashCreate(10, virObjectEventCallbackSetFree)))
+        return -1;
+
+    if (!(set = virHashLookup(bucket->keyed, cb->key))) {
+        if (VIR_ALLOC(set) < 0)
+            return -1;
+
+        if (virHashAddEntry(bucket->keyed, cb->key, set) < 0) {
+            VIR_FREE(set);
+            return -1;
+        }
+    }
+
+    if (VIR_APPEND_ELEMENT_COPY(set->callbacks, set->count, cb) < 0) {
+        if (set->count == 0)
+            virHashRemoveEntry(bucket->keyed, cb->key);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static void
+virObjectEventCallbackIndexRemove(virObjectEventCallbackIndexPtr index,
+                                  virObjectEventCallbackPtr cb)
+{
+    virObjectEventCallbackBucketPtr bucket;
+    virObjectEventCallbackSetPtr set;
+
+    if (!(bucket = virObjectEventCallbackIndexBucket(index, cb->eventID)))
+        return;
+
+    if (!cb->key_filter) {
+        virObjectEventCallbackSetRemove(&bucket->global, cb);
+        return;
+    }
+
+    if (!bucket->keyed || !(set = virHashLookup(bucket->keyed, cb->key)))
+        return;
+
+    virObjectEventCallbackSetRemove(set, cb);
+    if (set->count == 0)
+        virHashRemoveEntry(bucket->keyed, cb->key);
+}
+
+
+static void
+virObjectEventCallbackTableDispose(void *obj)
+{
+    virObjectEventCallbackTablePtr table = obj;
+
+    virObjectEventCallbackIndexClear(&table->index);
+}
+
+
+/**
+ * virObjectEventCallbackListGetTable:
+ * @list: event callback list
+ *
+ * Returns a reference to a table of all callbacks in @list which are
+ * not deleted, building it if needed, or NULL on error.
+ */
+static virObjectEventCallbackTablePtr
+virObjectEventCallbackListGetTable(virObjectEventCallbackListPtr list)
+{
+    virObjectEventCallbackTablePtr table;
+    size_t i;
+
+    if (list->table)
+        return virObjectRef(list->table);
+
+    if (!(table = virObjectNew(virObjectEventCallbackTableClass)))
+        return NULL;
+
+    for (i = 0; i < list->count; i++) {
+        if (list->callbacks[i]->deleted)
+            continue;
+
+        if (virObjectEventCallbackIndexAdd(&table->index,
+                                           list->callbacks[i]) < 0) {
+            virObjectUnref(table);
+            return NULL;
+        }
+    }
+
+    list->table = table;
+    return virObjectRef(table);
+}
+
+
+static void
+virObjectEventCallbackListInvalidateTable(virObjectEventCallbackListPtr list)
+{
+    virObjectUnref(list->table);
+    list->table = NULL;
+}
+
+
+/**
+ * virObjectEventCallbackListFindID:
+ * @list: event callback list
+ * @conn: pointer to the connection
+ * @callbackID: the callback ID
+ *
+ * Returns the position of callback @callbackID of @conn in @list or -1
+ * if there is no such callback.
+ */
+static ssize_t
+virObjectEventCallbackListFindID(virObjectEventCallbackListPtr list,
+                                 virConnectPtr conn,
+                                 int callbackID)
+{
+    size_t lo = 0;
+    size_t hi = list->count;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        virObjectEventCallbackPtr cb = list->callbacks[mid];
+
+        if (cb->callbackID == callbackID)
+            return cb->conn == conn ? mid : -1;
+
+        if (cb->callbackID < callbackID)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return -1;
+}
+
+
 /**
  * virObjectEventCallbackListFree:
  * @list: event callback list head
@@ -174,6 +456,8 @@ virObjectEventCallbackListFree(virObjectEventCallbackListPtr list)
         VIR_FREE(list->callbacks[i]);
     }
     VIR_FREE(list->callbacks);
+    virObjectEventCallbackIndexClear(&list->index);
+    virObjectUnref(list->table);
     VIR_FREE(list);
 }
 
@@ -200,33 +484,63 @@ virObjectEventCallbackListFree(virObjectEventCallbackListPtr list)
  * single callback on the server to manage both legacy and modern
  * global domain lifecycle events.
  */
+struct virObjectEventCallbackCountData {
+    virConnectPtr conn;
+    virClassPtr klass;
+    bool serverFilter;
+    int count;
+};
+
 static int
-virObjectEventCallbackListCount(virConnectPtr conn,
-                                virObjectEventCallbackListPtr cbList,
-                                virClassPtr klass,
-                                int eventID,
-                                const char *key,
-                                bool serverFilter)
+virObjectEventCallbackSetCount(void *payload,
+                               const void *name ATTRIBUTE_UNUSED,
+                               void *opaque)
 {
+    virObjectEventCallbackSetPtr set = payload;
+    struct virObjectEventCallbackCountData *data = opaque;
     size_t i;
-    int ret = 0;
 
-    for (i = 0; i < cbList->count; i++) {
-        virObjectEventCallbackPtr cb = cbList->callbacks[i];
+    for (i = 0; i < set->count; i++) {
+        virObjectEventCallbackPtr cb = set->callbacks[i];
 
         if (cb->filter)
             continue;
-        if (cb->klass == klass &&
-            cb->eventID == eventID &&
-            cb->conn == conn &&
+        if (cb->klass == data->klass &&
+            cb->conn == data->conn &&
             !cb->deleted &&
-            (!serverFilter ||
-             (cb->remoteID >= 0 &&
-              ((key && cb->key_filter && STREQ(cb->key, key)) ||
-               (!key && !cb->key_filter)))))
-            ret++;
+            (!data->serverFilter || cb->remoteID >= 0))
+            data->count++;
     }
-    return ret;
+    return 0;
+}
+
+static int
+virObjectEventCallbackListCount(virConnectPtr conn,
+                                virObjectEventCallbackListPtr cbList,
+                                virClassPtr klass,
+                                int eventID,
+                                const char *key,
+                                bool serverFilter)
+{
+    struct virObjectEventCallbackCountData data = {
+        .conn = conn, .klass = klass, .serverFilter = serverFilter,
+    };
+    virObjectEventCallbackBucketPtr bucket;
+    virObjectEventCallbackSetPtr set;
+
+    if (serverFilter) {
+        if ((set = virObjectEventCallbackIndexFind(&cbList->index,
+                                                   eventID, key)))
+            virObjectEventCallbackSetCount(set, NULL, &data);
+    } else if ((bucket = virObjectEventCallbackIndexBucket(&cbList->index,
+                                                           eventID))) {
+        virObjectEventCallbackSetCount(&bucket->global, NULL, &data);
+        if (bucket->keyed)
+            virHashForEach(bucket->keyed, virObjectEventCallbackSetCount,
+                           &data);
+    }
+
+    return data.count;
 }
 
 /**
@@ -244,29 +558,28 @@ virObjectEventCallbackListRemoveID(virConnectPtr conn,
                                    int callbackID,
                                    bool doFreeCb)
 {
-    size_t i;
+    ssize_t i;
 
-    for (i = 0; i < cbList->count; i++) {
+    if ((i = virObjectEventCallbackListFindID(cbList, conn, callbackID)) >= 0) {
         virObjectEventCallbackPtr cb = cbList->callbacks[i];
-
-        if (cb->callbackID == callbackID && cb->conn == conn) {
-            int ret;
-
-            ret = cb->filter ? 0 :
-                (virObjectEventCallbackListCount(conn, cbList, cb->klass,
-                                                 cb->eventID,
-                                                 cb->key_filter ? cb->key : NULL,
-                                                 cb->remoteID >= 0) - 1);
-
-            /* @doFreeCb inhibits calling @freecb from error paths in
-             * register functions to ensure the caller of a failed register
-             * function won't end up with a double free error */
-            if (doFreeCb && cb->freecb)
-                (*cb->freecb)(cb->opaque);
-            virObjectEventCallbackFree(cb);
-            VIR_DELETE_ELEMENT(cbList->callbacks, i, cbList->count);
-            return ret;
-        }
+        int ret;
+
+        ret = cb->filter ? 0 :
+            (virObjectEventCallbackListCount(conn, cbList, cb->klass,
+                                             cb->eventID,
+                                             cb->key_filter ? cb->key : NULL,
+                                             cb->remoteID >= 0) - 1);
+
+        /* @doFreeCb inhibits calling @freecb from error paths in
+         * register functions to ensure the caller of a failed register
+         * function won't end up with a double free error */
+        if (doFreeCb && cb->freecb)
+            (*cb->freecb)(cb->opaque);
+        virObjectEventCallbackIndexRemove(&cbList->index, cb);
+        virObjectEventCallbackListInvalidateTable(cbList);
+        virObjectEventCallbackFree(cb);
+        VIR_DELETE_ELEMENT(cbList->callbacks, i, cbList->count);
+        return ret;
     }
 
     virReportError(VIR_ERR_INVALID_ARG,
@@ -281,19 +594,19 @@ virObjectEventCallbackListMarkDeleteID(virConnectPtr conn,
                                        virObjectEventCallbackListPtr cbList,
                                        int callbackID)
 {
-    size_t i;
+    ssize_t i;
 
-    for (i = 0; i < cbList->count; i++) {
+    if ((i = virObjectEventCallbackListFindID(cbList, conn, callbackID)) >= 0) {
         virObjectEventCallbackPtr cb = cbList->callbacks[i];
 
-        if (cb->callbackID == callbackID && cb->conn == conn) {
-            cb->deleted = true;
-            return cb->filter ? 0 :
-                virObjectEventCallbackListCount(conn, cbList, cb->klass,
-                                                cb->eventID,
-                                                cb->key_filter ? cb->key : NULL,
-                                                cb->remoteID >= 0);
-        }
+        /* The dispatcher may be running without the state lock, it
+         * checks the flag before invoking each callback */
+        virAtomicIntSet(&cb->deleted, 1);
+        return cb->filter ? 0 :
+            virObjectEventCallbackListCount(conn, cbList, cb->klass,
+                                            cb->eventID,
+                                            cb->key_filter ? cb->key : NULL,
+                                            cb->remoteID >= 0);
     }
 
     virReportError(VIR_ERR_INVALID_ARG,
@@ -312,6 +625,9 @@ virObjectEventCallbackListPurgeMarked(virObjectEventCallbackListPtr cbList)
             virFreeCallback freecb = cbList->callbacks[n]->freecb;
             if (freecb)
                 (*freecb)(cbList->callbacks[n]->opaque);
+            virObjectEventCallbackIndexRemove(&cbList->index,
+                                              cbList->callbacks[n]);
+            virObjectEventCallbackListInvalidateTable(cbList);
             virObjectEventCallbackFree(cbList->callbacks[n]);
 
             VIR_DELETE_ELEMENT(cbList->callbacks, n, cbList->count);
@@ -350,21 +666,22 @@ virObjectEventCallbackLookup(virConnectPtr conn,
                              bool legacy,
                              int *remoteID)
 {
+    virObjectEventCallbackSetPtr set;
     size_t i;
 
     if (remoteID)
         *remoteID = -1;
 
-    for (i = 0; i < cbList->count; i++) {
-        virObjectEventCallbackPtr cb = cbList->callbacks[i];
+    if (!(set = virObjectEventCallbackIndexFind(&cbList->index, eventID, key)))
+        return -1;
+
+    for (i = 0; i < set->count; i++) {
+        virObjectEventCallbackPtr cb = set->callbacks[i];
 
         if (cb->deleted)
             continue;
         if (cb->klass == klass &&
-            cb->eventID == eventID &&
-            cb->conn == conn &&
-            ((key && cb->key_filter && STREQ(cb->key, key)) ||
-             (!key && !cb->key_filter))) {
+            cb->conn == conn) {
             if (remoteID)
                 *remoteID = cb->remoteID;
             if (cb->legacy == legacy &&
@@ -423,6 +740,12 @@ virObjectEventCallbackListAddID(virConnectPtr conn,
     if (!cbList)
         return -1;
 
+    if (eventID < 0) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("invalid event ID %d"), eventID);
+        return -1;
+    }
+
     /* If there is no additional filtering, then check if we already
      * have this callback on our list.  */
     if (!filter &&
@@ -454,9 +777,15 @@ virObjectEventCallbackListAddID(virConnectPtr conn,
     cb->filter_opaque = filter_opaque;
     cb->legacy = legacy;
 
-    if (VIR_APPEND_ELEMENT(cbList->callbacks, cbList->count, cb) < 0)
+    if (virObjectEventCallbackIndexAdd(&cbList->index, cb) < 0)
         goto cleanup;
 
+    if (VIR_APPEND_ELEMENT(cbList->callbacks, cbList->count, cb) < 0) {
+        virObjectEventCallbackIndexRemove(&cbList->index, cb);
+        goto cleanup;
+    }
+    virObjectEventCallbackListInvalidateTable(cbList);
+
     /* When additional filtering is being done, every client callback
      * is matched to exactly one server callback.  */
     if (filter) {
@@ -675,7 +1004,7 @@ virObjectEventDispatchMatchCallback(virObjectEventPtr event,
 {
     if (!cb)
         return false;
-    if (cb->deleted)
+    if (virAtomicIntGet(&cb->deleted))
         return false;
     if (!virObjectIsClass(event, cb->klass))
         return false;
@@ -694,40 +1023,55 @@ virObjectEventDispatchMatchCallback(virObjectEventPtr event,
 
 
 static void
-virObjectEventStateDispatchCallbacks(virObjectEventStatePtr state,
-                                     virObjectEventPtr event,
-                                     virObjectEventCallbackListPtr callbacks)
+virObjectEventStateDispatchCallbacks(virObjectEventPtr event,
+                                     virObjectEventCallbackTablePtr table)
 {
-    size_t i;
-    /* Cache this now, since we may be dropping the lock,
-       and have more callbacks added. We're guaranteed not
-       to have any removed */
-    size_t cbCount = callbacks->count;
+    virObjectEventCallbackSetPtr global;
+    virObjectEventCallbackSetPtr keyed = NULL;
+    size_t i = 0;
+    size_t j = 0;
+
+    if (!(global = virObjectEventCallbackIndexFind(&table->index,
+                                                   event->eventID, NULL)))
+        return;
+
+    if (event->meta.key)
+        keyed = virObjectEventCallbackIndexFind(&table->index,
+                                                event->eventID,
+                                                event->meta.key);
 
-    for (i = 0; i < cbCount; i++) {
-        virObjectEventCallbackPtr cb = callbacks->callbacks[i];
+    /* Merge both sets to invoke callbacks in the order of registration */
+    while (i < global->count || (keyed && j < keyed->count)) {
+        virObjectEventCallbackPtr cb;
+
+        if (!keyed || j == keyed->count ||
+            (i < global->count &&
+             global->callbacks[i]->callbackID < keyed->callbacks[j]->callbackID))
+            cb = global->callbacks[i++];
+        else
+            cb = keyed->callbacks[j++];
 
         if (!virObjectEventDispatchMatchCallback(event, cb))
             continue;
 
-        /* Drop the lock whle dispatching, for sake of re-entrancy */
-        virObjectUnlock(state);
         event->dispatch(cb->conn, event, cb->cb, cb->opaque);
-        virObjectLock(state);
     }
 }
 
 
 static void
-virObjectEventStateQueueDispatch(virObjectEventStatePtr state,
-                                 virObjectEventQueuePtr queue,
-                                 virObjectEventCallbackListPtr callbacks)
+virObjectEventStateQueueDispatch(virObjectEventQueuePtr queue,
+                                 virObjectEventCallbackTablePtr table)
 {
     size_t i;
 
+    if (!table && queue->count)
+        VIR_WARN("Unable to index event callbacks, dropping %zu events",
+                 queue->count);
+
     for (i = 0; i < queue->count; i++) {
-        virObjectEventStateDispatchCallbacks(state, queue->events[i],
-                                             callbacks);
+        if (table)
+            virObjectEventStateDispatchCallbacks(queue->events[i], table);
         virObjectUnref(queue->events[i]);
     }
     VIR_FREE(queue->events);
@@ -811,6 +1155,7 @@ static void
 virObjectEventStateFlush(virObjectEventStatePtr state)
 {
     virObjectEventQueue tempQueue;
+    virObjectEventCallbackTablePtr table;
 
     /* We need to lock as well as ref due to the fact that we might
      * unref the state we're working on in this very function */
@@ -827,9 +1172,17 @@ virObjectEventStateFlush(virObjectEventStatePtr state)
     if (state->timer != -1)
         virEventUpdateTimeout(state->timer, -1);
 
-    virObjectEventStateQueueDispatch(state,
-                                     &tempQueue,
-                                     state->callbacks);
+    /* While dispatching, callbacks are only marked as deleted and freed
+     * once we are done, so the table of callbacks can be used without
+     * holding the lock. Callbacks registered meanwhile will receive
+     * events from the next flush. */
+    table = virObjectEventCallbackListGetTable(state->callbacks);
+    virObjectUnlock(state);
+
+    virObjectEventStateQueueDispatch(&tempQueue, table);
+    virObjectUnref(table);
+
+    virObjectLock(state);
 
     /* Purge any deleted callbacks */
     virObjectEventCallbackListPurgeMarked(state->callbacks);
@@ -1025,22 +1378,17 @@ virObjectEventStateEventID(virConnectPtr conn,
                            int *remoteID)
 {
     int ret = -1;
-    size_t i;
+    ssize_t i;
     virObjectEventCallbackListPtr cbList = state->callbacks;
 
     virObjectLock(state);
-    for (i = 0; i < cbList->count; i++) {
+    if ((i = virObjectEventCallbackListFindID(cbList, conn, callbackID)) >= 0 &&
+        !cbList->callbacks[i]->deleted) {
         virObjectEventCallbackPtr cb = cbList->callbacks[i];
 
-        if (cb->deleted)
-            continue;
-
-        if (cb->callbackID == callbackID && cb->conn == conn) {
-            if (remoteID)
-                *remoteID = cb->remoteID;
-            ret = cb->eventID;
-            break;
-        }
+        if (remoteID)
+            *remoteID = cb->remoteID;
+        ret = cb->eventID;
     }
     virObjectUnlock(state);
 
@@ -1070,19 +1418,12 @@ virObjectEventStateSetRemote(virConnectPtr conn,
                              int callbackID,
                              int remoteID)
 {
-    size_t i;
+    virObjectEventCallbackListPtr cbList = state->callbacks;
+    ssize_t i;
 
     virObjectLock(state);
-    for (i = 0; i < state->callbacks->count; i++) {
-        virObjectEventCallbackPtr cb = state->callbacks->callbacks[i];
-
-        if (cb->deleted)
-            continue;
-
-        if (cb->callbackID == callbackID && cb->conn == conn) {
-            cb->remoteID = remoteID;
-            break;
-        }
-    }
+    if ((i = virObjectEventCallbackListFindID(cbList, conn, callbackID)) >= 0 &&
+        !cbList->callbacks[i]->deleted)
+        cbList->callbacks[i]->remoteID = remoteID;
     virObjectUnlock(state);
 }
@@ -67,6 +67,7 @@ struct _virStorageVolDef {
     int type; /* virStorageVolType */
 
     bool building;
+    bool wiping;
     unsigned int in_use;
 
     virStorageVolSource source;
@@ -30,6 +30,7 @@
 #include "snapshot_conf.h"
 #include "viralloc.h"
 #include "virfile.h"
+#include "virhashcode.h"
 #include "virlog.h"
 #include "virstring.h"
 
@@ -51,6 +52,14 @@ struct _virDomainObjList {
     /* name -> virDomainObj mapping for O(1),
      * lockless lookup-by-name */
     virHashTable *objsName;
+
+    /* id -> virDomainObj mapping for O(1) lookup-by-id.
+     * Kept in sync by virDomainObjListAdd and
+     * virDomainObjListSetID, each entry holds a reference.
+     * Protected by @idLock which may be acquired while
+     * holding the list lock (in either mode). */
+    virMutex idLock;
+    virHashTable *objsID;
 };
 
 
@@ -67,6 +76,33 @@ static int virDomainObjListOnceInit(void)
 
 VIR_ONCE_GLOBAL_INIT(virDomainObjList)
 
+
+/* IDs are shifted by one so that ID 0, which is valid
+ * (e.g. Xen's Domain-0), is not stored as a NULL key. */
+#define VIR_DOMAIN_OBJ_LIST_ID_KEY(id) ((void *)(intptr_t)((id) + 1))
+
+static uint32_t
+virDomainObjListIDCode(const void *name, uint32_t seed)
+{
+    int id = (intptr_t)name;
+    return virHashCodeGen(&id, sizeof(id), seed);
+}
+
+
+static bool
+virDomainObjListIDEqual(const void *namea, const void *nameb)
+{
+    return namea == nameb;
+}
+
+
+static void *
+virDomainObjListIDCopy(const void *name)
+{
+    return (void *)name;
+}
+
+
 virDomainObjListPtr virDomainObjListNew(void)
 {
     virDomainObjListPtr doms;
@@ -77,8 +113,20 @@ virDomainObjListPtr virDomainObjListNew(void)
     if (!(doms = virObjectRWLockableNew(virDomainObjListClass)))
         return NULL;
 
+    if (virMutexInit(&doms->idLock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to init domain list ID lock"));
+        virObjectUnref(doms);
+        return NULL;
+    }
+
     if (!(doms->objs = virHashCreate(50, virObjectFreeHashData)) ||
-        !(doms->objsName = virHashCreate(50, virObjectFreeHashData))) {
+        !(doms->objsName = virHashCreate(50, virObjectFreeHashData)) ||
+        !(doms->objsID = virHashCreateFull(50, virObjectFreeHashData,
+                                           virDomainObjListIDCode,
+                                           virDomainObjListIDEqual,
+                                           virDomainObjListIDCopy,
+                                           NULL))) {
         virObjectUnref(doms);
         return NULL;
     }
@@ -93,25 +141,93 @@ static void virDomainObjListDispose(void *obj)
 
     virHashFree(doms->objs);
     virHashFree(doms->objsName);
+    virHashFree(doms->objsID);
+    virMutexDestroy(&doms->idLock);
 }
 
 
-static int virDomainObjListSearchID(const void *payload,
-                                    const void *name ATTRIBUTE_UNUSED,
-                                    const void *data)
+/*
+ * Records @obj as the owner of its current ID. The caller must
+ * hold a lock on 'doms' (either mode) and 'obj' must be in the list.
+ */
+static void
+virDomainObjListAddID(virDomainObjListPtr doms,
+                      virDomainObjPtr obj)
 {
-    virDomainObjPtr obj = (virDomainObjPtr)payload;
-    const int *id = data;
-    int want = 0;
+    if (obj->def->id < 0)
+        return;
 
-    virObjectLock(obj);
-    if (virDomainObjIsActive(obj) &&
-        obj->def->id == *id)
-        want = 1;
-    virObjectUnlock(obj);
-    return want;
+    virMutexLock(&doms->idLock);
+    if (virHashUpdateEntry(doms->objsID,
+                           VIR_DOMAIN_OBJ_LIST_ID_KEY(obj->def->id), obj) == 0)
+        virObjectRef(obj);
+    virMutexUnlock(&doms->idLock);
 }
 
+
+/*
+ * Drops the ID entry of @obj, unless the ID has been taken over
+ * by another domain meanwhile. The caller must hold a lock on 'obj'.
+ */
+static void
+virDomainObjListRemoveID(virDomainObjListPtr doms,
+                         virDomainObjPtr obj)
+{
+    void *key = VIR_DOMAIN_OBJ_LIST_ID_KEY(obj->def->id);
+
+    if (obj->def->id < 0)
+        return;
+
+    virMutexLock(&doms->idLock);
+    if (virHashLookup(doms->objsID, key) == obj)
+        ignore_value(virHashRemoveEntry(doms->objsID, key));
+    virMutexUnlock(&doms->idLock);
+}
+
+
+/**
+ * virDomainObjListSetID:
+ * @doms: domain list
+ * @dom: domain object, locked
+ * @id: new ID, or -1 once the domain is no longer running
+ *
+ * Changes the ID of @dom, which must be in @doms, and updates
+ * the index used by virDomainObjListFindByID accordingly.
+ * Drivers must use this instead of modifying def->id directly
+ * for domains they have added to a list.
+ */
+void
+virDomainObjListSetID(virDomainObjListPtr doms,
+                      virDomainObjPtr dom,
+                      int id)
+{
+    virDomainObjListRemoveID(doms, dom);
+    dom->def->id = id;
+    virDomainObjListAddID(doms, dom);
+}
+
+
+/*
+ * Returns the domain with @id, unlocked, or NULL. The
+ * caller must hold a lock on 'doms' (either mode).
+ */
+static virDomainObjPtr
+virDomainObjListLookupID(virDomainObjListPtr doms,
+                         int id)
+{
+    virDomainObjPtr obj;
+
+    if (id < 0)
+        return NULL;
+
+    virMutexLock(&doms->idLock);
+    obj = virHashLookup(doms->objsID, VIR_DOMAIN_OBJ_LIST_ID_KEY(id));
+    virMutexUnlock(&doms->idLock);
+
+    return obj;
+}
+
+
 static virDomainObjPtr
 virDomainObjListFindByIDInternal(virDomainObjListPtr doms,
                                  int id,
@@ -119,14 +235,15 @@ virDomainObjListFindByIDInternal(virDomainObjListPtr doms,
 {
     virDomainObjPtr obj;
     virObjectRWLockRead(doms);
-    obj = virHashSearch(doms->objs, virDomainObjListSearchID, &id, NULL);
+    obj = virDomainObjListLookupID(doms, id);
     if (ref) {
         virObjectRef(obj);
         virObjectRWUnlock(doms);
     }
     if (obj) {
         virObjectLock(obj);
-        if (obj->removing) {
+        /* The ID may have changed before we got the lock */
+        if (obj->removing || obj->def->id != id) {
             virObjectUnlock(obj);
             if (ref)
                 virObjectUnref(obj);
@@ -279,6 +396,7 @@ virDomainObjListAddLocked(virDomainObjListPtr doms,
             }
         }
 
+        virDomainObjListRemoveID(doms, vm);
         virDomainObjAssignDef(vm,
                               def,
                               !!(flags & VIR_DOMAIN_OBJ_LIST_ADD_LIVE),
@@ -313,6 +431,9 @@ virDomainObjListAddLocked(virDomainObjListPtr doms,
          * reference counter */
         virObjectRef(vm);
     }
+
+    virDomainObjListAddID(doms, vm);
+
  cleanup:
     return vm;
 
@@ -355,6 +476,7 @@ void virDomainObjListRemove(virDomainObjListPtr doms,
 
     virObjectRWLockWrite(doms);
     virObjectLock(dom);
+    virDomainObjListRemoveID(doms, dom);
     virHashRemoveEntry(doms->objs, uuidstr);
     virHashRemoveEntry(doms->objsName, dom->def->name);
     virObjectUnlock(dom);
@@ -442,6 +564,7 @@ void virDomainObjListRemoveLocked(virDomainObjListPtr doms,
 
     virUUIDFormat(dom->def->uuid, uuidstr);
 
+    virDomainObjListRemoveID(doms, dom);
     virHashRemoveEntry(doms->objs, uuidstr);
     virHashRemoveEntry(doms->objsName, dom->def->name);
     virObjectUnlock(dom);
@@ -546,6 +669,8 @@ virDomainObjListLoadStatus(virDomainObjListPtr doms,
      * reference counter */
     virObjectRef(obj);
 
+    virDomainObjListAddID(doms, obj);
+
     if (notify)
         (*notify)(obj, 1, opaque);
 
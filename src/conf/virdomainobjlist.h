@@ -69,6 +69,10 @@ void virDomainObjListRemove(virDomainObjListPtr doms,
 void virDomainObjListRemoveLocked(virDomainObjListPtr doms,
                                   virDomainObjPtr dom);
 
+void virDomainObjListSetID(virDomainObjListPtr doms,
+                           virDomainObjPtr dom,
+                           int id);
+
 int virDomainObjListLoadAllConfigs(virDomainObjListPtr doms,
                                    const char *configDir,
                                    const char *autostartDir,
@@ -0,0 +1,509 @@
+/*
+ * virdomainstatuswriter.c: coalesced persistence of domain status
+ *
+ * Copyright (C) 2017 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "virdomainstatuswriter.h"
+#include "viralloc.h"
+#include "virerror.h"
+#include "virfile.h"
+#include "virlog.h"
+#include "virstring.h"
+#include "virthread.h"
+#include "virtime.h"
+#include "viruuid.h"
+#include "virxml.h"
+
+#define VIR_FROM_THIS VIR_FROM_DOMAIN
+
+VIR_LOG_INIT("conf.virdomainstatuswriter");
+
+typedef struct _virDomainStatusWriterEntry virDomainStatusWriterEntry;
+typedef virDomainStatusWriterEntry *virDomainStatusWriterEntryPtr;
+struct _virDomainStatusWriterEntry {
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    virDomainObjPtr obj;
+    virCapsPtr caps;
+
+    /* when a queued entry is due to be written */
+    unsigned long long deadline;
+    bool queued;
+
+    /* generation of the status XML last written to the file, or of
+     * the entry itself when nothing was written yet */
+    unsigned long long written;
+};
+
+struct _virDomainStatusWriter {
+    virObjectLockable parent;
+
+    virDomainXMLOptionPtr xmlopt;
+    char *statusDir;
+    unsigned int delay;
+
+    /* uuid string -> virDomainStatusWriterEntry */
+    virHashTablePtr entries;
+
+    /* entries waiting for the writer thread, in order of deadline */
+    virDomainStatusWriterEntryPtr *queue;
+    size_t nqueue;
+
+    virCond cond;
+    virThread thread;
+    bool quit;
+
+    /* every formatted status XML gets a new generation so that an
+     * older XML never replaces a newer one */
+    unsigned long long gen;
+
+    /* Serializes writes of status files. Taken either with the domain
+     * object locked or without any lock, never with @parent locked. */
+    virMutex writeLock;
+
+    unsigned long long requests;
+    unsigned long long writes;
+};
+
+static virClassPtr virDomainStatusWriterClass;
+static void virDomainStatusWriterDispose(void *obj);
+
+static int
+virDomainStatusWriterOnceInit(void)
+{
+    if (!(virDomainStatusWriterClass = virClassNew(virClassForObjectLockable(),
+                                                   "virDomainStatusWriter",
+                                                   sizeof(virDomainStatusWriter),
+                                                   virDomainStatusWriterDispose)))
+        return -1;
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virDomainStatusWriter)
+
+
+static void
+virDomainStatusWriterEntryFree(void *payload,
+                               const void *name ATTRIBUTE_UNUSED)
+{
+    virDomainStatusWriterEntryPtr entry = payload;
+
+    if (!entry)
+        return;
+
+    virObjectUnref(entry->obj);
+    virObjectUnref(entry->caps);
+    VIR_FREE(entry);
+}
+
+
+/* Must be called with @writer locked */
+static virDomainStatusWriterEntryPtr
+virDomainStatusWriterGetEntry(virDomainStatusWriterPtr writer,
+                              virDomainObjPtr obj,
+                              virCapsPtr caps)
+{
+    virDomainStatusWriterEntryPtr entry;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+
+    virUUIDFormat(obj->def->uuid, uuidstr);
+
+    if (!(entry = virHashLookup(writer->entries, uuidstr))) {
+        if (VIR_ALLOC(entry) < 0)
+            return NULL;
+
+        memcpy(entry->uuidstr, uuidstr, sizeof(uuidstr));
+        entry->written = ++writer->gen;
+
+        if (virHashAddEntry(writer->entries, uuidstr, entry) < 0) {
+            VIR_FREE(entry);
+            return NULL;
+        }
+    }
+
+    if (entry->obj != obj) {
+        virObjectUnref(entry->obj);
+        entry->obj = virObjectRef(obj);
+    }
+
+    if (entry->caps != caps) {
+        virObjectUnref(entry->caps);
+        entry->caps = virObjectRef(caps);
+    }
+
+    return entry;
+}
+
+
+/* Must be called with @writer locked */
+static void
+virDomainStatusWriterDequeue(virDomainStatusWriterPtr writer,
+                             virDomainStatusWriterEntryPtr entry)
+{
+    size_t i;
+
+    if (!entry->queued)
+        return;
+
+    for (i = 0; i < writer->nqueue; i++) {
+        if (writer->queue[i] == entry) {
+            VIR_DELETE_ELEMENT(writer->queue, i, writer->nqueue);
+            break;
+        }
+    }
+
+    entry->queued = false;
+}
+
+
+/* Must be called with @obj locked and @writer unlocked */
+static int
+virDomainStatusWriterSave(virDomainStatusWriterPtr writer,
+                          virDomainObjPtr obj,
+                          virCapsPtr caps)
+{
+    virDomainStatusWriterEntryPtr entry;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    unsigned long long gen;
+    char *xml = NULL;
+    char *file = NULL;
+    int ret = -1;
+
+    virUUIDFormat(obj->def->uuid, uuidstr);
+
+    if (!(xml = virDomainObjFormatStatus(writer->xmlopt, obj, caps)) ||
+        !(file = virDomainConfigFile(writer->statusDir, obj->def->name)))
+        goto cleanup;
+
+    virObjectLock(writer);
+    gen = ++writer->gen;
+    virObjectUnlock(writer);
+
+    virMutexLock(&writer->writeLock);
+
+    /* The domain was discarded or a newer status was already written */
+    virObjectLock(writer);
+    entry = virHashLookup(writer->entries, uuidstr);
+    if (!entry || entry->written > gen) {
+        virObjectUnlock(writer);
+        virMutexUnlock(&writer->writeLock);
+        ret = 0;
+        goto cleanup;
+    }
+    virObjectUnlock(writer);
+
+    if (virFileMakePath(writer->statusDir) < 0) {
+        virReportSystemError(errno,
+                             _("cannot create config directory '%s'"),
+                             writer->statusDir);
+    } else if (virXMLSaveFile(file,
+                              virXMLPickShellSafeComment(obj->def->name,
+                                                         uuidstr),
+                              "edit", xml) == 0) {
+        /* @writeLock keeps the entry from being discarded meanwhile */
+        virObjectLock(writer);
+        entry->written = gen;
+        writer->writes++;
+        virObjectUnlock(writer);
+        ret = 0;
+    }
+
+    virMutexUnlock(&writer->writeLock);
+
+ cleanup:
+    VIR_FREE(xml);
+    VIR_FREE(file);
+    return ret;
+}
+
+
+static void
+virDomainStatusWriterWorker(void *opaque)
+{
+    virDomainStatusWriterPtr writer = opaque;
+    virDomainStatusWriterEntryPtr entry;
+    virDomainObjPtr obj;
+    virCapsPtr caps;
+    unsigned long long now;
+
+    virObjectLock(writer);
+
+    while (true) {
+        if (!writer->nqueue) {
+            if (writer->quit)
+                break;
+
+            if (virCondWait(&writer->cond, &writer->parent.lock) < 0) {
+                VIR_ERROR(_("failed to wait on condition"));
+                break;
+            }
+            continue;
+        }
+
+        entry = writer->queue[0];
+
+        /* pending writes are done right away on shutdown */
+        if (!writer->quit &&
+            virTimeMillisNow(&now) == 0 &&
+            now < entry->deadline) {
+            ignore_value(virCondWaitUntil(&writer->cond, &writer->parent.lock,
+                                          entry->deadline));
+            continue;
+        }
+
+        virDomainStatusWriterDequeue(writer, entry);
+        obj = virObjectRef(entry->obj);
+        caps = virObjectRef(entry->caps);
+        virObjectUnlock(writer);
+
+        virObjectLock(obj);
+        if (virDomainObjIsActive(obj) &&
+            virDomainStatusWriterSave(writer, obj, caps) < 0)
+            VIR_WARN("Failed to save status on vm %s", obj->def->name);
+        virObjectUnlock(obj);
+
+        virObjectUnref(obj);
+        virObjectUnref(caps);
+
+        virObjectLock(writer);
+    }
+
+    virObjectUnlock(writer);
+}
+
+
+/**
+ * virDomainStatusWriterNew:
+ * @xmlopt: XML parser configuration used to format the status
+ * @statusDir: directory with the status files
+ * @delay: time in milliseconds a status change may wait to be written
+ *
+ * Creates a writer of domain status files. Changes to the status marked
+ * by virDomainStatusWriterMarkDirty within @delay milliseconds are
+ * written only once by a dedicated thread. Each status file is replaced
+ * atomically. Pending changes are written when the last reference to
+ * the writer is released.
+ *
+ * Returns the writer or NULL on error.
+ */
+virDomainStatusWriterPtr
+virDomainStatusWriterNew(virDomainXMLOptionPtr xmlopt,
+                         const char *statusDir,
+                         unsigned int delay)
+{
+    virDomainStatusWriterPtr writer;
+
+    if (virDomainStatusWriterInitialize() < 0)
+        return NULL;
+
+    if (!(writer = virObjectLockableNew(virDomainStatusWriterClass)))
+        return NULL;
+
+    writer->delay = delay;
+    writer->xmlopt = virObjectRef(xmlopt);
+
+    if (VIR_STRDUP(writer->statusDir, statusDir) < 0 ||
+        !(writer->entries = virHashCreate(50, virDomainStatusWriterEntryFree)))
+        goto error;
+
+    if (virMutexInit(&writer->writeLock) < 0) {
+        virReportSystemError(errno, "%s", _("cannot initialize mutex"));
+        goto error;
+    }
+
+    if (virCondInit(&writer->cond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize condition variable"));
+        virMutexDestroy(&writer->writeLock);
+        goto error;
+    }
+
+    if (virThreadCreate(&writer->thread, true,
+                        virDomainStatusWriterWorker, writer) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to create status writer thread"));
+        virCondDestroy(&writer->cond);
+        virMutexDestroy(&writer->writeLock);
+        goto error;
+    }
+
+    return writer;
+
+ error:
+    virHashFree(writer->entries);
+    VIR_FREE(writer->statusDir);
+    /* keeps dispose from joining a thread which doesn't exist */
+    virObjectUnref(writer->xmlopt);
+    writer->xmlopt = NULL;
+    virObjectUnref(writer);
+    return NULL;
+}
+
+
+static void
+virDomainStatusWriterDispose(void *opaque)
+{
+    virDomainStatusWriterPtr writer = opaque;
+
+    if (!writer->xmlopt)
+        return;
+
+    virObjectLock(writer);
+    writer->quit = true;
+    virCondSignal(&writer->cond);
+    virObjectUnlock(writer);
+
+    virThreadJoin(&writer->thread);
+
+    virCondDestroy(&writer->cond);
+    virMutexDestroy(&writer->writeLock);
+    VIR_FREE(writer->queue);
+    virHashFree(writer->entries);
+    VIR_FREE(writer->statusDir);
+    virObjectUnref(writer->xmlopt);
+}
+
+
+/**
+ * virDomainStatusWriterMarkDirty:
+ * @writer: status writer
+ * @obj: locked domain object
+ * @caps: driver capabilities
+ *
+ * Schedules writing the status of @obj. Further changes marked before
+ * the write happens are covered by that single write.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virDomainStatusWriterMarkDirty(virDomainStatusWriterPtr writer,
+                               virDomainObjPtr obj,
+                               virCapsPtr caps)
+{
+    virDomainStatusWriterEntryPtr entry;
+    unsigned long long now;
+    int ret = -1;
+
+    if (virTimeMillisNow(&now) < 0)
+        return -1;
+
+    virObjectLock(writer);
+    writer->requests++;
+
+    if (!(entry = virDomainStatusWriterGetEntry(writer, obj, caps)))
+        goto cleanup;
+
+    if (!entry->queued) {
+        entry->deadline = now + writer->delay;
+        if (VIR_APPEND_ELEMENT_COPY(writer->queue, writer->nqueue, entry) < 0)
+            goto cleanup;
+        entry->queued = true;
+
+        if (writer->nqueue == 1)
+            virCondSignal(&writer->cond);
+    }
+
+    ret = 0;
+ cleanup:
+    virObjectUnlock(writer);
+    return ret;
+}
+
+
+/**
+ * virDomainStatusWriterFlush:
+ * @writer: status writer
+ * @obj: locked domain object
+ * @caps: driver capabilities
+ *
+ * Writes the status of @obj right away, covering any pending change
+ * marked dirty before. Meant for callers which must not return before
+ * the status is on disk.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virDomainStatusWriterFlush(virDomainStatusWriterPtr writer,
+                           virDomainObjPtr obj,
+                           virCapsPtr caps)
+{
+    virDomainStatusWriterEntryPtr entry;
+
+    virObjectLock(writer);
+    writer->requests++;
+
+    if (!(entry = virDomainStatusWriterGetEntry(writer, obj, caps))) {
+        virObjectUnlock(writer);
+        return -1;
+    }
+
+    virDomainStatusWriterDequeue(writer, entry);
+    virObjectUnlock(writer);
+
+    return virDomainStatusWriterSave(writer, obj, caps);
+}
+
+
+/**
+ * virDomainStatusWriterDiscard:
+ * @writer: status writer
+ * @obj: locked domain object
+ *
+ * Drops pending changes of @obj. Must be called before the status file
+ * is removed so that it's not written again afterwards.
+ */
+void
+virDomainStatusWriterDiscard(virDomainStatusWriterPtr writer,
+                             virDomainObjPtr obj)
+{
+    virDomainStatusWriterEntryPtr entry;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+
+    virUUIDFormat(obj->def->uuid, uuidstr);
+
+    virMutexLock(&writer->writeLock);
+    virObjectLock(writer);
+
+    if ((entry = virHashLookup(writer->entries, uuidstr))) {
+        virDomainStatusWriterDequeue(writer, entry);
+        virHashRemoveEntry(writer->entries, uuidstr);
+    }
+
+    virObjectUnlock(writer);
+    virMutexUnlock(&writer->writeLock);
+}
+
+
+/**
+ * virDomainStatusWriterGetStats:
+ * @writer: status writer
+ * @requests: filled with the number of requests to save a status
+ * @writes: filled with the number of status files actually written
+ */
+void
+virDomainStatusWriterGetStats(virDomainStatusWriterPtr writer,
+                              unsigned long long *requests,
+                              unsigned long long *writes)
+{
+    virObjectLock(writer);
+    *requests = writer->requests;
+    *writes = writer->writes;
+    virObjectUnlock(writer);
+}
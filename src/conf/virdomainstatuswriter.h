@@ -0,0 +1,49 @@
+/*
+ * virdomainstatuswriter.h: coalesced persistence of domain status
+ *
+ * Copyright (C) 2017 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VIRDOMAINSTATUSWRITER_H__
+# define __VIRDOMAINSTATUSWRITER_H__
+
+# include "domain_conf.h"
+
+typedef struct _virDomainStatusWriter virDomainStatusWriter;
+typedef virDomainStatusWriter *virDomainStatusWriterPtr;
+
+virDomainStatusWriterPtr
+virDomainStatusWriterNew(virDomainXMLOptionPtr xmlopt,
+                         const char *statusDir,
+                         unsigned int delay);
+
+int virDomainStatusWriterMarkDirty(virDomainStatusWriterPtr writer,
+                                   virDomainObjPtr obj,
+                                   virCapsPtr caps);
+
+int virDomainStatusWriterFlush(virDomainStatusWriterPtr writer,
+                               virDomainObjPtr obj,
+                               virCapsPtr caps);
+
+void virDomainStatusWriterDiscard(virDomainStatusWriterPtr writer,
+                                  virDomainObjPtr obj);
+
+void virDomainStatusWriterGetStats(virDomainStatusWriterPtr writer,
+                                   unsigned long long *requests,
+                                   unsigned long long *writes);
+
+#endif /* __VIRDOMAINSTATUSWRITER_H__ */
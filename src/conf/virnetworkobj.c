@@ -27,6 +27,7 @@
 #include "virerror.h"
 #include "virfile.h"
 #include "virhash.h"
+#include "virleaseindex.h"
 #include "virlog.h"
 #include "virstring.h"
 
@@ -291,6 +292,10 @@ virNetworkObjMacMgrAdd(virNetworkObjPtr obj,
     if (virMacMapWriteFile(obj->macmap, file) < 0)
         goto cleanup;
 
+    /* The index only speeds up NSS lookups, which fall back to
+     * reading the MAC maps directly when it's missing. */
+    ignore_value(virLeaseIndexRebuild(dnsmasqStateDir));
+
     ret = 0;
  cleanup:
     VIR_FREE(file);
@@ -322,6 +327,10 @@ virNetworkObjMacMgrDel(virNetworkObjPtr obj,
     if (virMacMapWriteFile(obj->macmap, file) < 0)
         goto cleanup;
 
+    /* The index only speeds up NSS lookups, which fall back to
+     * reading the MAC maps directly when it's missing. */
+    ignore_value(virLeaseIndexRebuild(dnsmasqStateDir));
+
     ret = 0;
  cleanup:
     VIR_FREE(file);
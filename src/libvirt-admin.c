@@ -1241,3 +1241,90 @@ virAdmConnectSetLoggingFilters(virAdmConnectPtr conn,
     virDispatchError(NULL);
     return -1;
 }
+
+/**
+ * virAdmServerGetRPCStats:
+ * @srv: a valid server object reference
+ * @params: pointer to a list of statistics
+ *          (return value, allocated automatically)
+ * @nparams: pointer to number of parameters returned in @params
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Retrieve per-procedure statistics of the RPC calls @srv has dispatched
+ * so far. For every procedure that has been called at least once, the
+ * number of calls is reported along with the total time and a latency
+ * histogram of each phase of processing the call, see
+ * VIR_SERVER_RPC_STATS_CALLS and the macros following it for details.
+ *
+ * Returns 0 on success, allocating @params to size returned in @nparams, or
+ * -1 in case of an error. Caller is responsible for deallocating @params.
+ */
+int
+virAdmServerGetRPCStats(virAdmServerPtr srv,
+                        virTypedParameterPtr *params,
+                        int *nparams,
+                        unsigned int flags)
+{
+    int ret = -1;
+
+    VIR_DEBUG("srv=%p, params=%p, nparams=%p, flags=%x",
+              srv, params, nparams, flags);
+    virResetLastError();
+
+    virCheckAdmServerGoto(srv, error);
+    virCheckNonNullArgGoto(params, error);
+    virCheckNonNullArgGoto(nparams, error);
+
+    if ((ret = remoteAdminServerGetRPCStats(srv, params,
+                                            nparams, flags)) < 0)
+        goto error;
+
+    return ret;
+ error:
+    virDispatchError(NULL);
+    return -1;
+}
+
+/**
+ * virAdmConnectGetHostCPURates:
+ * @conn: pointer to an active admin connection
+ * @cpuNum: number of the CPU or VIR_NODE_CPU_STATS_ALL_CPUS (-1)
+ * @params: pointer to a list of rates
+ *          (return value, allocated automatically)
+ * @nparams: pointer to number of parameters returned in @params
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Retrieve the rates of CPU time counters of the host computed by the
+ * daemon from its last two samples of host statistics, see
+ * VIR_ADMIN_HOST_CPU_RATE for details. The daemon only samples host
+ * statistics when host_stats_interval is set in its configuration file.
+ *
+ * Returns 0 on success, allocating @params to size returned in @nparams, or
+ * -1 in case of an error. Caller is responsible for deallocating @params.
+ */
+int
+virAdmConnectGetHostCPURates(virAdmConnectPtr conn,
+                             int cpuNum,
+                             virTypedParameterPtr *params,
+                             int *nparams,
+                             unsigned int flags)
+{
+    int ret = -1;
+
+    VIR_DEBUG("conn=%p, cpuNum=%d, params=%p, nparams=%p, flags=%x",
+              conn, cpuNum, params, nparams, flags);
+    virResetLastError();
+
+    virCheckAdmConnectReturn(conn, -1);
+    virCheckNonNullArgGoto(params, error);
+    virCheckNonNullArgGoto(nparams, error);
+
+    if ((ret = remoteAdminConnectGetHostCPURates(conn, cpuNum, params,
+                                                 nparams, flags)) < 0)
+        goto error;
+
+    return ret;
+ error:
+    virDispatchError(NULL);
+    return -1;
+}
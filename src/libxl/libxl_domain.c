@@ -766,7 +766,7 @@ libxlDomainCleanup(libxlDriverPrivatePtr driver,
         VIR_WARN("Unable to release lease on %s", vm->def->name);
     VIR_DEBUG("Preserving lock state '%s'", NULLSTR(priv->lockState));
 
-    vm->def->id = -1;
+    virDomainObjListSetID(driver->domains, vm, -1);
 
     if (priv->deathW) {
         libxl_evdisable_domain_death(cfg->ctx, priv->deathW);
@@ -1218,7 +1218,7 @@ libxlDomainStart(libxlDriverPrivatePtr driver,
         VIR_FREE(managed_save_path);
     }
 
-    if (virDomainObjSetDefTransient(cfg->caps, driver->xmlopt, vm) < 0)
+    if (virDomainObjSetDefTransient(cfg->caps, driver->xmlopt, vm, NULL) < 0)
         goto cleanup;
 
     /* Run an early hook to set-up missing devices */
@@ -1329,7 +1329,7 @@ libxlDomainStart(libxlDriverPrivatePtr driver,
      * The domain has been successfully created with libxl, so it should
      * be cleaned up if there are any subsequent failures.
      */
-    vm->def->id = domid;
+    virDomainObjListSetID(driver->domains, vm, domid);
     config_json = libxl_domain_config_to_json(cfg->ctx, &d_config);
 
     libxlLoggerOpenFile(cfg->logger, domid, vm->def->name, config_json);
@@ -1402,7 +1402,7 @@ libxlDomainStart(libxlDriverPrivatePtr driver,
  destroy_dom:
     ret = -1;
     libxlDomainDestroyInternal(driver, vm);
-    vm->def->id = -1;
+    virDomainObjListSetID(driver->domains, vm, -1);
     virDomainObjSetState(vm, VIR_DOMAIN_SHUTOFF, VIR_DOMAIN_SHUTOFF_FAILED);
 
  cleanup_dom:
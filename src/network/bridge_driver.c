@@ -74,6 +74,7 @@
 #include "network_event.h"
 #include "virhook.h"
 #include "virjson.h"
+#include "virleaseindex.h"
 
 #define VIR_FROM_THIS VIR_FROM_NETWORK
 #define MAX_BRIDGE_ID 256
@@ -377,6 +378,9 @@ networkRemoveInactive(virNetworkDriverStatePtr driver,
     /* MAC map manager */
     unlink(macMapFile);
 
+    /* lease index used by the NSS module */
+    ignore_value(virLeaseIndexRebuild(driver->dnsmasqStateDir));
+
     /* radvd */
     unlink(radvdconfigfile);
     virPidFileDelete(driver->pidDir, radvdpidbase);
@@ -36,6 +36,7 @@
 #include "viralloc.h"
 #include "virjson.h"
 #include "virlease.h"
+#include "virleaseindex.h"
 #include "configmake.h"
 #include "virgettext.h"
 
@@ -249,6 +250,12 @@ main(int argc, char **argv)
         break;
     }
 
+    /* Refresh the index the NSS module looks leases up in. This is
+     * done on 'init' too so that an index left behind by an older
+     * helper gets corrected as soon as dnsmasq restarts. Failure is
+     * not fatal, the NSS module falls back to the status files. */
+    ignore_value(virLeaseIndexRebuild(LOCALSTATEDIR "/lib/libvirt/dnsmasq"));
+
     rv = EXIT_SUCCESS;
 
  cleanup:
@@ -35,6 +35,7 @@
 #include "virthread.h"
 #include "virtime.h"
 #include "locking/domain_lock.h"
+#include "storage/storage_source.h"
 
 #define VIR_FROM_THIS VIR_FROM_QEMU
 
@@ -167,6 +168,9 @@ qemuBlockJobEventProcess(virQEMUDriverPtr driver,
         save = disk->mirrorState != VIR_DOMAIN_DISK_MIRROR_STATE_NONE;
         disk->mirrorState = VIR_DOMAIN_DISK_MIRROR_STATE_NONE;
         disk->mirrorJob = VIR_DOMAIN_BLOCK_JOB_TYPE_UNKNOWN;
+        /* The images were rewritten by qemu just now, don't trust
+         * their cached headers */
+        virStorageFileMetadataCacheInvalidate(disk->src);
         ignore_value(qemuDomainDetermineDiskChain(driver, vm, disk,
                                                   true, true));
         ignore_value(qemuBlockNodeNamesDetect(driver, vm, asyncJob));
@@ -196,7 +200,7 @@ qemuBlockJobEventProcess(virQEMUDriverPtr driver,
     }
 
     if (save) {
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+        if (qemuDomainSaveStatus(driver, vm) < 0)
             VIR_WARN("Unable to save status on vm %s after block job",
                      vm->def->name);
         if (persistDisk && virDomainSaveConfig(cfg->configDir,
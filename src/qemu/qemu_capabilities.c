@@ -40,6 +40,8 @@
 #include "virnodesuspend.h"
 #include "virnuma.h"
 #include "virhostcpu.h"
+#include "virthreadpool.h"
+#include "virtime.h"
 #include "qemu_monitor.h"
 #include "virstring.h"
 #include "qemu_hostdev.h"
@@ -1179,6 +1181,110 @@ virQEMUCapsProbeHostCPUForEmulator(virArch hostArch,
 }
 
 
+struct virQEMUCapsProbeData {
+    virFileCachePtr cache;
+    char **binaries;
+    size_t nbinaries;
+};
+
+
+static int
+virQEMUCapsProbeWorker(size_t idx,
+                       void *opaque)
+{
+    struct virQEMUCapsProbeData *data = opaque;
+    virQEMUCapsPtr qemuCaps;
+
+    /* Failures are reported once again by virQEMUCapsInitGuest */
+    if (!(qemuCaps = virQEMUCapsCacheLookup(data->cache,
+                                            data->binaries[idx])))
+        virResetLastError();
+
+    virObjectUnref(qemuCaps);
+    return 0;
+}
+
+
+static int
+virQEMUCapsProbeAddBinary(struct virQEMUCapsProbeData *data,
+                          char *binary)
+{
+    size_t i;
+
+    for (i = 0; i < data->nbinaries; i++) {
+        if (STREQ(data->binaries[i], binary)) {
+            VIR_FREE(binary);
+            return 0;
+        }
+    }
+
+    if (VIR_APPEND_ELEMENT(data->binaries, data->nbinaries, binary) < 0) {
+        VIR_FREE(binary);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Looks up capabilities of all QEMU binaries virQEMUCapsInitGuest would
+ * look at in parallel, so that binaries which are not in the cache yet
+ * or whose cache is outdated are probed concurrently rather than one
+ * after another.
+ */
+static void
+virQEMUCapsProbeAll(virFileCachePtr cache,
+                    virArch hostarch)
+{
+    struct virQEMUCapsProbeData data = { .cache = cache };
+    const char *kvmbins[] = {
+        "/usr/libexec/qemu-kvm", /* RHEL */
+        "qemu-kvm", /* Fedora */
+        "kvm", /* Debian/Ubuntu */
+    };
+    unsigned long long start = 0;
+    unsigned long long end = 0;
+    char *binary;
+    int nworkers;
+    size_t i;
+
+    for (i = 0; i < VIR_ARCH_LAST; i++) {
+        if ((binary = virQEMUCapsFindBinaryForArch(hostarch, i)) &&
+            virQEMUCapsProbeAddBinary(&data, binary) < 0)
+            goto cleanup;
+    }
+
+    for (i = 0; i < ARRAY_CARDINALITY(kvmbins); i++) {
+        if ((binary = virFindFileInPath(kvmbins[i]))) {
+            if (virQEMUCapsProbeAddBinary(&data, binary) < 0)
+                goto cleanup;
+            break;
+        }
+    }
+
+    if (data.nbinaries < 2)
+        goto cleanup;
+
+    if ((nworkers = virHostCPUGetCount()) <= 0) {
+        virResetLastError();
+        nworkers = 1;
+    }
+
+    ignore_value(virTimeMillisNow(&start));
+    ignore_value(virThreadMapParallel(nworkers, data.nbinaries,
+                                      virQEMUCapsProbeWorker, &data));
+    ignore_value(virTimeMillisNow(&end));
+
+    VIR_DEBUG("Looked up capabilities of %zu QEMU binaries using %d threads "
+              "in %llu ms", data.nbinaries, nworkers, end - start);
+
+ cleanup:
+    virResetLastError();
+    virStringListFreeCount(data.binaries, data.nbinaries);
+}
+
+
 virCapsPtr
 virQEMUCapsInit(virFileCachePtr cache)
 {
@@ -1217,6 +1323,8 @@ virQEMUCapsInit(virFileCachePtr cache)
     virCapabilitiesAddHostMigrateTransport(caps, "tcp");
     virCapabilitiesAddHostMigrateTransport(caps, "rdma");
 
+    virQEMUCapsProbeAll(cache, hostarch);
+
     /* QEMU can support pretty much every arch that exists,
      * so just probe for them all - we gracefully fail
      * if a qemu-system-$ARCH binary can't be found
@@ -4232,6 +4340,174 @@ virQEMUCapsFormatCache(virQEMUCapsPtr qemuCaps)
 }
 
 
+/*
+ * Each cached capabilities XML file is accompanied by a small binary
+ * stamp holding just the data needed to check whether the cache is
+ * still valid. Outdated caches (e.g. after upgrading QEMU or libvirt)
+ * can thus be recognized without parsing the whole XML document. The
+ * stamp is only used on the host which created it, hence native byte
+ * order is fine.
+ */
+#define QEMU_CAPS_CACHE_STAMP_MAGIC "QEMUCAPS"
+#define QEMU_CAPS_CACHE_STAMP_FORMAT 1
+
+enum {
+    QEMU_CAPS_CACHE_STAMP_KVM = (1 << 0),
+    QEMU_CAPS_CACHE_STAMP_ENABLE_KVM = (1 << 1),
+};
+
+struct virQEMUCapsCacheStamp {
+    char magic[8];
+    uint32_t format;
+    uint32_t libvirtVersion;
+    int64_t ctime;
+    int64_t libvirtCtime;
+    uint64_t xmlSize;  /* size of the XML file the stamp belongs to */
+    uint32_t flags;
+    uint32_t unused;
+};
+verify(sizeof(struct virQEMUCapsCacheStamp) == 48);
+verify(sizeof(QEMU_CAPS_CACHE_STAMP_MAGIC) - 1 ==
+       sizeof(((struct virQEMUCapsCacheStamp *)0)->magic));
+
+
+static char *
+virQEMUCapsCacheStampPath(const char *filename)
+{
+    char *path;
+
+    ignore_value(virAsprintf(&path, "%s.stamp", filename));
+    return path;
+}
+
+
+static int
+virQEMUCapsWriteCacheStamp(int fd,
+                           const void *opaque)
+{
+    const struct virQEMUCapsCacheStamp *stamp = opaque;
+
+    if (safewrite(fd, stamp, sizeof(*stamp)) != sizeof(*stamp))
+        return -1;
+
+    return 0;
+}
+
+
+/**
+ * virQEMUCapsSaveCacheStamp:
+ * @qemuCaps: capabilities stored in @filename
+ * @filename: path to the cached capabilities XML
+ *
+ * Writes the binary stamp for capabilities XML which was just saved
+ * to @filename.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virQEMUCapsSaveCacheStamp(virQEMUCapsPtr qemuCaps,
+                          const char *filename)
+{
+    struct virQEMUCapsCacheStamp stamp;
+    struct stat sb;
+    char *path = NULL;
+    int ret = -1;
+
+    if (!(path = virQEMUCapsCacheStampPath(filename)))
+        return -1;
+
+    if (stat(filename, &sb) < 0) {
+        virReportSystemError(errno, _("Unable to stat '%s'"), filename);
+        goto cleanup;
+    }
+
+    memset(&stamp, 0, sizeof(stamp));
+    memcpy(stamp.magic, QEMU_CAPS_CACHE_STAMP_MAGIC, sizeof(stamp.magic));
+    stamp.format = QEMU_CAPS_CACHE_STAMP_FORMAT;
+    stamp.libvirtVersion = qemuCaps->libvirtVersion;
+    stamp.ctime = qemuCaps->ctime;
+    stamp.libvirtCtime = qemuCaps->libvirtCtime;
+    stamp.xmlSize = sb.st_size;
+    if (virQEMUCapsGet(qemuCaps, QEMU_CAPS_KVM))
+        stamp.flags |= QEMU_CAPS_CACHE_STAMP_KVM;
+    if (virQEMUCapsGet(qemuCaps, QEMU_CAPS_ENABLE_KVM))
+        stamp.flags |= QEMU_CAPS_CACHE_STAMP_ENABLE_KVM;
+
+    if (virFileRewrite(path, 0600, virQEMUCapsWriteCacheStamp, &stamp) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(path);
+    return ret;
+}
+
+
+/**
+ * virQEMUCapsLoadCacheStamp:
+ * @qemuCaps: capabilities to fill in
+ * @filename: path to the cached capabilities XML
+ *
+ * Loads the data needed by virQEMUCapsIsValid from the binary stamp of
+ * cached capabilities XML @filename.
+ *
+ * Returns 1 if the stamp was loaded, 0 if it is missing or does not
+ * belong to @filename.
+ */
+int
+virQEMUCapsLoadCacheStamp(virQEMUCapsPtr qemuCaps,
+                          const char *filename)
+{
+    struct virQEMUCapsCacheStamp stamp;
+    struct stat sb;
+    char *path = NULL;
+    int fd = -1;
+    int ret = 0;
+
+    if (!(path = virQEMUCapsCacheStampPath(filename))) {
+        virResetLastError();
+        return 0;
+    }
+
+    if ((fd = open(path, O_RDONLY)) < 0 ||
+        saferead(fd, &stamp, sizeof(stamp)) != sizeof(stamp) ||
+        fstat(fd, &sb) < 0 ||
+        sb.st_size != sizeof(stamp)) {
+        VIR_DEBUG("No usable cache stamp '%s'", path);
+        goto cleanup;
+    }
+
+    if (memcmp(stamp.magic, QEMU_CAPS_CACHE_STAMP_MAGIC,
+               sizeof(stamp.magic)) != 0 ||
+        stamp.format != QEMU_CAPS_CACHE_STAMP_FORMAT) {
+        VIR_DEBUG("Unknown format of cache stamp '%s'", path);
+        goto cleanup;
+    }
+
+    if (stat(filename, &sb) < 0 ||
+        sb.st_size != stamp.xmlSize) {
+        VIR_DEBUG("Cache stamp '%s' does not match '%s'", path, filename);
+        goto cleanup;
+    }
+
+    qemuCaps->libvirtVersion = stamp.libvirtVersion;
+    qemuCaps->ctime = stamp.ctime;
+    qemuCaps->libvirtCtime = stamp.libvirtCtime;
+    if (stamp.flags & QEMU_CAPS_CACHE_STAMP_KVM)
+        virQEMUCapsSet(qemuCaps, QEMU_CAPS_KVM);
+    if (stamp.flags & QEMU_CAPS_CACHE_STAMP_ENABLE_KVM)
+        virQEMUCapsSet(qemuCaps, QEMU_CAPS_ENABLE_KVM);
+
+    ret = 1;
+
+ cleanup:
+    VIR_FORCE_CLOSE(fd);
+    VIR_FREE(path);
+    return ret;
+}
+
+
 static int
 virQEMUCapsSaveFile(void *data,
                     const char *filename,
@@ -4239,10 +4515,15 @@ virQEMUCapsSaveFile(void *data,
 {
     virQEMUCapsPtr qemuCaps = data;
     char *xml = NULL;
+    char *stampPath = NULL;
     int ret = -1;
 
     xml = virQEMUCapsFormatCache(qemuCaps);
 
+    /* Make sure an old stamp is never paired with the new XML */
+    if ((stampPath = virQEMUCapsCacheStampPath(filename)))
+        ignore_value(unlink(stampPath));
+
     if (virFileWriteStr(filename, xml, 0600) < 0) {
         virReportSystemError(errno,
                              _("Failed to save '%s' for '%s'"),
@@ -4250,6 +4531,12 @@ virQEMUCapsSaveFile(void *data,
         goto cleanup;
     }
 
+    if (virQEMUCapsSaveCacheStamp(qemuCaps, filename) < 0) {
+        VIR_WARN("Failed to save cache stamp for '%s': %s",
+                 filename, virGetLastErrorMessage());
+        virResetLastError();
+    }
+
     VIR_DEBUG("Saved caps '%s' for '%s' with (%lld, %lld)",
               filename, qemuCaps->binary,
               (long long)qemuCaps->ctime,
@@ -4257,6 +4544,7 @@ virQEMUCapsSaveFile(void *data,
 
     ret = 0;
  cleanup:
+    VIR_FREE(stampPath);
     VIR_FREE(xml);
     return ret;
 }
@@ -4872,6 +5160,7 @@ struct _virQEMUCapsInitQMPCommand {
     char *monarg;
     char *monpath;
     char *pidfile;
+    char *uniqDir;
     virCommandPtr cmd;
     qemuMonitorPtr mon;
     virDomainChrSourceDef config;
@@ -4921,10 +5210,13 @@ virQEMUCapsInitQMPCommandFree(virQEMUCapsInitQMPCommandPtr cmd)
         return;
 
     virQEMUCapsInitQMPCommandAbort(cmd);
+    if (cmd->uniqDir)
+        rmdir(cmd->uniqDir);
     VIR_FREE(cmd->binary);
     VIR_FREE(cmd->monpath);
     VIR_FREE(cmd->monarg);
     VIR_FREE(cmd->pidfile);
+    VIR_FREE(cmd->uniqDir);
     VIR_FREE(cmd);
 }
 
@@ -4948,25 +5240,42 @@ virQEMUCapsInitQMPCommandNew(char *binary,
     cmd->runGid = runGid;
     cmd->qmperr = qmperr;
 
-    /* the ".sock" sufix is important to avoid a possible clash with a qemu
-     * domain called "capabilities"
-     */
-    if (virAsprintf(&cmd->monpath, "%s/%s", libDir,
-                    "capabilities.monitor.sock") < 0)
-        goto error;
-    if (virAsprintf(&cmd->monarg, "unix:%s,server,nowait", cmd->monpath) < 0)
-        goto error;
-
-    /* ".pidfile" suffix is used rather than ".pid" to avoid a possible clash
-     * with a qemu domain called "capabilities"
+    /* Binaries may be probed in parallel, so every probe needs its own
+     * monitor socket and pidfile. They live in a unique directory which
+     * also avoids any clash with a qemu domain called "capabilities".
+     *
      * Normally we'd use runDir for pid files, but because we're using
      * -daemonize we need QEMU to be allowed to create them, rather
      * than libvirtd. So we're using libDir which QEMU can write to
      */
-    if (virAsprintf(&cmd->pidfile, "%s/%s", libDir, "capabilities.pidfile") < 0)
+    if (virAsprintf(&cmd->uniqDir, "%s/qmp-XXXXXX", libDir) < 0)
+        goto error;
+
+    if (!mkdtemp(cmd->uniqDir)) {
+        virReportSystemError(errno,
+                             _("Failed to create unique directory with "
+                               "template '%s' for probing QEMU"),
+                             cmd->uniqDir);
+        VIR_FREE(cmd->uniqDir);
+        goto error;
+    }
+
+    if (chown(cmd->uniqDir, runUid, runGid) < 0) {
+        virReportSystemError(errno,
+                             _("Cannot change ownership of '%s' to %u:%u"),
+                             cmd->uniqDir, (unsigned int) runUid,
+                             (unsigned int) runGid);
+        goto error;
+    }
+
+    if (virAsprintf(&cmd->monpath, "%s/%s", cmd->uniqDir,
+                    "qmp.monitor") < 0)
+        goto error;
+    if (virAsprintf(&cmd->monarg, "unix:%s,server,nowait", cmd->monpath) < 0)
         goto error;
 
-    virPidFileForceCleanupPath(cmd->pidfile);
+    if (virAsprintf(&cmd->pidfile, "%s/%s", cmd->uniqDir, "qmp.pid") < 0)
+        goto error;
 
     cmd->config.type = VIR_DOMAIN_CHR_TYPE_UNIX;
     cmd->config.data.nix.path = cmd->monpath;
@@ -5232,6 +5541,16 @@ virQEMUCapsLoadFile(const char *filename,
     if (VIR_STRDUP(qemuCaps->binary, binary) < 0)
         goto error;
 
+    /* If the stamp says the cache is outdated, there's no need to parse
+     * the XML. The caller will find out and throw the cache away. */
+    if (virQEMUCapsLoadCacheStamp(qemuCaps, filename) > 0) {
+        if (!virQEMUCapsIsValid(qemuCaps, priv))
+            goto cleanup;
+
+        virQEMUCapsClear(qemuCaps, QEMU_CAPS_KVM);
+        virQEMUCapsClear(qemuCaps, QEMU_CAPS_ENABLE_KVM);
+    }
+
     if (virQEMUCapsLoadCache(priv->hostArch, qemuCaps, filename) < 0)
         goto error;
 
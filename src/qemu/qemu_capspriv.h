@@ -43,6 +43,11 @@ int virQEMUCapsLoadCache(virArch hostArch,
                          const char *filename);
 char *virQEMUCapsFormatCache(virQEMUCapsPtr qemuCaps);
 
+int virQEMUCapsSaveCacheStamp(virQEMUCapsPtr qemuCaps,
+                              const char *filename);
+int virQEMUCapsLoadCacheStamp(virQEMUCapsPtr qemuCaps,
+                              const char *filename);
+
 int
 virQEMUCapsInitQMPMonitor(virQEMUCapsPtr qemuCaps,
                           qemuMonitorPtr mon);
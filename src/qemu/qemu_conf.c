@@ -316,6 +316,10 @@ virQEMUDriverConfigPtr virQEMUDriverConfigNew(bool privileged)
 
     cfg->keepAliveInterval = 5;
     cfg->keepAliveCount = 5;
+    cfg->maxStatsWorkers = 1;
+    cfg->maxReconnectWorkers = 16;
+    cfg->saveImageIOBufferSize = 1024;
+    cfg->saveImageIOBuffers = 2;
     cfg->seccompSandbox = -1;
 
     cfg->logTimestamp = true;
@@ -724,6 +728,19 @@ int virQEMUDriverConfigLoadFile(virQEMUDriverConfigPtr cfg,
         goto cleanup;
     if (virConfGetValueBool(conf, "auto_start_bypass_cache", &cfg->autoStartBypassCache) < 0)
         goto cleanup;
+    if (virConfGetValueUInt(conf, "save_image_io_buffer_size", &cfg->saveImageIOBufferSize) < 0)
+        goto cleanup;
+    if (virConfGetValueUInt(conf, "save_image_io_buffers", &cfg->saveImageIOBuffers) < 0)
+        goto cleanup;
+    if (cfg->saveImageIOBufferSize == 0 ||
+        cfg->saveImageIOBufferSize > 64 * 1024 ||
+        cfg->saveImageIOBuffers == 0 ||
+        cfg->saveImageIOBuffers > 64) {
+        virReportError(VIR_ERR_CONF_SYNTAX, "%s",
+                       _("save_image_io_buffer_size must be between 1 and "
+                         "65536 and save_image_io_buffers between 1 and 64"));
+        goto cleanup;
+    }
 
     if (virConfGetValueStringList(conf, "hugetlbfs_mount", true,
                                   &hugetlbfs) < 0)
@@ -807,6 +824,11 @@ int virQEMUDriverConfigLoadFile(virQEMUDriverConfigPtr cfg,
     if (virConfGetValueUInt(conf, "max_queued", &cfg->maxQueuedJobs) < 0)
         goto cleanup;
 
+    if (virConfGetValueUInt(conf, "max_stats_workers", &cfg->maxStatsWorkers) < 0)
+        goto cleanup;
+    if (virConfGetValueUInt(conf, "max_reconnect_workers", &cfg->maxReconnectWorkers) < 0)
+        goto cleanup;
+
     if (virConfGetValueInt(conf, "keepalive_interval", &cfg->keepAliveInterval) < 0)
         goto cleanup;
     if (virConfGetValueUInt(conf, "keepalive_count", &cfg->keepAliveCount) < 0)
@@ -50,6 +50,7 @@
 # include "virfile.h"
 # include "virfilecache.h"
 # include "virfirmware.h"
+# include "virdomainstatuswriter.h"
 
 # ifdef CPU_SETSIZE /* Linux */
 #  define QEMUD_CPUMASK_LEN CPU_SETSIZE
@@ -169,6 +170,8 @@ struct _virQEMUDriverConfig {
     bool dumpGuestCore;
 
     unsigned int maxQueuedJobs;
+    unsigned int maxStatsWorkers;
+    unsigned int maxReconnectWorkers;
 
     char **securityDriverNames;
     bool securityDefaultConfined;
@@ -181,6 +184,8 @@ struct _virQEMUDriverConfig {
     char *autoDumpPath;
     bool autoDumpBypassCache;
     bool autoStartBypassCache;
+    unsigned int saveImageIOBufferSize; /* in KiB */
+    unsigned int saveImageIOBuffers;
 
     char *lockManagerName;
 
@@ -232,6 +237,9 @@ struct _virQEMUDriver {
     /* Immutable pointer, self-locking APIs */
     virDomainObjListPtr domains;
 
+    /* Immutable pointer, self-locking APIs */
+    virDomainStatusWriterPtr statusWriter;
+
     /* Immutable pointer */
     char *qemuImgBinary;
 
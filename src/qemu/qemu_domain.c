@@ -583,6 +583,12 @@ qemuDomainJobInfoToParams(qemuDomainJobInfoPtr jobInfo,
                              stats->cpu_throttle_percentage) < 0)
         goto error;
 
+    if (jobInfo->imageBps &&
+        virTypedParamsAddULLong(&par, &npar, &maxpar,
+                                VIR_DOMAIN_JOB_IMAGE_BPS,
+                                jobInfo->imageBps) < 0)
+        goto error;
+
     *type = jobInfo->type;
     *params = par;
     *nparams = npar;
@@ -3880,17 +3886,67 @@ virDomainDefParserConfig virQEMUDriverDomainDefParserConfig = {
 };
 
 
+/**
+ * qemuDomainSaveStatus:
+ * @driver: qemu driver
+ * @vm: locked domain object
+ *
+ * Schedules writing the status XML of @vm. Changes done shortly after
+ * each other are written at once in the background, see
+ * qemuDomainFlushStatus for when the status must be on disk before
+ * returning.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuDomainSaveStatus(virQEMUDriverPtr driver,
+                     virDomainObjPtr vm)
+{
+    if (!driver->statusWriter)
+        return qemuDomainFlushStatus(driver, vm);
+
+    return virDomainStatusWriterMarkDirty(driver->statusWriter, vm,
+                                          driver->caps);
+}
+
+
+/**
+ * qemuDomainFlushStatus:
+ * @driver: qemu driver
+ * @vm: locked domain object
+ *
+ * Writes the status XML of @vm including any changes which were
+ * scheduled to be written by qemuDomainSaveStatus.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuDomainFlushStatus(virQEMUDriverPtr driver,
+                      virDomainObjPtr vm)
+{
+    virQEMUDriverConfigPtr cfg;
+    int ret;
+
+    if (driver->statusWriter)
+        return virDomainStatusWriterFlush(driver->statusWriter, vm,
+                                          driver->caps);
+
+    cfg = virQEMUDriverGetConfig(driver);
+    ret = virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps);
+    virObjectUnref(cfg);
+    return ret;
+}
+
+
+/* Job and phase changes are what crash recovery looks at when the
+ * daemon restarts, so they must hit the disk before we proceed. */
 static void
 qemuDomainObjSaveJob(virQEMUDriverPtr driver, virDomainObjPtr obj)
 {
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
-
     if (virDomainObjIsActive(obj)) {
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, obj, driver->caps) < 0)
+        if (qemuDomainFlushStatus(driver, obj) < 0)
             VIR_WARN("Failed to save status on vm %s", obj->def->name);
     }
-
-    virObjectUnref(cfg);
 }
 
 void
@@ -3971,7 +4027,7 @@ qemuDomainJobAllowed(qemuDomainObjPrivatePtr priv, qemuDomainJob job)
 }
 
 /* Give up waiting for mutex after 30 seconds */
-#define QEMU_JOB_WAIT_TIME (1000ull * 30)
+unsigned long long qemuDomainJobWaitTime = 1000ull * 30;
 
 /*
  * obj must be locked before calling
@@ -4004,13 +4060,21 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
               qemuDomainJobTypeToString(priv->job.active),
               qemuDomainAsyncJobTypeToString(priv->job.asyncJob));
 
-    if (virTimeMillisNow(&now) < 0) {
-        virObjectUnref(cfg);
-        return -1;
+    priv->jobs_queued++;
+
+    /* A domain may wait for quite some time to be reconnected after the
+     * daemon starts when there are many of them. This is not a job held
+     * by anyone, so it does not count against qemuDomainJobWaitTime. */
+    while (priv->reconnecting) {
+        VIR_DEBUG("Waiting for reconnect (vm=%p name=%s)", obj, obj->def->name);
+        if (virCondWait(&priv->job.cond, &obj->parent.lock) < 0)
+            goto error;
     }
 
-    priv->jobs_queued++;
-    then = now + QEMU_JOB_WAIT_TIME;
+    if (virTimeMillisNow(&now) < 0)
+        goto cleanup;
+
+    then = now + qemuDomainJobWaitTime;
 
  retry:
     if (cfg->maxQueuedJobs &&
@@ -4185,6 +4249,20 @@ qemuDomainObjBeginNestedJob(virQEMUDriverPtr driver,
 }
 
 
+/* Monitor replies fetched ahead by qemuMonitorBatchQuery are meant for
+ * the job which asked for them only, be it a nested one */
+static void
+qemuDomainObjDropBatchReplies(qemuDomainObjPrivatePtr priv)
+{
+    if (!priv->mon)
+        return;
+
+    virObjectLock(priv->mon);
+    qemuMonitorDropBatchReplies(priv->mon);
+    virObjectUnlock(priv->mon);
+}
+
+
 /*
  * obj must be locked and have a reference before calling
  *
@@ -4204,6 +4282,8 @@ qemuDomainObjEndJob(virQEMUDriverPtr driver, virDomainObjPtr obj)
               qemuDomainAsyncJobTypeToString(priv->job.asyncJob),
               obj, obj->def->name);
 
+    qemuDomainObjDropBatchReplies(priv);
+
     qemuDomainObjResetJob(priv);
     if (qemuDomainTrackJob(job))
         qemuDomainObjSaveJob(driver, obj);
@@ -4221,6 +4301,7 @@ qemuDomainObjEndAsyncJob(virQEMUDriverPtr driver, virDomainObjPtr obj)
               qemuDomainAsyncJobTypeToString(priv->job.asyncJob),
               obj, obj->def->name);
 
+    qemuDomainObjDropBatchReplies(priv);
     qemuDomainObjResetAsyncJob(priv);
     qemuDomainObjSaveJob(driver, obj);
     virCondBroadcast(&priv->job.asyncCond);
@@ -5340,24 +5421,12 @@ qemuDomainSnapshotDiscardAllMetadata(virQEMUDriverPtr driver,
 }
 
 
-/**
- * qemuDomainRemoveInactive:
- *
- * The caller must hold a lock to the vm.
- */
-void
-qemuDomainRemoveInactive(virQEMUDriverPtr driver,
-                         virDomainObjPtr vm)
+static void
+qemuDomainRemoveInactiveCommon(virQEMUDriverPtr driver,
+                               virDomainObjPtr vm)
 {
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
     char *snapDir;
-    virQEMUDriverConfigPtr cfg;
-
-    if (vm->persistent) {
-        /* Short-circuit, we don't want to remove a persistent domain */
-        return;
-    }
-
-    cfg = virQEMUDriverGetConfig(driver);
 
     /* Remove any snapshot metadata prior to removing the domain */
     if (qemuDomainSnapshotDiscardAllMetadata(driver, vm) < 0) {
@@ -5374,6 +5443,26 @@ qemuDomainRemoveInactive(virQEMUDriverPtr driver,
         VIR_FREE(snapDir);
     }
 
+    virObjectUnref(cfg);
+}
+
+
+/**
+ * qemuDomainRemoveInactive:
+ *
+ * The caller must hold a lock to the vm.
+ */
+void
+qemuDomainRemoveInactive(virQEMUDriverPtr driver,
+                         virDomainObjPtr vm)
+{
+    if (vm->persistent) {
+        /* Short-circuit, we don't want to remove a persistent domain */
+        return;
+    }
+
+    qemuDomainRemoveInactiveCommon(driver, vm);
+
     virObjectRef(vm);
 
     virDomainObjListRemove(driver->domains, vm);
@@ -5390,7 +5479,31 @@ qemuDomainRemoveInactive(virQEMUDriverPtr driver,
      *      it's a work for another day.
      */
     virObjectLock(vm);
-    virObjectUnref(cfg);
+    virObjectUnref(vm);
+}
+
+
+/**
+ * qemuDomainRemoveInactiveLocked:
+ *
+ * The caller must hold a lock to the vm and must hold the
+ * lock on driver->domains in order to modify it.
+ */
+static void
+qemuDomainRemoveInactiveLocked(virQEMUDriverPtr driver,
+                               virDomainObjPtr vm)
+{
+    if (vm->persistent) {
+        /* Short-circuit, we don't want to remove a persistent domain */
+        return;
+    }
+
+    qemuDomainRemoveInactiveCommon(driver, vm);
+
+    /* See qemuDomainRemoveInactive for why the vm is locked back */
+    virObjectRef(vm);
+    virDomainObjListRemoveLocked(driver->domains, vm);
+    virObjectLock(vm);
     virObjectUnref(vm);
 }
 
@@ -5418,24 +5531,41 @@ qemuDomainRemoveInactiveJob(virQEMUDriverPtr driver,
 }
 
 
+/**
+ * qemuDomainRemoveInactiveJobLocked:
+ *
+ * Similar to qemuDomainRemoveInactiveJob, except that the caller must
+ * also hold the lock @driver->domains
+ */
+void
+qemuDomainRemoveInactiveJobLocked(virQEMUDriverPtr driver,
+                                  virDomainObjPtr vm)
+{
+    bool haveJob;
+
+    haveJob = qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) >= 0;
+
+    qemuDomainRemoveInactiveLocked(driver, vm);
+
+    if (haveJob)
+        qemuDomainObjEndJob(driver, vm);
+}
+
+
 void
 qemuDomainSetFakeReboot(virQEMUDriverPtr driver,
                         virDomainObjPtr vm,
                         bool value)
 {
     qemuDomainObjPrivatePtr priv = vm->privateData;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
     if (priv->fakeReboot == value)
-        goto cleanup;
+        return;
 
     priv->fakeReboot = value;
 
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+    if (qemuDomainSaveStatus(driver, vm) < 0)
         VIR_WARN("Failed to save status on vm %s", vm->def->name);
-
- cleanup:
-    virObjectUnref(cfg);
 }
 
 static void
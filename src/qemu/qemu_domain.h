@@ -119,6 +119,7 @@ struct _qemuDomainJobInfo {
                             source and the beginning of Finish phase on the
                             destination. */
     bool timeDeltaSet;
+    unsigned long long imageBps; /* Throughput of the save image I/O */
     /* Raw values from QEMU */
     qemuMonitorMigrationStats stats;
 };
@@ -234,6 +235,8 @@ struct _qemuDomainObjPrivate {
 
     bool gotShutdown;
     bool beingDestroyed;
+    bool reconnecting; /* no job may start before qemuProcessReconnect,
+                        * job.cond is signalled once it may */
     char *pidfile;
 
     virDomainPCIAddressSetPtr pciaddrs;
@@ -448,6 +451,9 @@ void qemuDomainEventQueue(virQEMUDriverPtr driver,
 void qemuDomainEventEmitJobCompleted(virQEMUDriverPtr driver,
                                      virDomainObjPtr vm);
 
+/* Only changed by unit tests */
+extern unsigned long long qemuDomainJobWaitTime;
+
 int qemuDomainObjBeginJob(virQEMUDriverPtr driver,
                           virDomainObjPtr obj,
                           qemuDomainJob job)
@@ -614,6 +620,17 @@ void qemuDomainRemoveInactive(virQEMUDriverPtr driver,
 void qemuDomainRemoveInactiveJob(virQEMUDriverPtr driver,
                                  virDomainObjPtr vm);
 
+void qemuDomainRemoveInactiveJobLocked(virQEMUDriverPtr driver,
+                                       virDomainObjPtr vm);
+
+/* How long in milliseconds a status change may wait to be written */
+# define QEMU_DOMAIN_STATUS_WRITE_DELAY 100
+
+int qemuDomainSaveStatus(virQEMUDriverPtr driver,
+                         virDomainObjPtr vm);
+int qemuDomainFlushStatus(virQEMUDriverPtr driver,
+                          virDomainObjPtr vm);
+
 void qemuDomainSetFakeReboot(virQEMUDriverPtr driver,
                              virDomainObjPtr vm,
                              bool value);
@@ -864,6 +864,11 @@ qemuStateInitialize(bool privileged,
     if (!(qemu_driver->xmlopt = virQEMUDriverCreateXMLConf(qemu_driver)))
         goto error;
 
+    if (!(qemu_driver->statusWriter =
+          virDomainStatusWriterNew(qemu_driver->xmlopt, cfg->stateDir,
+                                   QEMU_DOMAIN_STATUS_WRITE_DELAY)))
+        goto error;
+
     /* If hugetlbfs is present, then we need to create a sub-directory within
      * it, since we can't assume the root mount point has permissions that
      * will let our spawned QEMU instances use it. */
@@ -1078,6 +1083,8 @@ qemuStateCleanup(void)
 
     virNWFilterUnRegisterCallbackDriver(&qemuCallbackDriver);
     virThreadPoolFree(qemu_driver->workerPool);
+    /* writes out the pending status changes */
+    virObjectUnref(qemu_driver->statusWriter);
     virObjectUnref(qemu_driver->config);
     virObjectUnref(qemu_driver->hostdevMgr);
     virHashFree(qemu_driver->sharedDevices);
@@ -1881,7 +1888,7 @@ static int qemuDomainSuspend(virDomainPtr dom)
                                              eventDetail);
         }
     }
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+    if (qemuDomainFlushStatus(driver, vm) < 0)
         goto endjob;
     ret = 0;
 
@@ -1948,7 +1955,7 @@ static int qemuDomainResume(virDomainPtr dom)
                                          VIR_DOMAIN_EVENT_RESUMED,
                                          VIR_DOMAIN_EVENT_RESUMED_UNPAUSED);
     }
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+    if (qemuDomainFlushStatus(driver, vm) < 0)
         goto endjob;
     ret = 0;
 
@@ -2491,7 +2498,7 @@ static int qemuDomainSetMemoryStatsPeriod(virDomainPtr dom, int period,
         }
 
         def->memballoon->period = period;
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+        if (qemuDomainFlushStatus(driver, vm) < 0)
             goto endjob;
     }
 
@@ -3195,6 +3202,61 @@ qemuOpenFileAs(uid_t fallback_uid, gid_t fallback_gid,
     goto cleanup;
 }
 
+/* Wraps @fd in a helper process doing the I/O with buffers set
+ * in qemu.conf */
+static virFileWrapperFdPtr
+qemuDomainFileWrapperFDNew(virQEMUDriverPtr driver,
+                           int *fd,
+                           const char *path,
+                           unsigned int flags)
+{
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    virFileWrapperFdPtr ret;
+
+    ret = virFileWrapperFdNewFull(fd, path,
+                                  cfg->saveImageIOBufferSize * 1024ULL,
+                                  cfg->saveImageIOBuffers,
+                                  flags);
+
+    virObjectUnref(cfg);
+    return ret;
+}
+
+
+/* Records the throughput of a closed @wrapperFd in the stats of the
+ * completed job. Jobs which didn't get their stats from QEMU, such as
+ * restore, get them created from the current job. */
+static void
+qemuDomainJobRecordImageStats(virDomainObjPtr vm,
+                              virFileWrapperFdPtr wrapperFd)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    qemuDomainJobInfoPtr current = priv->job.current;
+    unsigned long long bytes;
+    unsigned long long elapsed;
+
+    if (!current ||
+        virFileWrapperFdGetStats(wrapperFd, &bytes, &elapsed) < 0)
+        return;
+
+    VIR_DEBUG("Image I/O of domain %s: %llu bytes in %llu ms",
+              vm->def->name, bytes, elapsed);
+
+    if (!priv->job.completed ||
+        priv->job.completed->started != current->started) {
+        VIR_FREE(priv->job.completed);
+        if (VIR_ALLOC_QUIET(priv->job.completed) < 0)
+            return;
+
+        *priv->job.completed = *current;
+        ignore_value(qemuDomainJobInfoUpdateTime(priv->job.completed));
+        priv->job.completed->type = VIR_DOMAIN_JOB_COMPLETED;
+    }
+
+    priv->job.completed->imageBps = bytes * 1000 / MAX(elapsed, 1);
+}
+
+
 /* Helper function to execute a migration to file with a correct save header
  * the caller needs to make sure that the processors are stopped and do all other
  * actions besides saving memory */
@@ -3234,7 +3296,8 @@ qemuDomainSaveMemory(virQEMUDriverPtr driver,
     if (qemuSecuritySetImageFDLabel(driver->securityManager, vm->def, fd) < 0)
         goto cleanup;
 
-    if (!(wrapperFd = virFileWrapperFdNew(&fd, path, wrapperFlags)))
+    if (!(wrapperFd = qemuDomainFileWrapperFDNew(driver, &fd, path,
+                                                 wrapperFlags)))
         goto cleanup;
 
     if (virQEMUSaveDataWrite(data, fd, path) < 0)
@@ -3258,6 +3321,8 @@ qemuDomainSaveMemory(virQEMUDriverPtr driver,
     if (virFileWrapperFdClose(wrapperFd) < 0)
         goto cleanup;
 
+    qemuDomainJobRecordImageStats(vm, wrapperFd);
+
     if ((fd = qemuOpenFile(driver, vm, path, O_WRONLY, NULL, NULL)) < 0 ||
         virQEMUSaveDataFinish(data, &fd, path) < 0)
         goto cleanup;
@@ -3768,7 +3833,7 @@ doCoreDump(virQEMUDriverPtr driver,
                            NULL, NULL)) < 0)
         goto cleanup;
 
-    if (!(wrapperFd = virFileWrapperFdNew(&fd, path, flags)))
+    if (!(wrapperFd = qemuDomainFileWrapperFDNew(driver, &fd, path, flags)))
         goto cleanup;
 
     if (dump_flags & VIR_DUMP_MEMORY_ONLY) {
@@ -3811,6 +3876,8 @@ doCoreDump(virQEMUDriverPtr driver,
     if (virFileWrapperFdClose(wrapperFd) < 0)
         goto cleanup;
 
+    qemuDomainJobRecordImageStats(vm, wrapperFd);
+
     ret = 0;
 
  cleanup:
@@ -4156,12 +4223,11 @@ processGuestPanicEvent(virQEMUDriverPtr driver,
 {
     qemuDomainObjPrivatePtr priv = vm->privateData;
     virObjectEventPtr event = NULL;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
     bool removeInactive = false;
 
     if (qemuDomainObjBeginAsyncJob(driver, vm, QEMU_ASYNC_JOB_DUMP,
                                    VIR_DOMAIN_JOB_OPERATION_DUMP) < 0)
-        goto cleanup;
+        return;
 
     if (!virDomainObjIsActive(vm)) {
         VIR_DEBUG("Ignoring GUEST_PANICKED event from inactive domain %s",
@@ -4180,7 +4246,7 @@ processGuestPanicEvent(virQEMUDriverPtr driver,
 
     qemuDomainEventQueue(driver, event);
 
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+    if (qemuDomainFlushStatus(driver, vm) < 0) {
         VIR_WARN("Unable to save status on vm %s after state change",
                  vm->def->name);
     }
@@ -4228,9 +4294,6 @@ processGuestPanicEvent(virQEMUDriverPtr driver,
     qemuDomainObjEndAsyncJob(driver, vm);
     if (removeInactive)
         qemuDomainRemoveInactiveJob(driver, vm);
-
- cleanup:
-    virObjectUnref(cfg);
 }
 
 
@@ -4239,7 +4302,6 @@ processDeviceDeletedEvent(virQEMUDriverPtr driver,
                           virDomainObjPtr vm,
                           char *devAlias)
 {
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
     virDomainDeviceDef dev;
 
     VIR_DEBUG("Removing device %s from domain %p %s",
@@ -4263,7 +4325,7 @@ processDeviceDeletedEvent(virQEMUDriverPtr driver,
             goto endjob;
     }
 
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+    if (qemuDomainFlushStatus(driver, vm) < 0)
         VIR_WARN("unable to save domain status after removing device %s",
                  devAlias);
 
@@ -4272,7 +4334,6 @@ processDeviceDeletedEvent(virQEMUDriverPtr driver,
 
  cleanup:
     VIR_FREE(devAlias);
-    virObjectUnref(cfg);
 }
 
 
@@ -4579,7 +4640,6 @@ processSerialChangedEvent(virQEMUDriverPtr driver,
                           char *devAlias,
                           bool connected)
 {
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
     virDomainChrDeviceState newstate;
     virObjectEventPtr event = NULL;
     virDomainDeviceDef dev;
@@ -4630,7 +4690,7 @@ processSerialChangedEvent(virQEMUDriverPtr driver,
 
     dev.data.chr->state = newstate;
 
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+    if (qemuDomainFlushStatus(driver, vm) < 0)
         VIR_WARN("unable to save status of domain %s after updating state of "
                  "channel %s", vm->def->name, devAlias);
 
@@ -4656,7 +4716,6 @@ processSerialChangedEvent(virQEMUDriverPtr driver,
 
  cleanup:
     VIR_FREE(devAlias);
-    virObjectUnref(cfg);
 
 }
 
@@ -4985,7 +5044,7 @@ qemuDomainPinVcpuLive(virDomainObjPtr vm,
     vcpuinfo->cpumask = tmpmap;
     tmpmap = NULL;
 
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+    if (qemuDomainFlushStatus(driver, vm) < 0)
         goto cleanup;
 
     if (snprintf(paramField, VIR_TYPED_PARAM_FIELD_LENGTH,
@@ -5210,7 +5269,7 @@ qemuDomainPinEmulator(virDomainPtr dom,
         if (!(def->cputune.emulatorpin = virBitmapNewCopy(pcpumap)))
             goto endjob;
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+        if (qemuDomainFlushStatus(driver, vm) < 0)
             goto endjob;
 
         str = virBitmapFormat(pcpumap);
@@ -5680,7 +5739,7 @@ qemuDomainPinIOThread(virDomainPtr dom,
         if (virProcessSetAffinity(iothrid->thread_id, pcpumap) < 0)
             goto endjob;
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+        if (qemuDomainFlushStatus(driver, vm) < 0)
             goto endjob;
 
         if (snprintf(paramField, VIR_TYPED_PARAM_FIELD_LENGTH,
@@ -5980,7 +6039,7 @@ qemuDomainChgIOThread(virQEMUDriverPtr driver,
                 goto endjob;
         }
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+        if (qemuDomainFlushStatus(driver, vm) < 0)
             goto endjob;
     }
 
@@ -6350,8 +6409,8 @@ qemuDomainSaveImageOpen(virQEMUDriverPtr driver,
     if ((fd = qemuOpenFile(driver, NULL, path, oflags, NULL, NULL)) < 0)
         goto error;
     if (bypass_cache &&
-        !(*wrapperFd = virFileWrapperFdNew(&fd, path,
-                                           VIR_FILE_WRAPPER_BYPASS_CACHE)))
+        !(*wrapperFd = qemuDomainFileWrapperFDNew(driver, &fd, path,
+                                                  VIR_FILE_WRAPPER_BYPASS_CACHE)))
         goto error;
 
     if (VIR_ALLOC(data) < 0)
@@ -6476,7 +6535,6 @@ qemuDomainSaveImageStartVM(virConnectPtr conn,
     int intermediatefd = -1;
     virCommandPtr cmd = NULL;
     char *errbuf = NULL;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
     virQEMUSaveHeaderPtr header = &data->header;
     qemuDomainSaveCookiePtr cookie = NULL;
 
@@ -6557,7 +6615,7 @@ qemuDomainSaveImageStartVM(virConnectPtr conn,
                                "%s", _("failed to resume domain"));
             goto cleanup;
         }
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+        if (qemuDomainFlushStatus(driver, vm) < 0) {
             VIR_WARN("Failed to save status on vm %s", vm->def->name);
             goto cleanup;
         }
@@ -6579,7 +6637,6 @@ qemuDomainSaveImageStartVM(virConnectPtr conn,
     if (qemuSecurityRestoreSavedStateLabel(driver->securityManager,
                                            vm->def, path) < 0)
         VIR_WARN("failed to restore save state label on %s", path);
-    virObjectUnref(cfg);
     return ret;
 }
 
@@ -6670,6 +6727,8 @@ qemuDomainRestoreFlags(virConnectPtr conn,
                                      false, QEMU_ASYNC_JOB_START);
     if (virFileWrapperFdClose(wrapperFd) < 0)
         VIR_WARN("Failed to close %s", path);
+    else if (ret == 0)
+        qemuDomainJobRecordImageStats(vm, wrapperFd);
 
     qemuProcessEndJob(driver, vm);
 
@@ -6945,6 +7004,8 @@ qemuDomainObjRestore(virConnectPtr conn,
                                      start_paused, asyncJob);
     if (virFileWrapperFdClose(wrapperFd) < 0)
         VIR_WARN("Failed to close %s", path);
+    else if (ret == 0)
+        qemuDomainJobRecordImageStats(vm, wrapperFd);
 
  cleanup:
     virQEMUSaveDataFree(data);
@@ -8264,6 +8325,7 @@ qemuDomainAttachDeviceLiveAndConfig(virConnectPtr conn,
                                     const char *xml,
                                     unsigned int flags)
 {
+    qemuDomainObjPrivatePtr priv = vm->privateData;
     virDomainDefPtr vmdef = NULL;
     virQEMUDriverConfigPtr cfg = NULL;
     virDomainDeviceDefPtr dev = NULL, dev_copy = NULL;
@@ -8299,7 +8361,8 @@ qemuDomainAttachDeviceLiveAndConfig(virConnectPtr conn,
 
     if (flags & VIR_DOMAIN_AFFECT_CONFIG) {
         /* Make a copy for updated domain. */
-        vmdef = virDomainObjCopyPersistentDef(vm, caps, driver->xmlopt);
+        vmdef = virDomainObjCopyPersistentDef(vm, caps, driver->xmlopt,
+                                              priv->qemuCaps);
         if (!vmdef)
             goto cleanup;
 
@@ -8324,7 +8387,7 @@ qemuDomainAttachDeviceLiveAndConfig(virConnectPtr conn,
          * changed even if we failed to attach the device. For example,
          * a new controller may be created.
          */
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+        if (qemuDomainFlushStatus(driver, vm) < 0) {
             ret = -1;
             goto cleanup;
         }
@@ -8400,6 +8463,7 @@ static int qemuDomainUpdateDeviceFlags(virDomainPtr dom,
 {
     virQEMUDriverPtr driver = dom->conn->privateData;
     virDomainObjPtr vm = NULL;
+    qemuDomainObjPrivatePtr priv;
     virDomainDefPtr vmdef = NULL;
     virDomainDeviceDefPtr dev = NULL, dev_copy = NULL;
     bool force = (flags & VIR_DOMAIN_DEVICE_MODIFY_FORCE) != 0;
@@ -8422,6 +8486,8 @@ static int qemuDomainUpdateDeviceFlags(virDomainPtr dom,
     if (!(vm = qemuDomObjFromDomain(dom)))
         goto cleanup;
 
+    priv = vm->privateData;
+
     if (virDomainUpdateDeviceFlagsEnsureACL(dom->conn, vm->def, flags) < 0)
         goto cleanup;
 
@@ -8450,7 +8516,8 @@ static int qemuDomainUpdateDeviceFlags(virDomainPtr dom,
 
     if (flags & VIR_DOMAIN_AFFECT_CONFIG) {
         /* Make a copy for updated domain. */
-        vmdef = virDomainObjCopyPersistentDef(vm, caps, driver->xmlopt);
+        vmdef = virDomainObjCopyPersistentDef(vm, caps, driver->xmlopt,
+                                              priv->qemuCaps);
         if (!vmdef)
             goto endjob;
 
@@ -8476,7 +8543,7 @@ static int qemuDomainUpdateDeviceFlags(virDomainPtr dom,
          * changed even if we failed to attach the device. For example,
          * a new controller may be created.
          */
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+        if (qemuDomainFlushStatus(driver, vm) < 0) {
             ret = -1;
             goto endjob;
         }
@@ -8512,6 +8579,7 @@ qemuDomainDetachDeviceLiveAndConfig(virQEMUDriverPtr driver,
                                     const char *xml,
                                     unsigned int flags)
 {
+    qemuDomainObjPrivatePtr priv = vm->privateData;
     virCapsPtr caps = NULL;
     virQEMUDriverConfigPtr cfg = NULL;
     virDomainDeviceDefPtr dev = NULL, dev_copy = NULL;
@@ -8550,7 +8618,8 @@ qemuDomainDetachDeviceLiveAndConfig(virQEMUDriverPtr driver,
 
     if (flags & VIR_DOMAIN_AFFECT_CONFIG) {
         /* Make a copy for updated domain. */
-        vmdef = virDomainObjCopyPersistentDef(vm, caps, driver->xmlopt);
+        vmdef = virDomainObjCopyPersistentDef(vm, caps, driver->xmlopt,
+                                              priv->qemuCaps);
         if (!vmdef)
             goto cleanup;
 
@@ -8576,7 +8645,7 @@ qemuDomainDetachDeviceLiveAndConfig(virQEMUDriverPtr driver,
          * changed even if we failed to attach the device. For example,
          * a new controller may be created.
          */
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+        if (qemuDomainFlushStatus(driver, vm) < 0) {
             ret = -1;
             goto cleanup;
         }
@@ -9136,7 +9205,7 @@ qemuDomainSetBlkioParameters(virDomainPtr dom,
             }
         }
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+        if (qemuDomainFlushStatus(driver, vm) < 0)
             goto endjob;
     }
     if (ret < 0)
@@ -9402,7 +9471,7 @@ qemuDomainSetMemoryParameters(virDomainPtr dom,
 #undef VIR_SET_MEM_PARAMETER
 
     if (def &&
-        virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+        qemuDomainFlushStatus(driver, vm) < 0)
         goto endjob;
 
     if (persistentDef &&
@@ -9671,7 +9740,7 @@ qemuDomainSetNumaParameters(virDomainPtr dom,
                                  -1, mode, nodeset) < 0)
             goto endjob;
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+        if (qemuDomainFlushStatus(driver, vm) < 0)
             goto endjob;
     }
 
@@ -9866,7 +9935,7 @@ qemuDomainSetPerfEvents(virDomainPtr dom,
                 VIR_TRISTATE_BOOL_YES : VIR_TRISTATE_BOOL_NO;
         }
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+        if (qemuDomainFlushStatus(driver, vm) < 0)
             goto endjob;
     }
 
@@ -10140,7 +10209,8 @@ qemuDomainSetSchedulerParametersFlags(virDomainPtr dom,
     if (persistentDef) {
         /* Make a copy for updated domain. */
         if (!(persistentDefCopy = virDomainObjCopyPersistentDef(vm, caps,
-                                                                driver->xmlopt)))
+                                                                driver->xmlopt,
+                                                                priv->qemuCaps)))
             goto endjob;
     }
 
@@ -10345,7 +10415,7 @@ qemuDomainSetSchedulerParametersFlags(virDomainPtr dom,
         }
     }
 
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+    if (qemuDomainFlushStatus(driver, vm) < 0)
         goto endjob;
 
     if (eventNparams) {
@@ -11153,7 +11223,7 @@ qemuDomainSetInterfaceParameters(virDomainPtr dom,
                 goto endjob;
         }
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+        if (qemuDomainFlushStatus(driver, vm) < 0)
             goto endjob;
     }
 
@@ -11757,7 +11827,7 @@ qemuDomainGetBlockInfo(virDomainPtr dom,
                                          &stats, false);
     if (rc >= 0)
         rc = qemuMonitorBlockStatsUpdateCapacity(qemuDomainGetMonitor(vm),
-                                                 stats, false);
+                                                 stats, 0);
 
     if (qemuDomainObjExitMonitor(driver, vm) < 0 || rc < 0)
         goto endjob;
@@ -14545,7 +14615,7 @@ qemuDomainSnapshotCreateDiskActive(virQEMUDriverPtr driver,
     }
 
     if (ret == 0 || !actions) {
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0 ||
+        if (qemuDomainFlushStatus(driver, vm) < 0 ||
             (persist && virDomainSaveConfig(cfg->configDir, driver->caps,
                                             vm->newDef) < 0))
             ret = -1;
@@ -16516,7 +16586,6 @@ qemuDomainBlockJobAbort(virDomainPtr dom,
     virQEMUDriverPtr driver = dom->conn->privateData;
     char *device = NULL;
     virDomainDiskDefPtr disk = NULL;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
     bool save = false;
     bool modern;
     bool pivot = !!(flags & VIR_DOMAIN_BLOCK_JOB_ABORT_PIVOT);
@@ -16589,7 +16658,7 @@ qemuDomainBlockJobAbort(virDomainPtr dom,
      * effort to save it now.  But we can ignore failure, since there
      * will be further changes when the event marks completion.  */
     if (save)
-        ignore_value(virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps));
+        ignore_value(qemuDomainFlushStatus(driver, vm));
 
     /* With synchronous block cancel, we must synthesize an event, and
      * we silently ignore the ABORT_ASYNC flag.  With asynchronous
@@ -16627,7 +16696,6 @@ qemuDomainBlockJobAbort(virDomainPtr dom,
     qemuDomainObjEndJob(driver, vm);
 
  cleanup:
-    virObjectUnref(cfg);
     VIR_FREE(device);
     virDomainObjEndAPI(&vm);
     return ret;
@@ -16735,11 +16803,9 @@ qemuDomainGetBlockJobInfo(virDomainPtr dom,
     if (disk->mirror &&
         rawInfo.ready != 0 &&
         info->cur == info->end && !disk->mirrorState) {
-        virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
         disk->mirrorState = VIR_DOMAIN_DISK_MIRROR_STATE_READY;
-        ignore_value(virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps));
-        virObjectUnref(cfg);
+        ignore_value(qemuDomainFlushStatus(driver, vm));
     }
  endjob:
     qemuDomainObjEndJob(driver, vm);
@@ -17040,7 +17106,7 @@ qemuDomainBlockCopyCommon(virDomainObjPtr vm,
     disk->mirrorJob = VIR_DOMAIN_BLOCK_JOB_TYPE_COPY;
     QEMU_DOMAIN_DISK_PRIVATE(disk)->blockjob = true;
 
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+    if (qemuDomainFlushStatus(driver, vm) < 0)
         VIR_WARN("Unable to save status on vm %s after state change",
                  vm->def->name);
 
@@ -17438,13 +17504,11 @@ qemuDomainBlockCommit(virDomainPtr dom,
 
     if (mirror) {
         if (ret == 0) {
-            virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
             mirror = NULL;
-            if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+            if (qemuDomainFlushStatus(driver, vm) < 0)
                 VIR_WARN("Unable to save status on vm %s after block job",
                          vm->def->name);
-            virObjectUnref(cfg);
         } else {
             disk->mirror = NULL;
             disk->mirrorJob = VIR_DOMAIN_BLOCK_JOB_TYPE_UNKNOWN;
@@ -17997,8 +18061,7 @@ qemuDomainSetBlockIoTune(virDomainPtr dom,
         if (virDomainDiskSetBlockIOTune(disk, &info) < 0)
             goto endjob;
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir,
-                                vm, driver->caps) < 0)
+        if (qemuDomainFlushStatus(driver, vm) < 0)
             goto endjob;
 
         if (eventNparams) {
@@ -19736,6 +19799,30 @@ qemuDomainGetStatsOneBlock(virQEMUDriverPtr driver,
 }
 
 
+/* Returns the length of the longest backing chain below the disks of @def */
+static size_t
+qemuDomainGetStatsBlockDepth(virDomainDefPtr def)
+{
+    virStorageSourcePtr src;
+    size_t depth = 0;
+    size_t i;
+
+    for (i = 0; i < def->ndisks; i++) {
+        size_t n = 0;
+
+        for (src = def->disks[i]->src->backingStore;
+             src;
+             src = src->backingStore)
+            n++;
+
+        if (n > depth)
+            depth = n;
+    }
+
+    return depth;
+}
+
+
 static int
 qemuDomainGetStatsBlock(virQEMUDriverPtr driver,
                         virDomainObjPtr dom,
@@ -19763,7 +19850,9 @@ qemuDomainGetStatsBlock(virQEMUDriverPtr driver,
                                              visitBacking);
         if (rc >= 0)
             ignore_value(qemuMonitorBlockStatsUpdateCapacity(priv->mon, stats,
-                                                             visitBacking));
+                                                             visitBacking ?
+                                                             qemuDomainGetStatsBlockDepth(dom->def) :
+                                                             0));
 
         if (fetchnodedata)
             nodedata = qemuMonitorQueryNamedBlockNodes(priv->mon);
@@ -19939,6 +20028,49 @@ qemuDomainGetStatsNeedMonitor(unsigned int stats)
 }
 
 
+/* Sends the monitor queries of the requested stats groups back-to-back
+ * rather than paying a round-trip for each of them. The replies are kept
+ * until the job ends. */
+static void
+qemuDomainGetStatsBatchQueries(virQEMUDriverPtr driver,
+                               virDomainObjPtr dom,
+                               unsigned int stats,
+                               unsigned int privflags)
+{
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+    const char *queries[5];
+    size_t nqueries = 0;
+
+    if (!HAVE_JOB(privflags) || !virDomainObjIsActive(dom))
+        return;
+
+    /* see qemuDomainRefreshVcpuHalted */
+    if (stats & VIR_DOMAIN_STATS_VCPU &&
+        dom->def->virtType != VIR_DOMAIN_VIRT_QEMU)
+        queries[nqueries++] = "query-cpus";
+
+    if (stats & VIR_DOMAIN_STATS_BLOCK) {
+        queries[nqueries++] = "query-blockstats";
+        /* the batched reply only holds the capacity of the top images */
+        if (!(privflags & QEMU_DOMAIN_STATS_BACKING))
+            queries[nqueries++] = "query-block";
+        if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_QUERY_NAMED_BLOCK_NODES))
+            queries[nqueries++] = "query-named-block-nodes";
+    }
+    queries[nqueries] = NULL;
+
+    if (nqueries < 2)
+        return;
+
+    qemuDomainObjEnterMonitor(driver, dom);
+    /* the stats workers will just ask again */
+    if (qemuMonitorBatchQuery(priv->mon, queries) < 0)
+        virResetLastError();
+    if (qemuDomainObjExitMonitor(driver, dom) < 0)
+        virResetLastError();
+}
+
+
 static int
 qemuDomainGetStats(virConnectPtr conn,
                    virDomainObjPtr dom,
@@ -19954,6 +20086,8 @@ qemuDomainGetStats(virConnectPtr conn,
     if (VIR_ALLOC(tmp) < 0)
         goto cleanup;
 
+    qemuDomainGetStatsBatchQueries(conn->privateData, dom, stats, flags);
+
     for (i = 0; qemuDomainGetStatsWorkers[i].func; i++) {
         if (stats & qemuDomainGetStatsWorkers[i].stats) {
             if (qemuDomainGetStatsWorkers[i].func(conn->privateData, dom, tmp,
@@ -19980,6 +20114,51 @@ qemuDomainGetStats(virConnectPtr conn,
 }
 
 
+struct qemuConnectGetAllDomainStatsData {
+    virConnectPtr conn;
+    virQEMUDriverPtr driver;
+    virDomainObjPtr *vms;
+    virDomainStatsRecordPtr *records;
+    unsigned int stats;
+    unsigned int privflags;
+    unsigned int flags;
+};
+
+
+static int
+qemuConnectGetAllDomainStatsOne(size_t idx,
+                                void *opaque)
+{
+    struct qemuConnectGetAllDomainStatsData *data = opaque;
+    virDomainObjPtr vm = data->vms[idx];
+    unsigned int domflags = 0;
+    int ret = -1;
+
+    virObjectLock(vm);
+
+    if (HAVE_JOB(data->privflags) &&
+        qemuDomainObjBeginJob(data->driver, vm, QEMU_JOB_QUERY) == 0)
+        domflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
+    /* else: without a job it's still possible to gather some data */
+
+    if (data->flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING)
+        domflags |= QEMU_DOMAIN_STATS_BACKING;
+
+    if (qemuDomainGetStats(data->conn, vm, data->stats,
+                           &data->records[idx], domflags) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    if (HAVE_JOB(domflags))
+        qemuDomainObjEndJob(data->driver, vm);
+
+    virObjectUnlock(vm);
+    return ret;
+}
+
+
 static int
 qemuConnectGetAllDomainStats(virConnectPtr conn,
                              virDomainPtr *doms,
@@ -19989,16 +20168,18 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
                              unsigned int flags)
 {
     virQEMUDriverPtr driver = conn->privateData;
+    virQEMUDriverConfigPtr cfg = NULL;
+    struct qemuConnectGetAllDomainStatsData data = {
+        .conn = conn, .driver = driver, .flags = flags,
+    };
     virDomainObjPtr *vms = NULL;
-    virDomainObjPtr vm;
     size_t nvms;
     virDomainStatsRecordPtr *tmpstats = NULL;
     bool enforce = !!(flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS);
     int nstats = 0;
     size_t i;
+    int rc;
     int ret = -1;
-    unsigned int privflags = 0;
-    unsigned int domflags = 0;
     unsigned int lflags = flags & (VIR_CONNECT_LIST_DOMAINS_FILTERS_ACTIVE |
                                    VIR_CONNECT_LIST_DOMAINS_FILTERS_PERSISTENT |
                                    VIR_CONNECT_LIST_DOMAINS_FILTERS_STATE);
@@ -20028,41 +20209,32 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
     }
 
     if (VIR_ALLOC_N(tmpstats, nvms + 1) < 0)
-        return -1;
+        goto cleanup;
 
     if (qemuDomainGetStatsNeedMonitor(stats))
-        privflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
-
-    for (i = 0; i < nvms; i++) {
-        virDomainStatsRecordPtr tmp = NULL;
-        domflags = 0;
-        vm = vms[i];
-
-        virObjectLock(vm);
-
-        if (HAVE_JOB(privflags) &&
-            qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) == 0)
-            domflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
-        /* else: without a job it's still possible to gather some data */
-
-        if (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING)
-            domflags |= QEMU_DOMAIN_STATS_BACKING;
-        if (qemuDomainGetStats(conn, vm, stats, &tmp, domflags) < 0) {
-            if (HAVE_JOB(domflags) && vm)
-                qemuDomainObjEndJob(driver, vm);
+        data.privflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
 
-            virObjectUnlock(vm);
-            goto cleanup;
-        }
+    cfg = virQEMUDriverGetConfig(driver);
 
-        if (tmp)
-            tmpstats[nstats++] = tmp;
+    /* Each domain fills in its own slot so that the records are returned
+     * in the same order regardless of the number of workers */
+    data.vms = vms;
+    data.records = tmpstats;
+    data.stats = stats;
 
-        if (HAVE_JOB(domflags))
-            qemuDomainObjEndJob(driver, vm);
+    rc = virThreadMapParallel(cfg->maxStatsWorkers, nvms,
+                              qemuConnectGetAllDomainStatsOne, &data);
 
-        virObjectUnlock(vm);
+    /* squash the slots of domains which didn't produce a record */
+    for (i = 0; i < nvms; i++) {
+        if (tmpstats[i])
+            tmpstats[nstats++] = tmpstats[i];
     }
+    for (i = nstats; i < nvms; i++)
+        tmpstats[i] = NULL;
+
+    if (rc < 0)
+        goto cleanup;
 
     *retStats = tmpstats;
     tmpstats = NULL;
@@ -20072,6 +20244,7 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
  cleanup:
     virDomainStatsRecordListFree(tmpstats);
     virObjectListFreeCount(vms, nvms);
+    virObjectUnref(cfg);
 
     return ret;
 }
@@ -20105,6 +20278,7 @@ qemuDomainGetFSInfo(virDomainPtr dom,
 {
     virQEMUDriverPtr driver = dom->conn->privateData;
     virDomainObjPtr vm;
+    qemuDomainObjPrivatePtr priv;
     qemuAgentPtr agent;
     virCapsPtr caps = NULL;
     virDomainDefPtr def = NULL;
@@ -20115,6 +20289,8 @@ qemuDomainGetFSInfo(virDomainPtr dom,
     if (!(vm = qemuDomObjFromDomain(dom)))
         return ret;
 
+    priv = vm->privateData;
+
     if (virDomainGetFSInfoEnsureACL(dom->conn, vm->def) < 0)
         goto cleanup;
 
@@ -20133,7 +20309,8 @@ qemuDomainGetFSInfo(virDomainPtr dom,
     if (!(caps = virQEMUDriverGetCapabilities(driver, false)))
         goto endjob;
 
-    if (!(def = virDomainDefCopy(vm->def, caps, driver->xmlopt, NULL, false)))
+    if (!(def = virDomainDefCopy(vm->def, caps, driver->xmlopt,
+                                 priv->qemuCaps, false)))
         goto endjob;
 
     agent = qemuDomainObjEnterAgent(vm);
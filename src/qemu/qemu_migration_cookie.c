@@ -474,7 +474,7 @@ qemuMigrationCookieAddNBD(qemuMigrationCookiePtr mig,
             if (qemuDomainObjEnterMonitorAsync(driver, vm,
                                                priv->job.asyncJob) < 0)
                 goto cleanup;
-            rc = qemuMonitorBlockStatsUpdateCapacity(priv->mon, stats, false);
+            rc = qemuMonitorBlockStatsUpdateCapacity(priv->mon, stats, 0);
             if (qemuDomainObjExitMonitor(driver, vm) < 0)
                 goto cleanup;
             if (rc < 0)
@@ -80,6 +80,11 @@ struct _qemuMonitor {
      * non-NULL */
     qemuMonitorMessagePtr msg;
 
+    /* Replies to queries sent ahead by qemuMonitorBatchQuery which
+     * were not consumed yet (qemuMonitorBatchReply), keyed by
+     * command name */
+    virHashTablePtr batchReplies;
+
     /* Buffer incoming data ready for Text/QMP monitor
      * code to process & find message boundaries */
     size_t bufferOffset;
@@ -329,6 +334,7 @@ qemuMonitorDispose(void *obj)
     virCondDestroy(&mon->notify);
     VIR_FREE(mon->buffer);
     virJSONValueFree(mon->options);
+    virHashFree(mon->batchReplies);
     VIR_FREE(mon->balloonpath);
 }
 
@@ -407,6 +413,42 @@ qemuMonitorOpenPty(const char *monitor)
 }
 
 
+/* Returns true once every message of the chain starting at @msg got
+ * its reply or the monitor failed */
+static bool
+qemuMonitorMessageFinished(qemuMonitorMessagePtr msg)
+{
+    for (; msg; msg = msg->next) {
+        if (!msg->finished)
+            return false;
+    }
+
+    return true;
+}
+
+
+static void
+qemuMonitorMessageFinish(qemuMonitorMessagePtr msg)
+{
+    for (; msg; msg = msg->next)
+        msg->finished = true;
+}
+
+
+/* Returns the first message of the chain starting at @msg which
+ * wasn't completely written yet */
+static qemuMonitorMessagePtr
+qemuMonitorMessagePending(qemuMonitorMessagePtr msg)
+{
+    for (; msg; msg = msg->next) {
+        if (msg->txOffset < msg->txLength)
+            return msg;
+    }
+
+    return NULL;
+}
+
+
 /* This method processes data that has been received
  * from the monitor. Looking for async events and
  * replies/errors.
@@ -462,7 +504,7 @@ qemuMonitorIOProcess(qemuMonitorPtr mon)
 #if DEBUG_IO
     VIR_DEBUG("Process done %d used %d", (int)mon->bufferOffset, len);
 #endif
-    if (msg && msg->finished)
+    if (msg && qemuMonitorMessageFinished(msg))
         virCondBroadcast(&mon->notify);
     return len;
 }
@@ -517,47 +559,55 @@ qemuMonitorIOWriteWithFD(qemuMonitorPtr mon,
 static int
 qemuMonitorIOWrite(qemuMonitorPtr mon)
 {
+    qemuMonitorMessagePtr msg;
     int done;
+    int ret = 0;
     char *buf;
     size_t len;
 
-    /* If no active message, or fully transmitted, the no-op */
-    if (!mon->msg || mon->msg->txOffset == mon->msg->txLength)
-        return 0;
+    /* Write as many of the pending messages as the socket takes so that
+     * a batch of commands reaches QEMU back-to-back. If there's no active
+     * message, or it's fully transmitted, this is a no-op */
+    while ((msg = qemuMonitorMessagePending(mon->msg))) {
+        if (msg->txFD != -1 && !mon->hasSendFD) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Monitor does not support sending of file descriptors"));
+            return -1;
+        }
 
-    if (mon->msg->txFD != -1 && !mon->hasSendFD) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("Monitor does not support sending of file descriptors"));
-        return -1;
-    }
+        buf = msg->txBuffer + msg->txOffset;
+        len = msg->txLength - msg->txOffset;
+        if (msg->txFD == -1)
+            done = write(mon->fd, buf, len);
+        else
+            done = qemuMonitorIOWriteWithFD(mon, buf, len, msg->txFD);
 
-    buf = mon->msg->txBuffer + mon->msg->txOffset;
-    len = mon->msg->txLength - mon->msg->txOffset;
-    if (mon->msg->txFD == -1)
-        done = write(mon->fd, buf, len);
-    else
-        done = qemuMonitorIOWriteWithFD(mon, buf, len, mon->msg->txFD);
+        PROBE(QEMU_MONITOR_IO_WRITE,
+              "mon=%p buf=%s len=%zu ret=%d errno=%d",
+              mon, buf, len, done, done < 0 ? errno : 0);
 
-    PROBE(QEMU_MONITOR_IO_WRITE,
-          "mon=%p buf=%s len=%zu ret=%d errno=%d",
-          mon, buf, len, done, done < 0 ? errno : 0);
+        if (msg->txFD != -1) {
+            PROBE(QEMU_MONITOR_IO_SEND_FD,
+                  "mon=%p fd=%d ret=%d errno=%d",
+                  mon, msg->txFD, done, done < 0 ? errno : 0);
+        }
 
-    if (mon->msg->txFD != -1) {
-        PROBE(QEMU_MONITOR_IO_SEND_FD,
-              "mon=%p fd=%d ret=%d errno=%d",
-              mon, mon->msg->txFD, done, done < 0 ? errno : 0);
-    }
+        if (done < 0) {
+            if (errno == EAGAIN)
+                break;
 
-    if (done < 0) {
-        if (errno == EAGAIN)
-            return 0;
+            virReportSystemError(errno, "%s",
+                                 _("Unable to write to monitor"));
+            return -1;
+        }
+        msg->txOffset += done;
+        ret += done;
 
-        virReportSystemError(errno, "%s",
-                             _("Unable to write to monitor"));
-        return -1;
+        if (msg->txOffset < msg->txLength)
+            break;
     }
-    mon->msg->txOffset += done;
-    return done;
+
+    return ret;
 }
 
 
@@ -626,7 +676,7 @@ qemuMonitorUpdateWatch(qemuMonitorPtr mon)
     if (mon->lastError.code == VIR_ERR_OK) {
         events |= VIR_EVENT_HANDLE_READABLE;
 
-        if ((mon->msg && mon->msg->txOffset < mon->msg->txLength) &&
+        if (qemuMonitorMessagePending(mon->msg) &&
             !mon->waitGreeting)
             events |= VIR_EVENT_HANDLE_WRITABLE;
     }
@@ -752,10 +802,11 @@ qemuMonitorIO(int watch, int fd, int events, void *opaque)
         }
 
         VIR_DEBUG("Error on monitor %s", NULLSTR(mon->lastError.message));
+        qemuMonitorDropBatchReplies(mon);
         /* If IO process resulted in an error & we have a message,
          * then wakeup that waiter */
-        if (mon->msg && !mon->msg->finished) {
-            mon->msg->finished = 1;
+        if (mon->msg && !qemuMonitorMessageFinished(mon->msg)) {
+            qemuMonitorMessageFinish(mon->msg);
             virCondSignal(&mon->notify);
         }
     }
@@ -993,6 +1044,7 @@ qemuMonitorClose(qemuMonitorPtr mon)
           "mon=%p refs=%d", mon, mon->parent.parent.u.s.refs);
 
     qemuMonitorSetDomainLogLocked(mon, NULL, NULL, NULL);
+    qemuMonitorDropBatchReplies(mon);
 
     if (mon->fd >= 0) {
         qemuMonitorUnregister(mon);
@@ -1016,7 +1068,7 @@ qemuMonitorClose(qemuMonitorPtr mon)
                 virResetLastError();
             }
         }
-        mon->msg->finished = 1;
+        qemuMonitorMessageFinish(mon->msg);
         virCondSignal(&mon->notify);
     }
 
@@ -1041,6 +1093,18 @@ qemuMonitorNextCommandID(qemuMonitorPtr mon)
 }
 
 
+/**
+ * qemuMonitorSend:
+ * @mon: monitor object
+ * @msg: message to send
+ *
+ * Sends @msg and waits for its reply. If @msg->next is set the whole chain
+ * of messages is written back-to-back without waiting for the replies in
+ * between and the function returns once all of them have arrived. Replies
+ * are paired with messages by their QMP id.
+ *
+ * Returns 0 on success, -1 on error.
+ */
 int
 qemuMonitorSend(qemuMonitorPtr mon,
                 qemuMonitorMessagePtr msg)
@@ -1062,7 +1126,7 @@ qemuMonitorSend(qemuMonitorPtr mon,
           "mon=%p msg=%s fd=%d",
           mon, mon->msg->txBuffer, mon->msg->txFD);
 
-    while (!mon->msg->finished) {
+    while (!qemuMonitorMessageFinished(mon->msg)) {
         if (virCondWait(&mon->notify, &mon->parent.lock) < 0) {
             virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                            _("Unable to wait on monitor condition"));
@@ -1087,6 +1151,112 @@ qemuMonitorSend(qemuMonitorPtr mon,
 }
 
 
+typedef struct _qemuMonitorBatchReply qemuMonitorBatchReply;
+typedef qemuMonitorBatchReply *qemuMonitorBatchReplyPtr;
+struct _qemuMonitorBatchReply {
+    virJSONValuePtr reply;
+    const char *const *filter;
+};
+
+
+static void
+qemuMonitorBatchReplyFree(void *payload,
+                          const void *name ATTRIBUTE_UNUSED)
+{
+    qemuMonitorBatchReplyPtr entry = payload;
+
+    virJSONValueFree(entry->reply);
+    VIR_FREE(entry);
+}
+
+
+/**
+ * qemuMonitorAddBatchReply:
+ * @mon: monitor object
+ * @command: name of the command
+ * @filter: filter @reply was parsed with, or NULL
+ * @reply: reply to @command
+ *
+ * Stores @reply so that the next time @command is about to be executed
+ * with the same @filter it's taken from here instead of sending the
+ * command to QEMU. Any reply to @command stored earlier is replaced. On
+ * success @reply is consumed.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuMonitorAddBatchReply(qemuMonitorPtr mon,
+                         const char *command,
+                         const char *const *filter,
+                         virJSONValuePtr reply)
+{
+    qemuMonitorBatchReplyPtr entry;
+
+    if (!mon->batchReplies &&
+        !(mon->batchReplies = virHashCreate(10, qemuMonitorBatchReplyFree)))
+        return -1;
+
+    if (VIR_ALLOC(entry) < 0)
+        return -1;
+    entry->filter = filter;
+
+    if (virHashUpdateEntry(mon->batchReplies, command, entry) < 0) {
+        VIR_FREE(entry);
+        return -1;
+    }
+
+    entry->reply = reply;
+    return 0;
+}
+
+
+/**
+ * qemuMonitorTakeBatchReply:
+ * @mon: monitor object
+ * @command: name of the command
+ * @filter: filter the caller would parse the reply with, or NULL
+ *
+ * Returns the reply to @command fetched by qemuMonitorBatchQuery and
+ * removes it from the monitor, or NULL if there is none. A reply which
+ * was filtered differently lacks members the caller may need and is
+ * not returned.
+ */
+virJSONValuePtr
+qemuMonitorTakeBatchReply(qemuMonitorPtr mon,
+                          const char *command,
+                          const char *const *filter)
+{
+    qemuMonitorBatchReplyPtr entry;
+    virJSONValuePtr reply;
+
+    if (!mon->batchReplies ||
+        !(entry = virHashLookup(mon->batchReplies, command)) ||
+        (entry->filter && entry->filter != filter))
+        return NULL;
+
+    reply = entry->reply;
+    entry->reply = NULL;
+    virHashRemoveEntry(mon->batchReplies, command);
+    return reply;
+}
+
+
+/**
+ * qemuMonitorDropBatchReplies:
+ * @mon: monitor object
+ *
+ * Forgets all replies fetched ahead as they may no longer reflect the
+ * state of QEMU, e.g. because an event arrived or a command that changes
+ * the state was sent.
+ */
+void
+qemuMonitorDropBatchReplies(qemuMonitorPtr mon)
+{
+    if (mon->batchReplies)
+        virHashRemoveAll(mon->batchReplies);
+}
+
+
 /**
  * This function returns a new virError object; the caller is responsible
  * for freeing it.
@@ -2256,6 +2426,39 @@ qemuMonitorQueryBlockstats(qemuMonitorPtr mon)
 }
 
 
+/**
+ * qemuMonitorBatchQuery:
+ * @mon: monitor object
+ * @commands: NULL terminated list of query commands without arguments
+ *
+ * Sends all of @commands to QEMU back-to-back and keeps their replies in
+ * @mon. Subsequent monitor calls executing one of @commands then use the
+ * stored reply instead of a round-trip of their own. The replies are
+ * dropped as soon as an event arrives, any other than a query command is
+ * sent or the job ends. Until then they show the state from the time of
+ * the batch, so only batch queries the caller is going to consume right
+ * away and which don't need to be more current than that, e.g. counters.
+ *
+ * Batching is just an optimization, so with the text monitor which
+ * doesn't support it this is a no-op.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuMonitorBatchQuery(qemuMonitorPtr mon,
+                      const char *const *commands)
+{
+    VIR_DEBUG("commands=%p", commands);
+
+    QEMU_CHECK_MONITOR(mon);
+
+    if (!mon->json)
+        return 0;
+
+    return qemuMonitorJSONBatchQuery(mon, commands);
+}
+
+
 /**
  * qemuMonitorGetAllBlockStatsInfo:
  * @mon: monitor object
@@ -2307,17 +2510,18 @@ qemuMonitorGetAllBlockStatsInfo(qemuMonitorPtr mon,
 }
 
 
-/* Updates "stats" to fill virtual and physical size of the image */
+/* Updates "stats" to fill virtual and physical size of the image and of
+ * the first @depth images of its backing chain */
 int
 qemuMonitorBlockStatsUpdateCapacity(qemuMonitorPtr mon,
                                     virHashTablePtr stats,
-                                    bool backingChain)
+                                    size_t depth)
 {
-    VIR_DEBUG("stats=%p, backing=%d", stats, backingChain);
+    VIR_DEBUG("stats=%p, depth=%zu", stats, depth);
 
     QEMU_CHECK_MONITOR_JSON(mon);
 
-    return qemuMonitorJSONBlockStatsUpdateCapacity(mon, stats, backingChain);
+    return qemuMonitorJSONBlockStatsUpdateCapacity(mon, stats, depth);
 }
 
 
@@ -54,20 +54,33 @@ struct _qemuMonitorMessage {
     char *txBuffer;
     int txOffset;
     int txLength;
+    /* QMP id of the command, used to pair replies with messages when
+     * several of them are in flight */
+    const char *txID;
 
     /* Used by the text monitor reply / error */
     char *rxBuffer;
     int rxLength;
     /* Used by the JSON monitor to hold reply / error */
     void *rxObject;
+    /* Optional list of reply members the JSON monitor needs to parse,
+     * see virJSONValueFromStringFiltered */
+    const char *const *rxFilter;
 
     /* True if rxBuffer / rxObject are ready, or a
      * fatal error occurred on the monitor channel
      */
     bool finished;
+    /* True if an event arrived after the reply, so it might not
+     * reflect the state of QEMU anymore */
+    bool outdated;
 
     qemuMonitorPasswordHandler passwordHandler;
     void *passwordOpaque;
+
+    /* Further messages sent back-to-back with this one, see
+     * qemuMonitorSend */
+    qemuMonitorMessagePtr next;
 };
 
 typedef enum {
@@ -316,6 +329,16 @@ int qemuMonitorSetLink(qemuMonitorPtr mon,
 char *qemuMonitorNextCommandID(qemuMonitorPtr mon);
 int qemuMonitorSend(qemuMonitorPtr mon,
                     qemuMonitorMessagePtr msg);
+int qemuMonitorAddBatchReply(qemuMonitorPtr mon,
+                             const char *command,
+                             const char *const *filter,
+                             virJSONValuePtr reply)
+    ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(4);
+virJSONValuePtr qemuMonitorTakeBatchReply(qemuMonitorPtr mon,
+                                          const char *command,
+                                          const char *const *filter)
+    ATTRIBUTE_NONNULL(2);
+void qemuMonitorDropBatchReplies(qemuMonitorPtr mon);
 virJSONValuePtr qemuMonitorGetOptions(qemuMonitorPtr mon)
     ATTRIBUTE_NONNULL(1);
 void qemuMonitorSetOptions(qemuMonitorPtr mon, virJSONValuePtr options)
@@ -545,6 +568,10 @@ struct _qemuBlockStats {
     bool wr_highest_offset_valid;
 };
 
+int qemuMonitorBatchQuery(qemuMonitorPtr mon,
+                          const char *const *commands)
+    ATTRIBUTE_NONNULL(2);
+
 int qemuMonitorGetAllBlockStatsInfo(qemuMonitorPtr mon,
                                     virHashTablePtr *ret_stats,
                                     bool backingChain)
@@ -552,7 +579,7 @@ int qemuMonitorGetAllBlockStatsInfo(qemuMonitorPtr mon,
 
 int qemuMonitorBlockStatsUpdateCapacity(qemuMonitorPtr mon,
                                         virHashTablePtr stats,
-                                        bool backingChain)
+                                        size_t depth)
     ATTRIBUTE_NONNULL(2);
 
 int qemuMonitorBlockResize(qemuMonitorPtr mon,
@@ -153,6 +153,10 @@ qemuMonitorJSONIOProcessEvent(qemuMonitorPtr mon,
 
     VIR_DEBUG("mon=%p obj=%p", mon, obj);
 
+    /* Whatever the event is about, replies fetched ahead might not
+     * reflect it */
+    qemuMonitorDropBatchReplies(mon);
+
     type = virJSONValueObjectGetString(obj, "event");
     if (!type) {
         VIR_WARN("missing event type in message");
@@ -182,17 +186,50 @@ qemuMonitorJSONIOProcessEvent(qemuMonitorPtr mon,
     return 0;
 }
 
+/* Finds the message a reply belongs to. Replies come in the order the
+ * commands were sent, so the first message still waiting is the one
+ * unless the id points elsewhere. */
+static qemuMonitorMessagePtr
+qemuMonitorJSONFindMessage(qemuMonitorMessagePtr msg,
+                           const char *id)
+{
+    qemuMonitorMessagePtr first = NULL;
+
+    for (; msg && msg->txOffset == msg->txLength; msg = msg->next) {
+        if (msg->finished)
+            continue;
+
+        if (id && STREQ_NULLABLE(msg->txID, id))
+            return msg;
+
+        if (!first)
+            first = msg;
+    }
+
+    return first;
+}
+
+
 int
 qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
                              const char *line,
                              qemuMonitorMessagePtr msg)
 {
+    qemuMonitorMessagePtr batch = NULL;
     virJSONValuePtr obj = NULL;
     int ret = -1;
 
     VIR_DEBUG("Line [%s]", line);
 
-    if (!(obj = virJSONValueFromString(line)))
+    if (msg && msg->next) {
+        batch = msg;
+        msg = qemuMonitorJSONFindMessage(batch, NULL);
+    }
+
+    /* The filter doesn't affect events as they don't carry any of the
+     * reply members it may restrict */
+    if (!(obj = virJSONValueFromStringFiltered(line,
+                                               msg ? msg->rxFilter : NULL)))
         goto cleanup;
 
     if (obj->type != VIR_JSON_TYPE_OBJECT) {
@@ -206,11 +243,31 @@ qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
     } else if (virJSONValueObjectHasKey(obj, "event") == 1) {
         PROBE(QEMU_MONITOR_RECV_EVENT,
               "mon=%p event=%s", mon, line);
+        for (; batch; batch = batch->next) {
+            if (batch->finished)
+                batch->outdated = true;
+        }
         ret = qemuMonitorJSONIOProcessEvent(mon, obj);
     } else if (virJSONValueObjectHasKey(obj, "error") == 1 ||
                virJSONValueObjectHasKey(obj, "return") == 1) {
         PROBE(QEMU_MONITOR_RECV_REPLY,
               "mon=%p reply=%s", mon, line);
+        if (batch && msg) {
+            const char *id = virJSONValueObjectGetString(obj, "id");
+            qemuMonitorMessagePtr match;
+
+            match = qemuMonitorJSONFindMessage(batch, id);
+
+            /* the reply was parsed with the filter of another message */
+            if (match != msg) {
+                msg = match;
+                virJSONValueFree(obj);
+                if (!(obj = virJSONValueFromStringFiltered(line,
+                                                           msg->rxFilter)))
+                    goto cleanup;
+            }
+        }
+
         if (msg) {
             msg->rxObject = obj;
             msg->finished = 1;
@@ -263,14 +320,27 @@ int qemuMonitorJSONIOProcess(qemuMonitorPtr mon,
     return used;
 }
 
+/* Queries don't change the state of QEMU so replies fetched ahead stay
+ * valid across them */
+static bool
+qemuMonitorJSONIsQuery(const char *command)
+{
+    return STRPREFIX(command, "query-") ||
+           STREQ(command, "qom-list") ||
+           STREQ(command, "qom-get");
+}
+
+
 static int
-qemuMonitorJSONCommandWithFd(qemuMonitorPtr mon,
-                             virJSONValuePtr cmd,
-                             int scm_fd,
-                             virJSONValuePtr *reply)
+qemuMonitorJSONCommandFull(qemuMonitorPtr mon,
+                           virJSONValuePtr cmd,
+                           int scm_fd,
+                           const char *const *filter,
+                           virJSONValuePtr *reply)
 {
     int ret = -1;
     qemuMonitorMessage msg;
+    const char *name;
     char *cmdstr = NULL;
     char *id = NULL;
 
@@ -278,6 +348,17 @@ qemuMonitorJSONCommandWithFd(qemuMonitorPtr mon,
 
     memset(&msg, 0, sizeof(msg));
 
+    if ((name = virJSONValueObjectGetString(cmd, "execute"))) {
+        if (!qemuMonitorJSONIsQuery(name)) {
+            qemuMonitorDropBatchReplies(mon);
+        } else if (scm_fd == -1 &&
+                   !virJSONValueObjectHasKey(cmd, "arguments") &&
+                   (*reply = qemuMonitorTakeBatchReply(mon, name, filter))) {
+            VIR_DEBUG("Using reply to '%s' fetched ahead", name);
+            return 0;
+        }
+    }
+
     if (virJSONValueObjectHasKey(cmd, "execute") == 1) {
         if (!(id = qemuMonitorNextCommandID(mon)))
             goto cleanup;
@@ -294,6 +375,8 @@ qemuMonitorJSONCommandWithFd(qemuMonitorPtr mon,
         goto cleanup;
     msg.txLength = strlen(msg.txBuffer);
     msg.txFD = scm_fd;
+    msg.txID = id;
+    msg.rxFilter = filter;
 
     VIR_DEBUG("Send command '%s' for write with FD %d", cmdstr, scm_fd);
 
@@ -322,12 +405,40 @@ qemuMonitorJSONCommandWithFd(qemuMonitorPtr mon,
 }
 
 
+static int
+qemuMonitorJSONCommandWithFd(qemuMonitorPtr mon,
+                             virJSONValuePtr cmd,
+                             int scm_fd,
+                             virJSONValuePtr *reply)
+{
+    return qemuMonitorJSONCommandFull(mon, cmd, scm_fd, NULL, reply);
+}
+
+
 static int
 qemuMonitorJSONCommand(qemuMonitorPtr mon,
                        virJSONValuePtr cmd,
                        virJSONValuePtr *reply)
 {
-    return qemuMonitorJSONCommandWithFd(mon, cmd, -1, reply);
+    return qemuMonitorJSONCommandFull(mon, cmd, -1, NULL, reply);
+}
+
+
+/**
+ * qemuMonitorJSONCommandFiltered:
+ *
+ * Like qemuMonitorJSONCommand, but only the members of the reply listed
+ * in @filter are parsed. Meant for commands whose replies are large while
+ * the caller needs only a fraction of them, e.g. query-block on guests
+ * with lots of disks.
+ */
+static int
+qemuMonitorJSONCommandFiltered(qemuMonitorPtr mon,
+                               virJSONValuePtr cmd,
+                               const char *const *filter,
+                               virJSONValuePtr *reply)
+{
+    return qemuMonitorJSONCommandFull(mon, cmd, -1, filter, reply);
 }
 
 /* Ignoring OOM in this method, since we're already reporting
@@ -1857,7 +1968,8 @@ qemuMonitorJSONSetMemoryStatsPeriod(qemuMonitorPtr mon,
  * Returns: NULL on error, reply on success
  */
 static virJSONValuePtr
-qemuMonitorJSONQueryBlock(qemuMonitorPtr mon)
+qemuMonitorJSONQueryBlock(qemuMonitorPtr mon,
+                          const char *const *filter)
 {
     virJSONValuePtr cmd;
     virJSONValuePtr reply = NULL;
@@ -1866,7 +1978,7 @@ qemuMonitorJSONQueryBlock(qemuMonitorPtr mon)
     if (!(cmd = qemuMonitorJSONMakeCommand("query-block", NULL)))
         return NULL;
 
-    if (qemuMonitorJSONCommand(mon, cmd, &reply) < 0 ||
+    if (qemuMonitorJSONCommandFiltered(mon, cmd, filter, &reply) < 0 ||
         qemuMonitorJSONCheckError(cmd, reply) < 0)
         goto cleanup;
 
@@ -1913,6 +2025,70 @@ qemuMonitorJSONGetBlockDevDevice(virJSONValuePtr dev)
 }
 
 
+/* Members of query-block replies used by the functions below. Devices
+ * with long backing chains make the full reply rather big. */
+static const char *const qemuMonitorJSONBlockInfoFilter[] = {
+    "return.device",
+    "return.removable",
+    "return.locked",
+    "return.tray_open",
+    "return.io-status",
+    "return.inserted.node-name",
+    NULL
+};
+
+/* Capacity of the top images only, see
+ * qemuMonitorJSONBlockImageFilterNew for deeper ones */
+static const char *const qemuMonitorJSONBlockCapacityFilter[] = {
+    "return.device",
+    "return.inserted.image.virtual-size",
+    "return.inserted.image.actual-size",
+    NULL
+};
+
+
+/* Builds a query-block filter keeping @members of the top image and of
+ * the first @depth images of its backing chain. Deeper images, which
+ * may be many, are dropped. Free the result with virStringListFree. */
+static char **
+qemuMonitorJSONBlockImageFilterNew(const char *const *members,
+                                   size_t depth)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    size_t nmembers = virStringListLength(members);
+    char **filter = NULL;
+    size_t nfilter = 0;
+    size_t i;
+    size_t j;
+
+    if (VIR_ALLOC_N(filter, (depth + 1) * nmembers + 2) < 0 ||
+        VIR_STRDUP(filter[nfilter++], "return.device") < 0)
+        goto error;
+
+    virBufferAddLit(&buf, "return.inserted.image");
+    for (i = 0; i <= depth; i++) {
+        if (i > 0)
+            virBufferAddLit(&buf, ".backing-image");
+        if (virBufferCheckError(&buf) < 0)
+            goto error;
+
+        for (j = 0; j < nmembers; j++) {
+            if (virAsprintf(&filter[nfilter++], "%s.%s",
+                            virBufferCurrentContent(&buf), members[j]) < 0)
+                goto error;
+        }
+    }
+
+    virBufferFreeAndReset(&buf);
+    return filter;
+
+ error:
+    virBufferFreeAndReset(&buf);
+    virStringListFree(filter);
+    return NULL;
+}
+
+
 int qemuMonitorJSONGetBlockInfo(qemuMonitorPtr mon,
                                 virHashTablePtr table)
 {
@@ -1921,7 +2097,8 @@ int qemuMonitorJSONGetBlockInfo(qemuMonitorPtr mon,
 
     virJSONValuePtr devices;
 
-    if (!(devices = qemuMonitorJSONQueryBlock(mon)))
+    if (!(devices = qemuMonitorJSONQueryBlock(mon,
+                                              qemuMonitorJSONBlockInfoFilter)))
         return -1;
 
     for (i = 0; i < virJSONValueArraySize(devices); i++) {
@@ -2061,6 +2238,117 @@ qemuMonitorJSONGetOneBlockStatsInfo(virJSONValuePtr dev,
 }
 
 
+/* Filter to parse a batched reply to @command with. It has to match
+ * the one used by the code consuming the reply. */
+static const char *const *
+qemuMonitorJSONBatchFilter(const char *command)
+{
+    /* Only qemuMonitorJSONBlockStatsUpdateCapacity is batched */
+    if (STREQ(command, "query-block"))
+        return qemuMonitorJSONBlockCapacityFilter;
+
+    return NULL;
+}
+
+
+/**
+ * qemuMonitorJSONBatchQuery:
+ *
+ * Sends all of @commands back-to-back and stores their replies in @mon
+ * to be picked up by qemuMonitorJSONCommandFull, see qemuMonitorBatchQuery.
+ */
+int
+qemuMonitorJSONBatchQuery(qemuMonitorPtr mon,
+                          const char *const *commands)
+{
+    qemuMonitorMessagePtr msgs = NULL;
+    char **ids = NULL;
+    size_t ncommands = 0;
+    size_t i;
+    int ret = -1;
+
+    while (commands[ncommands]) {
+        if (!qemuMonitorJSONIsQuery(commands[ncommands])) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("command '%s' can't be batched"),
+                           commands[ncommands]);
+            return -1;
+        }
+        ncommands++;
+    }
+
+    if (ncommands == 0)
+        return 0;
+
+    if (VIR_ALLOC_N(msgs, ncommands) < 0 ||
+        VIR_ALLOC_N(ids, ncommands) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ncommands; i++) {
+        virJSONValuePtr cmd;
+        char *cmdstr;
+
+        if (!(cmd = qemuMonitorJSONMakeCommand(commands[i], NULL)))
+            goto cleanup;
+
+        if (!(ids[i] = qemuMonitorNextCommandID(mon)) ||
+            virJSONValueObjectAppendString(cmd, "id", ids[i]) < 0 ||
+            !(cmdstr = virJSONValueToString(cmd, false))) {
+            virJSONValueFree(cmd);
+            goto cleanup;
+        }
+        virJSONValueFree(cmd);
+
+        if (virAsprintf(&msgs[i].txBuffer, "%s\r\n", cmdstr) < 0) {
+            VIR_FREE(cmdstr);
+            goto cleanup;
+        }
+        VIR_FREE(cmdstr);
+
+        msgs[i].txLength = strlen(msgs[i].txBuffer);
+        msgs[i].txFD = -1;
+        msgs[i].txID = ids[i];
+        msgs[i].rxFilter = qemuMonitorJSONBatchFilter(commands[i]);
+        if (i > 0)
+            msgs[i - 1].next = &msgs[i];
+    }
+
+    VIR_DEBUG("Send batch of %zu commands", ncommands);
+
+    if (qemuMonitorSend(mon, msgs) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ncommands; i++) {
+        if (!msgs[i].rxObject) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Missing monitor reply object"));
+            goto cleanup;
+        }
+
+        if (msgs[i].outdated)
+            continue;
+
+        if (qemuMonitorAddBatchReply(mon, commands[i], msgs[i].rxFilter,
+                                     msgs[i].rxObject) < 0)
+            goto cleanup;
+        msgs[i].rxObject = NULL;
+    }
+
+    ret = 0;
+
+ cleanup:
+    for (i = 0; ids && i < ncommands; i++)
+        VIR_FREE(ids[i]);
+    for (i = 0; msgs && i < ncommands; i++) {
+        VIR_FREE(msgs[i].txBuffer);
+        virJSONValueFree(msgs[i].rxObject);
+    }
+    VIR_FREE(ids);
+    VIR_FREE(msgs);
+    return ret;
+}
+
+
 virJSONValuePtr
 qemuMonitorJSONQueryBlockstats(qemuMonitorPtr mon)
 {
@@ -2192,13 +2480,26 @@ qemuMonitorJSONBlockStatsUpdateCapacityOne(virJSONValuePtr image,
 int
 qemuMonitorJSONBlockStatsUpdateCapacity(qemuMonitorPtr mon,
                                         virHashTablePtr stats,
-                                        bool backingChain)
+                                        size_t depth)
 {
     int ret = -1;
     size_t i;
-    virJSONValuePtr devices;
+    virJSONValuePtr devices = NULL;
+    char **filter = NULL;
+    const char *members[] = { "virtual-size", "actual-size", NULL };
+
+    /* The static filter lets the batched reply be used, see
+     * qemuMonitorJSONBatchFilter */
+    if (depth == 0) {
+        devices = qemuMonitorJSONQueryBlock(mon,
+                                            qemuMonitorJSONBlockCapacityFilter);
+    } else if ((filter = qemuMonitorJSONBlockImageFilterNew(members, depth))) {
+        devices = qemuMonitorJSONQueryBlock(mon,
+                                            (const char *const *) filter);
+        virStringListFree(filter);
+    }
 
-    if (!(devices = qemuMonitorJSONQueryBlock(mon)))
+    if (!devices)
         return -1;
 
     for (i = 0; i < virJSONValueArraySize(devices); i++) {
@@ -2220,7 +2521,7 @@ qemuMonitorJSONBlockStatsUpdateCapacity(qemuMonitorPtr mon,
 
         if (qemuMonitorJSONBlockStatsUpdateCapacityOne(image, dev_name, 0,
                                                        stats,
-                                                       backingChain) < 0)
+                                                       depth > 0) < 0)
             goto cleanup;
     }
 
@@ -4120,9 +4421,22 @@ qemuMonitorJSONDiskNameLookup(qemuMonitorPtr mon,
 {
     char *ret = NULL;
     virJSONValuePtr devices;
+    virStorageSourcePtr src;
+    const char *members[] = { "filename", NULL };
+    char **filter;
+    size_t depth = 0;
     size_t i;
 
-    if (!(devices = qemuMonitorJSONQueryBlock(mon)))
+    /* Only the images down to @target are looked at */
+    for (src = top; src && src != target; src = src->backingStore)
+        depth++;
+
+    if (!(filter = qemuMonitorJSONBlockImageFilterNew(members, depth)))
+        return NULL;
+
+    devices = qemuMonitorJSONQueryBlock(mon, (const char *const *) filter);
+    virStringListFree(filter);
+    if (!devices)
         return NULL;
 
     for (i = 0; i < virJSONValueArraySize(devices); i++) {
@@ -102,6 +102,9 @@ qemuProcessRemoveDomainStatus(virQEMUDriverPtr driver,
     if (virAsprintf(&file, "%s/%s.xml", cfg->stateDir, vm->def->name) < 0)
         goto cleanup;
 
+    if (driver->statusWriter)
+        virDomainStatusWriterDiscard(driver->statusWriter, vm);
+
     if (unlink(file) < 0 && errno != ENOENT && errno != ENOTDIR)
         VIR_WARN("Failed to remove domain XML for %s: %s",
                  vm->def->name, virStrerror(errno, ebuf, sizeof(ebuf)));
@@ -483,7 +486,6 @@ qemuProcessHandleReset(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
     virQEMUDriverPtr driver = opaque;
     virObjectEventPtr event;
     qemuDomainObjPrivatePtr priv;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
     int ret = -1;
 
     virObjectLock(vm);
@@ -493,7 +495,7 @@ qemuProcessHandleReset(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
     if (priv->agent)
         qemuAgentNotifyEvent(priv->agent, QEMU_AGENT_EVENT_RESET);
 
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+    if (qemuDomainSaveStatus(driver, vm) < 0)
         VIR_WARN("Failed to save status on vm %s", vm->def->name);
 
     if (vm->def->onReboot == VIR_DOMAIN_LIFECYCLE_DESTROY ||
@@ -520,7 +522,6 @@ qemuProcessHandleReset(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
  cleanup:
     virObjectUnlock(vm);
     qemuDomainEventQueue(driver, event);
-    virObjectUnref(cfg);
     return ret;
 }
 
@@ -540,7 +541,6 @@ qemuProcessFakeReboot(void *opaque)
     qemuDomainObjPrivatePtr priv = vm->privateData;
     virQEMUDriverPtr driver = priv->driver;
     virObjectEventPtr event = NULL;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
     virDomainRunningReason reason = VIR_DOMAIN_RUNNING_BOOTED;
     int ret = -1, rc;
 
@@ -580,7 +580,7 @@ qemuProcessFakeReboot(void *opaque)
                                      VIR_DOMAIN_EVENT_RESUMED,
                                      VIR_DOMAIN_EVENT_RESUMED_UNPAUSED);
 
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+    if (qemuDomainSaveStatus(driver, vm) < 0) {
         VIR_WARN("Unable to save status on vm %s after state change",
                  vm->def->name);
     }
@@ -595,7 +595,6 @@ qemuProcessFakeReboot(void *opaque)
         ignore_value(qemuProcessKill(vm, VIR_QEMU_PROCESS_KILL_FORCE));
     virDomainObjEndAPI(&vm);
     qemuDomainEventQueue(driver, event);
-    virObjectUnref(cfg);
 }
 
 
@@ -658,7 +657,6 @@ qemuProcessHandleShutdown(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
     virQEMUDriverPtr driver = opaque;
     qemuDomainObjPrivatePtr priv;
     virObjectEventPtr event = NULL;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
     int detail = 0;
 
     VIR_DEBUG("vm=%p", vm);
@@ -701,7 +699,7 @@ qemuProcessHandleShutdown(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
                                               VIR_DOMAIN_EVENT_SHUTDOWN,
                                               detail);
 
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+    if (qemuDomainSaveStatus(driver, vm) < 0) {
         VIR_WARN("Unable to save status on vm %s after state change",
                  vm->def->name);
     }
@@ -714,7 +712,6 @@ qemuProcessHandleShutdown(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
  unlock:
     virObjectUnlock(vm);
     qemuDomainEventQueue(driver, event);
-    virObjectUnref(cfg);
 
     return 0;
 }
@@ -729,7 +726,6 @@ qemuProcessHandleStop(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
     virObjectEventPtr event = NULL;
     virDomainPausedReason reason = VIR_DOMAIN_PAUSED_UNKNOWN;
     virDomainEventSuspendedDetailType detail = VIR_DOMAIN_EVENT_SUSPENDED_PAUSED;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
     virObjectLock(vm);
     if (virDomainObjGetState(vm, NULL) == VIR_DOMAIN_RUNNING) {
@@ -770,7 +766,7 @@ qemuProcessHandleStop(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
             VIR_WARN("Unable to release lease on %s", vm->def->name);
         VIR_DEBUG("Preserving lock state '%s'", NULLSTR(priv->lockState));
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+        if (qemuDomainSaveStatus(driver, vm) < 0) {
             VIR_WARN("Unable to save status on vm %s after state change",
                      vm->def->name);
         }
@@ -779,7 +775,6 @@ qemuProcessHandleStop(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
  unlock:
     virObjectUnlock(vm);
     qemuDomainEventQueue(driver, event);
-    virObjectUnref(cfg);
 
     return 0;
 }
@@ -792,7 +787,6 @@ qemuProcessHandleResume(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
 {
     virQEMUDriverPtr driver = opaque;
     virObjectEventPtr event = NULL;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
     virObjectLock(vm);
     if (virDomainObjGetState(vm, NULL) == VIR_DOMAIN_PAUSED) {
@@ -812,7 +806,7 @@ qemuProcessHandleResume(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
                                          VIR_DOMAIN_EVENT_RESUMED,
                                          VIR_DOMAIN_EVENT_RESUMED_UNPAUSED);
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+        if (qemuDomainSaveStatus(driver, vm) < 0) {
             VIR_WARN("Unable to save status on vm %s after state change",
                      vm->def->name);
         }
@@ -821,7 +815,6 @@ qemuProcessHandleResume(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
  unlock:
     virObjectUnlock(vm);
     qemuDomainEventQueue(driver, event);
-    virObjectUnref(cfg);
     return 0;
 }
 
@@ -833,7 +826,6 @@ qemuProcessHandleRTCChange(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
 {
     virQEMUDriverPtr driver = opaque;
     virObjectEventPtr event = NULL;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
     virObjectLock(vm);
 
@@ -856,7 +848,7 @@ qemuProcessHandleRTCChange(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
         offset += vm->def->clock.data.variable.adjustment0;
         vm->def->clock.data.variable.adjustment = offset;
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+        if (qemuDomainSaveStatus(driver, vm) < 0)
            VIR_WARN("unable to save domain status with RTC change");
     }
 
@@ -865,7 +857,6 @@ qemuProcessHandleRTCChange(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
     virObjectUnlock(vm);
 
     qemuDomainEventQueue(driver, event);
-    virObjectUnref(cfg);
     return 0;
 }
 
@@ -879,7 +870,6 @@ qemuProcessHandleWatchdog(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
     virQEMUDriverPtr driver = opaque;
     virObjectEventPtr watchdogEvent = NULL;
     virObjectEventPtr lifecycleEvent = NULL;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
     virObjectLock(vm);
     watchdogEvent = virDomainEventWatchdogNewFromObj(vm, action);
@@ -899,7 +889,7 @@ qemuProcessHandleWatchdog(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
             VIR_WARN("Unable to release lease on %s", vm->def->name);
         VIR_DEBUG("Preserving lock state '%s'", NULLSTR(priv->lockState));
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+        if (qemuDomainSaveStatus(driver, vm) < 0) {
             VIR_WARN("Unable to save status on vm %s after watchdog event",
                      vm->def->name);
         }
@@ -927,8 +917,6 @@ qemuProcessHandleWatchdog(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
         virObjectUnlock(vm);
     qemuDomainEventQueue(driver, watchdogEvent);
     qemuDomainEventQueue(driver, lifecycleEvent);
-
-    virObjectUnref(cfg);
     return 0;
 }
 
@@ -948,7 +936,6 @@ qemuProcessHandleIOError(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
     const char *srcPath;
     const char *devAlias;
     virDomainDiskDefPtr disk;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
     virObjectLock(vm);
     disk = qemuProcessFindDomainDiskByAlias(vm, diskAlias);
@@ -982,7 +969,7 @@ qemuProcessHandleIOError(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
             VIR_WARN("Unable to release lease on %s", vm->def->name);
         VIR_DEBUG("Preserving lock state '%s'", NULLSTR(priv->lockState));
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+        if (qemuDomainSaveStatus(driver, vm) < 0)
             VIR_WARN("Unable to save status on vm %s after IO error", vm->def->name);
     }
     virObjectUnlock(vm);
@@ -990,7 +977,6 @@ qemuProcessHandleIOError(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
     qemuDomainEventQueue(driver, ioErrorEvent);
     qemuDomainEventQueue(driver, ioErrorEvent2);
     qemuDomainEventQueue(driver, lifecycleEvent);
-    virObjectUnref(cfg);
     return 0;
 }
 
@@ -1149,7 +1135,6 @@ qemuProcessHandleTrayChange(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
     virQEMUDriverPtr driver = opaque;
     virObjectEventPtr event = NULL;
     virDomainDiskDefPtr disk;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
     virObjectLock(vm);
     disk = qemuProcessFindDomainDiskByAlias(vm, devAlias);
@@ -1164,7 +1149,7 @@ qemuProcessHandleTrayChange(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
         else if (reason == VIR_DOMAIN_EVENT_TRAY_CHANGE_CLOSE)
             disk->tray_status = VIR_DOMAIN_DISK_TRAY_CLOSED;
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+        if (qemuDomainSaveStatus(driver, vm) < 0) {
             VIR_WARN("Unable to save status on vm %s after tray moved event",
                      vm->def->name);
         }
@@ -1174,7 +1159,6 @@ qemuProcessHandleTrayChange(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
 
     virObjectUnlock(vm);
     qemuDomainEventQueue(driver, event);
-    virObjectUnref(cfg);
     return 0;
 }
 
@@ -1186,7 +1170,6 @@ qemuProcessHandlePMWakeup(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
     virQEMUDriverPtr driver = opaque;
     virObjectEventPtr event = NULL;
     virObjectEventPtr lifecycleEvent = NULL;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
     virObjectLock(vm);
     event = virDomainEventPMWakeupNewFromObj(vm);
@@ -1204,7 +1187,7 @@ qemuProcessHandlePMWakeup(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
                                                   VIR_DOMAIN_EVENT_STARTED,
                                                   VIR_DOMAIN_EVENT_STARTED_WAKEUP);
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+        if (qemuDomainSaveStatus(driver, vm) < 0) {
             VIR_WARN("Unable to save status on vm %s after wakeup event",
                      vm->def->name);
         }
@@ -1213,7 +1196,6 @@ qemuProcessHandlePMWakeup(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
     virObjectUnlock(vm);
     qemuDomainEventQueue(driver, event);
     qemuDomainEventQueue(driver, lifecycleEvent);
-    virObjectUnref(cfg);
     return 0;
 }
 
@@ -1225,7 +1207,6 @@ qemuProcessHandlePMSuspend(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
     virQEMUDriverPtr driver = opaque;
     virObjectEventPtr event = NULL;
     virObjectEventPtr lifecycleEvent = NULL;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
     virObjectLock(vm);
     event = virDomainEventPMSuspendNewFromObj(vm);
@@ -1242,7 +1223,7 @@ qemuProcessHandlePMSuspend(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
                                      VIR_DOMAIN_EVENT_PMSUSPENDED,
                                      VIR_DOMAIN_EVENT_PMSUSPENDED_MEMORY);
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+        if (qemuDomainSaveStatus(driver, vm) < 0) {
             VIR_WARN("Unable to save status on vm %s after suspend event",
                      vm->def->name);
         }
@@ -1255,7 +1236,6 @@ qemuProcessHandlePMSuspend(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
 
     qemuDomainEventQueue(driver, event);
     qemuDomainEventQueue(driver, lifecycleEvent);
-    virObjectUnref(cfg);
     return 0;
 }
 
@@ -1267,7 +1247,6 @@ qemuProcessHandleBalloonChange(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
 {
     virQEMUDriverPtr driver = opaque;
     virObjectEventPtr event = NULL;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
     virObjectLock(vm);
     event = virDomainEventBalloonChangeNewFromObj(vm, actual);
@@ -1276,13 +1255,12 @@ qemuProcessHandleBalloonChange(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
               vm->def->mem.cur_balloon, actual);
     vm->def->mem.cur_balloon = actual;
 
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+    if (qemuDomainSaveStatus(driver, vm) < 0)
         VIR_WARN("unable to save domain status with balloon change");
 
     virObjectUnlock(vm);
 
     qemuDomainEventQueue(driver, event);
-    virObjectUnref(cfg);
     return 0;
 }
 
@@ -1294,7 +1272,6 @@ qemuProcessHandlePMSuspendDisk(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
     virQEMUDriverPtr driver = opaque;
     virObjectEventPtr event = NULL;
     virObjectEventPtr lifecycleEvent = NULL;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
     virObjectLock(vm);
     event = virDomainEventPMSuspendDiskNewFromObj(vm);
@@ -1311,7 +1288,7 @@ qemuProcessHandlePMSuspendDisk(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
                                      VIR_DOMAIN_EVENT_PMSUSPENDED,
                                      VIR_DOMAIN_EVENT_PMSUSPENDED_DISK);
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+        if (qemuDomainSaveStatus(driver, vm) < 0) {
             VIR_WARN("Unable to save status on vm %s after suspend event",
                      vm->def->name);
         }
@@ -1324,7 +1301,6 @@ qemuProcessHandlePMSuspendDisk(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
 
     qemuDomainEventQueue(driver, event);
     qemuDomainEventQueue(driver, lifecycleEvent);
-    virObjectUnref(cfg);
 
     return 0;
 }
@@ -2659,7 +2635,7 @@ qemuProcessUpdateVideoRamSize(virQEMUDriverPtr driver,
         return -1;
 
     cfg = virQEMUDriverGetConfig(driver);
-    ret = virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps);
+    ret = qemuDomainFlushStatus(driver, vm);
     virObjectUnref(cfg);
 
     return ret;
@@ -4739,7 +4715,8 @@ qemuProcessInit(virQEMUDriverPtr driver,
      * report implicit runtime defaults in the XML, like vnc listen/socket
      */
     VIR_DEBUG("Setting current domain def as transient");
-    if (virDomainObjSetDefTransient(caps, driver->xmlopt, vm) < 0)
+    if (virDomainObjSetDefTransient(caps, driver->xmlopt, vm,
+                                    priv->qemuCaps) < 0)
         goto cleanup;
 
     if (flags & VIR_QEMU_PROCESS_START_PRETEND) {
@@ -4748,7 +4725,8 @@ qemuProcessInit(virQEMUDriverPtr driver,
             goto cleanup;
         }
     } else {
-        vm->def->id = qemuDriverAllocateID(driver);
+        virDomainObjListSetID(driver->domains, vm,
+                              qemuDriverAllocateID(driver));
         qemuDomainSetFakeReboot(driver, vm, false);
         virDomainObjSetState(vm, VIR_DOMAIN_PAUSED, VIR_DOMAIN_PAUSED_STARTING_UP);
 
@@ -5617,7 +5595,7 @@ qemuProcessLaunch(virConnectPtr conn,
     }
 
     VIR_DEBUG("Writing early domain status to disk");
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+    if (qemuDomainFlushStatus(driver, vm) < 0)
         goto cleanup;
 
     VIR_DEBUG("Waiting for handshake from child");
@@ -5813,7 +5791,6 @@ qemuProcessFinishStartup(virConnectPtr conn,
                          bool startCPUs,
                          virDomainPausedReason pausedReason)
 {
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
     int ret = -1;
 
     if (startCPUs) {
@@ -5831,7 +5808,7 @@ qemuProcessFinishStartup(virConnectPtr conn,
     }
 
     VIR_DEBUG("Writing domain status to disk");
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+    if (qemuDomainFlushStatus(driver, vm) < 0)
         goto cleanup;
 
     if (qemuProcessStartHook(driver, vm,
@@ -5842,7 +5819,6 @@ qemuProcessFinishStartup(virConnectPtr conn,
     ret = 0;
 
  cleanup:
-    virObjectUnref(cfg);
     return ret;
 }
 
@@ -6106,7 +6082,7 @@ void qemuProcessStop(virQEMUDriverPtr driver,
 
     qemuProcessBuildDestroyHugepagesPath(driver, vm, NULL, false);
 
-    vm->def->id = -1;
+    virDomainObjListSetID(driver->domains, vm, -1);
 
     if (virAtomicIntDecAndTest(&driver->nactive) && driver->inhibitCallback)
         driver->inhibitCallback(false, driver->inhibitOpaque);
@@ -6443,10 +6419,10 @@ int qemuProcessAttach(virConnectPtr conn ATTRIBUTE_UNUSED,
      * report implicit runtime defaults in the XML, like vnc listen/socket
      */
     VIR_DEBUG("Setting current domain def as transient");
-    if (virDomainObjSetDefTransient(caps, driver->xmlopt, vm) < 0)
+    if (virDomainObjSetDefTransient(caps, driver->xmlopt, vm, NULL) < 0)
         goto error;
 
-    vm->def->id = qemuDriverAllocateID(driver);
+    virDomainObjListSetID(driver->domains, vm, qemuDriverAllocateID(driver));
 
     if (virAtomicIntInc(&driver->nactive) == 1 && driver->inhibitCallback)
         driver->inhibitCallback(true, driver->inhibitOpaque);
@@ -6594,7 +6570,7 @@ int qemuProcessAttach(virConnectPtr conn ATTRIBUTE_UNUSED,
     }
 
     VIR_DEBUG("Writing domain status to disk");
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+    if (qemuDomainFlushStatus(driver, vm) < 0)
         goto error;
 
     /* Run an hook to allow admins to do some magic */
@@ -6774,20 +6750,106 @@ qemuProcessRefreshDisks(virQEMUDriverPtr driver,
 }
 
 
+typedef enum {
+    QEMU_PROCESS_RECONNECT_PHASE_JOB,      /* restoring the job and keys */
+    QEMU_PROCESS_RECONNECT_PHASE_MONITOR,  /* connecting to the monitor */
+    QEMU_PROCESS_RECONNECT_PHASE_DEVICES,  /* host devices, cgroups, disks */
+    QEMU_PROCESS_RECONNECT_PHASE_STATE,    /* domain state, CPUs, labels */
+    QEMU_PROCESS_RECONNECT_PHASE_FINISH,   /* job recovery, agent, status */
+    QEMU_PROCESS_RECONNECT_PHASE_DEFERRED, /* RTC and balloon */
+
+    QEMU_PROCESS_RECONNECT_PHASE_LAST
+} qemuProcessReconnectPhase;
+
+VIR_ENUM_DECL(qemuProcessReconnectPhase)
+VIR_ENUM_IMPL(qemuProcessReconnectPhase,
+              QEMU_PROCESS_RECONNECT_PHASE_LAST,
+              "job",
+              "monitor",
+              "devices",
+              "state",
+              "finish",
+              "deferred");
+
 struct qemuProcessReconnectData {
     virConnectPtr conn;
     virQEMUDriverPtr driver;
     virDomainObjPtr obj;
+    bool deferred;  /* the domain is usable, refresh the rest of its state */
+
+    unsigned long long phaseStart;
+    unsigned long long phaseTime[QEMU_PROCESS_RECONNECT_PHASE_LAST];
 };
+
+struct qemuProcessReconnectAllData {
+    virConnectPtr conn;
+    virQEMUDriverPtr driver;
+    size_t maxWorkers;
+
+    struct qemuProcessReconnectData **doms;
+    size_t ndoms;
+
+    virMutex lock;
+    size_t ndone;
+    size_t nfailed;
+    unsigned long long start;
+};
+
+
+static void
+qemuProcessReconnectPhaseDone(struct qemuProcessReconnectData *data,
+                              qemuProcessReconnectPhase phase)
+{
+    unsigned long long now;
+
+    if (virTimeMillisNow(&now) < 0)
+        return;
+
+    if (data->phaseStart && now > data->phaseStart)
+        data->phaseTime[phase] += now - data->phaseStart;
+    data->phaseStart = now;
+}
+
+
+/**
+ * qemuProcessReconnectMark:
+ * @obj: domain object, locked
+ *
+ * Makes any job on @obj wait until qemuProcessReconnectUnmark is called,
+ * without the wait counting against the job timeout.
+ */
+void
+qemuProcessReconnectMark(virDomainObjPtr obj)
+{
+    qemuDomainObjPrivatePtr priv = obj->privateData;
+
+    priv->reconnecting = true;
+}
+
+
+/**
+ * qemuProcessReconnectUnmark:
+ * @obj: domain object, locked
+ *
+ * Lets jobs waiting for @obj to be reconnected proceed.
+ */
+void
+qemuProcessReconnectUnmark(virDomainObjPtr obj)
+{
+    qemuDomainObjPrivatePtr priv = obj->privateData;
+
+    priv->reconnecting = false;
+    virCondBroadcast(&priv->job.cond);
+}
+
+
 /*
  * Open an existing VM's monitor, re-detect VCPU threads
  * and re-reserve the security labels in use
  *
- * We own the virConnectPtr we are passed here - whoever started
- * this thread function has increased the reference counter to it
- * so that we now have to close it.
- *
- * This function also inherits a locked and ref'd domain object.
+ * The domain object is ref'd and was marked as reconnecting by
+ * qemuProcessReconnectHelper so that nobody starts a job on it before
+ * we do.
  *
  * This function needs to:
  * 1. Enter job
@@ -6800,11 +6862,16 @@ struct qemuProcessReconnectData {
  *
  * We can't do normal MonitorEnter & MonitorExit because these two lock the
  * monitor lock, which does not exists in this early phase.
+ *
+ * Queries which are not needed for managing the domain are left to
+ * qemuProcessReconnectDeferred, which is called once all domains got
+ * this far.
+ *
+ * Returns 0 if the domain is running, -1 if it had to be killed.
  */
-static void
-qemuProcessReconnect(void *opaque)
+static int
+qemuProcessReconnect(struct qemuProcessReconnectData *data)
 {
-    struct qemuProcessReconnectData *data = opaque;
     virQEMUDriverPtr driver = data->driver;
     virDomainObjPtr obj = data->obj;
     qemuDomainObjPrivatePtr priv;
@@ -6817,16 +6884,21 @@ qemuProcessReconnect(void *opaque)
     unsigned int stopFlags = 0;
     bool jobStarted = false;
     virCapsPtr caps = NULL;
+    int ret = -1;
 
-    VIR_FREE(data);
+    virObjectLock(obj);
+    ignore_value(virTimeMillisNow(&data->phaseStart));
+
+    cfg = virQEMUDriverGetConfig(driver);
+    priv = obj->privateData;
+
+    /* From now on API calls on this domain just wait for our job */
+    qemuProcessReconnectUnmark(obj);
 
     qemuDomainObjRestoreJob(obj, &oldjob);
     if (oldjob.asyncJob == QEMU_ASYNC_JOB_MIGRATION_IN)
         stopFlags |= VIR_QEMU_PROCESS_STOP_MIGRATED;
 
-    cfg = virQEMUDriverGetConfig(driver);
-    priv = obj->privateData;
-
     if (!(caps = virQEMUDriverGetCapabilities(driver, false)))
         goto error;
 
@@ -6843,12 +6915,16 @@ qemuProcessReconnect(void *opaque)
     if (qemuDomainMasterKeyReadFile(priv) < 0)
         goto error;
 
+    qemuProcessReconnectPhaseDone(data, QEMU_PROCESS_RECONNECT_PHASE_JOB);
+
     VIR_DEBUG("Reconnect monitor to %p '%s'", obj, obj->def->name);
 
     /* XXX check PID liveliness & EXE path */
     if (qemuConnectMonitor(driver, obj, QEMU_ASYNC_JOB_NONE, NULL) < 0)
         goto error;
 
+    qemuProcessReconnectPhaseDone(data, QEMU_PROCESS_RECONNECT_PHASE_MONITOR);
+
     if (qemuHostdevUpdateActiveDomainDevices(driver, obj->def) < 0)
         goto error;
 
@@ -6881,6 +6957,8 @@ qemuProcessReconnect(void *opaque)
             goto error;
     }
 
+    qemuProcessReconnectPhaseDone(data, QEMU_PROCESS_RECONNECT_PHASE_DEVICES);
+
     if (qemuProcessUpdateState(driver, obj) < 0)
         goto error;
 
@@ -6912,6 +6990,7 @@ qemuProcessReconnect(void *opaque)
         VIR_DEBUG("Finishing shutdown sequence for domain %s",
                   obj->def->name);
         qemuProcessShutdownOrReboot(driver, obj);
+        ret = 0;
         goto cleanup;
     }
 
@@ -6975,11 +7054,7 @@ qemuProcessReconnect(void *opaque)
     if (qemuRefreshVirtioChannelState(driver, obj, QEMU_ASYNC_JOB_NONE) < 0)
         goto error;
 
-    /* If querying of guest's RTC failed, report error, but do not kill the domain. */
-    qemuRefreshRTC(driver, obj);
-
-    if (qemuProcessRefreshBalloonState(driver, obj, QEMU_ASYNC_JOB_NONE) < 0)
-        goto error;
+    qemuProcessReconnectPhaseDone(data, QEMU_PROCESS_RECONNECT_PHASE_STATE);
 
     if (qemuProcessRecoverJob(driver, obj, conn, &oldjob, &stopFlags) < 0)
         goto error;
@@ -6993,7 +7068,7 @@ qemuProcessReconnect(void *opaque)
         goto error;
 
     /* update domain state XML with possibly updated state in virDomainObj */
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, obj, driver->caps) < 0)
+    if (qemuDomainFlushStatus(driver, obj) < 0)
         goto error;
 
     /* Run an hook to allow admins to do some magic */
@@ -7016,6 +7091,10 @@ qemuProcessReconnect(void *opaque)
     if (virAtomicIntInc(&driver->nactive) == 1 && driver->inhibitCallback)
         driver->inhibitCallback(true, driver->inhibitOpaque);
 
+    qemuProcessReconnectPhaseDone(data, QEMU_PROCESS_RECONNECT_PHASE_FINISH);
+    data->deferred = true;
+    ret = 0;
+
  cleanup:
     if (jobStarted) {
         if (!virDomainObjIsActive(obj))
@@ -7025,12 +7104,11 @@ qemuProcessReconnect(void *opaque)
         if (!virDomainObjIsActive(obj))
             qemuDomainRemoveInactiveJob(driver, obj);
     }
-    virDomainObjEndAPI(&obj);
-    virObjectUnref(conn);
+    virObjectUnlock(obj);
     virObjectUnref(cfg);
     virObjectUnref(caps);
     virNWFilterUnlockFilterUpdates();
-    return;
+    return ret;
 
  error:
     if (virDomainObjIsActive(obj)) {
@@ -7057,57 +7135,201 @@ qemuProcessReconnect(void *opaque)
     goto cleanup;
 }
 
+
+/*
+ * Refresh the parts of the domain state which are not needed to manage
+ * the domain, but take a monitor round trip each. This runs once all
+ * domains are reconnected, i.e. while APIs are already being served.
+ * The status XML keeps the values from before the daemon restarted
+ * until then, so failures are only logged.
+ */
+static void
+qemuProcessReconnectDeferred(struct qemuProcessReconnectData *data)
+{
+    virQEMUDriverPtr driver = data->driver;
+    virDomainObjPtr obj = data->obj;
+
+    virObjectLock(obj);
+    ignore_value(virTimeMillisNow(&data->phaseStart));
+
+    if (qemuDomainObjBeginJob(driver, obj, QEMU_JOB_MODIFY) < 0) {
+        VIR_WARN("Unable to refresh state of domain %s after reconnect",
+                 obj->def->name);
+        goto cleanup;
+    }
+
+    if (!virDomainObjIsActive(obj))
+        goto endjob;
+
+    /* If querying of guest's RTC failed, report error, but do not kill the domain. */
+    qemuRefreshRTC(driver, obj);
+
+    if (qemuProcessRefreshBalloonState(driver, obj, QEMU_ASYNC_JOB_NONE) < 0) {
+        VIR_WARN("Unable to refresh balloon state of domain %s after "
+                 "reconnect: %s", obj->def->name, virGetLastErrorMessage());
+        virResetLastError();
+    }
+
+    if (qemuDomainSaveStatus(driver, obj) < 0)
+        VIR_WARN("Failed to save status on vm %s", obj->def->name);
+
+ endjob:
+    qemuDomainObjEndJob(driver, obj);
+
+ cleanup:
+    qemuProcessReconnectPhaseDone(data, QEMU_PROCESS_RECONNECT_PHASE_DEFERRED);
+    virObjectUnlock(obj);
+}
+
+
+static int
+qemuProcessReconnectWorker(size_t idx,
+                           void *opaque)
+{
+    struct qemuProcessReconnectAllData *all = opaque;
+    struct qemuProcessReconnectData *data = all->doms[idx];
+    size_t step = all->ndoms / 10 ? all->ndoms / 10 : 1;
+    unsigned long long now = 0;
+    int rc;
+
+    rc = qemuProcessReconnect(data);
+
+    ignore_value(virTimeMillisNow(&now));
+
+    virMutexLock(&all->lock);
+    all->ndone++;
+    if (rc < 0)
+        all->nfailed++;
+    if (all->ndone % step == 0 || all->ndone == all->ndoms)
+        VIR_INFO("Reconnected to %zu of %zu domains (%zu failed) in %llums",
+                 all->ndone, all->ndoms, all->nfailed, now - all->start);
+    virMutexUnlock(&all->lock);
+
+    /* Errors are handled per domain, never stop reconnecting the others */
+    return 0;
+}
+
+
+static int
+qemuProcessReconnectDeferredWorker(size_t idx,
+                                   void *opaque)
+{
+    struct qemuProcessReconnectAllData *all = opaque;
+    struct qemuProcessReconnectData *data = all->doms[idx];
+
+    if (data->deferred)
+        qemuProcessReconnectDeferred(data);
+
+    return 0;
+}
+
+
+static void
+qemuProcessReconnectAllFree(struct qemuProcessReconnectAllData *all)
+{
+    size_t i;
+
+    if (!all)
+        return;
+
+    for (i = 0; i < all->ndoms; i++) {
+        virObjectUnref(all->doms[i]->obj);
+        VIR_FREE(all->doms[i]);
+    }
+    VIR_FREE(all->doms);
+    virObjectUnref(all->conn);
+    virMutexDestroy(&all->lock);
+    VIR_FREE(all);
+}
+
+
+static void
+qemuProcessReconnectAllReport(struct qemuProcessReconnectAllData *all)
+{
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < QEMU_PROCESS_RECONNECT_PHASE_LAST; i++) {
+        unsigned long long total = 0;
+        unsigned long long max = 0;
+
+        for (j = 0; j < all->ndoms; j++) {
+            unsigned long long t = all->doms[j]->phaseTime[i];
+
+            total += t;
+            if (t > max)
+                max = t;
+        }
+
+        VIR_INFO("Reconnect phase '%s': %llums in total, %llums at most",
+                 qemuProcessReconnectPhaseTypeToString(i), total, max);
+    }
+}
+
+
+static void
+qemuProcessReconnectAllRun(void *opaque)
+{
+    struct qemuProcessReconnectAllData *all = opaque;
+    unsigned long long now = 0;
+
+    ignore_value(virThreadMapParallel(all->maxWorkers, all->ndoms,
+                                      qemuProcessReconnectWorker, all));
+
+    ignore_value(virTimeMillisNow(&now));
+    VIR_INFO("Finished reconnecting to %zu domains (%zu failed) in %llums",
+             all->ndoms, all->nfailed, now - all->start);
+
+    ignore_value(virThreadMapParallel(all->maxWorkers, all->ndoms,
+                                      qemuProcessReconnectDeferredWorker, all));
+    qemuProcessReconnectAllReport(all);
+
+    qemuProcessReconnectAllFree(all);
+}
+
+
 static int
 qemuProcessReconnectHelper(virDomainObjPtr obj,
                            void *opaque)
 {
-    virThread thread;
-    struct qemuProcessReconnectData *src = opaque;
+    struct qemuProcessReconnectAllData *all = opaque;
     struct qemuProcessReconnectData *data;
 
     /* If the VM was inactive, we don't need to reconnect */
     if (!obj->pid)
         return 0;
 
-    if (VIR_ALLOC(data) < 0)
-        return -1;
-
-    memcpy(data, src, sizeof(*data));
-    data->obj = obj;
-
-    virNWFilterReadLockFilterUpdates();
-
-    /* this lock and reference will be eventually transferred to the thread
-     * that handles the reconnect */
-    virObjectLock(obj);
     virObjectRef(obj);
+    virObjectLock(obj);
 
-    /* Since we close the connection later on, we have to make sure that the
-     * threads we start see a valid connection throughout their lifetime. We
-     * simply increase the reference counter here.
-     */
-    virObjectRef(data->conn);
-
-    if (virThreadCreate(&thread, false, qemuProcessReconnect, data) < 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("Could not create thread. QEMU initialization "
-                         "might be incomplete"));
-        /* We can't spawn a thread and thus connect to monitor. Kill qemu.
-         * It's safe to call qemuProcessStop without a job here since there
-         * is no thread that could be doing anything else with the same domain
-         * object.
-         */
-        qemuProcessStop(src->driver, obj, VIR_DOMAIN_SHUTOFF_FAILED,
+    if (VIR_ALLOC(data) < 0 ||
+        VIR_APPEND_ELEMENT(all->doms, all->ndoms, data) < 0) {
+        VIR_FREE(data);
+        /* Nobody will ever connect to the monitor. Kill qemu. It's safe to
+         * call qemuProcessStop without a job here since there is no thread
+         * that could be doing anything else with the same domain object.
+         * The domain list is locked by our caller. */
+        qemuProcessStop(all->driver, obj, VIR_DOMAIN_SHUTOFF_FAILED,
                         QEMU_ASYNC_JOB_NONE, 0);
-        qemuDomainRemoveInactiveJob(src->driver, obj);
-
+        qemuDomainRemoveInactiveJobLocked(all->driver, obj);
         virDomainObjEndAPI(&obj);
-        virNWFilterUnlockFilterUpdates();
-        virObjectUnref(data->conn);
-        VIR_FREE(data);
         return -1;
     }
 
+    data->conn = all->conn;
+    data->driver = all->driver;
+    data->obj = obj;
+
+    virNWFilterReadLockFilterUpdates();
+
+    /* The domain might not be reconnected for a while, but we need to
+     * make sure nobody else plays with it before that happens. Keeping it
+     * locked until then would block even listing the domains, so just make
+     * any job wait until qemuProcessReconnect starts its own. The reference
+     * is transferred to the thread that handles the reconnect. */
+    qemuProcessReconnectMark(obj);
+    virObjectUnlock(obj);
+
     return 0;
 }
 
@@ -7115,11 +7337,49 @@ qemuProcessReconnectHelper(virDomainObjPtr obj,
  * qemuProcessReconnectAll
  *
  * Try to re-open the resources for live VMs that we care
- * about.
+ * about. This is done in the background using at most
+ * max_reconnect_workers threads.
  */
 void
 qemuProcessReconnectAll(virConnectPtr conn, virQEMUDriverPtr driver)
 {
-    struct qemuProcessReconnectData data = {.conn = conn, .driver = driver};
-    virDomainObjListForEach(driver->domains, qemuProcessReconnectHelper, &data);
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    struct qemuProcessReconnectAllData *all = NULL;
+    virThread thread;
+
+    if (VIR_ALLOC(all) < 0)
+        goto cleanup;
+
+    if (virMutexInit(&all->lock) < 0) {
+        virReportSystemError(errno, "%s", _("Unable to initialize mutex"));
+        VIR_FREE(all);
+        goto cleanup;
+    }
+
+    all->conn = virObjectRef(conn);
+    all->driver = driver;
+    ignore_value(virTimeMillisNow(&all->start));
+
+    virDomainObjListForEach(driver->domains, qemuProcessReconnectHelper, all);
+
+    all->maxWorkers = cfg->maxReconnectWorkers;
+    if (!all->maxWorkers)
+        all->maxWorkers = all->ndoms;
+
+    VIR_DEBUG("Reconnecting to %zu domains using at most %zu threads",
+              all->ndoms, all->maxWorkers);
+
+    if (all->ndoms == 0) {
+        qemuProcessReconnectAllFree(all);
+        goto cleanup;
+    }
+
+    if (virThreadCreate(&thread, false, qemuProcessReconnectAllRun, all) < 0) {
+        VIR_WARN("Unable to reconnect to domains in the background: %s",
+                 virGetLastErrorMessage());
+        qemuProcessReconnectAllRun(all);
+    }
+
+ cleanup:
+    virObjectUnref(cfg);
 }
@@ -34,4 +34,7 @@ int qemuProcessHandleDeviceDeleted(qemuMonitorPtr mon,
                                    const char *devAlias,
                                    void *opaque);
 
+void qemuProcessReconnectMark(virDomainObjPtr obj);
+void qemuProcessReconnectUnmark(virDomainObjPtr obj);
+
 #endif /* __QEMU_PROCESSPRIV_H__ */
@@ -3458,13 +3458,15 @@ enum remote_procedure {
      *   <paramnumber> specifies at which offset the stream parameter is inserted
      *   in the function parameter list.
      *
-     * - @priority: low|high
+     * - @priority: low|high|urgent
      *
      *   Each API that might eventually access hypervisor's monitor (and thus
      *   block) MUST fall into low priority. However, there are some exceptions
      *   to this rule, e.g. domainDestroy. Other APIs MAY be marked as high
      *   priority. If in doubt, it's safe to choose low. Low is taken as default,
-     *   and thus can be left out.
+     *   and thus can be left out. Urgent APIs are handled like high priority
+     *   ones, but they are dispatched before any other queued calls. They
+     *   are reserved for APIs meant to recover from stuck guests.
      *
      * - @acl: <object>:<permission>
      * - @acl: <object>:<permission>:<flagname>
@@ -3563,7 +3565,7 @@ enum remote_procedure {
 
     /**
      * @generate: both
-     * @priority: high
+     * @priority: urgent
      * @acl: domain:stop
      */
     REMOTE_PROC_DOMAIN_DESTROY = 12,
@@ -5095,7 +5097,7 @@ enum remote_procedure {
 
     /**
      * @generate: both
-     * @priority: high
+     * @priority: urgent
      * @acl: domain:stop
      */
     REMOTE_PROC_DOMAIN_DESTROY_FLAGS = 234,
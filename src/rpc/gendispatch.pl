@@ -73,6 +73,7 @@ sub fixup_name {
     $name =~ s/Scsi/SCSI/;
     $name =~ s/Wwn$/WWN/;
     $name =~ s/Dhcp$/DHCP/;
+    $name =~ s/Rpc$/RPC/;
 
     return $name;
 }
@@ -291,10 +292,12 @@ while (<PROTOCOL>) {
         $calls{$name}->{acl} = $opts{acl};
         $calls{$name}->{aclfilter} = $opts{aclfilter};
 
-        # for now, we distinguish only two levels of priority:
-        # low (0) and high (1)
+        # the levels of priority map to virThreadPoolPriority:
+        # low (0), high (1) and urgent (2)
         if (exists $opts{priority}) {
-            if ($opts{priority} eq "high") {
+            if ($opts{priority} eq "urgent") {
+                $calls{$name}->{priority} = 2;
+            } elsif ($opts{priority} eq "high") {
                 $calls{$name}->{priority} = 1;
             } elsif ($opts{priority} eq "low") {
                 $calls{$name}->{priority} = 0;
@@ -1202,11 +1205,12 @@ elsif ($mode eq "server") {
 
     print "virNetServerProgramProc ${structprefix}Procs[] = {\n";
     for ($id = 0 ; $id <= $#calls ; $id++) {
-        my ($comment, $name, $argtype, $arglen, $argfilter, $retlen, $retfilter, $priority);
+        my ($comment, $name, $argtype, $arglen, $argfilter, $retlen, $retfilter, $priority, $procname);
 
         if (defined $calls[$id] && !$calls[$id]->{msg}) {
             $comment = "/* Method $calls[$id]->{ProcName} => $id */";
             $name = $structprefix . "Dispatch" . $calls[$id]->{ProcName} . "Helper";
+            $procname = "\"$structprefix.$calls[$id]->{ProcName}\"";
             my $argtype = $calls[$id]->{args};
             my $rettype = $calls[$id]->{ret};
             $arglen = $argtype ne "void" ? "sizeof($argtype)" : "0";
@@ -1220,6 +1224,7 @@ elsif ($mode eq "server") {
                 $comment = "/* Unused $id */";
             }
             $name = "NULL";
+            $procname = "NULL";
             $arglen = $retlen = 0;
             $argfilter = "xdr_void";
             $retfilter = "xdr_void";
@@ -1227,7 +1232,7 @@ elsif ($mode eq "server") {
 
     $priority = defined $calls[$id]->{priority} ? $calls[$id]->{priority} : 0;
 
-        print "{ $comment\n   ${name},\n   $arglen,\n   (xdrproc_t)$argfilter,\n   $retlen,\n   (xdrproc_t)$retfilter,\n   true,\n   $priority\n},\n";
+        print "{ $comment\n   ${name},\n   $arglen,\n   (xdrproc_t)$argfilter,\n   $retlen,\n   (xdrproc_t)$retfilter,\n   true,\n   $priority,\n   $procname\n},\n";
     }
     print "};\n";
     print "size_t ${structprefix}NProcs = ARRAY_CARDINALITY(${structprefix}Procs);\n";
@@ -346,7 +346,9 @@ int virNetClientStreamSendPacket(virNetClientStreamPtr st,
      * need a synchronous confirmation
      */
     if (status == VIR_NET_CONTINUE) {
-        if (virNetMessageEncodePayloadRaw(msg, data, nbytes) < 0)
+        /* Sending is synchronous, so @data outlives @msg being
+         * written out and doesn't have to be copied */
+        if (virNetMessageEncodePayloadRef(msg, data, nbytes) < 0)
             goto error;
 
         if (virNetClientSendNoReply(client, msg) < 0)
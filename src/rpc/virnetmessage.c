@@ -30,11 +30,85 @@
 #include "virfile.h"
 #include "virutil.h"
 #include "virstring.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_RPC
 
 VIR_LOG_INIT("rpc.netmessage");
 
+/* Stream data is sent in chunks of at most
+ * VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX bytes. Buffers of that size are
+ * big enough to be mmap()ed by malloc, so a few of them are kept around
+ * instead of being faulted in again for every chunk. */
+#define VIR_NET_MESSAGE_POOL_MAX 16
+
+static virMutex payloadPoolLock;
+static char *payloadPool[VIR_NET_MESSAGE_POOL_MAX];
+static size_t payloadPoolSize;
+
+static int
+virNetMessagePayloadPoolOnceInit(void)
+{
+    if (virMutexInit(&payloadPoolLock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize mutex"));
+        return -1;
+    }
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virNetMessagePayloadPool)
+
+
+/**
+ * virNetMessagePayloadAlloc:
+ *
+ * Returns a buffer of VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX bytes which
+ * can be handed over to virNetMessageEncodePayloadPooled(), or released
+ * with virNetMessagePayloadFree(). Returns NULL on error.
+ */
+char *
+virNetMessagePayloadAlloc(void)
+{
+    char *data = NULL;
+
+    if (virNetMessagePayloadPoolInitialize() < 0)
+        return NULL;
+
+    virMutexLock(&payloadPoolLock);
+    if (payloadPoolSize > 0)
+        data = payloadPool[--payloadPoolSize];
+    virMutexUnlock(&payloadPoolLock);
+
+    if (!data)
+        ignore_value(VIR_ALLOC_N(data, VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX));
+
+    return data;
+}
+
+
+void
+virNetMessagePayloadFree(char *data)
+{
+    if (!data)
+        return;
+
+    if (virNetMessagePayloadPoolInitialize() < 0) {
+        VIR_FREE(data);
+        return;
+    }
+
+    virMutexLock(&payloadPoolLock);
+    if (payloadPoolSize < VIR_NET_MESSAGE_POOL_MAX) {
+        payloadPool[payloadPoolSize++] = data;
+        data = NULL;
+    }
+    virMutexUnlock(&payloadPoolLock);
+
+    VIR_FREE(data);
+}
+
 virNetMessagePtr virNetMessageNew(bool tracked)
 {
     virNetMessagePtr msg;
@@ -64,6 +138,12 @@ virNetMessageClearPayload(virNetMessagePtr msg)
     msg->bufferOffset = 0;
     msg->bufferLength = 0;
     VIR_FREE(msg->buffer);
+
+    if (msg->payloadPooled)
+        virNetMessagePayloadFree((char *) msg->payload);
+    msg->payload = NULL;
+    msg->payloadLength = 0;
+    msg->payloadPooled = false;
 }
 
 
@@ -349,6 +429,9 @@ int virNetMessageEncodePayload(virNetMessagePtr msg,
 {
     XDR xdr;
     unsigned int msglen;
+#if HAVE_XDR_SIZEOF
+    bool sizeHinted = false;
+#endif
 
     /* Serialise payload of the message. This assumes that
      * virNetMessageEncodeHeader has already been run, so
@@ -361,6 +444,19 @@ int virNetMessageEncodePayload(virNetMessagePtr msg,
         unsigned int newlen = msg->bufferLength - VIR_NET_MESSAGE_LEN_MAX;
         newlen *= 2;
 
+#if HAVE_XDR_SIZEOF
+        /* Large payloads would be encoded over and over while the buffer
+         * doubles, rather find out how much is needed in one pass */
+        if (!sizeHinted) {
+            unsigned long long want = xdr_sizeof(filter, data);
+
+            sizeHinted = true;
+            want += msg->bufferOffset - VIR_NET_MESSAGE_LEN_MAX;
+            if (want > msg->bufferLength - VIR_NET_MESSAGE_LEN_MAX)
+                newlen = MIN(want, VIR_NET_MESSAGE_MAX + 1ULL);
+        }
+#endif
+
         if (newlen > VIR_NET_MESSAGE_MAX) {
             virReportError(VIR_ERR_RPC, "%s", _("Unable to encode message payload"));
             goto error;
@@ -508,6 +604,75 @@ int virNetMessageEncodePayloadEmpty(virNetMessagePtr msg)
 }
 
 
+/**
+ * virNetMessageEncodePayloadRef:
+ * @msg: the outgoing message, whose header was encoded
+ * @data: the payload
+ * @len: length of @data
+ *
+ * Like virNetMessageEncodePayloadRaw(), but rather than copying @data
+ * into the message buffer it is written out to the socket from where it
+ * is. The caller must keep @data around until the message is sent or
+ * freed.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNetMessageEncodePayloadRef(virNetMessagePtr msg,
+                              const char *data,
+                              size_t len)
+{
+    if (len > VIR_NET_MESSAGE_MAX + VIR_NET_MESSAGE_LEN_MAX -
+        msg->bufferOffset) {
+        virReportError(VIR_ERR_RPC,
+                       _("Stream data too long to send "
+                         "(%zu bytes needed, %zu bytes available)"),
+                       len,
+                       VIR_NET_MESSAGE_MAX +
+                       VIR_NET_MESSAGE_LEN_MAX -
+                       msg->bufferOffset);
+        return -1;
+    }
+
+    /* The length word accounts for the payload */
+    msg->bufferOffset += len;
+    if (virNetMessageEncodePayloadEmpty(msg) < 0) {
+        msg->bufferOffset -= len;
+        return -1;
+    }
+
+    msg->payload = data;
+    msg->payloadLength = len;
+    return 0;
+}
+
+
+/**
+ * virNetMessageEncodePayloadPooled:
+ * @msg: the outgoing message, whose header was encoded
+ * @data: pointer to a buffer from virNetMessagePayloadAlloc()
+ * @len: length of data in the buffer
+ *
+ * Like virNetMessageEncodePayloadRef(), but the message takes over the
+ * buffer and gives it back to the pool once it's done with it. @data is
+ * set to NULL on success.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNetMessageEncodePayloadPooled(virNetMessagePtr msg,
+                                 char **data,
+                                 size_t len)
+{
+    if (virNetMessageEncodePayloadRef(msg, *data, len) < 0)
+        return -1;
+
+    msg->payloadPooled = true;
+    *data = NULL;
+    return 0;
+}
+
+
 void virNetMessageSaveError(virNetMessageErrorPtr rerr)
 {
     /* This func may be called several times & the first
@@ -39,11 +39,23 @@ struct _virNetMessage {
     size_t bufferLength;
     size_t bufferOffset;
 
+    /* Outgoing payload kept out of @buffer to avoid copying it. It
+     * makes up the last @payloadLength bytes of the message, that is
+     * @bufferLength and @bufferOffset cover both @buffer and @payload */
+    const char *payload;
+    size_t payloadLength;
+    bool payloadPooled; /* @payload is released with the message */
+
     virNetMessageHeader header;
 
     virNetMessageFreeCallback cb;
     void *opaque;
 
+    /* Timestamps in microseconds used for latency accounting */
+    unsigned long long received; /* incoming message was read completely */
+    unsigned long long dispatched; /* a worker picked the call up */
+    unsigned long long queued;   /* reply was queued for transmission */
+
     size_t nfds;
     int *fds;
     size_t donefds;
@@ -91,6 +103,17 @@ int virNetMessageEncodePayloadRaw(virNetMessagePtr msg,
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
 int virNetMessageEncodePayloadEmpty(virNetMessagePtr msg)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
+int virNetMessageEncodePayloadRef(virNetMessagePtr msg,
+                                  const char *data,
+                                  size_t len)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
+int virNetMessageEncodePayloadPooled(virNetMessagePtr msg,
+                                     char **data,
+                                     size_t len)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_RETURN_CHECK;
+
+char *virNetMessagePayloadAlloc(void);
+void virNetMessagePayloadFree(char *data);
 
 void virNetMessageSaveError(virNetMessageErrorPtr rerr)
     ATTRIBUTE_NONNULL(1);
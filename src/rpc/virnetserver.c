@@ -69,6 +69,7 @@ struct _virNetServer {
     size_t nclients_max;                /* Max allowed clients count */
     size_t nclients_unauth;             /* Unauthenticated clients count */
     size_t nclients_unauth_max;         /* Max allowed unauth clients count */
+    size_t nrequests_client_ceiling;    /* Adaptive per-client request limit */
 
     int keepaliveInterval;
     unsigned int keepaliveCount;
@@ -297,6 +298,10 @@ int virNetServerAddClient(virNetServerPtr srv,
     virNetServerClientInitKeepAlive(client, srv->keepaliveInterval,
                                     srv->keepaliveCount);
 
+    if (srv->nrequests_client_ceiling)
+        virNetServerClientSetAdaptiveRequests(client,
+                                              srv->nrequests_client_ceiling);
+
     virObjectUnlock(srv);
     return 0;
 
@@ -360,10 +365,11 @@ virNetServerPtr virNetServerNew(const char *name,
         return NULL;
 
     if (max_workers &&
-        !(srv->workers = virThreadPoolNew(min_workers, max_workers,
-                                          priority_workers,
-                                          virNetServerHandleJob,
-                                          srv)))
+        !(srv->workers = virThreadPoolNewFlags(min_workers, max_workers,
+                                               priority_workers,
+                                               virNetServerHandleJob,
+                                               srv,
+                                               VIR_THREAD_POOL_PER_WORKER_QUEUES)))
         goto error;
 
     if (VIR_STRDUP(srv->name, name) < 0)
@@ -917,6 +923,16 @@ virNetServerGetThreadPoolParameters(virNetServerPtr srv,
     return 0;
 }
 
+int
+virNetServerGetThreadPoolStats(virNetServerPtr srv,
+                               virThreadPoolStatsPtr stats)
+{
+    virObjectLock(srv);
+    virThreadPoolGetStats(srv->workers, stats);
+    virObjectUnlock(srv);
+    return 0;
+}
+
 int
 virNetServerSetThreadPoolParameters(virNetServerPtr srv,
                                     long long int minWorkers,
@@ -1010,6 +1026,53 @@ virNetServerGetClients(virNetServerPtr srv,
     return ret;
 }
 
+int
+virNetServerGetPrograms(virNetServerPtr srv,
+                        virNetServerProgramPtr **progs)
+{
+    int ret = -1;
+    size_t i;
+    size_t nprograms = 0;
+    virNetServerProgramPtr *list = NULL;
+
+    virObjectLock(srv);
+
+    for (i = 0; i < srv->nprograms; i++) {
+        virNetServerProgramPtr prog = virObjectRef(srv->programs[i]);
+        if (VIR_APPEND_ELEMENT(list, nprograms, prog) < 0) {
+            virObjectUnref(prog);
+            goto cleanup;
+        }
+    }
+
+    *progs = list;
+    list = NULL;
+    ret = nprograms;
+
+ cleanup:
+    virObjectListFreeCount(list, nprograms);
+    virObjectUnlock(srv);
+    return ret;
+}
+
+/**
+ * virNetServerSetClientAdaptiveRequests:
+ * @srv: the server
+ * @ceiling: upper bound of per-client concurrent requests, 0 to disable
+ *
+ * Make the concurrent request limit of clients connecting from now on
+ * follow the observed service time, see
+ * virNetServerClientSetAdaptiveRequests.
+ */
+void
+virNetServerSetClientAdaptiveRequests(virNetServerPtr srv,
+                                      size_t ceiling)
+{
+    virObjectLock(srv);
+    srv->nrequests_client_ceiling = ceiling;
+    virObjectUnlock(srv);
+}
+
 virNetServerClientPtr
 virNetServerGetClient(virNetServerPtr srv,
                       unsigned long long id)
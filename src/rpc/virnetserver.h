@@ -32,6 +32,7 @@
 # include "virnetserverservice.h"
 # include "virobject.h"
 # include "virjson.h"
+# include "virthreadpool.h"
 
 
 virNetServerPtr virNetServerNew(const char *name,
@@ -98,6 +99,9 @@ int virNetServerGetThreadPoolParameters(virNetServerPtr srv,
                                         size_t *nPrioWorkers,
                                         size_t *jobQueueDepth);
 
+int virNetServerGetThreadPoolStats(virNetServerPtr srv,
+                                   virThreadPoolStatsPtr stats);
+
 int virNetServerSetThreadPoolParameters(virNetServerPtr srv,
                                         long long int minWorkers,
                                         long long int maxWorkers,
@@ -111,6 +115,12 @@ virNetServerClientPtr virNetServerGetClient(virNetServerPtr srv,
 int virNetServerGetClients(virNetServerPtr srv,
                            virNetServerClientPtr **clients);
 
+int virNetServerGetPrograms(virNetServerPtr srv,
+                            virNetServerProgramPtr **progs);
+
+void virNetServerSetClientAdaptiveRequests(virNetServerPtr srv,
+                                           size_t ceiling);
+
 size_t virNetServerGetMaxClients(virNetServerPtr srv);
 size_t virNetServerGetCurrentClients(virNetServerPtr srv);
 size_t virNetServerGetMaxUnauthClients(virNetServerPtr srv);
@@ -39,6 +39,7 @@
 #include "virprobe.h"
 #include "virstring.h"
 #include "virutil.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_RPC
 
@@ -99,6 +100,14 @@ struct _virNetServerClient
      * throttling calculations */
     size_t nrequests;
     size_t nrequests_max;
+    /* With adaptive limiting @nrequests_max floats between the
+     * configured limit @nrequests_floor and @nrequests_ceiling depending
+     * on how long the client's calls wait for a worker. Zero if adaptive
+     * limiting is disabled. */
+    size_t nrequests_floor;
+    size_t nrequests_ceiling;
+    unsigned long long waitAvg; /* moving average of queue wait in us */
+    size_t nsamples;            /* calls served since the last adjustment */
     /* Zero or one messages being received. Zero if
      * nrequests >= max_clients and throttling */
     virNetMessagePtr rx;
@@ -471,6 +480,8 @@ virNetServerClientPtr virNetServerClientNewPostExecRestart(virJSONValuePtr objec
     int auth;
     bool readonly;
     unsigned int nrequests_max;
+    unsigned int nrequests_floor = 0;
+    unsigned int nrequests_ceiling = 0;
     unsigned long long id;
     long long timestamp;
 
@@ -508,6 +519,25 @@ virNetServerClientPtr virNetServerClientNewPostExecRestart(virJSONValuePtr objec
         }
     }
 
+    if (virJSONValueObjectHasKey(object, "nrequests_ceiling") &&
+        virJSONValueObjectGetNumberUint(object, "nrequests_ceiling",
+                                        &nrequests_ceiling) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Malformed nrequests_ceiling field in JSON "
+                         "state document"));
+        return NULL;
+    }
+
+    if (!virJSONValueObjectHasKey(object, "nrequests_floor")) {
+        nrequests_floor = nrequests_max;
+    } else if (virJSONValueObjectGetNumberUint(object, "nrequests_floor",
+                                               &nrequests_floor) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Malformed nrequests_floor field in JSON "
+                         "state document"));
+        return NULL;
+    }
+
     if (!virJSONValueObjectHasKey(object, "conn_time")) {
         timestamp = 0;
     } else {
@@ -537,6 +567,8 @@ virNetServerClientPtr virNetServerClientNewPostExecRestart(virJSONValuePtr objec
         return NULL;
     }
     virObjectUnref(sock);
+    client->nrequests_floor = nrequests_floor;
+    client->nrequests_ceiling = nrequests_ceiling;
 
     if (privNew) {
         if (!(child = virJSONValueObjectGet(object, "privateData"))) {
@@ -579,6 +611,12 @@ virJSONValuePtr virNetServerClientPreExecRestart(virNetServerClientPtr client)
         goto error;
     if (virJSONValueObjectAppendNumberUint(object, "nrequests_max", client->nrequests_max) < 0)
         goto error;
+    if (client->nrequests_ceiling &&
+        (virJSONValueObjectAppendNumberUint(object, "nrequests_floor",
+                                            client->nrequests_floor) < 0 ||
+         virJSONValueObjectAppendNumberUint(object, "nrequests_ceiling",
+                                            client->nrequests_ceiling) < 0))
+        goto error;
 
     if (client->conn_time &&
         virJSONValueObjectAppendNumberLong(object, "conn_time",
@@ -903,6 +941,31 @@ void virNetServerClientSetDispatcher(virNetServerClientPtr client,
 }
 
 
+/**
+ * virNetServerClientSetAdaptiveRequests:
+ * @client: the client
+ * @ceiling: upper bound for the number of concurrent requests
+ *
+ * Let the client have more requests in flight than its configured limit,
+ * up to @ceiling, as long as its calls don't have to wait for a worker.
+ * The limit never drops below the one the client was created with.
+ * Passing zero keeps the current limit fixed.
+ */
+void virNetServerClientSetAdaptiveRequests(virNetServerClientPtr client,
+                                           size_t ceiling)
+{
+    virObjectLock(client);
+    if (!client->nrequests_ceiling)
+        client->nrequests_floor = client->nrequests_max;
+    else if (!ceiling)
+        client->nrequests_max = client->nrequests_floor;
+    client->nrequests_ceiling = ceiling;
+    client->nsamples = 0;
+    client->waitAvg = 0;
+    virObjectUnlock(client);
+}
+
+
 const char *virNetServerClientLocalAddrStringSASL(virNetServerClientPtr client)
 {
     if (!client->sock)
@@ -1224,6 +1287,7 @@ static void virNetServerClientDispatchRead(virNetServerClientPtr client)
 
         /* Definitely finished reading, so remove from queue */
         virNetMessageQueueServe(&client->rx);
+        ignore_value(virTimeMicrosNowRaw(&msg->received));
         PROBE(RPC_SERVER_CLIENT_MSG_RX,
               "client=%p len=%zu prog=%u vers=%u proc=%u type=%u status=%u serial=%u",
               client, msg->bufferLength,
@@ -1315,9 +1379,7 @@ static ssize_t virNetServerClientWrite(virNetServerClientPtr client)
     if (client->tx->bufferLength == client->tx->bufferOffset)
         return 1;
 
-    ret = virNetSocketWrite(client->sock,
-                            client->tx->buffer + client->tx->bufferOffset,
-                            client->tx->bufferLength - client->tx->bufferOffset);
+    ret = virNetSocketWriteMessage(client->sock, client->tx);
     if (ret <= 0)
         return ret; /* -1 error, 0 = egain */
 
@@ -1326,6 +1388,59 @@ static ssize_t virNetServerClientWrite(virNetServerClientPtr client)
 }
 
 
+/* Calls waiting longer than this for a worker on average mean that
+ * the workers are busy and the client must not get any more of them */
+#define VIR_NET_SERVER_CLIENT_MAX_QUEUE_WAIT 1000 /* us */
+
+/*
+ * Adjust the number of calls the client may have in flight after
+ * @msg, a reply, was sent. The time a call waits for a worker doesn't
+ * depend on what the call does, so unlike the time it takes to serve
+ * it, it can be compared across procedures. Every nrequests_max replies
+ * the limit is raised by one if calls were picked up quickly and it is
+ * halved otherwise, but it always stays within the configured limit
+ * and the ceiling.
+ */
+static void
+virNetServerClientAdaptRequests(virNetServerClientPtr client,
+                                virNetMessagePtr msg)
+{
+    unsigned long long sample;
+    size_t limit;
+
+    if (!client->nrequests_ceiling || !msg->received ||
+        msg->dispatched < msg->received)
+        return;
+
+    sample = msg->dispatched - msg->received;
+
+    if (!client->nsamples && !client->waitAvg)
+        client->waitAvg = sample;
+    else
+        client->waitAvg = (client->waitAvg * 7 + sample) / 8;
+
+    if (++client->nsamples < client->nrequests_max)
+        return;
+    client->nsamples = 0;
+
+    if (client->waitAvg <= VIR_NET_SERVER_CLIENT_MAX_QUEUE_WAIT)
+        limit = client->nrequests_max + 1;
+    else
+        limit = client->nrequests_max / 2;
+
+    if (limit > client->nrequests_ceiling)
+        limit = client->nrequests_ceiling;
+    if (limit < client->nrequests_floor)
+        limit = client->nrequests_floor;
+
+    if (limit != client->nrequests_max) {
+        VIR_DEBUG("client=%p nrequests_max=%zu -> %zu wait=%lluus",
+                  client, client->nrequests_max, limit, client->waitAvg);
+        client->nrequests_max = limit;
+    }
+}
+
+
 /*
  * Process all queued client->tx messages until
  * we would block on I/O
@@ -1375,11 +1490,16 @@ virNetServerClientDispatchWrite(virNetServerClientPtr client)
             msg = virNetMessageQueueServe(&client->tx);
 
             if (msg->tracked) {
+                virNetServerClientAdaptRequests(client, msg);
                 client->nrequests--;
                 /* See if the recv queue is currently throttled */
                 if (!client->rx &&
                     client->nrequests < client->nrequests_max) {
-                    /* Ready to recv more messages */
+                    /* Ready to recv more messages. The message is
+                     * done with, so let its owner know like it would
+                     * be freed. */
+                    if (msg->cb)
+                        msg->cb(msg, msg->opaque);
                     virNetMessageClear(msg);
                     msg->bufferLength = VIR_NET_MESSAGE_LEN_MAX;
                     if (VIR_ALLOC_N(msg->buffer, msg->bufferLength) < 0) {
@@ -138,6 +138,9 @@ bool virNetServerClientCheckKeepAlive(virNetServerClientPtr client,
                                       virNetMessagePtr msg);
 int virNetServerClientStartKeepAlive(virNetServerClientPtr client);
 
+void virNetServerClientSetAdaptiveRequests(virNetServerClientPtr client,
+                                           size_t ceiling);
+
 const char *virNetServerClientLocalAddrStringSASL(virNetServerClientPtr client);
 const char *virNetServerClientRemoteAddrStringSASL(virNetServerClientPtr client);
 const char *virNetServerClientRemoteAddrStringURI(virNetServerClientPtr client);
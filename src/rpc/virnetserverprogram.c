@@ -31,11 +31,19 @@
 #include "virlog.h"
 #include "virfile.h"
 #include "virthread.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_RPC
 
 VIR_LOG_INIT("rpc.netserverprogram");
 
+typedef struct _virNetServerProgramStats virNetServerProgramStats;
+typedef virNetServerProgramStats *virNetServerProgramStatsPtr;
+struct _virNetServerProgramStats {
+    virMutex lock;
+    virNetServerProgramProcStats stats;
+};
+
 struct _virNetServerProgram {
     virObject object;
 
@@ -43,8 +51,22 @@ struct _virNetServerProgram {
     unsigned version;
     virNetServerProgramProcPtr procs;
     size_t nprocs;
+
+    /* Per procedure latency statistics, one lock each so that
+     * concurrent calls of different procedures don't contend */
+    virNetServerProgramStatsPtr stats;
+    size_t nstats;
 };
 
+/* Marks phases not to be accounted by virNetServerProgramStatsRecord */
+#define VIR_NET_SERVER_PROGRAM_NO_TIME ULLONG_MAX
+
+static const unsigned long long virNetServerProgramLatencyBounds[] = {
+    100, 1000, 10 * 1000, 100 * 1000, 1000 * 1000,
+};
+verify(ARRAY_CARDINALITY(virNetServerProgramLatencyBounds) ==
+       VIR_NET_SERVER_PROGRAM_LATENCY_BUCKETS - 1);
+
 
 static virClassPtr virNetServerProgramClass;
 static void virNetServerProgramDispose(void *obj);
@@ -81,9 +103,24 @@ virNetServerProgramPtr virNetServerProgramNew(unsigned program,
     prog->procs = procs;
     prog->nprocs = nprocs;
 
+    if (VIR_ALLOC_N(prog->stats, nprocs) < 0)
+        goto error;
+
+    for (; prog->nstats < nprocs; prog->nstats++) {
+        if (virMutexInit(&prog->stats[prog->nstats].lock) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("Unable to initialize mutex"));
+            goto error;
+        }
+    }
+
     VIR_DEBUG("prog=%p", prog);
 
     return prog;
+
+ error:
+    virObjectUnref(prog);
+    return NULL;
 }
 
 
@@ -109,6 +146,12 @@ int virNetServerProgramMatches(virNetServerProgramPtr prog,
 }
 
 
+size_t virNetServerProgramGetNProcs(virNetServerProgramPtr prog)
+{
+    return prog->nprocs;
+}
+
+
 static virNetServerProgramProcPtr virNetServerProgramGetProc(virNetServerProgramPtr prog,
                                                              int procedure)
 {
@@ -139,6 +182,148 @@ virNetServerProgramGetPriority(virNetServerProgramPtr prog,
     return proc->priority;
 }
 
+
+/**
+ * virNetServerProgramGetProcStats:
+ * @prog: the program
+ * @procedure: procedure number
+ * @stats: filled with latency statistics of @procedure
+ *
+ * Returns the name of @procedure, or NULL if @prog has no such
+ * procedure or it has no name.
+ */
+const char *
+virNetServerProgramGetProcStats(virNetServerProgramPtr prog,
+                                int procedure,
+                                virNetServerProgramProcStatsPtr stats)
+{
+    virNetServerProgramProcPtr proc = virNetServerProgramGetProc(prog, procedure);
+
+    memset(stats, 0, sizeof(*stats));
+
+    if (!proc || !proc->name || procedure >= prog->nstats)
+        return NULL;
+
+    virMutexLock(&prog->stats[procedure].lock);
+    *stats = prog->stats[procedure].stats;
+    virMutexUnlock(&prog->stats[procedure].lock);
+
+    return proc->name;
+}
+
+
+/* Accounts the time spent by a call of @procedure in each phase listed
+ * in @elapsed, phases set to VIR_NET_SERVER_PROGRAM_NO_TIME are skipped.
+ * The call itself is counted when its queue phase is recorded. */
+static void
+virNetServerProgramStatsRecord(virNetServerProgramPtr prog,
+                               int procedure,
+                               const unsigned long long *elapsed)
+{
+    virNetServerProgramStatsPtr st;
+    size_t i;
+    size_t j;
+
+    if (procedure < 0 || procedure >= prog->nstats)
+        return;
+
+    st = &prog->stats[procedure];
+
+    virMutexLock(&st->lock);
+    if (elapsed[VIR_NET_SERVER_PROGRAM_PHASE_QUEUE] != VIR_NET_SERVER_PROGRAM_NO_TIME)
+        st->stats.calls++;
+
+    for (i = 0; i < VIR_NET_SERVER_PROGRAM_PHASE_LAST; i++) {
+        if (elapsed[i] == VIR_NET_SERVER_PROGRAM_NO_TIME)
+            continue;
+
+        for (j = 0; j < ARRAY_CARDINALITY(virNetServerProgramLatencyBounds); j++) {
+            if (elapsed[i] < virNetServerProgramLatencyBounds[j])
+                break;
+        }
+
+        st->stats.time[i] += elapsed[i];
+        st->stats.latency[i][j]++;
+    }
+    virMutexUnlock(&st->lock);
+}
+
+
+static unsigned long long
+virNetServerProgramElapsed(unsigned long long from,
+                           unsigned long long to)
+{
+    if (!from || to < from)
+        return 0;
+    return to - from;
+}
+
+
+/* Free callback of replies: accounts the time it took to send them */
+static void
+virNetServerProgramReplyFinished(virNetMessagePtr msg,
+                                 void *opaque)
+{
+    virNetServerProgramPtr prog = opaque;
+    unsigned long long elapsed[VIR_NET_SERVER_PROGRAM_PHASE_LAST];
+    unsigned long long now;
+    size_t i;
+
+    /* Replies dropped along with their client are not accounted */
+    if (msg->bufferLength &&
+        msg->bufferOffset == msg->bufferLength &&
+        virTimeMicrosNowRaw(&now) == 0) {
+        for (i = 0; i < VIR_NET_SERVER_PROGRAM_PHASE_LAST; i++)
+            elapsed[i] = VIR_NET_SERVER_PROGRAM_NO_TIME;
+        elapsed[VIR_NET_SERVER_PROGRAM_PHASE_REPLY] =
+            virNetServerProgramElapsed(msg->queued, now);
+
+        virNetServerProgramStatsRecord(prog, msg->header.proc, elapsed);
+    }
+
+    virObjectUnref(prog);
+}
+
+
+/* Records the phases of a call up to queuing its reply, which is
+ * accounted once sent */
+static void
+virNetServerProgramCallFinished(virNetServerProgramPtr prog,
+                                virNetMessagePtr msg,
+                                unsigned long long start,
+                                unsigned long long driverStart,
+                                unsigned long long driverEnd)
+{
+    unsigned long long elapsed[VIR_NET_SERVER_PROGRAM_PHASE_LAST];
+    unsigned long long end;
+
+    if (virTimeMicrosNowRaw(&end) < 0)
+        return;
+
+    /* The procedure might have failed before even being called */
+    if (!driverStart)
+        driverStart = driverEnd = end;
+
+    elapsed[VIR_NET_SERVER_PROGRAM_PHASE_QUEUE] =
+        virNetServerProgramElapsed(msg->received, start);
+    elapsed[VIR_NET_SERVER_PROGRAM_PHASE_DISPATCH] =
+        virNetServerProgramElapsed(start, driverStart) +
+        virNetServerProgramElapsed(driverEnd, end);
+    elapsed[VIR_NET_SERVER_PROGRAM_PHASE_DRIVER] =
+        virNetServerProgramElapsed(driverStart, driverEnd);
+    elapsed[VIR_NET_SERVER_PROGRAM_PHASE_REPLY] = VIR_NET_SERVER_PROGRAM_NO_TIME;
+
+    virNetServerProgramStatsRecord(prog, msg->header.proc, elapsed);
+
+    msg->dispatched = start;
+
+    if (!msg->cb) {
+        msg->queued = end;
+        msg->cb = virNetServerProgramReplyFinished;
+        msg->opaque = virObjectRef(prog);
+    }
+}
+
 static int
 virNetServerProgramSendError(unsigned program,
                              unsigned version,
@@ -374,13 +559,18 @@ virNetServerProgramDispatchCall(virNetServerProgramPtr prog,
     char *arg = NULL;
     char *ret = NULL;
     int rv = -1;
-    virNetServerProgramProcPtr dispatcher;
+    virNetServerProgramProcPtr dispatcher = NULL;
     virNetMessageError rerr;
     size_t i;
     virIdentityPtr identity = NULL;
+    unsigned long long start = 0;
+    unsigned long long driverStart = 0;
+    unsigned long long driverEnd = 0;
 
     memset(&rerr, 0, sizeof(rerr));
 
+    ignore_value(virTimeMicrosNowRaw(&start));
+
     if (msg->header.status != VIR_NET_OK) {
         virReportError(VIR_ERR_RPC,
                        _("Unexpected message status %u"),
@@ -434,7 +624,9 @@ virNetServerProgramDispatchCall(virNetServerProgramPtr prog,
      *
      *   'args and 'ret'
      */
+    ignore_value(virTimeMicrosNowRaw(&driverStart));
     rv = (dispatcher->func)(server, client, msg, &rerr, arg, ret);
+    ignore_value(virTimeMicrosNowRaw(&driverEnd));
 
     if (virIdentitySetCurrent(NULL) < 0)
         goto error;
@@ -490,10 +682,14 @@ virNetServerProgramDispatchCall(virNetServerProgramPtr prog,
     VIR_FREE(ret);
 
     virObjectUnref(identity);
+    virNetServerProgramCallFinished(prog, msg, start, driverStart, driverEnd);
     /* Put reply on end of tx queue to send out  */
     return virNetServerClientSendMessage(client, msg);
 
  error:
+    if (dispatcher)
+        virNetServerProgramCallFinished(prog, msg, start, driverStart, driverEnd);
+
     /* Bad stuff (de-)serializing message, but we have an
      * RPC error message we can send back to the client */
     rv = virNetServerProgramSendReplyError(prog, client, msg, &rerr, &msg->header);
@@ -506,16 +702,13 @@ virNetServerProgramDispatchCall(virNetServerProgramPtr prog,
 }
 
 
-int virNetServerProgramSendStreamData(virNetServerProgramPtr prog,
-                                      virNetServerClientPtr client,
-                                      virNetMessagePtr msg,
-                                      int procedure,
-                                      unsigned int serial,
-                                      const char *data,
-                                      size_t len)
+static void
+virNetServerProgramSetStreamHeader(virNetServerProgramPtr prog,
+                                   virNetMessagePtr msg,
+                                   int procedure,
+                                   unsigned int serial,
+                                   const char *data)
 {
-    VIR_DEBUG("client=%p msg=%p data=%p len=%zu", client, msg, data, len);
-
     /* Return header. We're reusing same message object, so
      * only need to tweak type/status fields */
     msg->header.prog = prog->program;
@@ -530,6 +723,20 @@ int virNetServerProgramSendStreamData(virNetServerProgramPtr prog,
      *   data == NULL              => VIR_NET_OK         (Sending finish handshake confirmation)
      */
     msg->header.status = data ? VIR_NET_CONTINUE : VIR_NET_OK;
+}
+
+
+int virNetServerProgramSendStreamData(virNetServerProgramPtr prog,
+                                      virNetServerClientPtr client,
+                                      virNetMessagePtr msg,
+                                      int procedure,
+                                      unsigned int serial,
+                                      const char *data,
+                                      size_t len)
+{
+    VIR_DEBUG("client=%p msg=%p data=%p len=%zu", client, msg, data, len);
+
+    virNetServerProgramSetStreamHeader(prog, msg, procedure, serial, data);
 
     if (virNetMessageEncodeHeader(msg) < 0)
         return -1;
@@ -548,6 +755,34 @@ int virNetServerProgramSendStreamData(virNetServerProgramPtr prog,
 }
 
 
+/*
+ * Same as virNetServerProgramSendStreamData, but @data is a buffer
+ * from virNetMessagePayloadAlloc() which is sent without being copied
+ * and given back to the pool once sent. @data is set to NULL if
+ * the message took it over.
+ */
+int virNetServerProgramSendStreamDataPooled(virNetServerProgramPtr prog,
+                                            virNetServerClientPtr client,
+                                            virNetMessagePtr msg,
+                                            int procedure,
+                                            unsigned int serial,
+                                            char **data,
+                                            size_t len)
+{
+    VIR_DEBUG("client=%p msg=%p data=%p len=%zu", client, msg, *data, len);
+
+    virNetServerProgramSetStreamHeader(prog, msg, procedure, serial, *data);
+
+    if (virNetMessageEncodeHeader(msg) < 0 ||
+        virNetMessageEncodePayloadPooled(msg, data, len) < 0)
+        return -1;
+
+    VIR_DEBUG("Total %zu", msg->bufferLength);
+
+    return virNetServerClientSendMessage(client, msg);
+}
+
+
 int virNetServerProgramSendStreamHole(virNetServerProgramPtr prog,
                                       virNetServerClientPtr client,
                                       virNetMessagePtr msg,
@@ -583,6 +818,12 @@ int virNetServerProgramSendStreamHole(virNetServerProgramPtr prog,
 }
 
 
-void virNetServerProgramDispose(void *obj ATTRIBUTE_UNUSED)
+void virNetServerProgramDispose(void *obj)
 {
+    virNetServerProgramPtr prog = obj;
+    size_t i;
+
+    for (i = 0; i < prog->nstats; i++)
+        virMutexDestroy(&prog->stats[i].lock);
+    VIR_FREE(prog->stats);
 }
@@ -58,6 +58,28 @@ struct _virNetServerProgramProc {
     xdrproc_t ret_filter;
     bool needAuth;
     unsigned int priority;
+    const char *name;
+};
+
+typedef enum {
+    VIR_NET_SERVER_PROGRAM_PHASE_QUEUE,    /* waiting for a worker */
+    VIR_NET_SERVER_PROGRAM_PHASE_DISPATCH, /* decoding and encoding */
+    VIR_NET_SERVER_PROGRAM_PHASE_DRIVER,   /* running the procedure */
+    VIR_NET_SERVER_PROGRAM_PHASE_REPLY,    /* sending the reply */
+
+    VIR_NET_SERVER_PROGRAM_PHASE_LAST
+} virNetServerProgramPhase;
+
+/* Calls taking less than 100us, 1ms, 10ms, 100ms, 1s and longer */
+# define VIR_NET_SERVER_PROGRAM_LATENCY_BUCKETS 6
+
+typedef struct _virNetServerProgramProcStats virNetServerProgramProcStats;
+typedef virNetServerProgramProcStats *virNetServerProgramProcStatsPtr;
+struct _virNetServerProgramProcStats {
+    unsigned long long calls;
+    /* total time spent in each phase in microseconds */
+    unsigned long long time[VIR_NET_SERVER_PROGRAM_PHASE_LAST];
+    unsigned long long latency[VIR_NET_SERVER_PROGRAM_PHASE_LAST][VIR_NET_SERVER_PROGRAM_LATENCY_BUCKETS];
 };
 
 virNetServerProgramPtr virNetServerProgramNew(unsigned program,
@@ -71,6 +93,12 @@ int virNetServerProgramGetVersion(virNetServerProgramPtr prog);
 unsigned int virNetServerProgramGetPriority(virNetServerProgramPtr prog,
                                             int procedure);
 
+size_t virNetServerProgramGetNProcs(virNetServerProgramPtr prog);
+
+const char *virNetServerProgramGetProcStats(virNetServerProgramPtr prog,
+                                            int procedure,
+                                            virNetServerProgramProcStatsPtr stats);
+
 int virNetServerProgramMatches(virNetServerProgramPtr prog,
                                virNetMessagePtr msg);
 
@@ -103,6 +131,13 @@ int virNetServerProgramSendStreamData(virNetServerProgramPtr prog,
                                       unsigned int serial,
                                       const char *data,
                                       size_t len);
+int virNetServerProgramSendStreamDataPooled(virNetServerProgramPtr prog,
+                                            virNetServerClientPtr client,
+                                            virNetMessagePtr msg,
+                                            int procedure,
+                                            unsigned int serial,
+                                            char **data,
+                                            size_t len);
 
 int virNetServerProgramSendStreamHole(virNetServerProgramPtr prog,
                                       virNetServerClientPtr client,
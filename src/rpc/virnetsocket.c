@@ -29,6 +29,9 @@
 #include <sys/wait.h>
 #include <signal.h>
 #include <fcntl.h>
+#ifndef WIN32
+# include <sys/uio.h>
+#endif
 #ifdef HAVE_IFADDRS_H
 # include <ifaddrs.h>
 #endif
@@ -1989,6 +1992,94 @@ ssize_t virNetSocketWrite(virNetSocketPtr sock, const char *buf, size_t len)
 }
 
 
+#ifndef WIN32
+/* Whether data goes to the socket unmodified */
+static bool
+virNetSocketIsPlain(virNetSocketPtr sock)
+{
+# if WITH_GNUTLS
+    if (sock->tlsSession)
+        return false;
+# endif
+# if WITH_SASL
+    if (sock->saslSession)
+        return false;
+# endif
+# if WITH_SSH2
+    if (sock->sshSession)
+        return false;
+# endif
+# if WITH_LIBSSH
+    if (sock->libsshSession)
+        return false;
+# endif
+    return true;
+}
+#endif
+
+
+/**
+ * virNetSocketWriteMessage:
+ * @sock: socket to write to
+ * @msg: outgoing message
+ *
+ * Writes the rest of @msg starting at its bufferOffset. A payload which
+ * is kept outside of the message buffer is sent along with it in a
+ * single writev() call if the socket doesn't need the data transformed.
+ *
+ * Returns the number of bytes written, 0 if it would block, -1 on error.
+ */
+ssize_t
+virNetSocketWriteMessage(virNetSocketPtr sock,
+                         virNetMessagePtr msg)
+{
+    size_t headLength = msg->bufferLength - msg->payloadLength;
+    ssize_t ret;
+
+    if (msg->bufferOffset >= headLength) {
+        size_t offset = msg->bufferOffset - headLength;
+
+        return virNetSocketWrite(sock, msg->payload + offset,
+                                 msg->payloadLength - offset);
+    }
+
+#ifndef WIN32
+    virObjectLock(sock);
+    if (msg->payloadLength && virNetSocketIsPlain(sock)) {
+        struct iovec iov[2];
+
+        iov[0].iov_base = msg->buffer + msg->bufferOffset;
+        iov[0].iov_len = headLength - msg->bufferOffset;
+        iov[1].iov_base = (char *) msg->payload;
+        iov[1].iov_len = msg->payloadLength;
+
+ rewrite:
+        if ((ret = writev(sock->fd, iov, ARRAY_CARDINALITY(iov))) < 0) {
+            if (errno == EINTR)
+                goto rewrite;
+            if (errno == EAGAIN) {
+                ret = 0;
+            } else {
+                virReportSystemError(errno, "%s",
+                                     _("Cannot write data"));
+            }
+        } else if (ret == 0) {
+            virReportSystemError(EIO, "%s",
+                                 _("End of file while writing data"));
+            ret = -1;
+        }
+        virObjectUnlock(sock);
+        return ret;
+    }
+    virObjectUnlock(sock);
+#endif
+
+    /* Encrypted or tunnelled data is written one buffer at a time */
+    return virNetSocketWrite(sock, msg->buffer + msg->bufferOffset,
+                             headLength - msg->bufferOffset);
+}
+
+
 /*
  * Returns 1 if an FD was sent, 0 if it would block, -1 on error
  */
@@ -2456,6 +2456,7 @@ storageVolWipePattern(virStorageVolPtr vol,
     virStorageBackendPtr backend;
     virStoragePoolObjPtr obj = NULL;
     virStorageVolDefPtr voldef = NULL;
+    int wiperet;
     int ret = -1;
 
     virCheckFlags(0, -1);
@@ -2493,8 +2494,33 @@ storageVolWipePattern(virStorageVolPtr vol,
         goto cleanup;
     }
 
-    if (backend->wipeVol(vol->conn, obj, voldef, algorithm, flags) < 0)
+    /* Drop the pool lock while wiping. Backends which report progress
+     * publish it as the allocation of the volume, see
+     * storageVolGetInfoFlags. */
+    obj->asyncjobs++;
+    voldef->in_use++;
+    virStoragePoolObjUnlock(obj);
+
+    wiperet = backend->wipeVol(vol->conn, obj, voldef, algorithm, flags);
+
+    storageDriverLock();
+    virStoragePoolObjLock(obj);
+    storageDriverUnlock();
+
+    voldef->in_use--;
+    obj->asyncjobs--;
+
+    if (wiperet < 0) {
+        virErrorPtr orig_err = virSaveLastError();
+
+        /* Get rid of the progress in the allocation */
+        ignore_value(virStorageBackendVolWipeDone(voldef));
+        virSetError(orig_err);
+        virFreeError(orig_err);
         goto cleanup;
+    }
+
+    voldef->wiping = false;
 
     /* Instead of using the refreshVol, since much changes on the target
      * volume, let's update using the same function as refreshPool would
@@ -2537,7 +2563,8 @@ storageVolGetInfoFlags(virStorageVolPtr vol,
     if (virStorageVolGetInfoFlagsEnsureACL(vol->conn, obj->def, voldef) < 0)
         goto cleanup;
 
-    if (backend->refreshVol &&
+    /* While wiping, the allocation tracks the progress of the wipe */
+    if (backend->refreshVol && !voldef->wiping &&
         backend->refreshVol(vol->conn, obj, voldef) < 0)
         goto cleanup;
 
@@ -2581,7 +2608,7 @@ storageVolGetXMLDesc(virStorageVolPtr vol,
     if (virStorageVolGetXMLDescEnsureACL(vol->conn, obj->def, voldef) < 0)
         goto cleanup;
 
-    if (backend->refreshVol &&
+    if (backend->refreshVol && !voldef->wiping &&
         backend->refreshVol(vol->conn, obj, voldef) < 0)
         goto cleanup;
 
@@ -31,12 +31,38 @@
 #include "virlog.h"
 #include "virstring.h"
 #include "virhash.h"
+#include "virthread.h"
+#include "stat-time.h"
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
 VIR_LOG_INIT("storage.storage_source");
 
 
+/* Headers of local images read while probing backing chains are cached,
+ * keyed by the identity and timestamp of the file, so that images shared
+ * by many chains or probed repeatedly are read only once. */
+typedef struct _virStorageFileMetadataCacheEntry virStorageFileMetadataCacheEntry;
+typedef virStorageFileMetadataCacheEntry *virStorageFileMetadataCacheEntryPtr;
+struct _virStorageFileMetadataCacheEntry {
+    char *path;
+    char *buf;
+    ssize_t len;
+};
+
+/* The whole cache is dropped once it grows this big */
+#define VIR_STORAGE_FILE_METADATA_CACHE_MAX 1024
+
+/* Files modified less than this many seconds ago might still change
+ * without their timestamp changing, so they are not cached */
+#define VIR_STORAGE_FILE_METADATA_CACHE_SETTLE 2
+
+static virMutex virStorageFileMetadataCacheLock = VIR_MUTEX_INITIALIZER;
+static virHashTablePtr virStorageFileMetadataCache;
+static unsigned long long virStorageFileMetadataCacheHits;
+static unsigned long long virStorageFileMetadataCacheMisses;
+
+
 static bool
 virStorageFileIsInitialized(const virStorageSource *src)
 {
@@ -389,6 +415,190 @@ virStorageFileChown(const virStorageSource *src,
 }
 
 
+static void
+virStorageFileMetadataCacheEntryFree(void *payload,
+                                     const void *name ATTRIBUTE_UNUSED)
+{
+    virStorageFileMetadataCacheEntryPtr entry = payload;
+
+    if (!entry)
+        return;
+
+    VIR_FREE(entry->path);
+    VIR_FREE(entry->buf);
+    VIR_FREE(entry);
+}
+
+
+static char *
+virStorageFileMetadataCacheKey(const char *path,
+                               const struct stat *st)
+{
+    struct timespec mtime = get_stat_mtime(st);
+    char *key;
+
+    ignore_value(virAsprintf(&key, "%llu:%llu:%lld.%09ld:%lld:%s",
+                             (unsigned long long)st->st_dev,
+                             (unsigned long long)st->st_ino,
+                             (long long)mtime.tv_sec, mtime.tv_nsec,
+                             (long long)st->st_size, path));
+    return key;
+}
+
+
+/* Reads the header of @src, preferring a cached copy if the file didn't
+ * change since it was last read. Returns the length of the header stored
+ * into @buf, or -1 on error. */
+static ssize_t
+virStorageFileReadHeader(virStorageSourcePtr src,
+                         char **buf)
+{
+    virStorageFileMetadataCacheEntryPtr entry = NULL;
+    struct stat st;
+    char *key = NULL;
+    ssize_t ret = -1;
+
+    /* Block devices and remote storage may change without any trace
+     * in their timestamps */
+    if (virStorageSourceGetActualType(src) != VIR_STORAGE_TYPE_FILE ||
+        virStorageFileStat(src, &st) < 0 ||
+        !S_ISREG(st.st_mode) ||
+        !(key = virStorageFileMetadataCacheKey(src->path, &st))) {
+        virResetLastError();
+        return virStorageFileRead(src, 0, VIR_STORAGE_MAX_HEADER, buf);
+    }
+
+    virMutexLock(&virStorageFileMetadataCacheLock);
+    if (virStorageFileMetadataCache &&
+        (entry = virHashLookup(virStorageFileMetadataCache, key))) {
+        if (VIR_ALLOC_N(*buf, entry->len) == 0) {
+            memcpy(*buf, entry->buf, entry->len);
+            ret = entry->len;
+        }
+        entry = NULL;
+    }
+    virMutexUnlock(&virStorageFileMetadataCacheLock);
+
+    if (ret >= 0) {
+        /* The header may have been cached on behalf of another user, so
+         * only hand it out if the caller could read the file itself */
+        if (virStorageFileAccess(src, R_OK) == 0) {
+            virMutexLock(&virStorageFileMetadataCacheLock);
+            virStorageFileMetadataCacheHits++;
+            virMutexUnlock(&virStorageFileMetadataCacheLock);
+            goto cleanup;
+        }
+        VIR_FREE(*buf);
+        ret = -1;
+    }
+
+    virMutexLock(&virStorageFileMetadataCacheLock);
+    virStorageFileMetadataCacheMisses++;
+    virMutexUnlock(&virStorageFileMetadataCacheLock);
+
+    /* Reading the file reports the appropriate error if the access
+     * check above failed */
+    if ((ret = virStorageFileRead(src, 0, VIR_STORAGE_MAX_HEADER, buf)) < 0)
+        goto cleanup;
+
+    if (get_stat_mtime(&st).tv_sec + VIR_STORAGE_FILE_METADATA_CACHE_SETTLE >
+        time(NULL))
+        goto cleanup;
+
+    if (VIR_ALLOC(entry) < 0 ||
+        VIR_STRDUP(entry->path, src->path) < 0 ||
+        VIR_ALLOC_N(entry->buf, ret) < 0)
+        goto error;
+    memcpy(entry->buf, *buf, ret);
+    entry->len = ret;
+
+    virMutexLock(&virStorageFileMetadataCacheLock);
+    if (!virStorageFileMetadataCache &&
+        !(virStorageFileMetadataCache =
+          virHashCreate(32, virStorageFileMetadataCacheEntryFree))) {
+        virMutexUnlock(&virStorageFileMetadataCacheLock);
+        goto error;
+    }
+
+    if (virHashSize(virStorageFileMetadataCache) >=
+        VIR_STORAGE_FILE_METADATA_CACHE_MAX)
+        virHashRemoveAll(virStorageFileMetadataCache);
+
+    if (virHashUpdateEntry(virStorageFileMetadataCache, key, entry) < 0) {
+        virMutexUnlock(&virStorageFileMetadataCacheLock);
+        goto error;
+    }
+    entry = NULL;
+    virMutexUnlock(&virStorageFileMetadataCacheLock);
+
+ cleanup:
+    VIR_FREE(key);
+    return ret;
+
+ error:
+    /* Failing to cache the header is not fatal */
+    virResetLastError();
+    virStorageFileMetadataCacheEntryFree(entry, NULL);
+    goto cleanup;
+}
+
+
+static int
+virStorageFileMetadataCacheMatchPath(const void *payload,
+                                     const void *name ATTRIBUTE_UNUSED,
+                                     const void *data)
+{
+    const virStorageFileMetadataCacheEntry *entry = payload;
+
+    return STREQ(entry->path, data);
+}
+
+
+/**
+ * virStorageFileMetadataCacheInvalidate:
+ * @src: top of a backing chain
+ *
+ * Drops cached headers of all images in the backing chain of @src. To be
+ * used whenever the chain was rewritten, e.g. after a block job, as the
+ * timestamps of the files might not reflect the change yet.
+ */
+void
+virStorageFileMetadataCacheInvalidate(virStorageSourcePtr src)
+{
+    virStorageSourcePtr n;
+
+    virMutexLock(&virStorageFileMetadataCacheLock);
+    if (virStorageFileMetadataCache) {
+        for (n = src; n; n = n->backingStore) {
+            if (!n->path)
+                continue;
+            virHashRemoveSet(virStorageFileMetadataCache,
+                             virStorageFileMetadataCacheMatchPath,
+                             n->path);
+        }
+    }
+    virMutexUnlock(&virStorageFileMetadataCacheLock);
+}
+
+
+/**
+ * virStorageFileMetadataCacheGetStats:
+ * @hits: filled with the number of headers served from the cache
+ * @misses: filled with the number of headers which had to be read
+ *
+ * Reports how efficient the backing chain metadata cache is.
+ */
+void
+virStorageFileMetadataCacheGetStats(unsigned long long *hits,
+                                    unsigned long long *misses)
+{
+    virMutexLock(&virStorageFileMetadataCacheLock);
+    *hits = virStorageFileMetadataCacheHits;
+    *misses = virStorageFileMetadataCacheMisses;
+    virMutexUnlock(&virStorageFileMetadataCacheLock);
+}
+
+
 /* Recursive workhorse for virStorageFileGetMetadata.  */
 static int
 virStorageFileGetMetadataRecurse(virStorageSourcePtr src,
@@ -447,8 +657,7 @@ virStorageFileGetMetadataRecurse(virStorageSourcePtr src,
     if (virHashAddEntry(cycle, uniqueName, (void *)1) < 0)
         goto cleanup;
 
-    if ((headerLen = virStorageFileRead(src, 0, VIR_STORAGE_MAX_HEADER,
-                                        &buf)) < 0)
+    if ((headerLen = virStorageFileReadHeader(src, &buf)) < 0)
         goto cleanup;
 
     if (virStorageFileGetMetadataInternal(src, buf, headerLen,
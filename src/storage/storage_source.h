@@ -48,6 +48,11 @@ int virStorageFileGetMetadata(virStorageSourcePtr src,
                               bool report_broken)
     ATTRIBUTE_NONNULL(1);
 
+void virStorageFileMetadataCacheInvalidate(virStorageSourcePtr src);
+void virStorageFileMetadataCacheGetStats(unsigned long long *hits,
+                                         unsigned long long *misses)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+
 char *virStorageFileGetBackingStoreStr(virStorageSourcePtr src)
     ATTRIBUTE_NONNULL(1);
 
@@ -68,6 +68,7 @@
 #include "virstring.h"
 #include "virxml.h"
 #include "virfdstream.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
@@ -77,42 +78,246 @@ VIR_LOG_INIT("storage.storage_util");
 #define WRITE_BLOCK_SIZE_DEFAULT (4 * 1024)
 
 /*
- * Perform the O(1) btrfs clone operation, if possible.
+ * Perform the O(1) reflink clone operation, if possible.  FICLONE is the
+ * generic name of the btrfs ioctl which other file systems such as XFS
+ * implement as well.
  * Upon success, return 0.  Otherwise, return -1 and set errno.
  */
-#if HAVE_LINUX_BTRFS_H
+#if defined(__linux__) && defined(FICLONE)
+static inline int
+reflinkCloneFile(int dest_fd, int src_fd)
+{
+    return ioctl(dest_fd, FICLONE, src_fd);
+}
+#elif HAVE_LINUX_BTRFS_H
 static inline int
-btrfsCloneFile(int dest_fd, int src_fd)
+reflinkCloneFile(int dest_fd, int src_fd)
 {
     return ioctl(dest_fd, BTRFS_IOC_CLONE, src_fd);
 }
 #else
 static inline int
-btrfsCloneFile(int dest_fd ATTRIBUTE_UNUSED,
-               int src_fd ATTRIBUTE_UNUSED)
+reflinkCloneFile(int dest_fd ATTRIBUTE_UNUSED,
+                 int src_fd ATTRIBUTE_UNUSED)
 {
     errno = ENOTSUP;
     return -1;
 }
 #endif
 
-static int ATTRIBUTE_NONNULL(2)
+/*
+ * Check whether @buf contains only zeroes.  Once the first few bytes are
+ * known to be zero, comparing the buffer against itself shifted by that
+ * amount covers the rest, which lets the vectorized memcmp() of the C
+ * library do the work without streaming a second, zeroed buffer through
+ * the cache.
+ */
+static bool
+storageBackendBufferIsZero(const char *buf,
+                           size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len && i < 16; i++) {
+        if (buf[i])
+            return false;
+    }
+
+    if (len <= 16)
+        return true;
+
+    return memcmp(buf, buf + 16, len - 16) == 0;
+}
+
+/*
+ * Find out whether the extent of @inputfd starting at @pos is data or a
+ * hole and how long it is.  The file position is left at @pos.
+ * Returns 0 on success, 1 if @pos is at or past the end of the file, or
+ * -1 with errno set if holes can't be told apart from data.
+ */
+static int
+storageBackendFindExtent(int inputfd,
+                         off_t pos,
+                         off_t size,
+                         bool *isdata,
+                         off_t *len)
+{
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+    off_t next;
+
+    if (pos >= size)
+        return 1;
+
+    if ((next = lseek(inputfd, pos, SEEK_DATA)) < 0) {
+        if (errno != ENXIO)
+            return -1;
+        /* Nothing but a hole up to the end of the file */
+        next = size;
+    }
+
+    if (next > pos) {
+        *isdata = false;
+        *len = next - pos;
+    } else {
+        if ((next = lseek(inputfd, pos, SEEK_HOLE)) < 0)
+            return -1;
+        *isdata = true;
+        *len = next - pos;
+    }
+
+    if (lseek(inputfd, pos, SEEK_SET) < 0)
+        return -1;
+
+    return 0;
+#else
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+/*
+ * Copy up to @len bytes through @buf, skipping @wbytes sized blocks of
+ * zeroes if @want_sparse.  Returns 0 on success and -errno on failure,
+ * @done is set to the number of bytes consumed which is less than @len
+ * only at the end of the input.
+ */
+static int
+storageBackendCopyUserspace(virStorageVolDefPtr vol,
+                            virStorageVolDefPtr inputvol,
+                            int inputfd,
+                            int fd,
+                            char *buf,
+                            size_t bufsize,
+                            size_t wbytes,
+                            unsigned long long len,
+                            bool want_sparse,
+                            virStorageBackendCopyStatsPtr stats,
+                            unsigned long long *done)
+{
+    *done = 0;
+
+    while (*done < len) {
+        size_t rbytes = MIN(bufsize, len - *done);
+        ssize_t amtread;
+        size_t offset;
+        size_t interval;
+
+        if ((amtread = saferead(inputfd, buf, rbytes)) < 0) {
+            virReportSystemError(errno,
+                                 _("failed reading from file '%s'"),
+                                 inputvol->target.path);
+            return -errno;
+        }
+
+        if (amtread == 0)
+            break;
+
+        stats->read += amtread;
+        *done += amtread;
+
+        for (offset = 0; offset < (size_t) amtread; offset += interval) {
+            interval = MIN(wbytes, amtread - offset);
+
+            if (want_sparse &&
+                storageBackendBufferIsZero(buf + offset, interval)) {
+                if (lseek(fd, interval, SEEK_CUR) < 0) {
+                    virReportSystemError(errno,
+                                         _("cannot extend file '%s'"),
+                                         vol->target.path);
+                    return -errno;
+                }
+                stats->skipped += interval;
+            } else {
+                if (safewrite(fd, buf + offset, interval) < 0) {
+                    virReportSystemError(errno,
+                                         _("failed writing to file '%s'"),
+                                         vol->target.path);
+                    return -errno;
+                }
+                stats->written += interval;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Let the kernel copy up to @len bytes, which allows the file system to
+ * share extents or offload the copy to the storage.  Returns 0 on
+ * success, 1 if the kernel can't copy between the two files, or -errno
+ * on failure.  @done is set as for storageBackendCopyUserspace.
+ */
+static int
+storageBackendCopyKernel(virStorageVolDefPtr vol,
+                         virStorageVolDefPtr inputvol,
+                         int inputfd,
+                         int fd,
+                         unsigned long long len,
+                         virStorageBackendCopyStatsPtr stats,
+                         unsigned long long *done)
+{
+    *done = 0;
+
+    while (*done < len) {
+        size_t chunk = MIN(len - *done, 1ULL << 30);
+        ssize_t amt;
+
+        if ((amt = virFileZeroCopy(inputfd, fd, chunk)) == -2)
+            return 1;
+
+        if (amt < 0) {
+            virReportSystemError(errno,
+                                 _("failed to copy '%s' to '%s'"),
+                                 inputvol->target.path, vol->target.path);
+            return -errno;
+        }
+
+        if (amt == 0)
+            break;
+
+        stats->copied += amt;
+        *done += amt;
+    }
+
+    return 0;
+}
+
+/*
+ * Copy the contents of @inputvol to @fd, up to *@total bytes, reducing
+ * *@total by the amount copied.  Holes in the input found via SEEK_DATA
+ * and SEEK_HOLE are skipped without reading them if @want_sparse.  The
+ * data is then copied by the kernel where it can, since the file system
+ * is free to share extents with a sparse target anyway; otherwise it is
+ * read and written so that the target is fully allocated.  If @stats
+ * is not NULL it is filled with the amount of data handled by each of
+ * those methods.
+ *
+ * Returns 0 on success and -errno on failure.
+ */
+int
 virStorageBackendCopyToFD(virStorageVolDefPtr vol,
                           virStorageVolDefPtr inputvol,
                           int fd,
                           unsigned long long *total,
                           bool want_sparse,
-                          bool reflink_copy)
+                          bool reflink_copy,
+                          virStorageBackendCopyStatsPtr stats)
 {
+    virStorageBackendCopyStats dummy;
     int inputfd = -1;
-    int amtread = -1;
     int ret = 0;
     size_t rbytes = READ_BLOCK_SIZE_DEFAULT;
     int wbytes = 0;
-    int interval;
-    char *zerobuf = NULL;
     char *buf = NULL;
     struct stat st;
+    bool seekable = false;
+    bool kernelcopy = false;
+    off_t pos = 0;
+
+    if (!stats)
+        stats = &dummy;
+    memset(stats, 0, sizeof(*stats));
 
     if ((inputfd = open(inputvol->target.path, O_RDONLY)) < 0) {
         ret = -errno;
@@ -131,70 +336,113 @@ virStorageBackendCopyToFD(virStorageVolDefPtr vol,
     if (wbytes < WRITE_BLOCK_SIZE_DEFAULT)
         wbytes = WRITE_BLOCK_SIZE_DEFAULT;
 
-    if (VIR_ALLOC_N(zerobuf, wbytes) < 0) {
-        ret = -errno;
-        goto cleanup;
-    }
-
     if (VIR_ALLOC_N(buf, rbytes) < 0) {
         ret = -errno;
         goto cleanup;
     }
 
     if (reflink_copy) {
-        if (btrfsCloneFile(fd, inputfd) < 0) {
+        if (reflinkCloneFile(fd, inputfd) < 0) {
             ret = -errno;
             virReportSystemError(errno,
                                  _("failed to clone files from '%s'"),
                                  inputvol->target.path);
             goto cleanup;
         } else {
-            VIR_DEBUG("btrfs clone finished.");
+            VIR_DEBUG("reflink clone finished.");
             goto cleanup;
         }
     }
 
-    while (amtread != 0) {
-        int amtleft;
+    if (fstat(inputfd, &st) == 0 && S_ISREG(st.st_mode))
+        seekable = true;
 
-        if (*total < rbytes)
-            rbytes = *total;
+    /* Without knowing where the holes are, zeroes can be skipped only
+     * by looking at the data */
+    if (seekable && want_sparse)
+        kernelcopy = true;
 
-        if ((amtread = saferead(inputfd, buf, rbytes)) < 0) {
-            ret = -errno;
-            virReportSystemError(errno,
-                                 _("failed reading from file '%s'"),
-                                 inputvol->target.path);
-            goto cleanup;
-        }
-        *total -= amtread;
+    while (*total > 0) {
+        unsigned long long len = *total;
+        unsigned long long done = 0;
+        unsigned long long more = 0;
+        bool isdata = true;
 
-        /* Loop over amt read in 512 byte increments, looking for sparse
-         * blocks */
-        amtleft = amtread;
-        do {
-            interval = ((wbytes > amtleft) ? amtleft : wbytes);
-            int offset = amtread - amtleft;
+        if (seekable) {
+            off_t extent;
+            int rc = storageBackendFindExtent(inputfd, pos, st.st_size,
+                                              &isdata, &extent);
 
-            if (want_sparse && memcmp(buf+offset, zerobuf, interval) == 0) {
-                if (lseek(fd, interval, SEEK_CUR) < 0) {
+            if (rc > 0)
+                break;
+
+            if (rc < 0) {
+                VIR_DEBUG("Cannot find holes in '%s', reading all of it",
+                          inputvol->target.path);
+                seekable = false;
+                isdata = true;
+                kernelcopy = false;
+                if (lseek(inputfd, pos, SEEK_SET) < 0) {
                     ret = -errno;
                     virReportSystemError(errno,
-                                         _("cannot extend file '%s'"),
-                                         vol->target.path);
+                                         _("cannot seek in file '%s'"),
+                                         inputvol->target.path);
                     goto cleanup;
                 }
-            } else if (safewrite(fd, buf+offset, interval) < 0) {
+            } else if ((unsigned long long) extent < len) {
+                len = extent;
+            }
+        }
+
+        if (!isdata && want_sparse) {
+            if (lseek(fd, len, SEEK_CUR) < 0) {
                 ret = -errno;
                 virReportSystemError(errno,
-                                     _("failed writing to file '%s'"),
+                                     _("cannot extend file '%s'"),
                                      vol->target.path);
                 goto cleanup;
+            }
+            stats->skipped += len;
+            done = len;
+        } else {
+            if (isdata && kernelcopy) {
+                int rc = storageBackendCopyKernel(vol, inputvol, inputfd, fd,
+                                                  len, stats, &done);
+                if (rc < 0) {
+                    ret = rc;
+                    goto cleanup;
+                }
+                if (rc > 0) {
+                    VIR_DEBUG("Kernel can't copy '%s' to '%s'",
+                              inputvol->target.path, vol->target.path);
+                    kernelcopy = false;
+                }
+            }
 
+            if (!isdata || !kernelcopy) {
+                if ((ret = storageBackendCopyUserspace(vol, inputvol,
+                                                       inputfd, fd,
+                                                       buf, rbytes, wbytes,
+                                                       len - done,
+                                                       want_sparse, stats,
+                                                       &more)) < 0)
+                    goto cleanup;
+                done += more;
             }
-        } while ((amtleft -= interval) > 0);
+        }
+
+        /* End of input */
+        if (done == 0)
+            break;
+
+        pos += done;
+        *total -= done;
     }
 
+    VIR_DEBUG("Copied '%s' to '%s': read=%llu written=%llu copied=%llu "
+              "skipped=%llu", inputvol->target.path, vol->target.path,
+              stats->read, stats->written, stats->copied, stats->skipped);
+
     if (fdatasync(fd) < 0) {
         ret = -errno;
         virReportSystemError(errno, _("cannot sync data to file '%s'"),
@@ -215,7 +463,6 @@ virStorageBackendCopyToFD(virStorageVolDefPtr vol,
  cleanup:
     VIR_FORCE_CLOSE(inputfd);
 
-    VIR_FREE(zerobuf);
     VIR_FREE(buf);
 
     return ret;
@@ -262,7 +509,7 @@ storageBackendCreateBlockFrom(virConnectPtr conn ATTRIBUTE_UNUSED,
 
     if (inputvol) {
         if (virStorageBackendCopyToFD(vol, inputvol, fd, &remain,
-                                      false, reflink_copy) < 0)
+                                      false, reflink_copy, NULL) < 0)
             goto cleanup;
     }
 
@@ -360,7 +607,8 @@ createRawFile(int fd, virStorageVolDefPtr vol,
          * allocation (allocation < capacity) or we have already
          * been able to allocate the required space. */
         if ((ret = virStorageBackendCopyToFD(vol, inputvol, fd, &remain,
-                                             !need_alloc, reflink_copy)) < 0)
+                                             !need_alloc, reflink_copy,
+                                             NULL)) < 0)
             goto cleanup;
 
         /* If the new allocation is greater than the original capacity,
@@ -2514,18 +2762,142 @@ storageBackendVolZeroSparseFileLocal(const char *path,
 }
 
 
+/* Amount of data wiped between two progress updates */
+#define WIPE_PROGRESS_CHUNK (1024ULL * 1024 * 1024)
+
+/*
+ * Publish the number of bytes wiped so far as the allocation of @vol,
+ * so that virStorageVolGetInfo can be used to watch a running wipe the
+ * same way as a running volume build.  Marks @vol as wiping so that the
+ * allocation isn't refreshed meanwhile, see virStorageBackendVolWipeDone.
+ * The caller must not hold the lock of @pool.
+ */
+static void
+storageBackendWipeProgress(virStoragePoolObjPtr pool,
+                           virStorageVolDefPtr vol,
+                           unsigned long long done)
+{
+    if (!pool || !vol)
+        return;
+
+    virStoragePoolObjLock(pool);
+    vol->wiping = true;
+    vol->target.allocation = done;
+    virStoragePoolObjUnlock(pool);
+}
+
+
+/**
+ * virStorageBackendVolWipeDone:
+ * @vol: volume which was wiped
+ *
+ * Replaces the wipe progress published in the allocation of @vol, if
+ * any, with the real allocation. The caller must hold the lock of the
+ * pool of @vol.
+ *
+ * Returns 0 on success, -2 if the volume can't be probed, -1 on failure
+ */
+int
+virStorageBackendVolWipeDone(virStorageVolDefPtr vol)
+{
+    if (!vol->wiping)
+        return 0;
+
+    vol->wiping = false;
+    return virStorageBackendRefreshVolTargetUpdate(vol);
+}
+
+
+/*
+ * Let the kernel or the device zero @len bytes at @offset without
+ * writing buffers full of zeroes.  Block devices are discarded if the
+ * device guarantees discarded blocks read back as zeroes, otherwise
+ * BLKZEROOUT is used which issues WRITE ZEROES where available.  Files
+ * have the range converted to zeroed extents.
+ *
+ * Returns 0 on success, -2 if the range can't be zeroed this way, or
+ * -1 with errno set on failure.
+ */
+static int
+storageBackendWipeOffload(int fd,
+                          bool isblock,
+                          unsigned long long offset,
+                          unsigned long long len,
+                          const char **method)
+{
+    int rc = -2;
+
+#ifdef __linux__
+    if (isblock) {
+        uint64_t range[2] = { offset, len };
+# ifdef BLKDISCARDZEROES
+        unsigned int zeroes = 0;
+
+        if (ioctl(fd, BLKDISCARDZEROES, &zeroes) == 0 && zeroes &&
+            (rc = ioctl(fd, BLKDISCARD, range)) == 0) {
+            *method = "BLKDISCARD";
+            return 0;
+        }
+# endif
+# ifdef BLKZEROOUT
+        if ((rc = ioctl(fd, BLKZEROOUT, range)) == 0) {
+            *method = "BLKZEROOUT";
+            return 0;
+        }
+# endif
+    }
+#endif /* __linux__ */
+
+#if HAVE_FALLOCATE - 0
+    if (!isblock) {
+# ifdef FALLOC_FL_ZERO_RANGE
+        if ((rc = fallocate(fd, FALLOC_FL_ZERO_RANGE, offset, len)) == 0) {
+            *method = "FALLOC_FL_ZERO_RANGE";
+            return 0;
+        }
+# endif
+# if defined(FALLOC_FL_PUNCH_HOLE) && defined(FALLOC_FL_KEEP_SIZE)
+        if ((rc = fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                            offset, len)) == 0) {
+            /* Allocate the range again, keeping it sparse is fine
+             * should that fail */
+            ignore_value(fallocate(fd, 0, offset, len));
+            *method = "FALLOC_FL_PUNCH_HOLE";
+            return 0;
+        }
+# endif
+    }
+#endif /* HAVE_FALLOCATE */
+
+    if (rc == -1 &&
+        errno != EINVAL && errno != ENOTTY && errno != ENOSYS &&
+        errno != EOPNOTSUPP && errno != ENOTSUP)
+        return -1;
+
+    return -2;
+}
+
+
 static int
 storageBackendWipeLocal(const char *path,
                         int fd,
                         unsigned long long wipe_len,
                         size_t writebuf_length,
-                        bool zero_end)
+                        bool zero_end,
+                        virStoragePoolObjPtr pool,
+                        virStorageVolDefPtr vol)
 {
     int ret = -1, written = 0;
     unsigned long long remaining = 0;
+    unsigned long long wiped = 0;
+    unsigned long long progress = 0;
+    unsigned long long start = 0;
+    unsigned long long end = 0;
+    const char *method = "write";
     off_t size;
     size_t write_size = 0;
     char *writebuf = NULL;
+    struct stat st;
 
     if (VIR_ALLOC_N(writebuf, writebuf_length) < 0)
         goto cleanup;
@@ -2550,7 +2922,51 @@ storageBackendWipeLocal(const char *path,
 
     VIR_DEBUG("wiping start: %zd len: %llu", (ssize_t) size, wipe_len);
 
-    remaining = wipe_len;
+    ignore_value(virTimeMillisNow(&start));
+    storageBackendWipeProgress(pool, vol, 0);
+
+    /* Zero the volume in large chunks without writing anything
+     * ourselves if possible, falling back to writing zeroes from where
+     * that stopped working */
+    if (fstat(fd, &st) == 0 &&
+        (S_ISBLK(st.st_mode) || S_ISREG(st.st_mode))) {
+        while (wiped < wipe_len) {
+            unsigned long long len = MIN(wipe_len - wiped,
+                                         WIPE_PROGRESS_CHUNK);
+            int rc = storageBackendWipeOffload(fd, S_ISBLK(st.st_mode),
+                                               size + wiped, len, &method);
+
+            if (rc == -2)
+                break;
+
+            if (rc < 0) {
+                virReportSystemError(errno,
+                                     _("Failed to zero %llu bytes of "
+                                       "storage volume with path '%s'"),
+                                     len, path);
+                goto cleanup;
+            }
+
+            wiped += len;
+            storageBackendWipeProgress(pool, vol, wiped);
+        }
+
+        if (wiped > 0 && wiped < wipe_len) {
+            VIR_DEBUG("%s stopped working after %llu bytes of '%s'",
+                      method, wiped, path);
+            method = "write";
+            if (lseek(fd, size + wiped, SEEK_SET) < 0) {
+                virReportSystemError(errno,
+                                     _("Failed to seek in volume with "
+                                       "path '%s'"),
+                                     path);
+                goto cleanup;
+            }
+        }
+    }
+
+    remaining = wipe_len - wiped;
+    progress = wiped;
     while (remaining > 0) {
 
         write_size = (writebuf_length < remaining) ? writebuf_length : remaining;
@@ -2565,6 +2981,12 @@ storageBackendWipeLocal(const char *path,
         }
 
         remaining -= written;
+        wiped += written;
+
+        if (wiped - progress >= WIPE_PROGRESS_CHUNK / 16) {
+            storageBackendWipeProgress(pool, vol, wiped);
+            progress = wiped;
+        }
     }
 
     if (fdatasync(fd) < 0) {
@@ -2574,7 +2996,13 @@ storageBackendWipeLocal(const char *path,
         goto cleanup;
     }
 
-    VIR_DEBUG("Wrote %llu bytes to volume with path '%s'", wipe_len, path);
+    storageBackendWipeProgress(pool, vol, wiped);
+    ignore_value(virTimeMillisNow(&end));
+
+    VIR_DEBUG("Wiped %llu bytes of volume with path '%s' using %s "
+              "in %llu ms (%llu MiB/s)",
+              wipe_len, path, method, end - start,
+              end > start ? wipe_len / 1024 / 1024 * 1000 / (end - start) : 0);
 
     ret = 0;
 
@@ -2588,7 +3016,9 @@ static int
 storageBackendVolWipeLocalFile(const char *path,
                                unsigned int algorithm,
                                unsigned long long allocation,
-                               bool zero_end)
+                               bool zero_end,
+                               virStoragePoolObjPtr pool,
+                               virStorageVolDefPtr vol)
 {
     int ret = -1, fd = -1;
     const char *alg_char = NULL;
@@ -2664,7 +3094,7 @@ storageBackendVolWipeLocalFile(const char *path,
             ret = storageBackendVolZeroSparseFileLocal(path, st.st_size, fd);
         } else {
             ret = storageBackendWipeLocal(path, fd, allocation, st.st_blksize,
-                                          zero_end);
+                                          zero_end, pool, vol);
         }
         if (ret < 0)
             goto cleanup;
@@ -2702,7 +3132,8 @@ storageBackendVolWipePloop(virStorageVolDefPtr vol,
         goto cleanup;
 
     if (storageBackendVolWipeLocalFile(target_path, algorithm,
-                                       vol->target.allocation, false) < 0)
+                                       vol->target.allocation, false,
+                                       NULL, NULL) < 0)
         goto cleanup;
 
     if (virFileRemove(disk_desc, 0, 0) < 0) {
@@ -2735,7 +3166,7 @@ storageBackendVolWipePloop(virStorageVolDefPtr vol,
 
 int
 virStorageBackendVolWipeLocal(virConnectPtr conn ATTRIBUTE_UNUSED,
-                              virStoragePoolObjPtr pool ATTRIBUTE_UNUSED,
+                              virStoragePoolObjPtr pool,
                               virStorageVolDefPtr vol,
                               unsigned int algorithm,
                               unsigned int flags)
@@ -2751,7 +3182,8 @@ virStorageBackendVolWipeLocal(virConnectPtr conn ATTRIBUTE_UNUSED,
         ret = storageBackendVolWipePloop(vol, algorithm);
     } else {
         ret = storageBackendVolWipeLocalFile(vol->target.path, algorithm,
-                                             vol->target.allocation, false);
+                                             vol->target.allocation, false,
+                                             pool, vol);
     }
 
     return ret;
@@ -4147,9 +4579,9 @@ virStorageBackendZeroPartitionTable(const char *path,
                                     unsigned long long size)
 {
     if (storageBackendVolWipeLocalFile(path, VIR_STORAGE_VOL_WIPE_ALG_ZERO,
-                                       size, false) < 0)
+                                       size, false, NULL, NULL) < 0)
         return -1;
 
     return storageBackendVolWipeLocalFile(path, VIR_STORAGE_VOL_WIPE_ALG_ZERO,
-                                          size, true);
+                                          size, true, NULL, NULL);
 }
@@ -31,6 +31,24 @@ virStorageBackendBuildVolFrom
 virStorageBackendGetBuildVolFromFunction(virStorageVolDefPtr vol,
                                          virStorageVolDefPtr inputvol);
 
+typedef struct _virStorageBackendCopyStats virStorageBackendCopyStats;
+typedef virStorageBackendCopyStats *virStorageBackendCopyStatsPtr;
+struct _virStorageBackendCopyStats {
+    unsigned long long read;    /* bytes read into userspace */
+    unsigned long long written; /* bytes written from userspace */
+    unsigned long long copied;  /* bytes copied by the kernel */
+    unsigned long long skipped; /* bytes left sparse in the target */
+};
+
+int virStorageBackendCopyToFD(virStorageVolDefPtr vol,
+                              virStorageVolDefPtr inputvol,
+                              int fd,
+                              unsigned long long *total,
+                              bool want_sparse,
+                              bool reflink_copy,
+                              virStorageBackendCopyStatsPtr stats)
+    ATTRIBUTE_NONNULL(2);
+
 int virStorageBackendVolCreateLocal(virConnectPtr conn,
                                     virStoragePoolObjPtr pool,
                                     virStorageVolDefPtr vol);
@@ -83,6 +101,8 @@ int virStorageBackendVolWipeLocal(virConnectPtr conn,
                                   unsigned int algorithm,
                                   unsigned int flags);
 
+int virStorageBackendVolWipeDone(virStorageVolDefPtr vol);
+
 /* Local/Common Storage Pool Backend APIs */
 int virStorageBackendBuildLocal(virStoragePoolObjPtr pool);
 
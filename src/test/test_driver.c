@@ -643,10 +643,12 @@ testDomainGenerateIfnames(virDomainDefPtr domdef)
 
 
 static void
-testDomainShutdownState(virDomainPtr domain,
+testDomainShutdownState(testDriverPtr privconn,
+                        virDomainPtr domain,
                         virDomainObjPtr privdom,
                         virDomainShutoffReason reason)
 {
+    virDomainObjListSetID(privconn->domains, privdom, -1);
     virDomainObjRemoveTransientDef(privdom);
     virDomainObjSetState(privdom, VIR_DOMAIN_SHUTOFF, reason);
 
@@ -663,11 +665,12 @@ testDomainStartState(testDriverPtr privconn,
     int ret = -1;
 
     virDomainObjSetState(dom, VIR_DOMAIN_RUNNING, reason);
-    dom->def->id = virAtomicIntAdd(&privconn->nextDomID, 1);
+    virDomainObjListSetID(privconn->domains, dom,
+                          virAtomicIntAdd(&privconn->nextDomID, 1));
 
     if (virDomainObjSetDefTransient(privconn->caps,
                                     privconn->xmlopt,
-                                    dom) < 0) {
+                                    dom, NULL) < 0) {
         goto cleanup;
     }
 
@@ -675,7 +678,7 @@ testDomainStartState(testDriverPtr privconn,
     ret = 0;
  cleanup:
     if (ret < 0)
-        testDomainShutdownState(NULL, dom, VIR_DOMAIN_SHUTOFF_FAILED);
+        testDomainShutdownState(privconn, NULL, dom, VIR_DOMAIN_SHUTOFF_FAILED);
     return ret;
 }
 
@@ -945,7 +948,7 @@ testParseDomains(testDriverPtr privconn,
                 goto error;
             }
         } else {
-            testDomainShutdownState(NULL, obj, 0);
+            testDomainShutdownState(privconn, NULL, obj, 0);
         }
         virDomainObjSetState(obj, nsdata->runstate, 0);
 
@@ -1775,7 +1778,8 @@ static int testDomainDestroy(virDomainPtr domain)
         goto cleanup;
     }
 
-    testDomainShutdownState(domain, privdom, VIR_DOMAIN_SHUTOFF_DESTROYED);
+    testDomainShutdownState(privconn, domain, privdom,
+                            VIR_DOMAIN_SHUTOFF_DESTROYED);
     event = virDomainEventLifecycleNewFromObj(privdom,
                                      VIR_DOMAIN_EVENT_STOPPED,
                                      VIR_DOMAIN_EVENT_STOPPED_DESTROYED);
@@ -1869,7 +1873,8 @@ static int testDomainShutdownFlags(virDomainPtr domain,
         goto cleanup;
     }
 
-    testDomainShutdownState(domain, privdom, VIR_DOMAIN_SHUTOFF_SHUTDOWN);
+    testDomainShutdownState(privconn, domain, privdom,
+                            VIR_DOMAIN_SHUTOFF_SHUTDOWN);
     event = virDomainEventLifecycleNewFromObj(privdom,
                                      VIR_DOMAIN_EVENT_STOPPED,
                                      VIR_DOMAIN_EVENT_STOPPED_SHUTDOWN);
@@ -1939,7 +1944,8 @@ static int testDomainReboot(virDomainPtr domain,
     }
 
     if (virDomainObjGetState(privdom, NULL) == VIR_DOMAIN_SHUTOFF) {
-        testDomainShutdownState(domain, privdom, VIR_DOMAIN_SHUTOFF_SHUTDOWN);
+        testDomainShutdownState(privconn, domain, privdom,
+                                VIR_DOMAIN_SHUTOFF_SHUTDOWN);
         event = virDomainEventLifecycleNewFromObj(privdom,
                                          VIR_DOMAIN_EVENT_STOPPED,
                                          VIR_DOMAIN_EVENT_STOPPED_SHUTDOWN);
@@ -2078,7 +2084,8 @@ testDomainSaveFlags(virDomainPtr domain, const char *path,
     }
     fd = -1;
 
-    testDomainShutdownState(domain, privdom, VIR_DOMAIN_SHUTOFF_SAVED);
+    testDomainShutdownState(privconn, domain, privdom,
+                            VIR_DOMAIN_SHUTOFF_SAVED);
     event = virDomainEventLifecycleNewFromObj(privdom,
                                      VIR_DOMAIN_EVENT_STOPPED,
                                      VIR_DOMAIN_EVENT_STOPPED_SAVED);
@@ -2265,7 +2272,8 @@ static int testDomainCoreDumpWithFormat(virDomainPtr domain,
     }
 
     if (flags & VIR_DUMP_CRASH) {
-        testDomainShutdownState(domain, privdom, VIR_DOMAIN_SHUTOFF_CRASHED);
+        testDomainShutdownState(privconn, domain, privdom,
+                                VIR_DOMAIN_SHUTOFF_CRASHED);
         event = virDomainEventLifecycleNewFromObj(privdom,
                                          VIR_DOMAIN_EVENT_STOPPED,
                                          VIR_DOMAIN_EVENT_STOPPED_CRASHED);
@@ -5825,7 +5833,7 @@ testDomainManagedSave(virDomainPtr dom, unsigned int flags)
         goto cleanup;
     }
 
-    testDomainShutdownState(dom, vm, VIR_DOMAIN_SHUTOFF_SAVED);
+    testDomainShutdownState(privconn, dom, vm, VIR_DOMAIN_SHUTOFF_SAVED);
     event = virDomainEventLifecycleNewFromObj(vm,
                                      VIR_DOMAIN_EVENT_STOPPED,
                                      VIR_DOMAIN_EVENT_STOPPED_SAVED);
@@ -6327,7 +6335,7 @@ testDomainSnapshotCreateXML(virDomainPtr domain,
 
         if ((flags & VIR_DOMAIN_SNAPSHOT_CREATE_HALT) &&
             virDomainObjIsActive(vm)) {
-            testDomainShutdownState(domain, vm,
+            testDomainShutdownState(privconn, domain, vm,
                                     VIR_DOMAIN_SHUTOFF_FROM_SNAPSHOT);
             event = virDomainEventLifecycleNewFromObj(vm, VIR_DOMAIN_EVENT_STOPPED,
                                     VIR_DOMAIN_EVENT_STOPPED_FROM_SNAPSHOT);
@@ -6587,7 +6595,7 @@ testDomainRevertToSnapshot(virDomainSnapshotPtr snapshot,
                 }
 
                 virResetError(err);
-                testDomainShutdownState(snapshot->domain, vm,
+                testDomainShutdownState(privconn, snapshot->domain, vm,
                                         VIR_DOMAIN_SHUTOFF_FROM_SNAPSHOT);
                 event = virDomainEventLifecycleNewFromObj(vm,
                             VIR_DOMAIN_EVENT_STOPPED,
@@ -6659,7 +6667,7 @@ testDomainRevertToSnapshot(virDomainSnapshotPtr snapshot,
 
         if (virDomainObjIsActive(vm)) {
             /* Transitions 4, 7 */
-            testDomainShutdownState(snapshot->domain, vm,
+            testDomainShutdownState(privconn, snapshot->domain, vm,
                                     VIR_DOMAIN_SHUTOFF_FROM_SNAPSHOT);
             event = virDomainEventLifecycleNewFromObj(vm,
                                     VIR_DOMAIN_EVENT_STOPPED,
@@ -360,7 +360,7 @@ umlInotifyEvent(int watch,
                 continue;
             }
 
-            dom->def->id = driver->nextvmid++;
+            virDomainObjListSetID(driver->domains, dom, driver->nextvmid++);
 
             if (!driver->nactive && driver->inhibitCallback)
                 driver->inhibitCallback(true, driver->inhibitOpaque);
@@ -1097,7 +1097,7 @@ static int umlStartVMDaemon(virConnectPtr conn,
      * report implicit runtime defaults in the XML, like vnc listen/socket
      */
     VIR_DEBUG("Setting current domain def as transient");
-    if (virDomainObjSetDefTransient(driver->caps, driver->xmlopt, vm) < 0) {
+    if (virDomainObjSetDefTransient(driver->caps, driver->xmlopt, vm, NULL) < 0) {
         VIR_FORCE_CLOSE(logfd);
         return -1;
     }
@@ -1135,6 +1135,7 @@ static int umlStartVMDaemon(virConnectPtr conn,
     if (ret < 0) {
         virDomainConfVMNWFilterTeardown(vm);
         umlCleanupTapDevices(vm);
+        virDomainObjListSetID(driver->domains, vm, -1);
         virDomainObjRemoveTransientDef(vm);
     }
 
@@ -1168,7 +1169,7 @@ static void umlShutdownVMDaemon(struct uml_driver *driver,
     }
 
     vm->pid = -1;
-    vm->def->id = -1;
+    virDomainObjListSetID(driver->domains, vm, -1);
     virDomainObjSetState(vm, VIR_DOMAIN_SHUTOFF, reason);
 
     virDomainConfVMNWFilterTeardown(vm);
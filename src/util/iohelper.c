@@ -40,36 +40,184 @@
 #include "virrandom.h"
 #include "virstring.h"
 #include "virgettext.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
+/* Fixed by O_DIRECT requirements, buffer sizes are rounded to it */
+#define IO_ALIGN (64 * 1024)
+#define IO_BUFLEN_MAX (64 * 1024 * 1024)
+#define IO_NBUFS_MAX 64
+
+typedef struct _runIOBuffer runIOBuffer;
+struct _runIOBuffer {
+    void *base; /* Location to be freed */
+    char *buf; /* Aligned location within base */
+    size_t len; /* Amount of data in @buf */
+    bool shortRead; /* @buf holds the only allowed short read */
+};
+
+/* Data are read into a ring of buffers by a separate thread while the
+ * main thread writes out the ones already filled, so that neither side
+ * has to wait for the other one as long as the ring isn't full. */
+typedef struct _runIOData runIOData;
+struct _runIOData {
+    virMutex lock;
+    virCond cond;
+
+    int fdin;
+    const char *fdinname;
+    unsigned long long length;
+    unsigned long long offset; /* Amount of data read so far */
+    bool direct;
+
+    runIOBuffer *bufs;
+    size_t nbufs;
+    size_t buflen;
+    size_t head; /* Next buffer to be filled by the reader */
+    size_t count; /* Filled buffers waiting to be written */
+
+    bool eof; /* The reader is done */
+    bool quit; /* The writer failed, the reader should stop */
+    virErrorPtr err;
+};
+
+/* Throughput of the transfer, measured from the moment the first write
+ * completed, so that waiting for the other end of a pipe to show up,
+ * e.g. for QEMU to start reading the incoming migration stream, is not
+ * counted. The data written by the first write is not counted either. */
+typedef struct _runIOStats runIOStats;
+struct _runIOStats {
+    unsigned long long started;
+    unsigned long long bytes;
+    unsigned long long elapsed;
+};
+
+
+static int
+runIOBufferAlloc(runIOBuffer *b,
+                 size_t buflen)
+{
+#if HAVE_POSIX_MEMALIGN
+    if (posix_memalign(&b->base, IO_ALIGN, buflen)) {
+        virReportOOMError();
+        return -1;
+    }
+    b->buf = b->base;
+#else
+    if (VIR_ALLOC_N(b->buf, buflen + IO_ALIGN - 1) < 0)
+        return -1;
+    b->base = b->buf;
+    b->buf = (char *) (((intptr_t) b->base + IO_ALIGN - 1) &
+                       ~((intptr_t) IO_ALIGN - 1));
+#endif
+    return 0;
+}
+
+
+static void
+runIOReader(void *opaque)
+{
+    runIOData *data = opaque;
+    bool shortRead = false; /* true if we hit a short read */
+
+    virMutexLock(&data->lock);
+
+    while (1) {
+        runIOBuffer *b = &data->bufs[data->head];
+        size_t want = data->buflen;
+        ssize_t got = 0;
+
+        while (data->count == data->nbufs && !data->quit) {
+            if (virCondWait(&data->cond, &data->lock) < 0) {
+                virReportSystemError(errno, "%s",
+                                     _("failed to wait on condition"));
+                goto error;
+            }
+        }
+
+        if (data->quit)
+            break;
+
+        if (data->length &&
+            (data->length - data->offset) < want)
+            want = data->length - data->offset;
+
+        if (want == 0)
+            break; /* End of requested data from client */
+
+        virMutexUnlock(&data->lock);
+        got = saferead(data->fdin, b->buf, want);
+        virMutexLock(&data->lock);
+
+        if (got < 0) {
+            virReportSystemError(errno, _("Unable to read %s"),
+                                 data->fdinname);
+            goto error;
+        }
+        if (got == 0)
+            break; /* End of file before end of requested data */
+
+        b->shortRead = false;
+        if (got < want || (want & (IO_ALIGN - 1))) {
+            /* O_DIRECT can handle at most one short read, at end of file */
+            if (data->direct && shortRead) {
+                virReportSystemError(EINVAL, "%s",
+                                     _("Too many short reads for O_DIRECT"));
+                goto error;
+            }
+            shortRead = b->shortRead = true;
+        }
+
+        b->len = got;
+        data->offset += got;
+        data->head = (data->head + 1) % data->nbufs;
+        data->count++;
+        virCondSignal(&data->cond);
+    }
+
+ cleanup:
+    data->eof = true;
+    virCondSignal(&data->cond);
+    virMutexUnlock(&data->lock);
+    return;
+
+ error:
+    data->err = virSaveLastError();
+    goto cleanup;
+}
+
+
+static void
+runIOStatsUpdate(runIOStats *stats,
+                 size_t len)
+{
+    if (!stats->started)
+        ignore_value(virTimeMillisNow(&stats->started));
+    else
+        stats->bytes += len;
+}
+
+
 static int
-runIO(const char *path, int fd, int oflags, unsigned long long length)
+runIO(const char *path, int fd, int oflags, unsigned long long length,
+      size_t buflen, size_t nbufs, runIOStats *stats)
 {
-    void *base = NULL; /* Location to be freed */
-    char *buf = NULL; /* Aligned location within base */
-    size_t buflen = 1024*1024;
-    intptr_t alignMask = 64*1024 - 1;
+    runIOData data = { .nbufs = nbufs, .length = length };
+    virThread reader;
+    bool readerRunning = false;
+    bool lockInit = false;
+    bool condInit = false;
     int ret = -1;
     int fdin, fdout;
     const char *fdinname, *fdoutname;
     unsigned long long total = 0;
     bool direct = O_DIRECT && ((oflags & O_DIRECT) != 0);
-    bool shortRead = false; /* true if we hit a short read */
     off_t end = 0;
+    size_t i;
 
-#if HAVE_POSIX_MEMALIGN
-    if (posix_memalign(&base, alignMask + 1, buflen)) {
-        virReportOOMError();
-        goto cleanup;
-    }
-    buf = base;
-#else
-    if (VIR_ALLOC_N(buf, buflen + alignMask) < 0)
-        goto cleanup;
-    base = buf;
-    buf = (char *) (((intptr_t) base + alignMask) & ~alignMask);
-#endif
+    /* O_DIRECT needs aligned buffers */
+    data.buflen = VIR_ROUND_UP(buflen, IO_ALIGN);
 
     switch (oflags & O_ACCMODE) {
     case O_RDONLY:
@@ -107,45 +255,120 @@ runIO(const char *path, int fd, int oflags, unsigned long long length)
         goto cleanup;
     }
 
-    while (1) {
+    /* Let the kernel move the data if the FDs allow it. O_DIRECT has
+     * alignment requirements so it always takes the buffered path. */
+    while (!direct && (!length || total < length)) {
         ssize_t got;
+        size_t want = data.buflen;
 
         if (length &&
-            (length - total) < buflen)
-            buflen = length - total;
+            (length - total) < want)
+            want = length - total;
 
-        if (buflen == 0)
-            break; /* End of requested data from client */
-
-        if ((got = saferead(fdin, buf, buflen)) < 0) {
-            virReportSystemError(errno, _("Unable to read %s"), fdinname);
+        if ((got = virFileZeroCopy(fdin, fdout, want)) == -2)
+            break; /* Fall back to copying through the buffers */
+        if (got < 0) {
+            virReportSystemError(errno, _("Unable to copy %s to %s"),
+                                 fdinname, fdoutname);
             goto cleanup;
         }
         if (got == 0)
-            break; /* End of file before end of requested data */
-        if (got < buflen || (buflen & alignMask)) {
-            /* O_DIRECT can handle at most one short read, at end of file */
-            if (direct && shortRead) {
-                virReportSystemError(EINVAL, "%s",
-                                     _("Too many short reads for O_DIRECT"));
+            break; /* End of file, the reader will notice too */
+
+        total += got;
+        runIOStatsUpdate(stats, got);
+    }
+
+    if (VIR_ALLOC_N(data.bufs, data.nbufs) < 0)
+        goto cleanup;
+
+    for (i = 0; i < data.nbufs; i++) {
+        if (runIOBufferAlloc(&data.bufs[i], data.buflen) < 0)
+            goto cleanup;
+    }
+
+    if (virMutexInit(&data.lock) < 0) {
+        virReportSystemError(errno, "%s", _("Unable to init mutex"));
+        goto cleanup;
+    }
+    lockInit = true;
+
+    if (virCondInit(&data.cond) < 0) {
+        virReportSystemError(errno, "%s", _("Unable to init condition"));
+        goto cleanup;
+    }
+    condInit = true;
+
+    data.fdin = fdin;
+    data.fdinname = fdinname;
+    data.offset = total;
+    data.direct = direct;
+
+    if (virThreadCreate(&reader, true, runIOReader, &data) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to create reader thread"));
+        goto cleanup;
+    }
+    readerRunning = true;
+
+    virMutexLock(&data.lock);
+    while (1) {
+        runIOBuffer *b;
+        size_t got;
+        bool failed = true;
+
+        while (!data.count && !data.eof) {
+            if (virCondWait(&data.cond, &data.lock) < 0) {
+                virReportSystemError(errno, "%s",
+                                     _("failed to wait on condition"));
+                break;
             }
-            shortRead = true;
         }
 
+        if (!data.count) {
+            failed = !data.eof;
+            virMutexUnlock(&data.lock);
+            if (failed)
+                goto cleanup;
+            break; /* Everything the reader got was written out */
+        }
+
+        b = &data.bufs[(data.head + data.nbufs - data.count) % data.nbufs];
+        virMutexUnlock(&data.lock);
+
+        got = b->len;
         total += got;
-        if (fdout == fd && direct && shortRead) {
+        if (fdout == fd && direct && b->shortRead) {
             end = total;
-            memset(buf + got, 0, buflen - got);
-            got = (got + alignMask) & ~alignMask;
+            memset(b->buf + got, 0, data.buflen - got);
+            got = (got + IO_ALIGN - 1) & ~(IO_ALIGN - 1);
         }
-        if (safewrite(fdout, buf, got) < 0) {
+        if (safewrite(fdout, b->buf, got) < 0) {
             virReportSystemError(errno, _("Unable to write %s"), fdoutname);
-            goto cleanup;
-        }
-        if (end && ftruncate(fd, end) < 0) {
+        } else if (end && ftruncate(fd, end) < 0) {
             virReportSystemError(errno, _("Unable to truncate %s"), fdoutname);
+        } else {
+            runIOStatsUpdate(stats, b->len);
+            failed = false;
+        }
+
+        virMutexLock(&data.lock);
+        if (failed) {
+            data.quit = true;
+            virCondSignal(&data.cond);
+            virMutexUnlock(&data.lock);
             goto cleanup;
         }
+        data.count--;
+        virCondSignal(&data.cond);
+    }
+
+    virThreadJoin(&reader);
+    readerRunning = false;
+
+    if (data.err) {
+        virSetError(data.err);
+        goto cleanup;
     }
 
     /* Ensure all data is written */
@@ -157,16 +380,38 @@ runIO(const char *path, int fd, int oflags, unsigned long long length)
         }
     }
 
+    if (stats->started) {
+        unsigned long long now;
+
+        if (virTimeMillisNow(&now) == 0)
+            stats->elapsed = now - stats->started;
+    }
+
     ret = 0;
 
  cleanup:
+    if (readerRunning) {
+        virMutexLock(&data.lock);
+        data.quit = true;
+        virCondSignal(&data.cond);
+        virMutexUnlock(&data.lock);
+        virThreadJoin(&reader);
+    }
+
     if (VIR_CLOSE(fd) < 0 &&
         ret == 0) {
         virReportSystemError(errno, _("Unable to close %s"), path);
         ret = -1;
     }
 
-    VIR_FREE(base);
+    if (condInit)
+        virCondDestroy(&data.cond);
+    if (lockInit)
+        virMutexDestroy(&data.lock);
+    for (i = 0; data.bufs && i < data.nbufs; i++)
+        VIR_FREE(data.bufs[i].base);
+    VIR_FREE(data.bufs);
+    virFreeError(data.err);
     return ret;
 }
 
@@ -178,7 +423,8 @@ usage(int status)
     if (status) {
         fprintf(stderr, _("%s: try --help for more details"), program_name);
     } else {
-        printf(_("Usage: %s FILENAME LENGTH FD\n"), program_name);
+        printf(_("Usage: %s FILENAME LENGTH FD [BUFSIZE NBUFFERS [STATSFD]]\n"),
+               program_name);
     }
     exit(status);
 }
@@ -188,8 +434,12 @@ main(int argc, char **argv)
 {
     const char *path;
     unsigned long long length;
+    unsigned long long buflen = 1024 * 1024;
+    unsigned int nbufs = 2;
     int oflags = -1;
     int fd = -1;
+    int statsfd = -1;
+    runIOStats stats = { 0 };
 
     program_name = argv[0];
 
@@ -204,7 +454,8 @@ main(int argc, char **argv)
 
     if (argc > 1 && STREQ(argv[1], "--help"))
         usage(EXIT_SUCCESS);
-    if (argc == 4) { /* FILENAME LENGTH FD */
+    if (argc == 4 || argc == 6 || argc == 7) {
+        /* FILENAME LENGTH FD [BUFSIZE NBUFFERS [STATSFD]] */
         if (virStrToLong_ull(argv[2], NULL, 10, &length) < 0) {
             fprintf(stderr, _("%s: malformed file length %s"),
                     program_name, argv[2]);
@@ -230,13 +481,42 @@ main(int argc, char **argv)
                     program_name, fd);
             exit(EXIT_FAILURE);
         }
+        if (argc >= 6 &&
+            (virStrToLong_ullp(argv[4], NULL, 10, &buflen) < 0 ||
+             buflen == 0 || buflen > IO_BUFLEN_MAX ||
+             virStrToLong_uip(argv[5], NULL, 10, &nbufs) < 0 ||
+             nbufs == 0 || nbufs > IO_NBUFS_MAX)) {
+            fprintf(stderr, _("%s: malformed buffer size %s or count %s"),
+                    program_name, argv[4], argv[5]);
+            exit(EXIT_FAILURE);
+        }
+        if (argc == 7 &&
+            (virStrToLong_i(argv[6], NULL, 10, &statsfd) < 0 ||
+             statsfd < 0)) {
+            fprintf(stderr, _("%s: malformed stats fd %s"),
+                    program_name, argv[6]);
+            exit(EXIT_FAILURE);
+        }
     } else { /* unknown argc pattern */
         usage(EXIT_FAILURE);
     }
 
-    if (fd < 0 || runIO(path, fd, oflags, length) < 0)
+    if (fd < 0 ||
+        runIO(path, fd, oflags, length, buflen, nbufs, &stats) < 0)
         goto error;
 
+    /* Report "BYTES MILLISECONDS" to whoever started us. Nothing is
+     * written if the transfer was too short to be measured. */
+    if (statsfd >= 0) {
+        char *msg = NULL;
+
+        if (stats.bytes &&
+            virAsprintf(&msg, "%llu %llu\n", stats.bytes, stats.elapsed) > 0)
+            ignore_value(safewrite(statsfd, msg, strlen(msg)));
+        VIR_FREE(msg);
+        VIR_FORCE_CLOSE(statsfd);
+    }
+
     return 0;
 
  error:
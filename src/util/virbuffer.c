@@ -147,6 +147,12 @@ virBufferGrow(virBufferPtr buf, unsigned int len)
 
     size = buf->use + len + 1000;
 
+    /* Grow geometrically, otherwise formatting large documents, such as
+     * the XML of a domain with hundreds of devices, keeps reallocating
+     * and copying the whole content every thousand bytes. */
+    if (buf->size <= INT_MAX / 2 && size < buf->size * 2)
+        size = buf->size * 2;
+
     if (VIR_REALLOC_N_QUIET(buf->content, size) < 0) {
         virBufferSetError(buf, errno);
         return -1;
@@ -849,6 +849,281 @@ virCgroupGetValueStr(virCgroupPtr group,
 }
 
 
+/* Closes the files kept open by @group whose key starts with @prefix,
+ * or all of them if @prefix is NULL. Must be called with @group locked */
+static void
+virCgroupValueFilesClose(virCgroupPtr group,
+                         const char *prefix)
+{
+    size_t i = 0;
+
+    while (i < group->nfiles) {
+        if (prefix && !STRPREFIX(group->files[i].key, prefix)) {
+            i++;
+            continue;
+        }
+
+        VIR_FORCE_CLOSE(group->files[i].fd);
+        VIR_FREE(group->files[i].key);
+        VIR_DELETE_ELEMENT(group->files, i, group->nfiles);
+    }
+}
+
+
+/* Must be called with @group locked */
+static struct virCgroupValueFile *
+virCgroupValueFileGet(virCgroupPtr group,
+                      int controller,
+                      const char *key)
+{
+    struct virCgroupValueFile file = { controller, NULL, -1, 0, 0 };
+    char *keypath = NULL;
+    size_t i;
+
+    for (i = 0; i < group->nfiles; i++) {
+        if (group->files[i].controller == controller &&
+            STREQ(group->files[i].key, key)) {
+            group->files[i].used = ++group->clock;
+            return &group->files[i];
+        }
+    }
+
+    if (virCgroupPathOfController(group, controller, key, &keypath) < 0)
+        return NULL;
+
+    VIR_DEBUG("Opening %s", keypath);
+
+    if ((file.fd = open(keypath, O_RDONLY | O_CLOEXEC)) < 0) {
+        virReportSystemError(errno,
+                             _("Unable to read from '%s'"), keypath);
+        goto error;
+    }
+
+    if (group->nfiles >= VIR_CGROUP_MAX_VALUE_FILES) {
+        size_t lru = 0;
+
+        for (i = 1; i < group->nfiles; i++) {
+            if (group->files[i].used < group->files[lru].used)
+                lru = i;
+        }
+
+        VIR_FORCE_CLOSE(group->files[lru].fd);
+        VIR_FREE(group->files[lru].key);
+        VIR_DELETE_ELEMENT(group->files, lru, group->nfiles);
+    }
+
+    file.used = ++group->clock;
+
+    if (VIR_STRDUP(file.key, key) < 0 ||
+        VIR_APPEND_ELEMENT(group->files, group->nfiles, file) < 0)
+        goto error;
+
+    VIR_FREE(keypath);
+    return &group->files[group->nfiles - 1];
+
+ error:
+    VIR_FORCE_CLOSE(file.fd);
+    VIR_FREE(file.key);
+    VIR_FREE(keypath);
+    return NULL;
+}
+
+
+/* Reads the current content of @file from its start, growing the buffer
+ * until the whole value fits. Must be called with @group locked. */
+static int
+virCgroupValueFileRead(struct virCgroupValueFile *file,
+                       char **value)
+{
+    size_t size = MAX(file->size + 1, CGROUP_MAX_VAL);
+    ssize_t got;
+    char *buf = NULL;
+
+    while (true) {
+        if (VIR_ALLOC_N(buf, size + 1) < 0)
+            return -1;
+
+        if ((got = pread(file->fd, buf, size, 0)) < 0) {
+            VIR_FREE(buf);
+            return -1;
+        }
+
+        if (got < size)
+            break;
+
+        VIR_FREE(buf);
+        if (size >= 1024 * 1024) {
+            errno = EFBIG;
+            return -1;
+        }
+        size *= 2;
+    }
+
+    /* Terminated with '\n' has sometimes harmful effects to the caller */
+    if (got > 0 && buf[got - 1] == '\n')
+        buf[--got] = '\0';
+
+    file->size = got;
+    *value = buf;
+    return 0;
+}
+
+
+/* Must be called with @group locked */
+static int
+virCgroupGetStatStrLocked(virCgroupPtr group,
+                          int controller,
+                          const char *key,
+                          char **value)
+{
+    struct virCgroupValueFile *file;
+    size_t i;
+
+    *value = NULL;
+
+    if (!(file = virCgroupValueFileGet(group, controller, key)))
+        return -1;
+
+    if (virCgroupValueFileRead(file, value) == 0)
+        return 0;
+
+    /* The file may be stale if the group was re-created meanwhile,
+     * try once more with a freshly opened one. */
+    i = file - group->files;
+    VIR_FORCE_CLOSE(file->fd);
+    VIR_FREE(file->key);
+    VIR_DELETE_ELEMENT(group->files, i, group->nfiles);
+
+    if (!(file = virCgroupValueFileGet(group, controller, key)))
+        return -1;
+
+    if (virCgroupValueFileRead(file, value) < 0) {
+        virReportSystemError(errno,
+                             _("Unable to read from '%s'"), key);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Statistics are read repeatedly, so unlike virCgroupGetValueStr this
+ * keeps the file open and re-reads it with pread() every time.
+ */
+static int
+virCgroupGetStatStr(virCgroupPtr group,
+                    int controller,
+                    const char *key,
+                    char **value)
+{
+    int ret;
+
+    virMutexLock(&group->lock);
+    ret = virCgroupGetStatStrLocked(group, controller, key, value);
+    virMutexUnlock(&group->lock);
+
+    return ret;
+}
+
+
+static int
+virCgroupGetStatU64(virCgroupPtr group,
+                    int controller,
+                    const char *key,
+                    unsigned long long *value)
+{
+    char *strval = NULL;
+    int ret = -1;
+
+    if (virCgroupGetStatStr(group, controller, key, &strval) < 0)
+        goto cleanup;
+
+    if (virStrToLong_ull(strval, NULL, 10, value) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unable to parse '%s' as an integer"),
+                       strval);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(strval);
+    return ret;
+}
+
+
+/**
+ * virCgroupGetValues:
+ *
+ * @group: The cgroup to read the values of
+ * @values: Array of values to read
+ * @nvalues: Number of items in @values
+ *
+ * Reads the statistics files given by the controller and key of each
+ * item in @values at once and fills in their content. The files are
+ * kept open by @group so that subsequent reads only need a single
+ * pread() each. On error no value is filled.
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int
+virCgroupGetValues(virCgroupPtr group,
+                   virCgroupValuePtr values,
+                   size_t nvalues)
+{
+    size_t i;
+    int ret = -1;
+
+    for (i = 0; i < nvalues; i++)
+        values[i].value = NULL;
+
+    virMutexLock(&group->lock);
+
+    for (i = 0; i < nvalues; i++) {
+        if (virCgroupGetStatStrLocked(group, values[i].controller,
+                                      values[i].key, &values[i].value) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virMutexUnlock(&group->lock);
+    if (ret < 0) {
+        for (i = 0; i < nvalues; i++)
+            VIR_FREE(values[i].value);
+    }
+    return ret;
+}
+
+
+/* Closes the files @domain keeps open for statistics of @thread, one of
+ * its thread groups, see virCgroupGetPercpuVcpuSum */
+static int
+virCgroupCloseThreadValueFiles(virCgroupPtr domain,
+                               virCgroupPtr thread)
+{
+    const char *name;
+    char *prefix = NULL;
+
+    if ((name = strrchr(thread->path, '/')))
+        name++;
+    else
+        name = thread->path;
+
+    if (virAsprintf(&prefix, "%s/", name) < 0)
+        return -1;
+
+    virMutexLock(&domain->lock);
+    virCgroupValueFilesClose(domain, prefix);
+    virMutexUnlock(&domain->lock);
+
+    VIR_FREE(prefix);
+    return 0;
+}
+
+
 static int
 virCgroupGetValueForBlkDev(virCgroupPtr group,
                            int controller,
@@ -1161,6 +1436,12 @@ virCgroupNew(pid_t pid,
     if (VIR_ALLOC((*group)) < 0)
         goto error;
 
+    if (virMutexInit(&(*group)->lock) < 0) {
+        virReportSystemError(errno, "%s", _("Unable to init cgroup mutex"));
+        VIR_FREE(*group);
+        goto error;
+    }
+
     if (path[0] == '/' || !parent) {
         if (VIR_STRDUP((*group)->path, path) < 0)
             goto error;
@@ -1799,6 +2080,9 @@ virCgroupFree(virCgroupPtr *group)
         VIR_FREE((*group)->controllers[i].placement);
     }
 
+    virCgroupValueFilesClose(*group, NULL);
+    virMutexDestroy(&(*group)->lock);
+
     VIR_FREE((*group)->path);
     VIR_FREE(*group);
 }
@@ -1897,6 +2181,10 @@ virCgroupGetBlkioIoServiced(virCgroupPtr group,
     char *str1 = NULL, *str2 = NULL, *p1, *p2;
     size_t i;
     int ret = -1;
+    virCgroupValue stats[] = {
+        { VIR_CGROUP_CONTROLLER_BLKIO, "blkio.throttle.io_service_bytes", NULL },
+        { VIR_CGROUP_CONTROLLER_BLKIO, "blkio.throttle.io_serviced", NULL },
+    };
 
     const char *value_names[] = {
         "Read ",
@@ -1916,15 +2204,11 @@ virCgroupGetBlkioIoServiced(virCgroupPtr group,
     *requests_read = 0;
     *requests_write = 0;
 
-    if (virCgroupGetValueStr(group,
-                             VIR_CGROUP_CONTROLLER_BLKIO,
-                             "blkio.throttle.io_service_bytes", &str1) < 0)
+    if (virCgroupGetValues(group, stats, ARRAY_CARDINALITY(stats)) < 0)
         goto cleanup;
 
-    if (virCgroupGetValueStr(group,
-                             VIR_CGROUP_CONTROLLER_BLKIO,
-                             "blkio.throttle.io_serviced", &str2) < 0)
-        goto cleanup;
+    str1 = stats[0].value;
+    str2 = stats[1].value;
 
     /* sum up all entries of the same kind, from all devices */
     for (i = 0; i < ARRAY_CARDINALITY(value_names); i++) {
@@ -2577,9 +2861,9 @@ virCgroupGetMemoryUsage(virCgroupPtr group, unsigned long *kb)
 {
     long long unsigned int usage_in_bytes;
     int ret;
-    ret = virCgroupGetValueU64(group,
-                               VIR_CGROUP_CONTROLLER_MEMORY,
-                               "memory.usage_in_bytes", &usage_in_bytes);
+    ret = virCgroupGetStatU64(group,
+                              VIR_CGROUP_CONTROLLER_MEMORY,
+                              "memory.usage_in_bytes", &usage_in_bytes);
     if (ret == 0)
         *kb = (unsigned long) usage_in_bytes >> 10;
     return ret;
@@ -3132,18 +3416,20 @@ virCgroupGetPercpuVcpuSum(virCgroupPtr group,
     int ret = -1;
     ssize_t i = -1;
     char *buf = NULL;
-    virCgroupPtr group_vcpu = NULL;
+    char *key = NULL;
 
+    /* The vCPU groups are read through the domain group which keeps
+     * their files open as well, see virCgroupNewThread for their names */
     while ((i = virBitmapNextSetBit(guestvcpus, i)) >= 0) {
         char *pos;
         unsigned long long tmp;
         ssize_t j;
 
-        if (virCgroupNewThread(group, VIR_CGROUP_THREAD_VCPU, i,
-                               false, &group_vcpu) < 0)
+        if (virAsprintf(&key, "vcpu%zd/cpuacct.usage_percpu", i) < 0)
             goto cleanup;
 
-        if (virCgroupGetCpuacctPercpuUsage(group_vcpu, &buf) < 0)
+        if (virCgroupGetStatStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
+                                key, &buf) < 0)
             goto cleanup;
 
         pos = buf;
@@ -3158,13 +3444,13 @@ virCgroupGetPercpuVcpuSum(virCgroupPtr group,
             sum_cpu_time[j] += tmp;
         }
 
-        virCgroupFree(&group_vcpu);
+        VIR_FREE(key);
         VIR_FREE(buf);
     }
 
     ret = 0;
  cleanup:
-    virCgroupFree(&group_vcpu);
+    VIR_FREE(key);
     VIR_FREE(buf);
     return ret;
 }
@@ -3437,8 +3723,8 @@ virCgroupSetCpuCfsQuota(virCgroupPtr group, long long cfs_quota)
 int
 virCgroupGetCpuacctPercpuUsage(virCgroupPtr group, char **usage)
 {
-    return virCgroupGetValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
-                                "cpuacct.usage_percpu", usage);
+    return virCgroupGetStatStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
+                               "cpuacct.usage_percpu", usage);
 }
 
 
@@ -3511,6 +3797,11 @@ virCgroupRemove(virCgroupPtr group)
     char *grppath = NULL;
 
     VIR_DEBUG("Removing cgroup %s", group->path);
+
+    virMutexLock(&group->lock);
+    virCgroupValueFilesClose(group, NULL);
+    virMutexUnlock(&group->lock);
+
     for (i = 0; i < VIR_CGROUP_CONTROLLER_LAST; i++) {
         /* Skip over controllers not mounted */
         if (!group->controllers[i].mountPoint)
@@ -3836,9 +4127,9 @@ virCgroupGetCpuCfsQuota(virCgroupPtr group, long long *cfs_quota)
 int
 virCgroupGetCpuacctUsage(virCgroupPtr group, unsigned long long *usage)
 {
-    return virCgroupGetValueU64(group,
-                                VIR_CGROUP_CONTROLLER_CPUACCT,
-                                "cpuacct.usage", usage);
+    return virCgroupGetStatU64(group,
+                               VIR_CGROUP_CONTROLLER_CPUACCT,
+                               "cpuacct.usage", usage);
 }
 
 
@@ -3851,8 +4142,8 @@ virCgroupGetCpuacctStat(virCgroupPtr group, unsigned long long *user,
     int ret = -1;
     static double scale = -1.0;
 
-    if (virCgroupGetValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
-                             "cpuacct.stat", &str) < 0)
+    if (virCgroupGetStatStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
+                            "cpuacct.stat", &str) < 0)
         return -1;
 
     if (!(p = STRSKIP(str, "user ")) ||
@@ -4124,6 +4415,14 @@ virCgroupControllerAvailable(int controller)
 
 #else /* !VIR_CGROUP_SUPPORTED */
 
+static int
+virCgroupCloseThreadValueFiles(virCgroupPtr domain ATTRIBUTE_UNUSED,
+                               virCgroupPtr thread ATTRIBUTE_UNUSED)
+{
+    return 0;
+}
+
+
 bool
 virCgroupAvailable(void)
 {
@@ -4475,6 +4774,17 @@ virCgroupGetMemoryUsage(virCgroupPtr group ATTRIBUTE_UNUSED,
 }
 
 
+int
+virCgroupGetValues(virCgroupPtr group ATTRIBUTE_UNUSED,
+                   virCgroupValuePtr values ATTRIBUTE_UNUSED,
+                   size_t nvalues ATTRIBUTE_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Control groups not supported on this platform"));
+    return -1;
+}
+
+
 int
 virCgroupSetMemoryHardLimit(virCgroupPtr group ATTRIBUTE_UNUSED,
                             unsigned long long kb ATTRIBUTE_UNUSED)
@@ -4913,6 +5223,11 @@ virCgroupDelThread(virCgroupPtr cgroup,
         if (virCgroupNewThread(cgroup, nameval, idx, false, &new_cgroup) < 0)
             return -1;
 
+        if (virCgroupCloseThreadValueFiles(cgroup, new_cgroup) < 0) {
+            virCgroupFree(&new_cgroup);
+            return -1;
+        }
+
         /* Remove the offlined cgroup */
         virCgroupRemove(new_cgroup);
         virCgroupFree(&new_cgroup);
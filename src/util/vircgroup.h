@@ -130,6 +130,18 @@ int virCgroupPathOfController(virCgroupPtr group,
                               const char *key,
                               char **path);
 
+typedef struct _virCgroupValue virCgroupValue;
+typedef virCgroupValue *virCgroupValuePtr;
+struct _virCgroupValue {
+    int controller;
+    const char *key;
+    char *value; /* filled by virCgroupGetValues, freed by caller */
+};
+
+int virCgroupGetValues(virCgroupPtr group,
+                       virCgroupValuePtr values,
+                       size_t nvalues);
+
 int virCgroupAddTask(virCgroupPtr group, pid_t pid);
 int virCgroupAddMachineTask(virCgroupPtr group, pid_t pid);
 
@@ -30,6 +30,7 @@
 # define __VIR_CGROUP_PRIV_H__
 
 # include "vircgroup.h"
+# include "virthread.h"
 
 struct virCgroupController {
     int type;
@@ -42,10 +43,28 @@ struct virCgroupController {
     char *placement;
 };
 
+/* A statistics file kept open so that it can be re-read with pread() */
+struct virCgroupValueFile {
+    int controller;
+    char *key;
+    int fd;
+    size_t size; /* size of the value read last time */
+    unsigned long long used; /* value of @clock when last read */
+};
+
+/* At most this many files are kept open per group, the least recently
+ * read one is closed to make room for another */
+# define VIR_CGROUP_MAX_VALUE_FILES 64
+
 struct virCgroup {
     char *path;
 
     struct virCgroupController controllers[VIR_CGROUP_CONTROLLER_LAST];
+
+    virMutex lock; /* protects @files and @clock */
+    struct virCgroupValueFile *files;
+    size_t nfiles;
+    unsigned long long clock;
 };
 
 int virCgroupDetectMountsFromFile(virCgroupPtr group,
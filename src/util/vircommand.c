@@ -30,6 +30,15 @@
 #include <sys/wait.h>
 #include <fcntl.h>
 #include <unistd.h>
+#ifdef __linux__
+# include <sched.h>
+# include <sys/syscall.h>
+
+/* close_range() got the same number on all architectures but alpha */
+# if !defined(__NR_close_range) && !defined(__alpha__)
+#  define __NR_close_range 436
+# endif
+#endif
 
 #if WITH_CAPNG
 # include <cap-ng.h>
@@ -54,6 +63,7 @@
 #include "virbuffer.h"
 #include "virthread.h"
 #include "virstring.h"
+#include "c-ctype.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -416,6 +426,152 @@ prepareStdFd(int fd, int std)
     return 0;
 }
 
+/* Close all FDs above stderr which are neither listed in @keep nor
+ * passed to the child via @cmd.  Only FDs which are actually open are
+ * visited: close_range() is used for the gaps between the kept FDs
+ * where the kernel supports it, otherwise /proc/self/fd is scanned and
+ * looping up to @openmax is the last resort.
+ *
+ * This is called between fork()/clone() and exec() and must therefore
+ * neither allocate memory nor log.  */
+static bool
+virCommandMassCloseKeep(virCommandPtr cmd,
+                        const int *keep,
+                        size_t nkeep,
+                        int fd)
+{
+    size_t i;
+
+    for (i = 0; i < nkeep; i++) {
+        if (keep[i] == fd)
+            return true;
+    }
+
+    return virCommandFDIsSet(cmd, fd);
+}
+
+# if defined(__linux__) && defined(__NR_close_range)
+/* Returns the lowest FD >= @fd which must be kept, or -1 */
+static int
+virCommandMassCloseNextKeep(virCommandPtr cmd,
+                            const int *keep,
+                            size_t nkeep,
+                            int fd)
+{
+    int ret = -1;
+    size_t i;
+
+    for (i = 0; i < nkeep; i++) {
+        if (keep[i] >= fd && (ret < 0 || keep[i] < ret))
+            ret = keep[i];
+    }
+
+    for (i = 0; i < cmd->npassfd; i++) {
+        if (cmd->passfd[i].fd >= fd && (ret < 0 || cmd->passfd[i].fd < ret))
+            ret = cmd->passfd[i].fd;
+    }
+
+    return ret;
+}
+
+static int
+virCommandMassCloseRange(virCommandPtr cmd,
+                         const int *keep,
+                         size_t nkeep)
+{
+    int fd = STDERR_FILENO + 1;
+    int next;
+
+    while ((next = virCommandMassCloseNextKeep(cmd, keep, nkeep, fd)) >= 0) {
+        if (next > fd &&
+            syscall(__NR_close_range, fd, next - 1, 0) < 0)
+            return -1;
+        fd = next + 1;
+    }
+
+    if (syscall(__NR_close_range, fd, ~0U, 0) < 0)
+        return -1;
+
+    return 0;
+}
+# endif /* defined(__linux__) && defined(__NR_close_range) */
+
+# if defined(__linux__) && defined(__NR_getdents64)
+struct virCommandDirent64 {
+    unsigned long long d_ino;
+    long long d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+static int
+virCommandMassCloseProc(virCommandPtr cmd,
+                        const int *keep,
+                        size_t nkeep)
+{
+    char buf[4096];
+    long len;
+    int dirfd;
+
+    if ((dirfd = open("/proc/self/fd", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+        return -1;
+
+    while ((len = syscall(__NR_getdents64, dirfd, buf, sizeof(buf))) > 0) {
+        long off = 0;
+
+        while (off < len) {
+            struct virCommandDirent64 *ent = (void *) (buf + off);
+            const char *p = ent->d_name;
+            int fd = 0;
+
+            off += ent->d_reclen;
+
+            if (!c_isdigit(*p))
+                continue;
+            while (c_isdigit(*p))
+                fd = fd * 10 + (*p++ - '0');
+
+            if (fd <= STDERR_FILENO || fd == dirfd ||
+                virCommandMassCloseKeep(cmd, keep, nkeep, fd))
+                continue;
+
+            VIR_LOG_CLOSE(fd);
+        }
+    }
+
+    VIR_LOG_CLOSE(dirfd);
+    return len < 0 ? -1 : 0;
+}
+# endif /* defined(__linux__) && defined(__NR_getdents64) */
+
+static void
+virCommandMassClose(virCommandPtr cmd,
+                    const int *keep,
+                    size_t nkeep,
+                    int openmax)
+{
+    int fd;
+
+# if defined(__linux__) && defined(__NR_close_range)
+    if (virCommandMassCloseRange(cmd, keep, nkeep) == 0)
+        return;
+# endif
+# if defined(__linux__) && defined(__NR_getdents64)
+    if (virCommandMassCloseProc(cmd, keep, nkeep) == 0)
+        return;
+# endif
+
+    for (fd = STDERR_FILENO + 1; fd < openmax; fd++) {
+        int tmpfd = fd;
+
+        if (virCommandMassCloseKeep(cmd, keep, nkeep, fd))
+            continue;
+
+        VIR_LOG_CLOSE(tmpfd);
+    }
+}
+
 /* virCommandHandshakeChild:
  *
  *   child side of handshake - called by child process in virExec() to
@@ -499,6 +655,233 @@ virExecCommon(virCommandPtr cmd)
     return ret;
 }
 
+# if defined(__linux__) && defined(CLONE_VFORK)
+typedef struct _virExecSpawnData virExecSpawnData;
+typedef virExecSpawnData *virExecSpawnDataPtr;
+struct _virExecSpawnData {
+    virCommandPtr cmd;
+    const char *binary;
+    int childin;
+    int childout;
+    int childerr;
+    int openmax;
+
+    /* Filled in by the child if it fails before or in exec() */
+    int err;
+    const char *msg;
+};
+
+/*
+ * Whether @cmd can be started without running any of our own code in
+ * the child beyond plain syscalls, in which case there is no need to
+ * pay for duplicating the address space of the daemon with fork().
+ */
+static bool
+virExecCanSpawn(virCommandPtr cmd,
+                const char *binary)
+{
+    if (cmd->hook || cmd->handshake || cmd->pidfile ||
+        (cmd->flags & (VIR_EXEC_DAEMON |
+                       VIR_EXEC_CLEAR_CAPS |
+                       VIR_EXEC_LISTEN_FDS)))
+        return false;
+
+    if (cmd->uid != (uid_t)-1 || cmd->gid != (gid_t)-1 ||
+        cmd->capabilities)
+        return false;
+
+    if (cmd->maxMemLock || cmd->maxProcesses ||
+        cmd->maxFiles || cmd->setMaxCore)
+        return false;
+
+#  if defined(WITH_SECDRIVER_SELINUX)
+    if (cmd->seLinuxLabel)
+        return false;
+#  endif
+#  if defined(WITH_SECDRIVER_APPARMOR)
+    if (cmd->appArmorProfile)
+        return false;
+#  endif
+
+    /* Let virFork() path report missing binaries in the usual way */
+    return virFileIsExecutable(binary);
+}
+
+/*
+ * Child side of virExecSpawn.  This runs on a private stack but shares
+ * memory with the parent, whose calling thread is suspended until we
+ * exec() or exit.  Hence nothing here may allocate, log or take locks.
+ */
+static int
+virExecSpawnChild(void *opaque)
+{
+    virExecSpawnDataPtr data = opaque;
+    virCommandPtr cmd = data->cmd;
+    struct sigaction sig_action;
+    sigset_t mask;
+    size_t i;
+
+    sig_action.sa_handler = SIG_DFL;
+    sig_action.sa_flags = 0;
+    sigemptyset(&sig_action.sa_mask);
+    for (i = 1; i < NSIG; i++)
+        ignore_value(sigaction(i, &sig_action, NULL));
+
+    sigemptyset(&mask);
+    if (sigprocmask(SIG_SETMASK, &mask, NULL) < 0) {
+        data->msg = N_("cannot unblock signals");
+        goto error;
+    }
+
+    if (cmd->mask)
+        umask(cmd->mask);
+
+    if (prepareStdFd(data->childin, STDIN_FILENO) < 0) {
+        data->msg = N_("failed to setup stdin file handle");
+        goto error;
+    }
+    if (data->childout > 0 &&
+        prepareStdFd(data->childout, STDOUT_FILENO) < 0) {
+        data->msg = N_("failed to setup stdout file handle");
+        goto error;
+    }
+    if (data->childerr > 0 &&
+        prepareStdFd(data->childerr, STDERR_FILENO) < 0) {
+        data->msg = N_("failed to setup stderr file handle");
+        goto error;
+    }
+
+    for (i = 0; i < cmd->npassfd; i++) {
+        if (virSetInherit(cmd->passfd[i].fd, true) < 0) {
+            data->msg = N_("failed to preserve file descriptors");
+            goto error;
+        }
+    }
+
+    /* The std handles are duplicated by now so we needn't keep the
+     * originals open */
+    virCommandMassClose(cmd, NULL, 0, data->openmax);
+
+    if (cmd->pwd && chdir(cmd->pwd) < 0) {
+        data->msg = N_("Unable to change working directory");
+        goto error;
+    }
+
+    if (cmd->env)
+        execve(data->binary, cmd->args, cmd->env);
+    else
+        execv(data->binary, cmd->args);
+
+    data->err = errno;
+    _exit(errno == ENOENT ? EXIT_ENOENT : EXIT_CANNOT_INVOKE);
+
+ error:
+    data->err = errno;
+    _exit(EXIT_CANCELED);
+}
+
+/*
+ * virExecSpawn:
+ *
+ * Start @cmd using clone(CLONE_VM | CLONE_VFORK), which is what
+ * posix_spawn() does internally, except that we also get to close
+ * every FD which is not meant to be inherited.  Unlike virFork() it
+ * does not copy the page tables of the daemon, which makes a big
+ * difference when spawning lots of short lived helpers from a large
+ * process.  Unlike virFork() the child setup is finished by the time
+ * this returns, so failures are reported right here.
+ *
+ * Returns the PID of the child, or -1 on error.
+ */
+static pid_t
+virExecSpawn(virCommandPtr cmd,
+             const char *binary,
+             int childin,
+             int childout,
+             int childerr,
+             int openmax)
+{
+    virExecSpawnData data = {
+        .cmd = cmd, .binary = binary, .childin = childin,
+        .childout = childout, .childerr = childerr, .openmax = openmax,
+    };
+    sigset_t oldmask, newmask;
+    int stacksize = 64 * 1024;
+    char *stack;
+    int orig_errno;
+    int saved_errno;
+    int status;
+    pid_t pid;
+
+    if (VIR_ALLOC_N(stack, stacksize) < 0)
+        return -1;
+
+    /* Block signals so that no handler of ours can run in the child
+     * before it has reset them */
+    sigfillset(&newmask);
+    if (pthread_sigmask(SIG_SETMASK, &newmask, &oldmask) != 0) {
+        virReportSystemError(errno,
+                             "%s", _("cannot block signals"));
+        VIR_FREE(stack);
+        return -1;
+    }
+
+    /* The child shares our memory, errno included, and overwrites it
+     * while setting itself up */
+    orig_errno = errno;
+    pid = clone(virExecSpawnChild, stack + stacksize,
+                CLONE_VM | CLONE_VFORK | SIGCHLD, &data);
+    saved_errno = errno;
+    errno = orig_errno;
+
+    ignore_value(pthread_sigmask(SIG_SETMASK, &oldmask, NULL));
+    VIR_FREE(stack);
+
+    if (pid < 0) {
+        virReportSystemError(saved_errno,
+                             "%s", _("cannot fork child process"));
+        return -1;
+    }
+
+    if (data.err) {
+        if (data.msg)
+            virReportSystemError(data.err, "%s", _(data.msg));
+        else
+            virReportSystemError(data.err,
+                                 _("cannot execute binary %s"),
+                                 cmd->args[0]);
+        ignore_value(virProcessWait(pid, &status, true));
+        return -1;
+    }
+
+    VIR_DEBUG("Spawned child %lld without fork", (long long) pid);
+    return pid;
+}
+
+# else /* !(defined(__linux__) && defined(CLONE_VFORK)) */
+
+static bool
+virExecCanSpawn(virCommandPtr cmd ATTRIBUTE_UNUSED,
+                const char *binary ATTRIBUTE_UNUSED)
+{
+    return false;
+}
+
+static pid_t
+virExecSpawn(virCommandPtr cmd ATTRIBUTE_UNUSED,
+             const char *binary ATTRIBUTE_UNUSED,
+             int childin ATTRIBUTE_UNUSED,
+             int childout ATTRIBUTE_UNUSED,
+             int childerr ATTRIBUTE_UNUSED,
+             int openmax ATTRIBUTE_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("spawning without fork is not supported"));
+    return -1;
+}
+
+# endif /* !(defined(__linux__) && defined(CLONE_VFORK)) */
+
 /*
  * virExec:
  * @cmd virCommandPtr containing all information about the program to
@@ -508,13 +891,14 @@ static int
 virExec(virCommandPtr cmd)
 {
     pid_t pid;
-    int null = -1, fd, openmax;
+    int null = -1, openmax;
     int pipeout[2] = {-1, -1};
     int pipeerr[2] = {-1, -1};
     int childin = cmd->infd;
     int childout = -1;
     int childerr = -1;
-    int tmpfd;
+    int keep[3];
+    size_t i;
     char *binarystr = NULL;
     const char *binary = NULL;
     int ret;
@@ -589,7 +973,17 @@ virExec(virCommandPtr cmd)
         childerr = null;
     }
 
-    pid = virFork();
+    openmax = sysconf(_SC_OPEN_MAX);
+    if (openmax < 0) {
+        virReportSystemError(errno,  "%s",
+                             _("sysconf(_SC_OPEN_MAX) failed"));
+        goto cleanup;
+    }
+
+    if (virExecCanSpawn(cmd, binary))
+        pid = virExecSpawn(cmd, binary, childin, childout, childerr, openmax);
+    else
+        pid = virFork();
 
     if (pid < 0)
         goto cleanup;
@@ -617,24 +1011,23 @@ virExec(virCommandPtr cmd)
     if (cmd->mask)
         umask(cmd->mask);
     ret = EXIT_CANCELED;
-    openmax = sysconf(_SC_OPEN_MAX);
-    if (openmax < 0) {
-        virReportSystemError(errno,  "%s",
-                             _("sysconf(_SC_OPEN_MAX) failed"));
-        goto fork_error;
-    }
-    for (fd = 3; fd < openmax; fd++) {
-        if (fd == childin || fd == childout || fd == childerr)
+    for (i = 0; i < cmd->npassfd; i++) {
+        int fd = cmd->passfd[i].fd;
+
+        if (fd <= STDERR_FILENO ||
+            fd == childin || fd == childout || fd == childerr)
             continue;
-        if (!virCommandFDIsSet(cmd, fd)) {
-            tmpfd = fd;
-            VIR_MASS_CLOSE(tmpfd);
-        } else if (virSetInherit(fd, true) < 0) {
+        if (virSetInherit(fd, true) < 0) {
             virReportSystemError(errno, _("failed to preserve fd %d"), fd);
             goto fork_error;
         }
     }
 
+    keep[0] = childin;
+    keep[1] = childout;
+    keep[2] = childerr;
+    virCommandMassClose(cmd, keep, ARRAY_CARDINALITY(keep), openmax);
+
     if (prepareStdFd(childin, STDIN_FILENO) < 0) {
         virReportSystemError(errno,
                              "%s", _("failed to setup stdin file handle"));
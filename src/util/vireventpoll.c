@@ -1,5 +1,5 @@
 /*
- * vireventpoll.c: Poll based event loop for monitoring file handles
+ * vireventpoll.c: Poll/epoll based event loop for monitoring file handles
  *
  * Copyright (C) 2007, 2010-2014 Red Hat, Inc.
  * Copyright (C) 2007 Daniel P. Berrange
@@ -30,6 +30,9 @@
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
+#ifdef HAVE_SYS_EPOLL_H
+# include <sys/epoll.h>
+#endif
 
 #include "virthread.h"
 #include "virlog.h"
@@ -38,6 +41,8 @@
 #include "virutil.h"
 #include "virfile.h"
 #include "virerror.h"
+#include "virhash.h"
+#include "virhashcode.h"
 #include "virprobe.h"
 #include "virtime.h"
 
@@ -49,6 +54,9 @@ VIR_LOG_INIT("util.eventpoll");
 
 static int virEventPollInterruptLocked(void);
 
+typedef struct _virEventPollFD virEventPollFD;
+typedef virEventPollFD *virEventPollFDPtr;
+
 /* State for a single file handle being monitored */
 struct virEventPollHandle {
     int watch;
@@ -58,6 +66,7 @@ struct virEventPollHandle {
     virFreeCallback ff;
     void *opaque;
     int deleted;
+    virEventPollFDPtr pfd; /* Only used by the epoll backend */
 };
 
 /* State for a single timer being generated */
@@ -69,11 +78,27 @@ struct virEventPollTimeout {
     virFreeCallback ff;
     void *opaque;
     int deleted;
+    ssize_t heapIndex; /* -1 if the timer is not scheduled */
 };
 
-/* Allocate extra slots for virEventPollHandle/virEventPollTimeout
-   records in this multiple */
-#define EVENT_ALLOC_EXTENT 10
+/* With epoll a file descriptor can be registered only once,
+ * but callers are allowed to add several watches on the same
+ * FD. This tracks all watches on an FD together with the
+ * union of their events currently registered with epoll. */
+struct _virEventPollFD {
+    int fd;
+    unsigned int gen; /* tells apart FDs reusing the same number */
+    int events;
+    bool registered;
+    bool nopoll; /* epoll refused the FD (e.g. a regular file) */
+    bool stale; /* unregistering failed, epoll may still report it */
+    size_t nhandles;
+    struct virEventPollHandle **handles;
+};
+
+/* Maximum number of ready FDs fetched by one epoll_wait(). Any
+ * remaining ones are reported by the next iteration. */
+#define EVENT_EPOLL_MAX_EVENTS 64
 
 /* State for the main event loop */
 struct virEventPollLoop {
@@ -81,23 +106,326 @@ struct virEventPollLoop {
     int running;
     virThread leader;
     int wakeupfd[2];
-    size_t handlesCount;
-    size_t handlesAlloc;
-    struct virEventPollHandle *handles;
-    size_t timeoutsCount;
-    size_t timeoutsAlloc;
-    struct virEventPollTimeout *timeouts;
+    int epollfd; /* -1 if plain poll() is used */
+
+    /* watch -> virEventPollHandle, deleted handles are removed */
+    virHashTablePtr handles;
+    /* fd -> virEventPollFD, only used by the epoll backend */
+    virHashTablePtr fds;
+    /* FDs which epoll refused and are always considered ready */
+    size_t nnopoll;
+    virEventPollFDPtr *nopoll;
+    /* Purged FDs which epoll may still report, freed only after
+     * the next epoll_wait() completed */
+    size_t nfdsPurge;
+    virEventPollFDPtr *fdsPurge;
+    /* Deleted handles waiting for their free callback */
+    size_t nhandlesPurge;
+    struct virEventPollHandle **handlesPurge;
+
+    /* timer -> virEventPollTimeout, deleted timers are removed */
+    virHashTablePtr timeouts;
+    /* Binary min-heap of enabled timers ordered by expiresAt */
+    size_t timeoutsHeapCount;
+    size_t timeoutsHeapAlloc;
+    struct virEventPollTimeout **timeoutsHeap;
+    /* Deleted timers waiting for their free callback */
+    size_t ntimeoutsPurge;
+    struct virEventPollTimeout **timeoutsPurge;
 };
 
 /* Only have one event loop */
-static struct virEventPollLoop eventLoop;
+static struct virEventPollLoop eventLoop = { .epollfd = -1 };
 
 /* Unique ID for the next FD watch to be registered */
 static int nextWatch = 1;
 
+/* Generation of the next FD registered with epoll */
+static unsigned int nextFDGen = 1;
+
 /* Unique ID for the next timer to be registered */
 static int nextTimer = 1;
 
+
+static uint32_t
+virEventPollIntCode(const void *name, uint32_t seed)
+{
+    int val = (intptr_t)name;
+    return virHashCodeGen(&val, sizeof(val), seed);
+}
+
+
+static bool
+virEventPollIntEqual(const void *namea, const void *nameb)
+{
+    return namea == nameb;
+}
+
+
+static void *
+virEventPollIntCopy(const void *name)
+{
+    return (void *)name;
+}
+
+
+static virHashTablePtr
+virEventPollIntHashCreate(virHashDataFree dataFree)
+{
+    return virHashCreateFull(32, dataFree,
+                             virEventPollIntCode,
+                             virEventPollIntEqual,
+                             virEventPollIntCopy,
+                             NULL);
+}
+
+
+#ifdef HAVE_SYS_EPOLL_H
+static int
+virEventPollToEpollEvents(int events)
+{
+    int ret = 0;
+    if (events & POLLIN)
+        ret |= EPOLLIN;
+    if (events & POLLOUT)
+        ret |= EPOLLOUT;
+    return ret;
+}
+
+
+static int
+virEventPollFromEpollEvents(int events)
+{
+    int ret = 0;
+    if (events & EPOLLIN)
+        ret |= POLLIN;
+    if (events & EPOLLOUT)
+        ret |= POLLOUT;
+    if (events & EPOLLERR)
+        ret |= POLLERR;
+    if (events & EPOLLHUP)
+        ret |= POLLHUP;
+    return ret;
+}
+
+
+/*
+ * Bring the epoll registration of @pfd in sync with the union
+ * of events of its non-deleted watches. An FD whose watches
+ * are all deleted or idle is unregistered completely, just
+ * like poll() wouldn't be asked about it.
+ *
+ * Returns 0 on success, -1 on error
+ */
+static int
+virEventPollEpollSync(virEventPollFDPtr pfd)
+{
+    struct epoll_event ev;
+    int events = 0;
+    int op;
+    size_t i;
+
+    for (i = 0; i < pfd->nhandles; i++) {
+        if (!pfd->handles[i]->deleted)
+            events |= pfd->handles[i]->events;
+    }
+
+    if (pfd->nopoll || (pfd->registered && events == pfd->events)) {
+        pfd->events = events;
+        return 0;
+    }
+
+    /* Events refer to the FD by number and generation rather than
+     * by pointer, see virEventPollEpollLookupFD */
+    memset(&ev, 0, sizeof(ev));
+    ev.events = virEventPollToEpollEvents(events);
+    ev.data.u64 = ((uint64_t) pfd->gen << 32) | (uint32_t) pfd->fd;
+
+    if (events == 0) {
+        /* The FD might be closed already, in which case the kernel
+         * has dropped it from the epoll set on its own unless it was
+         * dup()-ed. Either way we can't tell, so assume epoll may
+         * still report it. */
+        if (pfd->registered &&
+            epoll_ctl(eventLoop.epollfd, EPOLL_CTL_DEL, pfd->fd, &ev) < 0) {
+            EVENT_DEBUG("Unable to unregister fd=%d: %d", pfd->fd, errno);
+            pfd->stale = true;
+        }
+        pfd->registered = false;
+        pfd->events = 0;
+        return 0;
+    }
+
+    op = pfd->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (epoll_ctl(eventLoop.epollfd, op, pfd->fd, &ev) < 0) {
+        /* The FD number may have been closed and reused behind our
+         * back while we still had it registered, or the other way
+         * around. Retry with the opposite operation. */
+        if (errno == ENOENT && op == EPOLL_CTL_MOD)
+            op = EPOLL_CTL_ADD;
+        else if (errno == EEXIST && op == EPOLL_CTL_ADD)
+            op = EPOLL_CTL_MOD;
+        else
+            op = -1;
+
+        if (op == -1 ||
+            epoll_ctl(eventLoop.epollfd, op, pfd->fd, &ev) < 0) {
+            if (errno == EPERM) {
+                /* Regular files and such are always readable and
+                 * writable as far as poll() is concerned */
+                EVENT_DEBUG("fd=%d does not support epoll", pfd->fd);
+                if (VIR_APPEND_ELEMENT_COPY(eventLoop.nopoll,
+                                            eventLoop.nnopoll, pfd) < 0)
+                    return -1;
+                pfd->nopoll = true;
+                pfd->registered = false;
+                pfd->events = events;
+                return 0;
+            }
+            virReportSystemError(errno,
+                                 _("Unable to register fd %d with epoll"),
+                                 pfd->fd);
+            return -1;
+        }
+    }
+
+    pfd->registered = true;
+    pfd->stale = false;
+    pfd->events = events;
+    return 0;
+}
+
+
+/* Maps the data of an event returned by epoll_wait() back to the
+ * FD. Returns NULL if the FD was purged in the meantime or its
+ * number was reused by another FD. */
+static virEventPollFDPtr
+virEventPollEpollLookupFD(uint64_t data)
+{
+    int fd = (int) (uint32_t) data;
+    unsigned int gen = data >> 32;
+    virEventPollFDPtr pfd;
+
+    if (!(pfd = virHashLookup(eventLoop.fds, (void *)(intptr_t)fd)) ||
+        pfd->gen != gen) {
+        EVENT_DEBUG("Ignoring event for stale fd=%d gen=%u", fd, gen);
+        return NULL;
+    }
+
+    return pfd;
+}
+
+
+static int
+virEventPollEpollAddHandle(struct virEventPollHandle *handle)
+{
+    virEventPollFDPtr pfd;
+    bool created = false;
+
+    /* The FD number of a stale FD was reused before its watches were
+     * purged. Its registration is bound to the old FD, so leave it
+     * to the watches still referencing it and start afresh. */
+    if ((pfd = virHashLookup(eventLoop.fds, (void *)(intptr_t)handle->fd)) &&
+        pfd->stale) {
+        virHashSteal(eventLoop.fds, (void *)(intptr_t)handle->fd);
+        pfd = NULL;
+    }
+
+    if (!pfd) {
+        if (VIR_ALLOC(pfd) < 0)
+            return -1;
+        pfd->fd = handle->fd;
+        pfd->gen = nextFDGen++;
+        if (virHashAddEntry(eventLoop.fds,
+                            (void *)(intptr_t)handle->fd, pfd) < 0) {
+            VIR_FREE(pfd);
+            return -1;
+        }
+        created = true;
+    }
+
+    if (VIR_APPEND_ELEMENT_COPY(pfd->handles, pfd->nhandles, handle) < 0)
+        goto error;
+    handle->pfd = pfd;
+
+    if (virEventPollEpollSync(pfd) < 0) {
+        VIR_DELETE_ELEMENT(pfd->handles, pfd->nhandles - 1, pfd->nhandles);
+        handle->pfd = NULL;
+        goto error;
+    }
+
+    return 0;
+
+ error:
+    if (created)
+        virHashRemoveEntry(eventLoop.fds, (void *)(intptr_t)handle->fd);
+    return -1;
+}
+
+
+static void virEventPollEpollFDFree(void *payload, const void *name);
+
+/* Detaches a purged handle from its FD, dropping the FD
+ * entirely once its last watch is gone */
+static void
+virEventPollEpollPurgeHandle(struct virEventPollHandle *handle)
+{
+    virEventPollFDPtr pfd = handle->pfd;
+    size_t i;
+
+    if (!pfd)
+        return;
+
+    for (i = 0; i < pfd->nhandles; i++) {
+        if (pfd->handles[i] == handle) {
+            VIR_DELETE_ELEMENT(pfd->handles, i, pfd->nhandles);
+            break;
+        }
+    }
+    handle->pfd = NULL;
+
+    if (pfd->nhandles)
+        return;
+
+    ignore_value(virEventPollEpollSync(pfd));
+
+    if (pfd->nopoll) {
+        for (i = 0; i < eventLoop.nnopoll; i++) {
+            if (eventLoop.nopoll[i] == pfd) {
+                VIR_DELETE_ELEMENT(eventLoop.nopoll, i, eventLoop.nnopoll);
+                break;
+            }
+        }
+    }
+
+    if (pfd->stale) {
+        /* Keep the FD around until the events already queued for it
+         * were fetched and ignored */
+        if (virHashLookup(eventLoop.fds, (void *)(intptr_t)pfd->fd) == pfd)
+            virHashSteal(eventLoop.fds, (void *)(intptr_t)pfd->fd);
+        if (VIR_APPEND_ELEMENT_COPY(eventLoop.fdsPurge,
+                                    eventLoop.nfdsPurge, pfd) == 0)
+            return;
+        virEventPollEpollFDFree(pfd, NULL);
+        return;
+    }
+
+    virHashRemoveEntry(eventLoop.fds, (void *)(intptr_t)pfd->fd);
+}
+
+
+static void
+virEventPollEpollFDFree(void *payload,
+                        const void *name ATTRIBUTE_UNUSED)
+{
+    virEventPollFDPtr pfd = payload;
+
+    VIR_FREE(pfd->handles);
+    VIR_FREE(pfd);
+}
+#endif /* HAVE_SYS_EPOLL_H */
+
+
 /*
  * Register a callback for monitoring file handle events.
  * NB, it *must* be safe to call this from within a callback
@@ -108,30 +436,35 @@ int virEventPollAddHandle(int fd, int events,
                           void *opaque,
                           virFreeCallback ff)
 {
+    struct virEventPollHandle *handle;
     int watch;
+
+    if (VIR_ALLOC(handle) < 0)
+        return -1;
+
     virMutexLock(&eventLoop.lock);
-    if (eventLoop.handlesCount == eventLoop.handlesAlloc) {
-        EVENT_DEBUG("Used %zu handle slots, adding at least %d more",
-                    eventLoop.handlesAlloc, EVENT_ALLOC_EXTENT);
-        if (VIR_RESIZE_N(eventLoop.handles, eventLoop.handlesAlloc,
-                         eventLoop.handlesCount, EVENT_ALLOC_EXTENT) < 0) {
-            virMutexUnlock(&eventLoop.lock);
-            return -1;
-        }
-    }
 
     watch = nextWatch++;
 
-    eventLoop.handles[eventLoop.handlesCount].watch = watch;
-    eventLoop.handles[eventLoop.handlesCount].fd = fd;
-    eventLoop.handles[eventLoop.handlesCount].events =
-                                         virEventPollToNativeEvents(events);
-    eventLoop.handles[eventLoop.handlesCount].cb = cb;
-    eventLoop.handles[eventLoop.handlesCount].ff = ff;
-    eventLoop.handles[eventLoop.handlesCount].opaque = opaque;
-    eventLoop.handles[eventLoop.handlesCount].deleted = 0;
+    handle->watch = watch;
+    handle->fd = fd;
+    handle->events = virEventPollToNativeEvents(events);
+    handle->cb = cb;
+    handle->ff = ff;
+    handle->opaque = opaque;
+    handle->deleted = 0;
 
-    eventLoop.handlesCount++;
+    if (virHashAddEntry(eventLoop.handles,
+                        (void *)(intptr_t)watch, handle) < 0)
+        goto error;
+
+#ifdef HAVE_SYS_EPOLL_H
+    if (eventLoop.epollfd != -1 &&
+        virEventPollEpollAddHandle(handle) < 0) {
+        virHashRemoveEntry(eventLoop.handles, (void *)(intptr_t)watch);
+        goto error;
+    }
+#endif
 
     virEventPollInterruptLocked();
 
@@ -141,12 +474,16 @@ int virEventPollAddHandle(int fd, int events,
     virMutexUnlock(&eventLoop.lock);
 
     return watch;
+
+ error:
+    virMutexUnlock(&eventLoop.lock);
+    VIR_FREE(handle);
+    return -1;
 }
 
 void virEventPollUpdateHandle(int watch, int events)
 {
-    size_t i;
-    bool found = false;
+    struct virEventPollHandle *handle;
     PROBE(EVENT_POLL_UPDATE_HANDLE,
           "watch=%d events=%d",
           watch, events);
@@ -157,18 +494,18 @@ void virEventPollUpdateHandle(int watch, int events)
     }
 
     virMutexLock(&eventLoop.lock);
-    for (i = 0; i < eventLoop.handlesCount; i++) {
-        if (eventLoop.handles[i].watch == watch) {
-            eventLoop.handles[i].events =
-                    virEventPollToNativeEvents(events);
-            virEventPollInterruptLocked();
-            found = true;
-            break;
-        }
+    if ((handle = virHashLookup(eventLoop.handles, (void *)(intptr_t)watch))) {
+        handle->events = virEventPollToNativeEvents(events);
+#ifdef HAVE_SYS_EPOLL_H
+        if (handle->pfd &&
+            virEventPollEpollSync(handle->pfd) < 0)
+            VIR_WARN("Unable to update events of watch %d", watch);
+#endif
+        virEventPollInterruptLocked();
     }
     virMutexUnlock(&eventLoop.lock);
 
-    if (!found)
+    if (!handle)
         VIR_WARN("Got update for non-existent handle watch %d", watch);
 }
 
@@ -180,7 +517,7 @@ void virEventPollUpdateHandle(int watch, int events)
  */
 int virEventPollRemoveHandle(int watch)
 {
-    size_t i;
+    struct virEventPollHandle *handle;
     PROBE(EVENT_POLL_REMOVE_HANDLE,
           "watch=%d",
           watch);
@@ -191,20 +528,120 @@ int virEventPollRemoveHandle(int watch)
     }
 
     virMutexLock(&eventLoop.lock);
-    for (i = 0; i < eventLoop.handlesCount; i++) {
-        if (eventLoop.handles[i].deleted)
-            continue;
+    if (!(handle = virHashLookup(eventLoop.handles,
+                                 (void *)(intptr_t)watch))) {
+        virMutexUnlock(&eventLoop.lock);
+        return -1;
+    }
 
-        if (eventLoop.handles[i].watch == watch) {
-            EVENT_DEBUG("mark delete %zu %d", i, eventLoop.handles[i].fd);
-            eventLoop.handles[i].deleted = 1;
-            virEventPollInterruptLocked();
-            virMutexUnlock(&eventLoop.lock);
-            return 0;
-        }
+    if (VIR_APPEND_ELEMENT_COPY(eventLoop.handlesPurge,
+                                eventLoop.nhandlesPurge, handle) < 0) {
+        virMutexUnlock(&eventLoop.lock);
+        return -1;
     }
+
+    EVENT_DEBUG("mark delete %d %d", handle->watch, handle->fd);
+    handle->deleted = 1;
+    virHashRemoveEntry(eventLoop.handles, (void *)(intptr_t)watch);
+#ifdef HAVE_SYS_EPOLL_H
+    if (handle->pfd)
+        ignore_value(virEventPollEpollSync(handle->pfd));
+#endif
+    virEventPollInterruptLocked();
     virMutexUnlock(&eventLoop.lock);
-    return -1;
+    return 0;
+}
+
+
+static bool
+virEventPollTimeoutHeapLess(size_t a, size_t b)
+{
+    return eventLoop.timeoutsHeap[a]->expiresAt <
+        eventLoop.timeoutsHeap[b]->expiresAt;
+}
+
+
+static void
+virEventPollTimeoutHeapSwap(size_t a, size_t b)
+{
+    struct virEventPollTimeout *tmp = eventLoop.timeoutsHeap[a];
+
+    eventLoop.timeoutsHeap[a] = eventLoop.timeoutsHeap[b];
+    eventLoop.timeoutsHeap[b] = tmp;
+    eventLoop.timeoutsHeap[a]->heapIndex = a;
+    eventLoop.timeoutsHeap[b]->heapIndex = b;
+}
+
+
+/* Restores the heap property around @i after its expiry changed */
+static void
+virEventPollTimeoutHeapFix(size_t i)
+{
+    while (i > 0 && virEventPollTimeoutHeapLess(i, (i - 1) / 2)) {
+        virEventPollTimeoutHeapSwap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+
+    while (true) {
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+        size_t smallest = i;
+
+        if (left < eventLoop.timeoutsHeapCount &&
+            virEventPollTimeoutHeapLess(left, smallest))
+            smallest = left;
+        if (right < eventLoop.timeoutsHeapCount &&
+            virEventPollTimeoutHeapLess(right, smallest))
+            smallest = right;
+        if (smallest == i)
+            break;
+
+        virEventPollTimeoutHeapSwap(i, smallest);
+        i = smallest;
+    }
+}
+
+
+static void
+virEventPollTimeoutUnschedule(struct virEventPollTimeout *timeout)
+{
+    size_t i = timeout->heapIndex;
+    size_t last = eventLoop.timeoutsHeapCount - 1;
+
+    if (timeout->heapIndex < 0)
+        return;
+
+    if (i != last)
+        virEventPollTimeoutHeapSwap(i, last);
+    eventLoop.timeoutsHeap[last] = NULL;
+    eventLoop.timeoutsHeapCount--;
+    timeout->heapIndex = -1;
+
+    if (i != last)
+        virEventPollTimeoutHeapFix(i);
+}
+
+
+/* Places @timeout in the heap according to its frequency,
+ * @timeout must not be scheduled yet */
+static int
+virEventPollTimeoutSchedule(struct virEventPollTimeout *timeout,
+                            unsigned long long now)
+{
+    if (timeout->frequency < 0) {
+        timeout->expiresAt = 0;
+        return 0;
+    }
+
+    if (VIR_RESIZE_N(eventLoop.timeoutsHeap, eventLoop.timeoutsHeapAlloc,
+                     eventLoop.timeoutsHeapCount, 1) < 0)
+        return -1;
+
+    timeout->expiresAt = now + timeout->frequency;
+    timeout->heapIndex = eventLoop.timeoutsHeapCount;
+    eventLoop.timeoutsHeap[eventLoop.timeoutsHeapCount++] = timeout;
+    virEventPollTimeoutHeapFix(timeout->heapIndex);
+    return 0;
 }
 
 
@@ -218,34 +655,37 @@ int virEventPollAddTimeout(int frequency,
                            void *opaque,
                            virFreeCallback ff)
 {
+    struct virEventPollTimeout *timeout;
     unsigned long long now;
     int ret;
 
     if (virTimeMillisNow(&now) < 0)
         return -1;
 
+    if (VIR_ALLOC(timeout) < 0)
+        return -1;
+
     virMutexLock(&eventLoop.lock);
-    if (eventLoop.timeoutsCount == eventLoop.timeoutsAlloc) {
-        EVENT_DEBUG("Used %zu timeout slots, adding at least %d more",
-                    eventLoop.timeoutsAlloc, EVENT_ALLOC_EXTENT);
-        if (VIR_RESIZE_N(eventLoop.timeouts, eventLoop.timeoutsAlloc,
-                         eventLoop.timeoutsCount, EVENT_ALLOC_EXTENT) < 0) {
-            virMutexUnlock(&eventLoop.lock);
-            return -1;
-        }
-    }
 
-    eventLoop.timeouts[eventLoop.timeoutsCount].timer = nextTimer++;
-    eventLoop.timeouts[eventLoop.timeoutsCount].frequency = frequency;
-    eventLoop.timeouts[eventLoop.timeoutsCount].cb = cb;
-    eventLoop.timeouts[eventLoop.timeoutsCount].ff = ff;
-    eventLoop.timeouts[eventLoop.timeoutsCount].opaque = opaque;
-    eventLoop.timeouts[eventLoop.timeoutsCount].deleted = 0;
-    eventLoop.timeouts[eventLoop.timeoutsCount].expiresAt =
-        frequency >= 0 ? frequency + now : 0;
+    timeout->timer = nextTimer++;
+    timeout->frequency = frequency;
+    timeout->cb = cb;
+    timeout->ff = ff;
+    timeout->opaque = opaque;
+    timeout->deleted = 0;
+    timeout->heapIndex = -1;
 
-    eventLoop.timeoutsCount++;
-    ret = nextTimer-1;
+    if (virHashAddEntry(eventLoop.timeouts,
+                        (void *)(intptr_t)timeout->timer, timeout) < 0)
+        goto error;
+
+    if (virEventPollTimeoutSchedule(timeout, now) < 0) {
+        virHashRemoveEntry(eventLoop.timeouts,
+                           (void *)(intptr_t)timeout->timer);
+        goto error;
+    }
+
+    ret = timeout->timer;
     virEventPollInterruptLocked();
 
     PROBE(EVENT_POLL_ADD_TIMEOUT,
@@ -253,13 +693,17 @@ int virEventPollAddTimeout(int frequency,
           ret, frequency, cb, opaque, ff);
     virMutexUnlock(&eventLoop.lock);
     return ret;
+
+ error:
+    virMutexUnlock(&eventLoop.lock);
+    VIR_FREE(timeout);
+    return -1;
 }
 
 void virEventPollUpdateTimeout(int timer, int frequency)
 {
+    struct virEventPollTimeout *timeout;
     unsigned long long now;
-    size_t i;
-    bool found = false;
     PROBE(EVENT_POLL_UPDATE_TIMEOUT,
           "timer=%d frequency=%d",
           timer, frequency);
@@ -273,21 +717,19 @@ void virEventPollUpdateTimeout(int timer, int frequency)
         return;
 
     virMutexLock(&eventLoop.lock);
-    for (i = 0; i < eventLoop.timeoutsCount; i++) {
-        if (eventLoop.timeouts[i].timer == timer) {
-            eventLoop.timeouts[i].frequency = frequency;
-            eventLoop.timeouts[i].expiresAt =
-                frequency >= 0 ? frequency + now : 0;
-            VIR_DEBUG("Set timer freq=%d expires=%llu", frequency,
-                      eventLoop.timeouts[i].expiresAt);
-            virEventPollInterruptLocked();
-            found = true;
-            break;
-        }
+    if ((timeout = virHashLookup(eventLoop.timeouts,
+                                 (void *)(intptr_t)timer))) {
+        virEventPollTimeoutUnschedule(timeout);
+        timeout->frequency = frequency;
+        if (virEventPollTimeoutSchedule(timeout, now) < 0)
+            VIR_WARN("Unable to schedule timer %d", timer);
+        VIR_DEBUG("Set timer freq=%d expires=%llu", frequency,
+                  timeout->expiresAt);
+        virEventPollInterruptLocked();
     }
     virMutexUnlock(&eventLoop.lock);
 
-    if (!found)
+    if (!timeout)
         VIR_WARN("Got update for non-existent timer %d", timer);
 }
 
@@ -299,7 +741,7 @@ void virEventPollUpdateTimeout(int timer, int frequency)
  */
 int virEventPollRemoveTimeout(int timer)
 {
-    size_t i;
+    struct virEventPollTimeout *timeout;
     PROBE(EVENT_POLL_REMOVE_TIMEOUT,
           "timer=%d",
           timer);
@@ -310,23 +752,28 @@ int virEventPollRemoveTimeout(int timer)
     }
 
     virMutexLock(&eventLoop.lock);
-    for (i = 0; i < eventLoop.timeoutsCount; i++) {
-        if (eventLoop.timeouts[i].deleted)
-            continue;
+    if (!(timeout = virHashLookup(eventLoop.timeouts,
+                                  (void *)(intptr_t)timer))) {
+        virMutexUnlock(&eventLoop.lock);
+        return -1;
+    }
 
-        if (eventLoop.timeouts[i].timer == timer) {
-            eventLoop.timeouts[i].deleted = 1;
-            virEventPollInterruptLocked();
-            virMutexUnlock(&eventLoop.lock);
-            return 0;
-        }
+    if (VIR_APPEND_ELEMENT_COPY(eventLoop.timeoutsPurge,
+                                eventLoop.ntimeoutsPurge, timeout) < 0) {
+        virMutexUnlock(&eventLoop.lock);
+        return -1;
     }
+
+    timeout->deleted = 1;
+    virEventPollTimeoutUnschedule(timeout);
+    virHashRemoveEntry(eventLoop.timeouts, (void *)(intptr_t)timer);
+    virEventPollInterruptLocked();
     virMutexUnlock(&eventLoop.lock);
-    return -1;
+    return 0;
 }
 
-/* Iterates over all registered timeouts and determine which
- * will be the first to expire.
+/* Looks at the head of the timer heap to determine which
+ * timer will be the first to expire.
  * @timeout: filled with expiry time of soonest timer, or -1 if
  *           no timeout is pending
  * returns: 0 on success, -1 on error
@@ -334,20 +781,11 @@ int virEventPollRemoveTimeout(int timer)
 static int virEventPollCalculateTimeout(int *timeout)
 {
     unsigned long long then = 0;
-    size_t i;
-    EVENT_DEBUG("Calculate expiry of %zu timers", eventLoop.timeoutsCount);
+    EVENT_DEBUG("Calculate expiry of %zu timers",
+                eventLoop.timeoutsHeapCount);
     /* Figure out if we need a timeout */
-    for (i = 0; i < eventLoop.timeoutsCount; i++) {
-        if (eventLoop.timeouts[i].deleted)
-            continue;
-        if (eventLoop.timeouts[i].frequency < 0)
-            continue;
-
-        EVENT_DEBUG("Got a timeout scheduled for %llu", eventLoop.timeouts[i].expiresAt);
-        if (then == 0 ||
-            eventLoop.timeouts[i].expiresAt < then)
-            then = eventLoop.timeouts[i].expiresAt;
-    }
+    if (eventLoop.timeoutsHeapCount > 0)
+        then = eventLoop.timeoutsHeap[0]->expiresAt;
 
     /* Calculate how long we should wait for a timeout if needed */
     if (then > 0) {
@@ -373,46 +811,88 @@ static int virEventPollCalculateTimeout(int *timeout)
     return 0;
 }
 
+
+static int
+virEventPollCollectHandle(void *payload,
+                          const void *name ATTRIBUTE_UNUSED,
+                          void *opaque)
+{
+    struct virEventPollHandle ***handles = opaque;
+    struct virEventPollHandle *handle = payload;
+
+    if (handle->events)
+        *((*handles)++) = handle;
+    return 0;
+}
+
+
 /*
  * Allocate a pollfd array containing data for all registered
- * file handles. The caller must free the returned data struct
+ * file handles, along with an array of the matching handles.
+ * The caller must free the returned data structs.
  * returns: the pollfd array, or NULL on error
  */
-static struct pollfd *virEventPollMakePollFDs(int *nfds) {
-    struct pollfd *fds;
+static struct pollfd *
+virEventPollMakePollFDs(struct virEventPollHandle ***handles,
+                        int *nfds)
+{
+    struct pollfd *fds = NULL;
+    struct virEventPollHandle **last;
     size_t i;
 
     *nfds = 0;
-    for (i = 0; i < eventLoop.handlesCount; i++) {
-        if (eventLoop.handles[i].events && !eventLoop.handles[i].deleted)
-            (*nfds)++;
-    }
 
     /* Setup the poll file handle data structs */
-    if (VIR_ALLOC_N(fds, *nfds) < 0)
+    if (VIR_ALLOC_N(fds, virHashSize(eventLoop.handles) + 1) < 0 ||
+        VIR_ALLOC_N(*handles, virHashSize(eventLoop.handles) + 1) < 0) {
+        VIR_FREE(fds);
         return NULL;
+    }
 
-    *nfds = 0;
-    for (i = 0; i < eventLoop.handlesCount; i++) {
-        EVENT_DEBUG("Prepare n=%zu w=%d, f=%d e=%d d=%d", i,
-                    eventLoop.handles[i].watch,
-                    eventLoop.handles[i].fd,
-                    eventLoop.handles[i].events,
-                    eventLoop.handles[i].deleted);
-        if (!eventLoop.handles[i].events || eventLoop.handles[i].deleted)
-            continue;
-        fds[*nfds].fd = eventLoop.handles[i].fd;
-        fds[*nfds].events = eventLoop.handles[i].events;
-        fds[*nfds].revents = 0;
-        (*nfds)++;
+    last = *handles;
+    virHashForEach(eventLoop.handles, virEventPollCollectHandle, &last);
+    *nfds = last - *handles;
+
+    for (i = 0; i < *nfds; i++) {
+        EVENT_DEBUG("Prepare n=%zu w=%d, f=%d e=%d", i,
+                    (*handles)[i]->watch,
+                    (*handles)[i]->fd,
+                    (*handles)[i]->events);
+        fds[i].fd = (*handles)[i]->fd;
+        fds[i].events = (*handles)[i]->events;
+        fds[i].revents = 0;
     }
 
     return fds;
 }
 
 
+static int
+virEventPollCollectExpired(size_t i,
+                           unsigned long long deadline,
+                           struct virEventPollTimeout ***expired,
+                           size_t *nexpired)
+{
+    if (i >= eventLoop.timeoutsHeapCount ||
+        eventLoop.timeoutsHeap[i]->expiresAt > deadline)
+        return 0;
+
+    if (VIR_APPEND_ELEMENT_COPY(*expired, *nexpired,
+                                eventLoop.timeoutsHeap[i]) < 0)
+        return -1;
+
+    if (virEventPollCollectExpired(2 * i + 1, deadline,
+                                   expired, nexpired) < 0 ||
+        virEventPollCollectExpired(2 * i + 2, deadline,
+                                   expired, nexpired) < 0)
+        return -1;
+
+    return 0;
+}
+
+
 /*
- * Iterate over all timers and determine if any have expired.
+ * Determine from the timer heap which timers have expired.
  * Invoke the user supplied callback for each timer whose
  * expiry time is met, and schedule the next timeout. Does
  * not try to 'catch up' on time if the actual expiry time
@@ -426,42 +906,88 @@ static struct pollfd *virEventPollMakePollFDs(int *nfds) {
 static int virEventPollDispatchTimeouts(void)
 {
     unsigned long long now;
+    struct virEventPollTimeout **expired = NULL;
+    size_t nexpired = 0;
     size_t i;
-    /* Save this now - it may be changed during dispatch */
-    int ntimeouts = eventLoop.timeoutsCount;
-    VIR_DEBUG("Dispatch %d", ntimeouts);
 
     if (virTimeMillisNow(&now) < 0)
         return -1;
 
-    for (i = 0; i < ntimeouts; i++) {
-        if (eventLoop.timeouts[i].deleted || eventLoop.timeouts[i].frequency < 0)
+    /* Add 20ms fuzz so we don't pointlessly spin doing
+     * <10ms sleeps, particularly on kernels with low HZ
+     * it is fine that a timer expires 20ms earlier than
+     * requested
+     */
+    /* Collect expired timers upfront, so that timers re-armed
+     * by their own callback are not dispatched twice */
+    if (virEventPollCollectExpired(0, now + 20, &expired, &nexpired) < 0)
+        return -1;
+
+    VIR_DEBUG("Dispatch %zu", nexpired);
+
+    for (i = 0; i < nexpired; i++) {
+        struct virEventPollTimeout *timeout = expired[i];
+        virEventTimeoutCallback cb = timeout->cb;
+        int timer = timeout->timer;
+        void *opaque = timeout->opaque;
+
+        /* An earlier callback may have changed this one. Since
+         * timers are purged only after dispatch the pointer
+         * remains valid. */
+        if (timeout->deleted || timeout->heapIndex < 0 ||
+            timeout->expiresAt > (now + 20))
             continue;
 
-        /* Add 20ms fuzz so we don't pointlessly spin doing
-         * <10ms sleeps, particularly on kernels with low HZ
-         * it is fine that a timer expires 20ms earlier than
-         * requested
-         */
-        if (eventLoop.timeouts[i].expiresAt <= (now+20)) {
-            virEventTimeoutCallback cb = eventLoop.timeouts[i].cb;
-            int timer = eventLoop.timeouts[i].timer;
-            void *opaque = eventLoop.timeouts[i].opaque;
-            eventLoop.timeouts[i].expiresAt =
-                now + eventLoop.timeouts[i].frequency;
-
-            PROBE(EVENT_POLL_DISPATCH_TIMEOUT,
-                  "timer=%d",
-                  timer);
-            virMutexUnlock(&eventLoop.lock);
-            (cb)(timer, opaque);
-            virMutexLock(&eventLoop.lock);
-        }
+        timeout->expiresAt = now + timeout->frequency;
+        virEventPollTimeoutHeapFix(timeout->heapIndex);
+
+        PROBE(EVENT_POLL_DISPATCH_TIMEOUT,
+              "timer=%d",
+              timer);
+        virMutexUnlock(&eventLoop.lock);
+        (cb)(timer, opaque);
+        virMutexLock(&eventLoop.lock);
     }
+
+    VIR_FREE(expired);
     return 0;
 }
 
 
+/* Dispatches @revents to a single handle unless it was
+ * removed or disabled meanwhile */
+static void
+virEventPollDispatchHandle(struct virEventPollHandle *handle,
+                           int revents)
+{
+    virEventHandleCallback cb = handle->cb;
+    int watch = handle->watch;
+    int fd = handle->fd;
+    void *opaque = handle->opaque;
+    int hEvents;
+
+    VIR_DEBUG("w=%d", watch);
+    if (handle->deleted) {
+        EVENT_DEBUG("Skip deleted w=%d f=%d", watch, fd);
+        return;
+    }
+
+    /* Like poll(), report errors and hangups even if they
+     * were not asked for explicitly */
+    revents &= handle->events | POLLERR | POLLHUP | POLLNVAL;
+    if (!handle->events || !revents)
+        return;
+
+    hEvents = virEventPollFromNativeEvents(revents);
+    PROBE(EVENT_POLL_DISPATCH_HANDLE,
+          "watch=%d events=%d",
+          watch, hEvents);
+    virMutexUnlock(&eventLoop.lock);
+    (cb)(watch, fd, hEvents, opaque);
+    virMutexLock(&eventLoop.lock);
+}
+
+
 /* Iterate over all file handles and dispatch any which
  * have pending events listed in the poll() data. Invoke
  * the user supplied callback for each handle which has
@@ -472,46 +998,68 @@ static int virEventPollDispatchTimeouts(void)
  *
  * Returns 0 upon success, -1 if an error occurred
  */
-static int virEventPollDispatchHandles(int nfds, struct pollfd *fds)
+static int virEventPollDispatchHandles(int nfds,
+                                       struct pollfd *fds,
+                                       struct virEventPollHandle **handles)
 {
-    size_t i, n;
+    size_t n;
     VIR_DEBUG("Dispatch %d", nfds);
 
-    /* NB, use nfds not eventLoop.handlesCount, because new
-     * fds might be added on end of list, and they're not
-     * in the fds array we've got */
-    for (i = 0, n = 0; n < nfds && i < eventLoop.handlesCount; n++) {
-        while (i < eventLoop.handlesCount &&
-               (eventLoop.handles[i].fd != fds[n].fd ||
-                eventLoop.handles[i].events == 0)) {
-            i++;
-        }
-        if (i == eventLoop.handlesCount)
-            break;
+    /* NB, handles registered by a callback are not in the
+     * fds array we've got, and removed ones are not purged
+     * until after dispatch, so @handles remains valid */
+    for (n = 0; n < nfds; n++) {
+        if (fds[n].revents)
+            virEventPollDispatchHandle(handles[n], fds[n].revents);
+    }
 
-        VIR_DEBUG("i=%zu w=%d", i, eventLoop.handles[i].watch);
-        if (eventLoop.handles[i].deleted) {
-            EVENT_DEBUG("Skip deleted n=%zu w=%d f=%d", i,
-                        eventLoop.handles[i].watch, eventLoop.handles[i].fd);
-            continue;
-        }
+    return 0;
+}
 
-        if (fds[n].revents) {
-            virEventHandleCallback cb = eventLoop.handles[i].cb;
-            int watch = eventLoop.handles[i].watch;
-            void *opaque = eventLoop.handles[i].opaque;
-            int hEvents = virEventPollFromNativeEvents(fds[n].revents);
-            PROBE(EVENT_POLL_DISPATCH_HANDLE,
-                  "watch=%d events=%d",
-                  watch, hEvents);
-            virMutexUnlock(&eventLoop.lock);
-            (cb)(watch, fds[n].fd, hEvents, opaque);
-            virMutexLock(&eventLoop.lock);
-        }
+
+#ifdef HAVE_SYS_EPOLL_H
+/* Dispatches all watches on @pfd, taking care of watches
+ * added to the FD by the callbacks themselves */
+static void
+virEventPollEpollDispatchFD(virEventPollFDPtr pfd,
+                            int revents)
+{
+    size_t nhandles = pfd->nhandles;
+    size_t i;
+
+    for (i = 0; i < nhandles && i < pfd->nhandles; i++)
+        virEventPollDispatchHandle(pfd->handles[i], revents);
+}
+
+
+/* Same as virEventPollDispatchHandles, but for the events
+ * returned by epoll_wait() */
+static int
+virEventPollEpollDispatchHandles(int nevents,
+                                 struct epoll_event *events)
+{
+    size_t nnopoll = eventLoop.nnopoll;
+    size_t i;
+    VIR_DEBUG("Dispatch %d", nevents);
+
+    /* Handles are purged only after dispatch, but the FD an event
+     * was queued for may have been purged before this iteration */
+    for (i = 0; i < nevents; i++) {
+        int revents = virEventPollFromEpollEvents(events[i].events);
+        virEventPollFDPtr pfd;
+
+        if ((pfd = virEventPollEpollLookupFD(events[i].data.u64)))
+            virEventPollEpollDispatchFD(pfd, revents);
+    }
+
+    for (i = 0; i < nnopoll && i < eventLoop.nnopoll; i++) {
+        virEventPollFDPtr pfd = eventLoop.nopoll[i];
+        virEventPollEpollDispatchFD(pfd, pfd->events & (POLLIN | POLLOUT));
     }
 
     return 0;
 }
+#endif /* HAVE_SYS_EPOLL_H */
 
 
 /* Used post dispatch to actually remove any timers that
@@ -520,46 +1068,30 @@ static int virEventPollDispatchHandles(int nfds, struct pollfd *fds)
  */
 static void virEventPollCleanupTimeouts(void)
 {
-    size_t i;
-    size_t gap;
-    VIR_DEBUG("Cleanup %zu", eventLoop.timeoutsCount);
+    VIR_DEBUG("Cleanup %zu", eventLoop.ntimeoutsPurge);
 
-    /* Remove deleted entries, shuffling down remaining
-     * entries as needed to form contiguous series
-     */
-    for (i = 0; i < eventLoop.timeoutsCount;) {
-        if (!eventLoop.timeouts[i].deleted) {
-            i++;
-            continue;
-        }
+    /* Free callbacks may remove further timers, so always
+     * take the last entry of the list anew */
+    while (eventLoop.ntimeoutsPurge > 0) {
+        struct virEventPollTimeout *timeout =
+            eventLoop.timeoutsPurge[eventLoop.ntimeoutsPurge - 1];
+
+        VIR_DELETE_ELEMENT(eventLoop.timeoutsPurge,
+                           eventLoop.ntimeoutsPurge - 1,
+                           eventLoop.ntimeoutsPurge);
 
         PROBE(EVENT_POLL_PURGE_TIMEOUT,
               "timer=%d",
-              eventLoop.timeouts[i].timer);
-        if (eventLoop.timeouts[i].ff) {
-            virFreeCallback ff = eventLoop.timeouts[i].ff;
-            void *opaque = eventLoop.timeouts[i].opaque;
+              timeout->timer);
+        if (timeout->ff) {
+            virFreeCallback ff = timeout->ff;
+            void *opaque = timeout->opaque;
             virMutexUnlock(&eventLoop.lock);
             ff(opaque);
             virMutexLock(&eventLoop.lock);
         }
 
-        if ((i+1) < eventLoop.timeoutsCount) {
-            memmove(eventLoop.timeouts+i,
-                    eventLoop.timeouts+i+1,
-                    sizeof(struct virEventPollTimeout)*(eventLoop.timeoutsCount
-                                                    -(i+1)));
-        }
-        eventLoop.timeoutsCount--;
-    }
-
-    /* Release some memory if we've got a big chunk free */
-    gap = eventLoop.timeoutsAlloc - eventLoop.timeoutsCount;
-    if (eventLoop.timeoutsCount == 0 ||
-        (gap > eventLoop.timeoutsCount && gap > EVENT_ALLOC_EXTENT)) {
-        EVENT_DEBUG("Found %zu out of %zu timeout slots used, releasing %zu",
-                    eventLoop.timeoutsCount, eventLoop.timeoutsAlloc, gap);
-        VIR_SHRINK_N(eventLoop.timeouts, eventLoop.timeoutsAlloc, gap);
+        VIR_FREE(timeout);
     }
 }
 
@@ -569,66 +1101,49 @@ static void virEventPollCleanupTimeouts(void)
  */
 static void virEventPollCleanupHandles(void)
 {
-    size_t i;
-    size_t gap;
-    VIR_DEBUG("Cleanup %zu", eventLoop.handlesCount);
+    VIR_DEBUG("Cleanup %zu", eventLoop.nhandlesPurge);
 
-    /* Remove deleted entries, shuffling down remaining
-     * entries as needed to form contiguous series
-     */
-    for (i = 0; i < eventLoop.handlesCount;) {
-        if (!eventLoop.handles[i].deleted) {
-            i++;
-            continue;
-        }
+    /* Free callbacks may remove further handles, so always
+     * take the last entry of the list anew */
+    while (eventLoop.nhandlesPurge > 0) {
+        struct virEventPollHandle *handle =
+            eventLoop.handlesPurge[eventLoop.nhandlesPurge - 1];
+
+        VIR_DELETE_ELEMENT(eventLoop.handlesPurge,
+                           eventLoop.nhandlesPurge - 1,
+                           eventLoop.nhandlesPurge);
 
         PROBE(EVENT_POLL_PURGE_HANDLE,
               "watch=%d",
-              eventLoop.handles[i].watch);
-        if (eventLoop.handles[i].ff) {
-            virFreeCallback ff = eventLoop.handles[i].ff;
-            void *opaque = eventLoop.handles[i].opaque;
+              handle->watch);
+#ifdef HAVE_SYS_EPOLL_H
+        virEventPollEpollPurgeHandle(handle);
+#endif
+        if (handle->ff) {
+            virFreeCallback ff = handle->ff;
+            void *opaque = handle->opaque;
             virMutexUnlock(&eventLoop.lock);
             ff(opaque);
             virMutexLock(&eventLoop.lock);
         }
 
-        if ((i+1) < eventLoop.handlesCount) {
-            memmove(eventLoop.handles+i,
-                    eventLoop.handles+i+1,
-                    sizeof(struct virEventPollHandle)*(eventLoop.handlesCount
-                                                   -(i+1)));
-        }
-        eventLoop.handlesCount--;
-    }
-
-    /* Release some memory if we've got a big chunk free */
-    gap = eventLoop.handlesAlloc - eventLoop.handlesCount;
-    if (eventLoop.handlesCount == 0 ||
-        (gap > eventLoop.handlesCount && gap > EVENT_ALLOC_EXTENT)) {
-        EVENT_DEBUG("Found %zu out of %zu handles slots used, releasing %zu",
-                    eventLoop.handlesCount, eventLoop.handlesAlloc, gap);
-        VIR_SHRINK_N(eventLoop.handles, eventLoop.handlesAlloc, gap);
+        VIR_FREE(handle);
     }
 }
 
+
 /*
- * Run a single iteration of the event loop, blocking until
- * at least one file handle has an event, or a timer expires
+ * Wait for events using poll(), the file handles are
+ * collected anew on each iteration.
  */
-int virEventPollRunOnce(void)
+static int
+virEventPollRunOncePoll(void)
 {
     struct pollfd *fds = NULL;
+    struct virEventPollHandle **handles = NULL;
     int ret, timeout, nfds;
 
-    virMutexLock(&eventLoop.lock);
-    eventLoop.running = 1;
-    virThreadSelf(&eventLoop.leader);
-
-    virEventPollCleanupTimeouts();
-    virEventPollCleanupHandles();
-
-    if (!(fds = virEventPollMakePollFDs(&nfds)) ||
+    if (!(fds = virEventPollMakePollFDs(&handles, &nfds)) ||
         virEventPollCalculateTimeout(&timeout) < 0)
         goto error;
 
@@ -654,25 +1169,122 @@ int virEventPollRunOnce(void)
         goto error;
 
     if (ret > 0 &&
-        virEventPollDispatchHandles(nfds, fds) < 0)
+        virEventPollDispatchHandles(nfds, fds, handles) < 0)
         goto error;
 
-    virEventPollCleanupTimeouts();
-    virEventPollCleanupHandles();
-
-    eventLoop.running = 0;
-    virMutexUnlock(&eventLoop.lock);
     VIR_FREE(fds);
+    VIR_FREE(handles);
     return 0;
 
- error:
-    virMutexUnlock(&eventLoop.lock);
  error_unlocked:
+    virMutexLock(&eventLoop.lock);
+ error:
     VIR_FREE(fds);
+    VIR_FREE(handles);
     return -1;
 }
 
 
+#ifdef HAVE_SYS_EPOLL_H
+/*
+ * Wait for events using epoll, which keeps the registered
+ * file handles in the kernel. The cost of an iteration thus
+ * depends on the number of ready handles only.
+ */
+static int
+virEventPollRunOnceEpoll(void)
+{
+    struct epoll_event events[EVENT_EPOLL_MAX_EVENTS];
+    size_t nfdsPurge = eventLoop.nfdsPurge;
+    int ret, timeout;
+    size_t i;
+
+    if (virEventPollCalculateTimeout(&timeout) < 0)
+        return -1;
+
+    /* Handles epoll refused are always ready */
+    for (i = 0; i < eventLoop.nnopoll; i++) {
+        if (eventLoop.nopoll[i]->events)
+            timeout = 0;
+    }
+
+    virMutexUnlock(&eventLoop.lock);
+
+ retry:
+    PROBE(EVENT_POLL_RUN,
+          "nhandles=%d timeout=%d",
+          (int) virHashSize(eventLoop.fds), timeout);
+    ret = epoll_wait(eventLoop.epollfd, events,
+                     EVENT_EPOLL_MAX_EVENTS, timeout);
+    if (ret < 0) {
+        EVENT_DEBUG("Poll got error event %d", errno);
+        if (errno == EINTR || errno == EAGAIN)
+            goto retry;
+        virReportSystemError(errno, "%s",
+                             _("Unable to poll on file handles"));
+        virMutexLock(&eventLoop.lock);
+        return -1;
+    }
+    EVENT_DEBUG("Poll got %d event(s)", ret);
+
+    virMutexLock(&eventLoop.lock);
+
+    /* Any event for FDs purged before epoll_wait() was called has
+     * been fetched now, so they can be freed */
+    for (i = 0; i < nfdsPurge; i++)
+        virEventPollEpollFDFree(eventLoop.fdsPurge[i], NULL);
+    if (nfdsPurge)
+        ignore_value(virDeleteElementsN(&eventLoop.fdsPurge,
+                                        sizeof(*eventLoop.fdsPurge), 0,
+                                        &eventLoop.nfdsPurge, nfdsPurge,
+                                        false));
+
+    if (virEventPollDispatchTimeouts() < 0)
+        return -1;
+
+    if (virEventPollEpollDispatchHandles(ret, events) < 0)
+        return -1;
+
+    return 0;
+}
+#endif /* HAVE_SYS_EPOLL_H */
+
+
+/*
+ * Run a single iteration of the event loop, blocking until
+ * at least one file handle has an event, or a timer expires
+ */
+int virEventPollRunOnce(void)
+{
+    int ret;
+
+    virMutexLock(&eventLoop.lock);
+    eventLoop.running = 1;
+    virThreadSelf(&eventLoop.leader);
+
+    virEventPollCleanupTimeouts();
+    virEventPollCleanupHandles();
+
+#ifdef HAVE_SYS_EPOLL_H
+    if (eventLoop.epollfd != -1)
+        ret = virEventPollRunOnceEpoll();
+    else
+#endif
+        ret = virEventPollRunOncePoll();
+
+    if (ret < 0)
+        goto cleanup;
+
+    virEventPollCleanupTimeouts();
+    virEventPollCleanupHandles();
+
+    eventLoop.running = 0;
+ cleanup:
+    virMutexUnlock(&eventLoop.lock);
+    return ret;
+}
+
+
 static void virEventPollHandleWakeup(int watch ATTRIBUTE_UNUSED,
                                      int fd,
                                      int events ATTRIBUTE_UNUSED,
@@ -692,6 +1304,24 @@ int virEventPollInit(void)
         return -1;
     }
 
+    if (!(eventLoop.handles = virEventPollIntHashCreate(NULL)) ||
+        !(eventLoop.timeouts = virEventPollIntHashCreate(NULL)))
+        return -1;
+
+#ifdef HAVE_SYS_EPOLL_H
+    /* Fall back to poll() on kernels without epoll */
+    if ((eventLoop.epollfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        char ebuf[1024];
+        VIR_WARN("Unable to create epoll instance, using poll: %s",
+                 virStrerror(errno, ebuf, sizeof(ebuf)));
+        eventLoop.epollfd = -1;
+    } else if (!(eventLoop.fds =
+                 virEventPollIntHashCreate(virEventPollEpollFDFree))) {
+        VIR_FORCE_CLOSE(eventLoop.epollfd);
+        return -1;
+    }
+#endif
+
     if (pipe2(eventLoop.wakeupfd, O_CLOEXEC | O_NONBLOCK) < 0) {
         virReportSystemError(errno, "%s",
                              _("Unable to setup wakeup pipe"));
@@ -32,6 +32,7 @@
 #endif
 #include <netinet/in.h>
 #include <termios.h>
+#include <sys/ioctl.h>
 
 #include "virfdstream.h"
 #include "virerror.h"
@@ -110,6 +111,8 @@ struct virFDStreamData {
     bool threadQuit;
     bool threadAbort;
     bool threadDoRead;
+    /* Data flows through the pipe itself rather than via @msg */
+    bool threadPipe;
     virFDStreamMsgPtr msg;
 };
 
@@ -571,6 +574,88 @@ virFDStreamThreadDoWrite(virFDStreamDataPtr fdst,
 }
 
 
+/* Moves data between the file and the pipe directly. Unlike the message
+ * queue this lets the kernel splice the data without copying it through
+ * userspace, or at least saves the allocation and copy of every chunk if
+ * that's not possible. The lock is held on entry and exit. */
+static int
+virFDStreamThreadDoCopy(virFDStreamDataPtr fdst,
+                        bool doRead,
+                        const int fdin,
+                        const int fdout,
+                        const char *fdinname,
+                        const char *fdoutname,
+                        size_t length,
+                        size_t buflen)
+{
+    char *buf = NULL;
+    bool zerocopy = true;
+    size_t total = 0;
+    int ret = -1;
+
+    while (!length || total < length) {
+        size_t want = buflen;
+        ssize_t got = -2;
+
+        if (length &&
+            want > length - total)
+            want = length - total;
+
+        /* The other side of the pipe needs the lock to make progress */
+        virObjectUnlock(fdst);
+
+        if (zerocopy &&
+            (got = virFileZeroCopy(fdin, fdout, want)) == -2) {
+            VIR_DEBUG("Copying %s to %s through a buffer",
+                      fdinname, fdoutname);
+            zerocopy = false;
+        }
+
+        if (got == -1) {
+            virReportSystemError(errno,
+                                 _("Unable to copy %s to %s"),
+                                 fdinname, fdoutname);
+        } else if (got == -2) {
+            if (!buf && VIR_ALLOC_N(buf, buflen) < 0) {
+                got = -1;
+            } else if ((got = saferead(fdin, buf, want)) < 0) {
+                virReportSystemError(errno,
+                                     _("Unable to read %s"),
+                                     fdinname);
+            } else if (safewrite(fdout, buf, got) < 0) {
+                virReportSystemError(errno,
+                                     _("Unable to write %s"),
+                                     fdoutname);
+                got = -1;
+            }
+        }
+
+        virObjectLock(fdst);
+
+        /* Errors are expected once the reader went away or the stream
+         * was aborted. */
+        if (fdst->threadQuit &&
+            (doRead || fdst->threadAbort)) {
+            virResetLastError();
+            break;
+        }
+
+        if (got < 0)
+            goto cleanup;
+
+        if (got == 0)
+            break;
+
+        total += got;
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(buf);
+    return ret;
+}
+
+
 static void
 virFDStreamThread(void *opaque)
 {
@@ -591,6 +676,15 @@ virFDStreamThread(void *opaque)
     virObjectRef(fdst);
     virObjectLock(fdst);
 
+    if (fdst->threadPipe) {
+        if (virFDStreamThreadDoCopy(fdst, doRead,
+                                    fdin, fdout,
+                                    fdinname, fdoutname,
+                                    length, buflen) < 0)
+            goto error;
+        goto cleanup;
+    }
+
     while (1) {
         ssize_t got;
 
@@ -661,6 +755,11 @@ virFDStreamJoinWorker(virFDStreamDataPtr fdst,
     fdst->threadQuit = true;
     virCondSignal(&fdst->threadCond);
 
+    /* The thread may be blocked on the pipe. Closing our end wakes it
+     * up, and when writing it makes it flush the rest of the data. */
+    if (fdst->threadPipe)
+        VIR_FORCE_CLOSE(fdst->fd);
+
     /* Give the thread a chance to lock the FD stream object. */
     virObjectUnlock(fdst);
     virThreadJoin(fdst->thread);
@@ -794,14 +893,15 @@ static int virFDStreamWrite(virStreamPtr st, const char *bytes, size_t nbytes)
             nbytes = fdst->length - fdst->offset;
     }
 
-    if (fdst->thread) {
-        char *buf;
+    if (fdst->thread &&
+        (fdst->threadQuit || fdst->threadErr)) {
+        virReportSystemError(EBADF, "%s",
+                             _("cannot write to stream"));
+        goto cleanup;
+    }
 
-        if (fdst->threadQuit || fdst->threadErr) {
-            virReportSystemError(EBADF, "%s",
-                                 _("cannot write to stream"));
-            goto cleanup;
-        }
+    if (fdst->thread && !fdst->threadPipe) {
+        char *buf;
 
         if (VIR_ALLOC(msg) < 0 ||
             VIR_ALLOC_N(buf, nbytes) < 0)
@@ -872,7 +972,7 @@ static int virFDStreamRead(virStreamPtr st, char *bytes, size_t nbytes)
             nbytes = fdst->length - fdst->offset;
     }
 
-    if (fdst->thread) {
+    if (fdst->thread && !fdst->threadPipe) {
         virFDStreamMsgPtr msg = NULL;
 
         while (!(msg = fdst->msg)) {
@@ -938,6 +1038,13 @@ static int virFDStreamRead(virStreamPtr st, char *bytes, size_t nbytes)
             }
             goto cleanup;
         }
+
+        /* The thread closes the pipe on errors too */
+        if (ret == 0 && fdst->thread && fdst->threadErr) {
+            virSetError(fdst->threadErr);
+            ret = -1;
+            goto cleanup;
+        }
     }
 
     if (fdst->length)
@@ -1035,7 +1142,24 @@ virFDStreamInData(virStreamPtr st,
 
     virObjectLock(fdst);
 
-    if (fdst->thread) {
+    if (fdst->thread && fdst->threadPipe) {
+        int avail = 0;
+
+        if (fdst->threadErr)
+            goto cleanup;
+
+        /* Not sparse, so all there is is data, however much is
+         * buffered in the pipe */
+        if (ioctl(fdst->fd, FIONREAD, &avail) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("Unable to get amount of data in pipe"));
+            goto cleanup;
+        }
+
+        *inData = avail || !fdst->threadQuit;
+        *length = avail;
+        ret = 0;
+    } else if (fdst->thread) {
         virFDStreamMsgPtr msg;
 
         if (fdst->threadErr)
@@ -1113,6 +1237,7 @@ static int virFDStreamOpenInternal(virStreamPtr st,
 
     if (threadData) {
         fdst->threadDoRead = threadData->doRead;
+        fdst->threadPipe = !threadData->sparse;
 
         /* Create the thread after fdst and st were initialized.
          * The thread worker expects them to be that way. */
@@ -1281,6 +1406,13 @@ virFDStreamOpenFileInternal(virStreamPtr st,
             goto error;
         }
 
+#ifdef F_SETPIPE_SZ
+        /* Non-sparse streams move the data through the pipe, a bigger
+         * one means fewer wakeups. Not fatal if it can't be resized. */
+        if (!sparse)
+            ignore_value(fcntl(pipefds[0], F_SETPIPE_SZ, 1024 * 1024));
+#endif
+
         if (VIR_ALLOC(threadData) < 0)
             goto error;
 
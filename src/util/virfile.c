@@ -51,6 +51,9 @@
 #if HAVE_SYS_ACL_H
 # include <sys/acl.h>
 #endif
+#if HAVE_SYS_SENDFILE_H
+# include <sys/sendfile.h>
+#endif
 
 #ifdef __linux__
 # if HAVE_LINUX_MAGIC_H
@@ -174,13 +177,18 @@ virFileDirectFdFlag(void)
 struct _virFileWrapperFd {
     virCommandPtr cmd; /* Child iohelper process to do the I/O.  */
     char *err_msg; /* stderr of @cmd */
+    int statsfd; /* Read end of the pipe @cmd reports its throughput on */
+    unsigned long long bytes; /* Amount of data timed by @cmd */
+    unsigned long long elapsed; /* Time it took in milliseconds */
 };
 
 #ifndef WIN32
 /**
- * virFileWrapperFdNew:
+ * virFileWrapperFdNewFull:
  * @fd: pointer to fd to wrap
  * @name: name of fd, for diagnostics
+ * @buflen: size of each I/O buffer, or 0 for the default
+ * @nbufs: number of I/O buffers, or 0 for the default
  * @flags: bitwise-OR of virFileWrapperFdFlags
  *
  * Update @fd so that it meets parameters requested by @flags.
@@ -200,16 +208,26 @@ struct _virFileWrapperFd {
  * In some cases, @fd is changed to a non-seekable pipe; in this case, the
  * caller must not do anything further with the original fd.
  *
+ * The helper process reads into up to @nbufs buffers of @buflen bytes
+ * while writing out the ones already filled, so that reading and
+ * writing overlap. It also measures the throughput of the transfer,
+ * see virFileWrapperFdGetStats().
+ *
  * On success, the new wrapper object is returned, which must be later
  * freed with virFileWrapperFdFree().  On failure, @fd is unchanged, an
  * error message is output, and NULL is returned.
  */
 virFileWrapperFdPtr
-virFileWrapperFdNew(int *fd, const char *name, unsigned int flags)
+virFileWrapperFdNewFull(int *fd,
+                        const char *name,
+                        size_t buflen,
+                        unsigned int nbufs,
+                        unsigned int flags)
 {
     virFileWrapperFdPtr ret = NULL;
     bool output = false;
     int pipefd[2] = { -1, -1 };
+    int statspipe[2] = { -1, -1 };
     int mode = -1;
     char *iohelper_path = NULL;
 
@@ -235,6 +253,8 @@ virFileWrapperFdNew(int *fd, const char *name, unsigned int flags)
     if (VIR_ALLOC(ret) < 0)
         return NULL;
 
+    ret->statsfd = -1;
+
     mode = fcntl(*fd, F_GETFL);
 
     if (mode < 0) {
@@ -249,7 +269,8 @@ virFileWrapperFdNew(int *fd, const char *name, unsigned int flags)
         goto error;
     }
 
-    if (pipe2(pipefd, O_CLOEXEC) < 0) {
+    if (pipe2(pipefd, O_CLOEXEC) < 0 ||
+        pipe2(statspipe, O_CLOEXEC) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("unable to create pipe for %s"), name);
         goto error;
@@ -274,6 +295,15 @@ virFileWrapperFdNew(int *fd, const char *name, unsigned int flags)
         virCommandAddArg(ret->cmd, "0");
     }
 
+    virCommandAddArgFormat(ret->cmd, "%zu", buflen ? buflen : 1024 * 1024);
+    virCommandAddArgFormat(ret->cmd, "%u", nbufs ? nbufs : 2);
+
+    virCommandPassFD(ret->cmd, statspipe[1],
+                     VIR_COMMAND_PASS_FD_CLOSE_PARENT);
+    virCommandAddArgFormat(ret->cmd, "%d", statspipe[1]);
+    ret->statsfd = statspipe[0];
+    statspipe[0] = statspipe[1] = -1;
+
     /* In order to catch iohelper stderr, we must change
      * iohelper's env so virLog functions print to stderr
      */
@@ -297,14 +327,18 @@ virFileWrapperFdNew(int *fd, const char *name, unsigned int flags)
     VIR_FREE(iohelper_path);
     VIR_FORCE_CLOSE(pipefd[0]);
     VIR_FORCE_CLOSE(pipefd[1]);
+    VIR_FORCE_CLOSE(statspipe[0]);
+    VIR_FORCE_CLOSE(statspipe[1]);
     virFileWrapperFdFree(ret);
     return NULL;
 }
 #else
 virFileWrapperFdPtr
-virFileWrapperFdNew(int *fd ATTRIBUTE_UNUSED,
-                    const char *name ATTRIBUTE_UNUSED,
-                    unsigned int fdflags ATTRIBUTE_UNUSED)
+virFileWrapperFdNewFull(int *fd ATTRIBUTE_UNUSED,
+                        const char *name ATTRIBUTE_UNUSED,
+                        size_t buflen ATTRIBUTE_UNUSED,
+                        unsigned int nbufs ATTRIBUTE_UNUSED,
+                        unsigned int fdflags ATTRIBUTE_UNUSED)
 {
     virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                  _("virFileWrapperFd unsupported on this platform"));
@@ -312,6 +346,22 @@ virFileWrapperFdNew(int *fd ATTRIBUTE_UNUSED,
 }
 #endif
 
+
+/**
+ * virFileWrapperFdNew:
+ * @fd: pointer to fd to wrap
+ * @name: name of fd, for diagnostics
+ * @flags: bitwise-OR of virFileWrapperFdFlags
+ *
+ * Same as virFileWrapperFdNewFull() with the default buffers.
+ */
+virFileWrapperFdPtr
+virFileWrapperFdNew(int *fd, const char *name, unsigned int flags)
+{
+    return virFileWrapperFdNewFull(fd, name, 0, 0, flags);
+}
+
+
 /**
  * virFileWrapperFdClose:
  * @wfd: fd wrapper, or NULL
@@ -336,9 +386,50 @@ virFileWrapperFdClose(virFileWrapperFdPtr wfd)
     if (wfd->err_msg && *wfd->err_msg)
         VIR_WARN("iohelper reports: %s", wfd->err_msg);
 
+    /* The helper has exited, so its stats, if any, are in the pipe */
+    if (ret == 0 && wfd->statsfd >= 0) {
+        char buf[64];
+        ssize_t len;
+
+        if ((len = saferead(wfd->statsfd, buf, sizeof(buf) - 1)) > 0) {
+            buf[len] = '\0';
+            if (sscanf(buf, "%llu %llu", &wfd->bytes, &wfd->elapsed) != 2)
+                wfd->bytes = wfd->elapsed = 0;
+        }
+    }
+    VIR_FORCE_CLOSE(wfd->statsfd);
+
     return ret;
 }
 
+
+/**
+ * virFileWrapperFdGetStats:
+ * @wfd: fd wrapper
+ * @bytes: filled in with the amount of data transferred
+ * @elapsed: filled in with the time the transfer took in milliseconds
+ *
+ * Reports how the I/O went once virFileWrapperFdClose() succeeded.
+ * The helper process starts the clock once its first write completed,
+ * so the time spent waiting for the other end of the pipe, e.g. for
+ * QEMU to start, is not included.
+ *
+ * Returns 0 on success, -1 if the stats are not known. No error is
+ * reported in that case.
+ */
+int
+virFileWrapperFdGetStats(virFileWrapperFdPtr wfd,
+                         unsigned long long *bytes,
+                         unsigned long long *elapsed)
+{
+    if (!wfd || !wfd->bytes)
+        return -1;
+
+    *bytes = wfd->bytes;
+    *elapsed = wfd->elapsed;
+    return 0;
+}
+
 /**
  * virFileWrapperFdFree:
  * @wfd: fd wrapper, or NULL
@@ -355,6 +446,7 @@ virFileWrapperFdFree(virFileWrapperFdPtr wfd)
         return;
 
     VIR_FREE(wfd->err_msg);
+    VIR_FORCE_CLOSE(wfd->statsfd);
 
     virCommandFree(wfd->cmd);
     VIR_FREE(wfd);
@@ -1216,6 +1308,130 @@ int safezero(int fd, off_t offset, off_t len)
     return safezero_slow(fd, offset, len);
 }
 
+/* Errors meaning the kernel can't move data between the given pair of
+ * file descriptors, rather than that something went wrong */
+static ssize_t
+virFileZeroCopyResult(ssize_t ret)
+{
+    if (ret < 0 &&
+        (errno == EINVAL || errno == ENOSYS ||
+         errno == EXDEV || errno == EOPNOTSUPP))
+        return -2;
+
+    return ret;
+}
+
+#if HAVE_SPLICE
+static ssize_t
+virFileZeroCopySplice(int fdin, int fdout, size_t len)
+{
+    ssize_t ret;
+
+    do {
+        ret = splice(fdin, NULL, fdout, NULL, len,
+                     SPLICE_F_MOVE | SPLICE_F_MORE);
+    } while (ret < 0 && errno == EINTR);
+
+    return virFileZeroCopyResult(ret);
+}
+#else /* !HAVE_SPLICE */
+static ssize_t
+virFileZeroCopySplice(int fdin ATTRIBUTE_UNUSED,
+                      int fdout ATTRIBUTE_UNUSED,
+                      size_t len ATTRIBUTE_UNUSED)
+{
+    return -2;
+}
+#endif /* !HAVE_SPLICE */
+
+#if HAVE_COPY_FILE_RANGE
+static ssize_t
+virFileZeroCopyRange(int fdin, int fdout, size_t len)
+{
+    ssize_t ret;
+
+    do {
+        ret = copy_file_range(fdin, NULL, fdout, NULL, len, 0);
+    } while (ret < 0 && errno == EINTR);
+
+    return virFileZeroCopyResult(ret);
+}
+#else /* !HAVE_COPY_FILE_RANGE */
+static ssize_t
+virFileZeroCopyRange(int fdin ATTRIBUTE_UNUSED,
+                     int fdout ATTRIBUTE_UNUSED,
+                     size_t len ATTRIBUTE_UNUSED)
+{
+    return -2;
+}
+#endif /* !HAVE_COPY_FILE_RANGE */
+
+#if HAVE_SENDFILE && HAVE_SYS_SENDFILE_H
+static ssize_t
+virFileZeroCopySendfile(int fdin, int fdout, size_t len)
+{
+    ssize_t ret;
+
+    do {
+        ret = sendfile(fdout, fdin, NULL, len);
+    } while (ret < 0 && errno == EINTR);
+
+    return virFileZeroCopyResult(ret);
+}
+#else /* !HAVE_SENDFILE || !HAVE_SYS_SENDFILE_H */
+static ssize_t
+virFileZeroCopySendfile(int fdin ATTRIBUTE_UNUSED,
+                        int fdout ATTRIBUTE_UNUSED,
+                        size_t len ATTRIBUTE_UNUSED)
+{
+    return -2;
+}
+#endif /* !HAVE_SENDFILE || !HAVE_SYS_SENDFILE_H */
+
+/**
+ * virFileZeroCopy:
+ * @fdin: file descriptor to read from
+ * @fdout: file descriptor to write to
+ * @len: maximum number of bytes to move
+ *
+ * Moves up to @len bytes from the current position of @fdin to the
+ * current position of @fdout without copying them through userspace.
+ * Depending on the type of the descriptors splice(), copy_file_range()
+ * or sendfile() is used. Both positions advance as with read()/write(),
+ * so callers are free to mix this with plain I/O on the same descriptors.
+ *
+ * Like saferead(), this doesn't report errors.
+ *
+ * Returns the number of bytes moved (0 at EOF of @fdin), -1 with errno
+ * set on error, or -2 if the kernel can't move data between the two
+ * descriptors in which case nothing was moved and the caller is expected
+ * to fall back to read() and write().
+ */
+ssize_t
+virFileZeroCopy(int fdin, int fdout, size_t len)
+{
+    struct stat sbin;
+    struct stat sbout;
+    ssize_t ret;
+
+    if (fstat(fdin, &sbin) < 0 ||
+        fstat(fdout, &sbout) < 0)
+        return -1;
+
+    /* splice() requires one of the descriptors to be a pipe */
+    if (S_ISFIFO(sbin.st_mode) || S_ISFIFO(sbout.st_mode))
+        return virFileZeroCopySplice(fdin, fdout, len);
+
+    if (S_ISREG(sbin.st_mode) && S_ISREG(sbout.st_mode) &&
+        (ret = virFileZeroCopyRange(fdin, fdout, len)) != -2)
+        return ret;
+
+    if (S_ISREG(sbin.st_mode) || S_ISBLK(sbin.st_mode))
+        return virFileZeroCopySendfile(fdin, fdout, len);
+
+    return -2;
+}
+
 #if defined HAVE_MNTENT_H && defined HAVE_GETMNTENT_R
 /* search /proc/mounts for mount point of *type; return pointer to
  * malloc'ed string of the path if found, otherwise return NULL
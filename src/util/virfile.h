@@ -44,6 +44,8 @@ ssize_t safewrite(int fd, const void *buf, size_t count)
     ATTRIBUTE_RETURN_CHECK;
 int safezero(int fd, off_t offset, off_t len)
     ATTRIBUTE_RETURN_CHECK;
+ssize_t virFileZeroCopy(int fdin, int fdout, size_t len)
+    ATTRIBUTE_RETURN_CHECK;
 
 /* Don't call these directly - use the macros below */
 int virFileClose(int *fdptr, virFileCloseFlags flags)
@@ -94,9 +96,19 @@ virFileWrapperFdPtr virFileWrapperFdNew(int *fd,
                                         const char *name,
                                         unsigned int flags)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_RETURN_CHECK;
+virFileWrapperFdPtr virFileWrapperFdNewFull(int *fd,
+                                            const char *name,
+                                            size_t buflen,
+                                            unsigned int nbufs,
+                                            unsigned int flags)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_RETURN_CHECK;
 
 int virFileWrapperFdClose(virFileWrapperFdPtr dfd);
 
+int virFileWrapperFdGetStats(virFileWrapperFdPtr wfd,
+                             unsigned long long *bytes,
+                             unsigned long long *elapsed);
+
 void virFileWrapperFdFree(virFileWrapperFdPtr dfd);
 
 int virFileLock(int fd, bool shared, off_t start, off_t len, bool waitForLock);
@@ -48,6 +48,8 @@ struct _virFileCache {
     virObjectLockable object;
 
     virHashTablePtr table;
+    virHashTablePtr pending; /* names for which data is being created */
+    virCond cond;            /* signalled when data creation finishes */
 
     char *dir;
     char *suffix;
@@ -78,6 +80,8 @@ virFileCacheDispose(void *obj)
     VIR_FREE(cache->suffix);
 
     virHashFree(cache->table);
+    virHashFree(cache->pending);
+    virCondDestroy(&cache->cond);
 
     virFileCachePrivFree(cache);
 }
@@ -260,6 +264,15 @@ virFileCacheNew(const char *dir,
     if (!(cache->table = virHashCreate(10, virObjectFreeHashData)))
         goto cleanup;
 
+    if (!(cache->pending = virHashCreate(10, NULL)))
+        goto cleanup;
+
+    if (virCondInit(&cache->cond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize condition variable"));
+        goto cleanup;
+    }
+
     if (VIR_STRDUP(cache->dir, dir) < 0)
         goto cleanup;
 
@@ -289,15 +302,40 @@ virFileCacheValidate(virFileCachePtr cache,
         *data = NULL;
     }
 
-    if (!*data && name) {
-        VIR_DEBUG("Creating data for '%s'", name);
-        *data = virFileCacheNewData(cache, name);
-        if (*data) {
-            VIR_DEBUG("Caching data '%p' for '%s'", *data, name);
-            if (virHashAddEntry(cache->table, name, *data) < 0) {
-                virObjectUnref(*data);
-                *data = NULL;
-            }
+    if (*data || !name)
+        return;
+
+    /* Creating the data may take a long time (e.g. probing a binary), so
+     * it is done without holding the cache lock to let data for other
+     * names be created in parallel. Only one thread creates data for a
+     * particular name, others wait for it to finish. */
+    while (virHashLookup(cache->pending, name)) {
+        if (virCondWait(&cache->cond, &cache->object.lock) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("failed to wait on condition"));
+            return;
+        }
+    }
+
+    if ((*data = virHashLookup(cache->table, name)))
+        return;
+
+    if (virHashAddEntry(cache->pending, name, cache) < 0)
+        return;
+
+    VIR_DEBUG("Creating data for '%s'", name);
+    virObjectUnlock(cache);
+    *data = virFileCacheNewData(cache, name);
+    virObjectLock(cache);
+
+    virHashRemoveEntry(cache->pending, name);
+    virCondBroadcast(&cache->cond);
+
+    if (*data) {
+        VIR_DEBUG("Caching data '%p' for '%s'", *data, name);
+        if (virHashAddEntry(cache->table, name, *data) < 0) {
+            virObjectUnref(*data);
+            *data = NULL;
         }
     }
 }
@@ -310,7 +348,8 @@ virFileCacheValidate(virFileCachePtr cache,
  *
  * Lookup a data specified by name.  This tries to find a file with
  * cached data, if it doesn't exist or is no longer valid new data
- * is created.
+ * is created.  Data for different names can be created by several
+ * threads at once, the cache is not locked meanwhile.
  *
  * Returns data object or NULL on error.  The caller is responsible for
  * unrefing the data.
@@ -51,6 +51,12 @@ VIR_ENUM_IMPL(virFirewallLayerCommand, VIR_FIREWALL_LAYER_LAST,
               IPTABLES_PATH,
               IP6TABLES_PATH);
 
+VIR_ENUM_DECL(virFirewallLayerRestoreCommand)
+VIR_ENUM_IMPL(virFirewallLayerRestoreCommand, VIR_FIREWALL_LAYER_LAST,
+              EBTABLES_RESTORE_PATH,
+              IPTABLES_RESTORE_PATH,
+              IP6TABLES_RESTORE_PATH);
+
 VIR_ENUM_DECL(virFirewallLayerFirewallD)
 VIR_ENUM_IMPL(virFirewallLayerFirewallD, VIR_FIREWALL_LAYER_LAST,
               "eb", "ipv4", "ipv6")
@@ -109,12 +115,34 @@ static bool ip6tablesUseLock;
 static bool ebtablesUseLock;
 static bool lockOverride; /* true to avoid lock probes */
 
+/* Whether rules of a layer can be batched via *-restore, and
+ * whether *-restore needs to be told to wait for the lock the
+ * plain command takes */
+static bool restoreUsable[VIR_FIREWALL_LAYER_LAST];
+static bool restoreUseLock[VIR_FIREWALL_LAYER_LAST];
+static bool batchRules; /* true to let the direct backend use *-restore */
+
 void
 virFirewallSetLockOverride(bool avoid)
 {
     lockOverride = avoid;
 }
 
+/**
+ * virFirewallSetBatchRules:
+ * @batch: true to batch rules via *-restore
+ *
+ * Allow the automatically picked direct backend to apply the rules
+ * of a transaction with a single iptables-restore, ip6tables-restore
+ * or ebtables-restore call, for the layers whose command passes the
+ * probe. Must be called before any firewall is applied.
+ */
+void
+virFirewallSetBatchRules(bool batch)
+{
+    batchRules = batch;
+}
+
 static void
 virFirewallCheckUpdateLock(bool *lockflag,
                            const char *const*args)
@@ -152,9 +180,79 @@ virFirewallCheckUpdateLocking(void)
                                ebtablesArgs);
 }
 
+/* ebtables has its own lock and its own option to wait for it */
+static const char *
+virFirewallRestoreLockArg(virFirewallLayer layer)
+{
+    if (layer == VIR_FIREWALL_LAYER_ETHERNET)
+        return "--concurrent";
+    return "-w";
+}
+
+static bool
+virFirewallCheckRestore(virFirewallLayer layer,
+                        bool useLock)
+{
+    const char *bin = virFirewallLayerRestoreCommandTypeToString(layer);
+    virCommandPtr cmd = virCommandNew(bin);
+    int status;
+    bool ret;
+
+    if (useLock)
+        virCommandAddArg(cmd, virFirewallRestoreLockArg(layer));
+    virCommandAddArg(cmd, "--noflush");
+
+    /* An empty input is accepted by versions which can't parse a
+     * transaction at all, so commit an empty one, which is a no-op
+     * with --noflush */
+    virCommandSetInputBuffer(cmd, "*filter\nCOMMIT\n");
+
+    ret = virCommandRun(cmd, &status) == 0 && status == 0;
+    virCommandFree(cmd);
+    return ret;
+}
+
+static void
+virFirewallCheckUpdateRestore(bool force)
+{
+    const bool *useLock[VIR_FIREWALL_LAYER_LAST] = {
+        &ebtablesUseLock, &iptablesUseLock, &ip6tablesUseLock,
+    };
+    size_t i;
+
+    for (i = 0; i < VIR_FIREWALL_LAYER_LAST; i++) {
+        const char *bin = virFirewallLayerRestoreCommandTypeToString(i);
+
+        restoreUsable[i] = false;
+        restoreUseLock[i] = false;
+
+        if (lockOverride) {
+            restoreUsable[i] = force;
+            continue;
+        }
+
+        if (!virFileIsExecutable(bin))
+            continue;
+
+        /* Don't give up on the lock the plain commands use */
+        if (virFirewallCheckRestore(i, true)) {
+            restoreUsable[i] = true;
+            restoreUseLock[i] = true;
+        } else if (!*useLock[i] && virFirewallCheckRestore(i, false)) {
+            restoreUsable[i] = true;
+        }
+
+        VIR_INFO("%s is %susable for batching rules",
+                 bin, restoreUsable[i] ? "" : "not ");
+    }
+}
+
 static int
 virFirewallValidateBackend(virFirewallBackend backend)
 {
+    virFirewallBackend requested = backend;
+    size_t i;
+
     VIR_DEBUG("Validating backend %d", backend);
     if (backend == VIR_FIREWALL_BACKEND_AUTOMATIC ||
         backend == VIR_FIREWALL_BACKEND_FIREWALLD) {
@@ -180,11 +278,11 @@ virFirewallValidateBackend(virFirewallBackend backend)
         }
     }
 
-    if (backend == VIR_FIREWALL_BACKEND_DIRECT) {
+    if (backend == VIR_FIREWALL_BACKEND_DIRECT ||
+        backend == VIR_FIREWALL_BACKEND_RESTORE) {
         const char *commands[] = {
             IPTABLES_PATH, IP6TABLES_PATH, EBTABLES_PATH
         };
-        size_t i;
 
         for (i = 0; i < ARRAY_CARDINALITY(commands); i++) {
             if (!virFileIsExecutable(commands[i])) {
@@ -197,10 +295,40 @@ virFirewallValidateBackend(virFirewallBackend backend)
         VIR_DEBUG("found iptables/ip6tables/ebtables, using direct backend");
     }
 
+    if (backend == VIR_FIREWALL_BACKEND_RESTORE) {
+        for (i = 0; i < VIR_FIREWALL_LAYER_LAST; i++) {
+            const char *bin = virFirewallLayerRestoreCommandTypeToString(i);
+
+            if (!virFileIsExecutable(bin)) {
+                virReportSystemError(errno,
+                                     _("restore firewall backend requested, but %s is not available"),
+                                     bin);
+                return -1;
+            }
+        }
+    }
+
     currentBackend = backend;
 
     virFirewallCheckUpdateLocking();
 
+    if (backend == VIR_FIREWALL_BACKEND_RESTORE) {
+        virFirewallCheckUpdateRestore(true);
+    } else if (backend == VIR_FIREWALL_BACKEND_DIRECT &&
+               requested == VIR_FIREWALL_BACKEND_AUTOMATIC &&
+               batchRules) {
+        /* Batch rules of the layers whose *-restore passed the probe,
+         * the remaining layers are changed one rule at a time */
+        virFirewallCheckUpdateRestore(false);
+        for (i = 0; i < VIR_FIREWALL_LAYER_LAST; i++) {
+            if (restoreUsable[i]) {
+                VIR_DEBUG("found *-restore, using restore backend");
+                currentBackend = VIR_FIREWALL_BACKEND_RESTORE;
+                break;
+            }
+        }
+    }
+
     return 0;
 }
 
@@ -820,6 +948,7 @@ virFirewallApplyRule(virFirewallPtr firewall,
 
     switch (currentBackend) {
     case VIR_FIREWALL_BACKEND_DIRECT:
+    case VIR_FIREWALL_BACKEND_RESTORE:
         if (virFirewallApplyRuleDirect(rule, ignoreErrors, &output) < 0)
             return -1;
         break;
@@ -860,6 +989,218 @@ virFirewallApplyRule(virFirewallPtr firewall,
     return ret;
 }
 
+/*
+ * Rules of one layer waiting to be applied as a single
+ * *-restore transaction
+ */
+typedef struct _virFirewallRestoreBatch virFirewallRestoreBatch;
+typedef virFirewallRestoreBatch *virFirewallRestoreBatchPtr;
+struct _virFirewallRestoreBatch {
+    virBuffer buf;
+    const char *table;
+    size_t nrules;
+};
+
+static bool
+virFirewallRuleIsLockArg(virFirewallRulePtr rule,
+                         const char *arg)
+{
+    if (rule->layer == VIR_FIREWALL_LAYER_ETHERNET)
+        return STREQ(arg, "--concurrent");
+    return STREQ(arg, "-w") || STREQ(arg, "--wait");
+}
+
+static bool
+virFirewallRuleIsBatchable(virFirewallRulePtr rule)
+{
+    size_t i;
+
+    /* Failures of rules which ignore them or whose output is
+     * needed can't be told apart from the rest of a transaction */
+    if (!restoreUsable[rule->layer] ||
+        rule->queryCB ||
+        rule->ignoreErrors)
+        return false;
+
+    for (i = 0; i < rule->argsLen; i++) {
+        const char *arg = rule->args[i];
+
+        if (STREQ(arg, "-L") || STREQ(arg, "--list") ||
+            STREQ(arg, "-S") || STREQ(arg, "--list-rules"))
+            return false;
+
+        /* Can't be quoted in *-restore input */
+        if (strpbrk(arg, "\n\\'"))
+            return false;
+    }
+
+    return true;
+}
+
+static void
+virFirewallRestoreBatchAddRule(virFirewallRestoreBatchPtr batch,
+                               virFirewallRulePtr rule)
+{
+    const char *table = "filter";
+    bool first = true;
+    size_t i;
+
+    for (i = 0; i + 1 < rule->argsLen; i++) {
+        if (STREQ(rule->args[i], "-t") || STREQ(rule->args[i], "--table"))
+            table = rule->args[i + 1];
+    }
+
+    if (!batch->table || STRNEQ(batch->table, table)) {
+        if (batch->table)
+            virBufferAddLit(&batch->buf, "COMMIT\n");
+        virBufferAsprintf(&batch->buf, "*%s\n", table);
+        batch->table = table;
+    }
+
+    for (i = 0; i < rule->argsLen; i++) {
+        const char *arg = rule->args[i];
+
+        if (virFirewallRuleIsLockArg(rule, arg))
+            continue;
+
+        if ((STREQ(arg, "-t") || STREQ(arg, "--table")) &&
+            i + 1 < rule->argsLen) {
+            i++;
+            continue;
+        }
+
+        if (!first)
+            virBufferAddChar(&batch->buf, ' ');
+        first = false;
+
+        if (!*arg || strpbrk(arg, " \t\"")) {
+            virBufferAddChar(&batch->buf, '"');
+            for (; *arg; arg++) {
+                if (*arg == '"')
+                    virBufferAddChar(&batch->buf, '\\');
+                virBufferAddChar(&batch->buf, *arg);
+            }
+            virBufferAddChar(&batch->buf, '"');
+        } else {
+            virBufferAdd(&batch->buf, arg, -1);
+        }
+    }
+    virBufferAddChar(&batch->buf, '\n');
+
+    batch->nrules++;
+}
+
+static int
+virFirewallRestoreBatchApply(virFirewallRestoreBatchPtr batch,
+                             virFirewallLayer layer)
+{
+    const char *bin = virFirewallLayerRestoreCommandTypeToString(layer);
+    virCommandPtr cmd = NULL;
+    char *input = NULL;
+    char *error = NULL;
+    int status;
+    int ret = -1;
+
+    if (batch->nrules == 0)
+        return 0;
+
+    virBufferAddLit(&batch->buf, "COMMIT\n");
+    if (virBufferCheckError(&batch->buf) < 0)
+        goto cleanup;
+    input = virBufferContentAndReset(&batch->buf);
+
+    VIR_INFO("Applying %zu rules with '%s'", batch->nrules, bin);
+    VIR_DEBUG("Transaction:\n%s", input);
+
+    cmd = virCommandNew(bin);
+    if (restoreUseLock[layer])
+        virCommandAddArg(cmd, virFirewallRestoreLockArg(layer));
+    virCommandAddArg(cmd, "--noflush");
+
+    virCommandSetInputBuffer(cmd, input);
+    virCommandSetErrorBuffer(cmd, &error);
+
+    if (virCommandRun(cmd, &status) < 0)
+        goto cleanup;
+
+    if (status != 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Failed to apply firewall rules with %s: %s"),
+                       bin, NULLSTR(error));
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virBufferFreeAndReset(&batch->buf);
+    batch->table = NULL;
+    batch->nrules = 0;
+    VIR_FREE(input);
+    VIR_FREE(error);
+    virCommandFree(cmd);
+    return ret;
+}
+
+static int
+virFirewallRestoreBatchApplyAll(virFirewallRestoreBatchPtr batches)
+{
+    size_t i;
+
+    for (i = 0; i < VIR_FIREWALL_LAYER_LAST; i++) {
+        if (virFirewallRestoreBatchApply(&batches[i], i) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Apply the rules of a group with as few *-restore invocations as
+ * possible. Rules which have to be applied on their own are run
+ * directly, after everything batched before them. Rules of different
+ * layers are independent of each other, so only the order within a
+ * layer is preserved.
+ *
+ * A batch is not atomic: *-restore commits each table separately, so
+ * if a later table fails the earlier ones stay applied, as do batches
+ * of other layers applied before it. This is no different from
+ * applying the rules one by one, and the caller undoes it the same
+ * way by running the rollback rules of the failed group.
+ */
+static int
+virFirewallApplyGroupRestore(virFirewallPtr firewall,
+                             virFirewallGroupPtr group)
+{
+    virFirewallRestoreBatch batches[VIR_FIREWALL_LAYER_LAST];
+    size_t i;
+    int ret = -1;
+
+    memset(batches, 0, sizeof(batches));
+
+    /* Query callbacks may append rules to the group as we go */
+    for (i = 0; i < group->naction; i++) {
+        virFirewallRulePtr rule = group->action[i];
+
+        if (virFirewallRuleIsBatchable(rule)) {
+            virFirewallRestoreBatchAddRule(&batches[rule->layer], rule);
+            continue;
+        }
+
+        if (virFirewallRestoreBatchApplyAll(batches) < 0 ||
+            virFirewallApplyRule(firewall, rule, false) < 0)
+            goto cleanup;
+    }
+
+    if (virFirewallRestoreBatchApplyAll(batches) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    for (i = 0; i < VIR_FIREWALL_LAYER_LAST; i++)
+        virBufferFreeAndReset(&batches[i].buf);
+    return ret;
+}
+
 static int
 virFirewallApplyGroup(virFirewallPtr firewall,
                       size_t idx)
@@ -872,6 +1213,10 @@ virFirewallApplyGroup(virFirewallPtr firewall,
              firewall, group, group->actionFlags);
     firewall->currentGroup = idx;
     group->addingRollback = false;
+
+    if (currentBackend == VIR_FIREWALL_BACKEND_RESTORE && !ignoreErrors)
+        return virFirewallApplyGroupRestore(firewall, group);
+
     for (i = 0; i < group->naction; i++) {
         if (virFirewallApplyRule(firewall,
                                  group->action[i],
@@ -48,6 +48,7 @@
 #include "c-ctype.h"
 #include "viralloc.h"
 #include "virhostcpupriv.h"
+#include "virhoststats.h"
 #include "physmem.h"
 #include "virerror.h"
 #include "count-one-bits.h"
@@ -199,8 +200,6 @@ virHostCPUGetStatsFreeBSD(int cpuNum,
 # define PROCSTAT_PATH "/proc/stat"
 # define VIR_HOST_CPU_MASK_LEN 1024
 
-# define LINUX_NB_CPU_STATS 4
-
 
 static unsigned long
 virHostCPUCountThreadSiblings(unsigned int cpu)
@@ -769,6 +768,44 @@ virHostCPUGetInfoPopulateLinux(FILE *cpuinfo,
 
 # define TICK_TO_NSEC (1000ull * 1000ull * 1000ull / sysconf(_SC_CLK_TCK))
 
+/* Fills @params with CPU times from a "cpu..." @line of /proc/stat.
+ * Returns 1 on success, 0 if the line is malformed, -1 on error. */
+static int
+virHostCPUGetStatsParseLine(const char *line,
+                            virNodeCPUStatsPtr params)
+{
+    unsigned long long usr, ni, sys, idle, iowait;
+    unsigned long long irq, softirq, steal, guest, guest_nice;
+
+    /* Fields which are missing in older kernels are counted as zero */
+    irq = softirq = steal = guest = guest_nice = 0;
+
+    if (sscanf(line,
+               "%*s %llu %llu %llu %llu %llu" /* user ~ iowait */
+               "%llu %llu %llu %llu %llu",    /* irq  ~ guest_nice */
+               &usr, &ni, &sys, &idle, &iowait,
+               &irq, &softirq, &steal, &guest, &guest_nice) < 4)
+        return 0;
+
+    if (virHostCPUStatsAssign(&params[0], VIR_NODE_CPU_STATS_KERNEL,
+                              (sys + irq + softirq) * TICK_TO_NSEC) < 0)
+        return -1;
+
+    if (virHostCPUStatsAssign(&params[1], VIR_NODE_CPU_STATS_USER,
+                              (usr + ni) * TICK_TO_NSEC) < 0)
+        return -1;
+
+    if (virHostCPUStatsAssign(&params[2], VIR_NODE_CPU_STATS_IDLE,
+                              idle * TICK_TO_NSEC) < 0)
+        return -1;
+
+    if (virHostCPUStatsAssign(&params[3], VIR_NODE_CPU_STATS_IOWAIT,
+                              iowait * TICK_TO_NSEC) < 0)
+        return -1;
+
+    return 1;
+}
+
 int
 virHostCPUGetStatsLinux(FILE *procstat,
                         int cpuNum,
@@ -777,8 +814,6 @@ virHostCPUGetStatsLinux(FILE *procstat,
 {
     int ret = -1;
     char line[1024];
-    unsigned long long usr, ni, sys, idle, iowait;
-    unsigned long long irq, softirq, steal, guest, guest_nice;
     char cpu_header[4 + INT_BUFSIZE_BOUND(cpuNum)];
 
     if ((*nparams) == 0) {
@@ -805,31 +840,12 @@ virHostCPUGetStatsLinux(FILE *procstat,
         char *buf = line;
 
         if (STRPREFIX(buf, cpu_header)) { /* aka logical CPU time */
-            if (sscanf(buf,
-                       "%*s %llu %llu %llu %llu %llu" /* user ~ iowait */
-                       "%llu %llu %llu %llu %llu",    /* irq  ~ guest_nice */
-                       &usr, &ni, &sys, &idle, &iowait,
-                       &irq, &softirq, &steal, &guest, &guest_nice) < 4) {
-                continue;
-            }
-
-            if (virHostCPUStatsAssign(&params[0], VIR_NODE_CPU_STATS_KERNEL,
-                                      (sys + irq + softirq) * TICK_TO_NSEC) < 0)
-                goto cleanup;
-
-            if (virHostCPUStatsAssign(&params[1], VIR_NODE_CPU_STATS_USER,
-                                      (usr + ni) * TICK_TO_NSEC) < 0)
-                goto cleanup;
-
-            if (virHostCPUStatsAssign(&params[2], VIR_NODE_CPU_STATS_IDLE,
-                                      idle * TICK_TO_NSEC) < 0)
-                goto cleanup;
+            int rc = virHostCPUGetStatsParseLine(buf, params);
 
-            if (virHostCPUStatsAssign(&params[3], VIR_NODE_CPU_STATS_IOWAIT,
-                                      iowait * TICK_TO_NSEC) < 0)
-                goto cleanup;
-
-            ret = 0;
+            if (rc == 0)
+                continue;
+            if (rc > 0)
+                ret = 0;
             goto cleanup;
         }
     }
@@ -843,6 +859,55 @@ virHostCPUGetStatsLinux(FILE *procstat,
 }
 
 
+/**
+ * virHostCPUGetStatsAllLinux:
+ * @procstat: opened /proc/stat
+ * @cb: callback to invoke for each CPU
+ * @opaque: data passed to @cb
+ *
+ * Reads times of all CPUs from @procstat in a single pass and calls
+ * @cb for each of them with LINUX_NB_CPU_STATS parameters in the same
+ * order as virHostCPUGetStatsLinux would return them. The sum of all
+ * CPUs is reported as VIR_NODE_CPU_STATS_ALL_CPUS.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virHostCPUGetStatsAllLinux(FILE *procstat,
+                           virHostCPUStatsCallback cb,
+                           void *opaque)
+{
+    char line[1024];
+    virNodeCPUStats params[LINUX_NB_CPU_STATS];
+
+    memset(params, 0, sizeof(params));
+
+    while (fgets(line, sizeof(line), procstat) != NULL) {
+        int cpuNum = VIR_NODE_CPU_STATS_ALL_CPUS;
+        char *end;
+        int rc;
+
+        if (!STRPREFIX(line, "cpu"))
+            continue;
+
+        if (line[3] != ' ' &&
+            (virStrToLong_i(line + 3, &end, 10, &cpuNum) < 0 ||
+             cpuNum < 0 || *end != ' '))
+            continue;
+
+        if ((rc = virHostCPUGetStatsParseLine(line, params)) < 0)
+            return -1;
+        if (rc == 0)
+            continue;
+
+        if (cb(cpuNum, params, opaque) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
 /* Determine the number of CPUs (maximum CPU id + 1) from a file containing
  * a list of CPU ids, like the Linux sysfs cpu/present file */
 static int
@@ -993,8 +1058,12 @@ virHostCPUGetStats(int cpuNum ATTRIBUTE_UNUSED,
 #ifdef __linux__
     {
         int ret;
-        FILE *procstat = fopen(PROCSTAT_PATH, "r");
-        if (!procstat) {
+        FILE *procstat;
+
+        if ((ret = virHostStatsGetCPU(cpuNum, params, nparams)) != 0)
+            return ret < 0 ? -1 : 0;
+
+        if (!(procstat = fopen(PROCSTAT_PATH, "r"))) {
             virReportSystemError(errno,
                                  _("cannot open %s"), PROCSTAT_PATH);
             return -1;
@@ -25,6 +25,12 @@
 # include "virhostcpu.h"
 
 # ifdef __linux__
+#  define LINUX_NB_CPU_STATS 4
+
+typedef int (*virHostCPUStatsCallback)(int cpuNum,
+                                       virNodeCPUStatsPtr params,
+                                       void *opaque);
+
 int virHostCPUGetInfoPopulateLinux(FILE *cpuinfo,
                                    virArch arch,
                                    unsigned int *cpus,
@@ -38,6 +44,10 @@ int virHostCPUGetStatsLinux(FILE *procstat,
                             int cpuNum,
                             virNodeCPUStatsPtr params,
                             int *nparams);
+
+int virHostCPUGetStatsAllLinux(FILE *procstat,
+                               virHostCPUStatsCallback cb,
+                               void *opaque);
 # endif
 
 #endif /* __VIR_HOSTCPU_PRIV_H__ */
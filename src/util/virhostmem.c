@@ -41,7 +41,8 @@
 #endif
 
 #include "viralloc.h"
-#include "virhostmem.h"
+#include "virhostmempriv.h"
+#include "virhoststats.h"
 #include "physmem.h"
 #include "virerror.h"
 #include "count-one-bits.h"
@@ -141,10 +142,7 @@ virHostMemGetStatsFreeBSD(virNodeMemoryStatsPtr params,
 # define SYSFS_MEMORY_SHARED_PATH "/sys/kernel/mm/ksm"
 # define SYSFS_THREAD_SIBLINGS_LIST_LENGTH_MAX 8192
 
-# define LINUX_NB_MEMORY_STATS_ALL 4
-# define LINUX_NB_MEMORY_STATS_CELL 2
-
-static int
+int
 virHostMemGetStatsLinux(FILE *meminfo,
                         int cellNum,
                         virNodeMemoryStatsPtr params,
@@ -267,6 +265,9 @@ virHostMemGetStats(int cellNum ATTRIBUTE_UNUSED,
         FILE *meminfo;
         int max_node;
 
+        if ((ret = virHostStatsGetMemory(cellNum, params, nparams)) != 0)
+            return ret < 0 ? -1 : 0;
+
         if (cellNum == VIR_NODE_MEMORY_STATS_ALL_CELLS) {
             if (VIR_STRDUP(meminfo_path, MEMINFO_PATH) < 0)
                 return -1;
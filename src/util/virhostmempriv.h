@@ -0,0 +1,37 @@
+/*
+ * virhostmempriv.h: helper APIs for host memory info
+ *
+ * Copyright (C) 2017 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __VIR_HOSTMEM_PRIV_H__
+# define __VIR_HOSTMEM_PRIV_H__
+
+# include "virhostmem.h"
+
+# ifdef __linux__
+#  define LINUX_NB_MEMORY_STATS_ALL 4
+#  define LINUX_NB_MEMORY_STATS_CELL 2
+
+int virHostMemGetStatsLinux(FILE *meminfo,
+                            int cellNum,
+                            virNodeMemoryStatsPtr params,
+                            int *nparams);
+# endif
+
+#endif /* __VIR_HOSTMEM_PRIV_H__ */
@@ -0,0 +1,786 @@
+/*
+ * virhoststats.c: background sampling of host CPU and memory statistics
+ *
+ * Copyright (C) 2017 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+
+#include "viralloc.h"
+#include "virerror.h"
+#include "virfile.h"
+#include "virhostcpupriv.h"
+#include "virhostmempriv.h"
+#include "virhoststats.h"
+#include "virlog.h"
+#include "virnuma.h"
+#include "virobject.h"
+#include "virstring.h"
+#include "virthread.h"
+#include "virtime.h"
+#include "virtypedparam.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("util.hoststats");
+
+/*
+ * When the sampler is running, a snapshot of the host statistics is
+ * taken every @interval seconds by a background thread and the
+ * virNodeGetCPUStats / virNodeGetMemoryStats implementations answer
+ * from it instead of reading and parsing /proc and sysfs on every call.
+ *
+ * A snapshot is never modified once published. Readers only hold the
+ * lock for as long as it takes to get a reference to the current one,
+ * so neither the sampler nor other readers can make them wait for I/O.
+ *
+ * The parameters reported from a snapshot are exactly those the direct
+ * path would report, so callers can't tell which one answered. Rates
+ * derived from two consecutive snapshots can't be read directly and
+ * are therefore reported separately, see virHostStatsGetCPURates.
+ */
+
+#ifdef __linux__
+
+# define PROCSTAT_PATH "/proc/stat"
+# define MEMINFO_PATH "/proc/meminfo"
+# define SYSFS_SYSTEM_PATH "/sys/devices/system"
+
+/* Snapshots older than this number of intervals are not used */
+# define VIR_HOST_STATS_MAX_AGE 2
+
+typedef struct _virHostStatsCPU virHostStatsCPU;
+typedef virHostStatsCPU *virHostStatsCPUPtr;
+struct _virHostStatsCPU {
+    bool present;
+    virNodeCPUStats stats[LINUX_NB_CPU_STATS];
+
+    /* Since the previous snapshot, valid only if hasRates is set */
+    bool hasRates;
+    unsigned long long rates[LINUX_NB_CPU_STATS]; /* nanoseconds per second */
+    unsigned int utilization;                     /* percent */
+};
+
+typedef struct _virHostStatsMem virHostStatsMem;
+typedef virHostStatsMem *virHostStatsMemPtr;
+struct _virHostStatsMem {
+    bool present;
+    virNodeMemoryStats stats[LINUX_NB_MEMORY_STATS_ALL];
+};
+
+struct _virHostStatsSnapshot {
+    virObject parent;
+
+    unsigned long long timestamp;
+
+    virHostStatsCPU cpuAll;
+    virHostStatsCPUPtr cpus;    /* indexed by CPU number */
+    size_t ncpus;
+
+    virHostStatsMem memAll;
+    virHostStatsMemPtr cells;   /* indexed by NUMA node number */
+    size_t ncells;
+};
+
+static virClassPtr virHostStatsSnapshotClass;
+
+static virMutex virHostStatsLock = VIR_MUTEX_INITIALIZER;
+static virCond virHostStatsCond;
+static virThread virHostStatsThread;
+static unsigned int virHostStatsInterval; /* 0 if the sampler is not running */
+static bool virHostStatsQuit;
+static virHostStatsSnapshotPtr virHostStatsCurrent;
+
+
+static void
+virHostStatsSnapshotDispose(void *obj)
+{
+    virHostStatsSnapshotPtr snapshot = obj;
+
+    VIR_FREE(snapshot->cpus);
+    VIR_FREE(snapshot->cells);
+}
+
+
+static int
+virHostStatsOnceInit(void)
+{
+    if (!(virHostStatsSnapshotClass = virClassNew(virClassForObject(),
+                                                  "virHostStatsSnapshot",
+                                                  sizeof(virHostStatsSnapshot),
+                                                  virHostStatsSnapshotDispose)))
+        return -1;
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virHostStats)
+
+
+static virHostStatsCPUPtr
+virHostStatsSnapshotFindCPU(virHostStatsSnapshotPtr snapshot,
+                            int cpuNum)
+{
+    virHostStatsCPUPtr cpu;
+
+    if (cpuNum == VIR_NODE_CPU_STATS_ALL_CPUS)
+        cpu = &snapshot->cpuAll;
+    else if (cpuNum >= 0 && cpuNum < snapshot->ncpus)
+        cpu = &snapshot->cpus[cpuNum];
+    else
+        return NULL;
+
+    return cpu->present ? cpu : NULL;
+}
+
+
+static int
+virHostStatsSnapshotAddCPU(int cpuNum,
+                           virNodeCPUStatsPtr params,
+                           void *opaque)
+{
+    virHostStatsSnapshotPtr snapshot = opaque;
+    virHostStatsCPUPtr cpu;
+
+    if (cpuNum == VIR_NODE_CPU_STATS_ALL_CPUS) {
+        cpu = &snapshot->cpuAll;
+    } else {
+        if (cpuNum >= snapshot->ncpus &&
+            VIR_EXPAND_N(snapshot->cpus, snapshot->ncpus,
+                         cpuNum + 1 - snapshot->ncpus) < 0)
+            return -1;
+        cpu = &snapshot->cpus[cpuNum];
+    }
+
+    memcpy(cpu->stats, params, sizeof(cpu->stats));
+    cpu->present = true;
+
+    return 0;
+}
+
+
+/* The order of stats is kernel, user, idle and iowait, see
+ * virHostCPUGetStatsLinux */
+static void
+virHostStatsCPUComputeRates(virHostStatsCPUPtr cpu,
+                            virHostStatsCPUPtr prev,
+                            unsigned long long elapsed)
+{
+    unsigned long long delta[LINUX_NB_CPU_STATS];
+    unsigned long long busy;
+    unsigned long long total = 0;
+    size_t i;
+
+    if (!prev || !elapsed)
+        return;
+
+    for (i = 0; i < LINUX_NB_CPU_STATS; i++) {
+        /* The CPU went offline and back in the meantime */
+        if (cpu->stats[i].value < prev->stats[i].value)
+            return;
+
+        delta[i] = cpu->stats[i].value - prev->stats[i].value;
+        total += delta[i];
+    }
+
+    for (i = 0; i < LINUX_NB_CPU_STATS; i++)
+        cpu->rates[i] = delta[i] * 1000 / elapsed;
+
+    busy = delta[0] + delta[1];
+    cpu->utilization = total ? busy * 100 / total : 0;
+    cpu->hasRates = true;
+}
+
+
+/**
+ * virHostStatsSnapshotNew:
+ * @procstat: opened /proc/stat
+ * @meminfo: opened /proc/meminfo
+ * @cellMeminfo: opened meminfo files of NUMA nodes, NULL for missing nodes
+ * @ncells: number of items in @cellMeminfo
+ * @prev: previous snapshot to compute rates against, or NULL
+ * @timestamp: time the data was read at in milliseconds
+ *
+ * Returns a new snapshot of host statistics or NULL on error.
+ */
+virHostStatsSnapshotPtr
+virHostStatsSnapshotNew(FILE *procstat,
+                        FILE *meminfo,
+                        FILE **cellMeminfo,
+                        size_t ncells,
+                        virHostStatsSnapshotPtr prev,
+                        unsigned long long timestamp)
+{
+    virHostStatsSnapshotPtr snapshot;
+    size_t i;
+
+    if (virHostStatsInitialize() < 0)
+        return NULL;
+
+    if (!(snapshot = virObjectNew(virHostStatsSnapshotClass)))
+        return NULL;
+
+    snapshot->timestamp = timestamp;
+
+    if (virHostCPUGetStatsAllLinux(procstat, virHostStatsSnapshotAddCPU,
+                                   snapshot) < 0)
+        goto error;
+
+    if (prev && timestamp > prev->timestamp) {
+        unsigned long long elapsed = timestamp - prev->timestamp;
+
+        virHostStatsCPUComputeRates(&snapshot->cpuAll,
+                                    virHostStatsSnapshotFindCPU(prev,
+                                                                VIR_NODE_CPU_STATS_ALL_CPUS),
+                                    elapsed);
+
+        for (i = 0; i < snapshot->ncpus; i++) {
+            if (!snapshot->cpus[i].present)
+                continue;
+
+            virHostStatsCPUComputeRates(&snapshot->cpus[i],
+                                        virHostStatsSnapshotFindCPU(prev, i),
+                                        elapsed);
+        }
+    }
+
+    if (meminfo) {
+        int nparams = LINUX_NB_MEMORY_STATS_ALL;
+
+        if (virHostMemGetStatsLinux(meminfo, VIR_NODE_MEMORY_STATS_ALL_CELLS,
+                                    snapshot->memAll.stats, &nparams) < 0)
+            goto error;
+        snapshot->memAll.present = true;
+    }
+
+    if (ncells && VIR_ALLOC_N(snapshot->cells, ncells) < 0)
+        goto error;
+    snapshot->ncells = ncells;
+
+    for (i = 0; i < ncells; i++) {
+        int nparams = LINUX_NB_MEMORY_STATS_CELL;
+
+        if (!cellMeminfo[i])
+            continue;
+
+        if (virHostMemGetStatsLinux(cellMeminfo[i], i,
+                                    snapshot->cells[i].stats, &nparams) < 0)
+            goto error;
+        snapshot->cells[i].present = true;
+    }
+
+    return snapshot;
+
+ error:
+    virObjectUnref(snapshot);
+    return NULL;
+}
+
+
+/**
+ * virHostStatsSnapshotGetCPU:
+ *
+ * Same as virHostCPUGetStatsLinux, but using data from @snapshot.
+ *
+ * Returns 1 if the stats were filled in, 0 if @snapshot doesn't have
+ * any data for @cpuNum, -1 on error.
+ */
+int
+virHostStatsSnapshotGetCPU(virHostStatsSnapshotPtr snapshot,
+                           int cpuNum,
+                           virNodeCPUStatsPtr params,
+                           int *nparams)
+{
+    virHostStatsCPUPtr cpu;
+
+    if (*nparams == 0) {
+        *nparams = LINUX_NB_CPU_STATS;
+        return 1;
+    }
+
+    if (*nparams != LINUX_NB_CPU_STATS) {
+        virReportInvalidArg(*nparams,
+                            _("nparams in %s must be equal to %d"),
+                            __FUNCTION__, LINUX_NB_CPU_STATS);
+        return -1;
+    }
+
+    if (!(cpu = virHostStatsSnapshotFindCPU(snapshot, cpuNum)))
+        return 0;
+
+    memcpy(params, cpu->stats, sizeof(cpu->stats));
+    return 1;
+}
+
+
+/**
+ * virHostStatsSnapshotGetCPURates:
+ * @snapshot: snapshot to read from
+ * @cpuNum: number of the CPU or VIR_NODE_CPU_STATS_ALL_CPUS
+ * @params: pointer to the array of typed parameters
+ * @nparams: number of items in @params
+ * @maxparams: allocated size of @params
+ *
+ * Appends the rates at which the CPU time counters grew since the
+ * previous snapshot to @params. Each counter gets a "<field>.rate"
+ * parameter in nanoseconds per second, and the share of kernel and
+ * user time is reported as VIR_NODE_CPU_STATS_UTILIZATION in percent.
+ *
+ * Returns 1 if the rates were added, 0 if @snapshot doesn't have any
+ * rates for @cpuNum, -1 on error.
+ */
+int
+virHostStatsSnapshotGetCPURates(virHostStatsSnapshotPtr snapshot,
+                                int cpuNum,
+                                virTypedParameterPtr *params,
+                                int *nparams,
+                                int *maxparams)
+{
+    virHostStatsCPUPtr cpu;
+    char *name = NULL;
+    size_t i;
+    int ret = -1;
+
+    if (!(cpu = virHostStatsSnapshotFindCPU(snapshot, cpuNum)) ||
+        !cpu->hasRates)
+        return 0;
+
+    for (i = 0; i < LINUX_NB_CPU_STATS; i++) {
+        if (virAsprintf(&name, "%s.rate", cpu->stats[i].field) < 0 ||
+            virTypedParamsAddULLong(params, nparams, maxparams,
+                                    name, cpu->rates[i]) < 0)
+            goto cleanup;
+        VIR_FREE(name);
+    }
+
+    if (virTypedParamsAddUInt(params, nparams, maxparams,
+                              VIR_NODE_CPU_STATS_UTILIZATION,
+                              cpu->utilization) < 0)
+        goto cleanup;
+
+    ret = 1;
+
+ cleanup:
+    VIR_FREE(name);
+    return ret;
+}
+
+
+/**
+ * virHostStatsSnapshotGetMemory:
+ *
+ * Same as virHostMemGetStatsLinux, but using data from @snapshot.
+ *
+ * Returns 1 if the stats were filled in, 0 if @snapshot doesn't have
+ * any data for @cellNum, -1 on error.
+ */
+int
+virHostStatsSnapshotGetMemory(virHostStatsSnapshotPtr snapshot,
+                              int cellNum,
+                              virNodeMemoryStatsPtr params,
+                              int *nparams)
+{
+    virHostStatsMemPtr mem;
+    int nr_param;
+
+    if (cellNum == VIR_NODE_MEMORY_STATS_ALL_CELLS) {
+        mem = &snapshot->memAll;
+        nr_param = LINUX_NB_MEMORY_STATS_ALL;
+    } else if (cellNum >= 0 && cellNum < snapshot->ncells) {
+        mem = &snapshot->cells[cellNum];
+        nr_param = LINUX_NB_MEMORY_STATS_CELL;
+    } else {
+        return 0;
+    }
+
+    if (!mem->present)
+        return 0;
+
+    if (*nparams == 0) {
+        *nparams = nr_param;
+        return 1;
+    }
+
+    if (*nparams != nr_param) {
+        virReportInvalidArg(nparams,
+                            _("nparams in %s must be %d"),
+                            __FUNCTION__, nr_param);
+        return -1;
+    }
+
+    memcpy(params, mem->stats, nr_param * sizeof(*params));
+    return 1;
+}
+
+
+static virHostStatsSnapshotPtr
+virHostStatsSample(virHostStatsSnapshotPtr prev)
+{
+    virHostStatsSnapshotPtr snapshot = NULL;
+    unsigned long long now;
+    FILE *procstat = NULL;
+    FILE *meminfo = NULL;
+    FILE **cellMeminfo = NULL;
+    size_t ncells = 0;
+    size_t i;
+
+    if (virTimeMillisNow(&now) < 0)
+        return NULL;
+
+    if (!(procstat = fopen(PROCSTAT_PATH, "r"))) {
+        virReportSystemError(errno, _("cannot open %s"), PROCSTAT_PATH);
+        goto cleanup;
+    }
+
+    if (!(meminfo = fopen(MEMINFO_PATH, "r"))) {
+        virReportSystemError(errno, _("cannot open %s"), MEMINFO_PATH);
+        goto cleanup;
+    }
+
+    if (virNumaIsAvailable()) {
+        int maxNode;
+
+        if ((maxNode = virNumaGetMaxNode()) < 0)
+            goto cleanup;
+
+        if (VIR_ALLOC_N(cellMeminfo, maxNode + 1) < 0)
+            goto cleanup;
+        ncells = maxNode + 1;
+
+        for (i = 0; i < ncells; i++) {
+            char *path;
+
+            if (virAsprintf(&path, SYSFS_SYSTEM_PATH "/node/node%zu/meminfo",
+                            i) < 0)
+                goto cleanup;
+
+            /* Missing nodes are left for the direct path to report */
+            cellMeminfo[i] = fopen(path, "r");
+            VIR_FREE(path);
+        }
+    }
+
+    snapshot = virHostStatsSnapshotNew(procstat, meminfo, cellMeminfo, ncells,
+                                       prev, now);
+
+ cleanup:
+    for (i = 0; i < ncells; i++)
+        VIR_FORCE_FCLOSE(cellMeminfo[i]);
+    VIR_FREE(cellMeminfo);
+    VIR_FORCE_FCLOSE(meminfo);
+    VIR_FORCE_FCLOSE(procstat);
+    return snapshot;
+}
+
+
+static void
+virHostStatsWorker(void *opaque ATTRIBUTE_UNUSED)
+{
+    virMutexLock(&virHostStatsLock);
+
+    while (!virHostStatsQuit) {
+        virHostStatsSnapshotPtr prev;
+        virHostStatsSnapshotPtr snapshot;
+        unsigned long long now;
+
+        if (virTimeMillisNow(&now) < 0 ||
+            (virCondWaitUntil(&virHostStatsCond, &virHostStatsLock,
+                              now + virHostStatsInterval * 1000ull) < 0 &&
+             errno != ETIMEDOUT)) {
+            VIR_WARN("Host statistics sampler failed: %s",
+                     virGetLastErrorMessage());
+            break;
+        }
+
+        if (virHostStatsQuit)
+            break;
+
+        prev = virObjectRef(virHostStatsCurrent);
+        virMutexUnlock(&virHostStatsLock);
+
+        if (!(snapshot = virHostStatsSample(prev))) {
+            VIR_WARN("Failed to sample host statistics: %s",
+                     virGetLastErrorMessage());
+            virResetLastError();
+        }
+        virObjectUnref(prev);
+
+        virMutexLock(&virHostStatsLock);
+        if (snapshot) {
+            prev = virHostStatsCurrent;
+            virHostStatsCurrent = snapshot;
+            virObjectUnref(prev);
+        }
+    }
+
+    virMutexUnlock(&virHostStatsLock);
+}
+
+
+/**
+ * virHostStatsSamplerStart:
+ * @interval: sampling interval in seconds
+ *
+ * Starts sampling host CPU and memory statistics in the background
+ * every @interval seconds. Does nothing if @interval is 0 or the
+ * sampler is running already.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virHostStatsSamplerStart(unsigned int interval)
+{
+    virHostStatsSnapshotPtr snapshot;
+    int ret = -1;
+
+    if (!interval)
+        return 0;
+
+    if (virHostStatsInitialize() < 0)
+        return -1;
+
+    virMutexLock(&virHostStatsLock);
+
+    if (virHostStatsInterval) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    /* Have the first snapshot ready before anyone asks */
+    if (!(snapshot = virHostStatsSample(NULL)))
+        goto cleanup;
+
+    if (virCondInit(&virHostStatsCond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize condition variable"));
+        virObjectUnref(snapshot);
+        goto cleanup;
+    }
+
+    virHostStatsCurrent = snapshot;
+    virHostStatsInterval = interval;
+    virHostStatsQuit = false;
+
+    if (virThreadCreate(&virHostStatsThread, true,
+                        virHostStatsWorker, NULL) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to create host statistics thread"));
+        virObjectUnref(virHostStatsCurrent);
+        virHostStatsCurrent = NULL;
+        virHostStatsInterval = 0;
+        virCondDestroy(&virHostStatsCond);
+        goto cleanup;
+    }
+
+    VIR_DEBUG("Sampling host statistics every %u seconds", interval);
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&virHostStatsLock);
+    return ret;
+}
+
+
+/**
+ * virHostStatsSamplerStop:
+ *
+ * Stops the sampler started by virHostStatsSamplerStart. Statistics are
+ * read directly again afterwards.
+ */
+void
+virHostStatsSamplerStop(void)
+{
+    virHostStatsSnapshotPtr snapshot;
+
+    virMutexLock(&virHostStatsLock);
+    if (!virHostStatsInterval) {
+        virMutexUnlock(&virHostStatsLock);
+        return;
+    }
+    virHostStatsQuit = true;
+    virCondSignal(&virHostStatsCond);
+    virMutexUnlock(&virHostStatsLock);
+
+    virThreadJoin(&virHostStatsThread);
+
+    virMutexLock(&virHostStatsLock);
+    snapshot = virHostStatsCurrent;
+    virHostStatsCurrent = NULL;
+    virHostStatsInterval = 0;
+    virCondDestroy(&virHostStatsCond);
+    virMutexUnlock(&virHostStatsLock);
+
+    virObjectUnref(snapshot);
+}
+
+
+static virHostStatsSnapshotPtr
+virHostStatsGetSnapshot(void)
+{
+    virHostStatsSnapshotPtr snapshot = NULL;
+    unsigned long long now;
+
+    if (virTimeMillisNow(&now) < 0) {
+        virResetLastError();
+        return NULL;
+    }
+
+    virMutexLock(&virHostStatsLock);
+    if (virHostStatsCurrent &&
+        now - virHostStatsCurrent->timestamp <=
+        VIR_HOST_STATS_MAX_AGE * virHostStatsInterval * 1000ull)
+        snapshot = virObjectRef(virHostStatsCurrent);
+    virMutexUnlock(&virHostStatsLock);
+
+    return snapshot;
+}
+
+
+/**
+ * virHostStatsGetCPU:
+ *
+ * Fills in CPU stats from the current snapshot if the sampler is
+ * running. See virHostStatsSnapshotGetCPU.
+ *
+ * Returns 1 if the stats were filled in, 0 if they have to be read
+ * directly, -1 on error.
+ */
+int
+virHostStatsGetCPU(int cpuNum,
+                   virNodeCPUStatsPtr params,
+                   int *nparams)
+{
+    virHostStatsSnapshotPtr snapshot;
+    int ret;
+
+    if (!(snapshot = virHostStatsGetSnapshot()))
+        return 0;
+
+    ret = virHostStatsSnapshotGetCPU(snapshot, cpuNum, params, nparams);
+    virObjectUnref(snapshot);
+    return ret;
+}
+
+
+/**
+ * virHostStatsGetCPURates:
+ * @cpuNum: number of the CPU or VIR_NODE_CPU_STATS_ALL_CPUS
+ * @params: pointer to the array of typed parameters
+ * @nparams: number of items in @params
+ * @maxparams: allocated size of @params
+ *
+ * Appends CPU time rates computed from the last two snapshots to
+ * @params if the sampler is running. See
+ * virHostStatsSnapshotGetCPURates.
+ *
+ * Returns 1 if the rates were added, 0 if there are none, -1 on error.
+ */
+int
+virHostStatsGetCPURates(int cpuNum,
+                        virTypedParameterPtr *params,
+                        int *nparams,
+                        int *maxparams)
+{
+    virHostStatsSnapshotPtr snapshot;
+    int ret;
+
+    if (!(snapshot = virHostStatsGetSnapshot()))
+        return 0;
+
+    ret = virHostStatsSnapshotGetCPURates(snapshot, cpuNum,
+                                          params, nparams, maxparams);
+    virObjectUnref(snapshot);
+    return ret;
+}
+
+
+/**
+ * virHostStatsGetMemory:
+ *
+ * Fills in memory stats from the current snapshot if the sampler is
+ * running. See virHostStatsSnapshotGetMemory.
+ *
+ * Returns 1 if the stats were filled in, 0 if they have to be read
+ * directly, -1 on error.
+ */
+int
+virHostStatsGetMemory(int cellNum,
+                      virNodeMemoryStatsPtr params,
+                      int *nparams)
+{
+    virHostStatsSnapshotPtr snapshot;
+    int ret;
+
+    if (!(snapshot = virHostStatsGetSnapshot()))
+        return 0;
+
+    ret = virHostStatsSnapshotGetMemory(snapshot, cellNum, params, nparams);
+    virObjectUnref(snapshot);
+    return ret;
+}
+
+#else /* !__linux__ */
+
+int
+virHostStatsSamplerStart(unsigned int interval)
+{
+    if (!interval)
+        return 0;
+
+    virReportError(VIR_ERR_NO_SUPPORT, "%s",
+                   _("host statistics sampling is not supported on this platform"));
+    return -1;
+}
+
+
+void
+virHostStatsSamplerStop(void)
+{
+}
+
+
+int
+virHostStatsGetCPU(int cpuNum ATTRIBUTE_UNUSED,
+                   virNodeCPUStatsPtr params ATTRIBUTE_UNUSED,
+                   int *nparams ATTRIBUTE_UNUSED)
+{
+    return 0;
+}
+
+
+int
+virHostStatsGetCPURates(int cpuNum ATTRIBUTE_UNUSED,
+                        virTypedParameterPtr *params ATTRIBUTE_UNUSED,
+                        int *nparams ATTRIBUTE_UNUSED,
+                        int *maxparams ATTRIBUTE_UNUSED)
+{
+    return 0;
+}
+
+
+int
+virHostStatsGetMemory(int cellNum ATTRIBUTE_UNUSED,
+                      virNodeMemoryStatsPtr params ATTRIBUTE_UNUSED,
+                      int *nparams ATTRIBUTE_UNUSED)
+{
+    return 0;
+}
+
+#endif /* !__linux__ */
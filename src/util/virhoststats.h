@@ -0,0 +1,68 @@
+/*
+ * virhoststats.h: background sampling of host CPU and memory statistics
+ *
+ * Copyright (C) 2017 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __VIR_HOSTSTATS_H__
+# define __VIR_HOSTSTATS_H__
+
+# include "internal.h"
+
+typedef struct _virHostStatsSnapshot virHostStatsSnapshot;
+typedef virHostStatsSnapshot *virHostStatsSnapshotPtr;
+
+int virHostStatsSamplerStart(unsigned int interval);
+void virHostStatsSamplerStop(void);
+
+int virHostStatsGetCPU(int cpuNum,
+                       virNodeCPUStatsPtr params,
+                       int *nparams);
+int virHostStatsGetCPURates(int cpuNum,
+                            virTypedParameterPtr *params,
+                            int *nparams,
+                            int *maxparams);
+int virHostStatsGetMemory(int cellNum,
+                          virNodeMemoryStatsPtr params,
+                          int *nparams);
+
+# ifdef __linux__
+virHostStatsSnapshotPtr
+virHostStatsSnapshotNew(FILE *procstat,
+                        FILE *meminfo,
+                        FILE **cellMeminfo,
+                        size_t ncells,
+                        virHostStatsSnapshotPtr prev,
+                        unsigned long long timestamp);
+
+int virHostStatsSnapshotGetCPU(virHostStatsSnapshotPtr snapshot,
+                               int cpuNum,
+                               virNodeCPUStatsPtr params,
+                               int *nparams);
+int virHostStatsSnapshotGetCPURates(virHostStatsSnapshotPtr snapshot,
+                                    int cpuNum,
+                                    virTypedParameterPtr *params,
+                                    int *nparams,
+                                    int *maxparams);
+int virHostStatsSnapshotGetMemory(virHostStatsSnapshotPtr snapshot,
+                                  int cellNum,
+                                  virNodeMemoryStatsPtr params,
+                                  int *nparams);
+# endif
+
+#endif /* __VIR_HOSTSTATS_H__ */
@@ -26,6 +26,7 @@
 #include "virjson.h"
 #include "viralloc.h"
 #include "virerror.h"
+#include "virhashcode.h"
 #include "virlog.h"
 #include "virstring.h"
 #include "virutil.h"
@@ -51,11 +52,16 @@
 
 VIR_LOG_INIT("util.json");
 
+/* Objects with at least this many keys get a hash table index so that
+ * key lookups don't have to walk all of them */
+#define VIR_JSON_OBJECT_INDEX_MIN 16
+
 typedef struct _virJSONParserState virJSONParserState;
 typedef virJSONParserState *virJSONParserStatePtr;
 struct _virJSONParserState {
     virJSONValuePtr value;
     char *key;
+    char *path; /* set if the members of @value are being filtered */
 };
 
 typedef struct _virJSONParser virJSONParser;
@@ -65,6 +71,11 @@ struct _virJSONParser {
     virJSONParserStatePtr state;
     size_t nstate;
     int wrap;
+
+    const char *const *filter;
+    char *path; /* filter path of the value following the current key */
+    bool skipValue; /* the value following the current key is dropped */
+    size_t skipDepth; /* nesting level inside a dropped container */
 };
 
 
@@ -355,6 +366,7 @@ virJSONValueFree(virJSONValuePtr value)
             virJSONValueFree(value->data.object.pairs[i].value);
         }
         VIR_FREE(value->data.object.pairs);
+        virHashFree(value->data.object.index);
         break;
     case VIR_JSON_TYPE_ARRAY:
         for (i = 0; i < value->data.array.nvalues; i++)
@@ -365,7 +377,7 @@ virJSONValueFree(virJSONValuePtr value)
         VIR_FREE(value->data.string);
         break;
     case VIR_JSON_TYPE_NUMBER:
-        VIR_FREE(value->data.number);
+        VIR_FREE(value->data.number.str);
         break;
     case VIR_JSON_TYPE_BOOLEAN:
     case VIR_JSON_TYPE_NULL:
@@ -428,7 +440,7 @@ virJSONValueNewStringLen(const char *data,
 
 
 static virJSONValuePtr
-virJSONValueNewNumber(const char *data)
+virJSONValueNewNumber(virJSONNumberType type)
 {
     virJSONValuePtr val;
 
@@ -436,10 +448,22 @@ virJSONValueNewNumber(const char *data)
         return NULL;
 
     val->type = VIR_JSON_TYPE_NUMBER;
-    if (VIR_STRDUP(val->data.number, data) < 0) {
-        VIR_FREE(val);
+    val->data.number.type = type;
+
+    return val;
+}
+
+
+/* Takes ownership of @str on success */
+static virJSONValuePtr
+virJSONValueNewNumberString(char *str)
+{
+    virJSONValuePtr val;
+
+    if (!(val = virJSONValueNewNumber(VIR_JSON_NUMBER_NONE)))
         return NULL;
-    }
+
+    val->data.number.str = str;
 
     return val;
 }
@@ -448,38 +472,27 @@ virJSONValueNewNumber(const char *data)
 virJSONValuePtr
 virJSONValueNewNumberInt(int data)
 {
-    virJSONValuePtr val = NULL;
-    char *str;
-    if (virAsprintf(&str, "%i", data) < 0)
-        return NULL;
-    val = virJSONValueNewNumber(str);
-    VIR_FREE(str);
-    return val;
+    return virJSONValueNewNumberLong(data);
 }
 
 
 virJSONValuePtr
 virJSONValueNewNumberUint(unsigned int data)
 {
-    virJSONValuePtr val = NULL;
-    char *str;
-    if (virAsprintf(&str, "%u", data) < 0)
-        return NULL;
-    val = virJSONValueNewNumber(str);
-    VIR_FREE(str);
-    return val;
+    return virJSONValueNewNumberUlong(data);
 }
 
 
 virJSONValuePtr
 virJSONValueNewNumberLong(long long data)
 {
-    virJSONValuePtr val = NULL;
-    char *str;
-    if (virAsprintf(&str, "%lld", data) < 0)
+    virJSONValuePtr val;
+
+    if (!(val = virJSONValueNewNumber(VIR_JSON_NUMBER_LONG)))
         return NULL;
-    val = virJSONValueNewNumber(str);
-    VIR_FREE(str);
+
+    val->data.number.val.l = data;
+
     return val;
 }
 
@@ -487,12 +500,13 @@ virJSONValueNewNumberLong(long long data)
 virJSONValuePtr
 virJSONValueNewNumberUlong(unsigned long long data)
 {
-    virJSONValuePtr val = NULL;
-    char *str;
-    if (virAsprintf(&str, "%llu", data) < 0)
+    virJSONValuePtr val;
+
+    if (!(val = virJSONValueNewNumber(VIR_JSON_NUMBER_ULONG)))
         return NULL;
-    val = virJSONValueNewNumber(str);
-    VIR_FREE(str);
+
+    val->data.number.val.ul = data;
+
     return val;
 }
 
@@ -500,12 +514,13 @@ virJSONValueNewNumberUlong(unsigned long long data)
 virJSONValuePtr
 virJSONValueNewNumberDouble(double data)
 {
-    virJSONValuePtr val = NULL;
-    char *str;
-    if (virDoubleToStr(&str, data) < 0)
+    virJSONValuePtr val;
+
+    if (!(val = virJSONValueNewNumber(VIR_JSON_NUMBER_DOUBLE)))
         return NULL;
-    val = virJSONValueNewNumber(str);
-    VIR_FREE(str);
+
+    val->data.number.val.d = data;
+
     return val;
 }
 
@@ -567,31 +582,131 @@ virJSONValueNewObject(void)
 }
 
 
+static uint32_t
+virJSONObjectIndexCode(const void *name,
+                       uint32_t seed)
+{
+    return virHashCodeGen(name, strlen(name), seed);
+}
+
+
+static bool
+virJSONObjectIndexEqual(const void *namea,
+                        const void *nameb)
+{
+    return STREQ(namea, nameb);
+}
+
+
+/* The index borrows the keys from the pairs array */
+static void *
+virJSONObjectIndexCopy(const void *name)
+{
+    return (void *) name;
+}
+
+
+static int
+virJSONObjectIndexAdd(virJSONObjectPtr obj,
+                      size_t pos)
+{
+    return virHashAddEntry(obj->index, obj->pairs[pos].key,
+                           (void *) (uintptr_t) (pos + 1));
+}
+
+
+static int
+virJSONObjectIndexBuild(virJSONObjectPtr obj)
+{
+    size_t i;
+
+    if (!(obj->index = virHashCreateFull(obj->npairs * 2, NULL,
+                                         virJSONObjectIndexCode,
+                                         virJSONObjectIndexEqual,
+                                         virJSONObjectIndexCopy,
+                                         NULL)))
+        return -1;
+
+    for (i = 0; i < obj->npairs; i++) {
+        if (virJSONObjectIndexAdd(obj, i) < 0) {
+            virHashFree(obj->index);
+            obj->index = NULL;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/* Removing a pair shifts the positions of the ones after it, so rather
+ * than patching the index up it's dropped and rebuilt on the next append */
+static void
+virJSONObjectIndexDrop(virJSONObjectPtr obj)
+{
+    virHashFree(obj->index);
+    obj->index = NULL;
+}
+
+
+static ssize_t
+virJSONObjectFind(virJSONObjectPtr obj,
+                  const char *key)
+{
+    size_t i;
+
+    if (obj->index) {
+        uintptr_t pos = (uintptr_t) virHashLookup(obj->index, key);
+        return pos ? pos - 1 : -1;
+    }
+
+    for (i = 0; i < obj->npairs; i++) {
+        if (STREQ(obj->pairs[i].key, key))
+            return i;
+    }
+
+    return -1;
+}
+
+
 int
 virJSONValueObjectAppend(virJSONValuePtr object,
                          const char *key,
                          virJSONValuePtr value)
 {
+    virJSONObjectPtr obj = &object->data.object;
     char *newkey;
+    int rc = 0;
 
     if (object->type != VIR_JSON_TYPE_OBJECT)
         return -1;
 
-    if (virJSONValueObjectHasKey(object, key))
+    if (virJSONObjectFind(obj, key) >= 0)
         return -1;
 
     if (VIR_STRDUP(newkey, key) < 0)
         return -1;
 
-    if (VIR_REALLOC_N(object->data.object.pairs,
-                      object->data.object.npairs + 1) < 0) {
+    if (VIR_REALLOC_N(obj->pairs, obj->npairs + 1) < 0) {
         VIR_FREE(newkey);
         return -1;
     }
 
-    object->data.object.pairs[object->data.object.npairs].key = newkey;
-    object->data.object.pairs[object->data.object.npairs].value = value;
-    object->data.object.npairs++;
+    obj->pairs[obj->npairs].key = newkey;
+    obj->pairs[obj->npairs].value = value;
+    obj->npairs++;
+
+    if (obj->index)
+        rc = virJSONObjectIndexAdd(obj, obj->npairs - 1);
+    else if (obj->npairs >= VIR_JSON_OBJECT_INDEX_MIN)
+        rc = virJSONObjectIndexBuild(obj);
+
+    if (rc < 0) {
+        /* the caller still owns @value on failure */
+        obj->npairs--;
+        VIR_FREE(newkey);
+        return -1;
+    }
 
     return 0;
 }
@@ -746,17 +861,10 @@ int
 virJSONValueObjectHasKey(virJSONValuePtr object,
                          const char *key)
 {
-    size_t i;
-
     if (object->type != VIR_JSON_TYPE_OBJECT)
         return -1;
 
-    for (i = 0; i < object->data.object.npairs; i++) {
-        if (STREQ(object->data.object.pairs[i].key, key))
-            return 1;
-    }
-
-    return 0;
+    return virJSONObjectFind(&object->data.object, key) >= 0;
 }
 
 
@@ -764,17 +872,15 @@ virJSONValuePtr
 virJSONValueObjectGet(virJSONValuePtr object,
                       const char *key)
 {
-    size_t i;
+    ssize_t i;
 
     if (object->type != VIR_JSON_TYPE_OBJECT)
         return NULL;
 
-    for (i = 0; i < object->data.object.npairs; i++) {
-        if (STREQ(object->data.object.pairs[i].key, key))
-            return object->data.object.pairs[i].value;
-    }
+    if ((i = virJSONObjectFind(&object->data.object, key)) < 0)
+        return NULL;
 
-    return NULL;
+    return object->data.object.pairs[i].value;
 }
 
 
@@ -782,21 +888,20 @@ static virJSONValuePtr
 virJSONValueObjectSteal(virJSONValuePtr object,
                         const char *key)
 {
-    size_t i;
+    ssize_t i;
     virJSONValuePtr obj = NULL;
 
     if (object->type != VIR_JSON_TYPE_OBJECT)
         return NULL;
 
-    for (i = 0; i < object->data.object.npairs; i++) {
-        if (STREQ(object->data.object.pairs[i].key, key)) {
-            VIR_STEAL_PTR(obj, object->data.object.pairs[i].value);
-            VIR_FREE(object->data.object.pairs[i].key);
-            VIR_DELETE_ELEMENT(object->data.object.pairs, i,
-                               object->data.object.npairs);
-            break;
-        }
-    }
+    if ((i = virJSONObjectFind(&object->data.object, key)) < 0)
+        return NULL;
+
+    virJSONObjectIndexDrop(&object->data.object);
+    VIR_STEAL_PTR(obj, object->data.object.pairs[i].value);
+    VIR_FREE(object->data.object.pairs[i].key);
+    VIR_DELETE_ELEMENT(object->data.object.pairs, i,
+                       object->data.object.npairs);
 
     return obj;
 }
@@ -864,7 +969,7 @@ virJSONValueObjectRemoveKey(virJSONValuePtr object,
                             const char *key,
                             virJSONValuePtr *value)
 {
-    size_t i;
+    ssize_t i;
 
     if (value)
         *value = NULL;
@@ -872,21 +977,19 @@ virJSONValueObjectRemoveKey(virJSONValuePtr object,
     if (object->type != VIR_JSON_TYPE_OBJECT)
         return -1;
 
-    for (i = 0; i < object->data.object.npairs; i++) {
-        if (STREQ(object->data.object.pairs[i].key, key)) {
-            if (value) {
-                *value = object->data.object.pairs[i].value;
-                object->data.object.pairs[i].value = NULL;
-            }
-            VIR_FREE(object->data.object.pairs[i].key);
-            virJSONValueFree(object->data.object.pairs[i].value);
-            VIR_DELETE_ELEMENT(object->data.object.pairs, i,
-                               object->data.object.npairs);
-            return 1;
-        }
-    }
+    if ((i = virJSONObjectFind(&object->data.object, key)) < 0)
+        return 0;
 
-    return 0;
+    virJSONObjectIndexDrop(&object->data.object);
+    if (value) {
+        *value = object->data.object.pairs[i].value;
+        object->data.object.pairs[i].value = NULL;
+    }
+    VIR_FREE(object->data.object.pairs[i].key);
+    virJSONValueFree(object->data.object.pairs[i].value);
+    VIR_DELETE_ELEMENT(object->data.object.pairs, i,
+                       object->data.object.npairs);
+    return 1;
 }
 
 
@@ -1032,14 +1135,64 @@ virJSONValueGetString(virJSONValuePtr string)
 }
 
 
+/* Returns the textual form of @number, formatting it first if the value
+ * was created from a native C type. */
+static const char *
+virJSONValueNumberFormat(virJSONValuePtr number)
+{
+    virJSONNumberPtr num = &number->data.number;
+
+    if (num->str)
+        return num->str;
+
+    switch ((virJSONNumberType) num->type) {
+    case VIR_JSON_NUMBER_LONG:
+        ignore_value(virAsprintf(&num->str, "%lld", num->val.l));
+        break;
+    case VIR_JSON_NUMBER_ULONG:
+        ignore_value(virAsprintf(&num->str, "%llu", num->val.ul));
+        break;
+    case VIR_JSON_NUMBER_DOUBLE:
+        ignore_value(virDoubleToStr(&num->str, num->val.d));
+        break;
+    case VIR_JSON_NUMBER_NONE:
+        break;
+    }
+
+    return num->str;
+}
+
+
+const char *
+virJSONValueGetNumberString(virJSONValuePtr number)
+{
+    if (number->type != VIR_JSON_TYPE_NUMBER)
+        return NULL;
+
+    return virJSONValueNumberFormat(number);
+}
+
+
+/* Numbers coming from the parser only have their textual form. The
+ * getters below parse it exactly as before, but remember the result so
+ * that repeated lookups of the same kind don't have to do it again. Only
+ * conversions that are lossless with respect to the string are taken
+ * from the cached value. */
 int
 virJSONValueGetNumberInt(virJSONValuePtr number,
                          int *value)
 {
+    long long l;
+
     if (number->type != VIR_JSON_TYPE_NUMBER)
         return -1;
 
-    return virStrToLong_i(number->data.number, NULL, 10, value);
+    if (virJSONValueGetNumberLong(number, &l) < 0 ||
+        l < INT_MIN || l > INT_MAX)
+        return -1;
+
+    *value = l;
+    return 0;
 }
 
 
@@ -1047,10 +1200,23 @@ int
 virJSONValueGetNumberUint(virJSONValuePtr number,
                           unsigned int *value)
 {
+    virJSONNumberPtr num = &number->data.number;
+    const char *str;
+
     if (number->type != VIR_JSON_TYPE_NUMBER)
         return -1;
 
-    return virStrToLong_ui(number->data.number, NULL, 10, value);
+    if (num->type == VIR_JSON_NUMBER_ULONG) {
+        if (num->val.ul > UINT_MAX)
+            return -1;
+        *value = num->val.ul;
+        return 0;
+    }
+
+    if (!(str = virJSONValueNumberFormat(number)))
+        return -1;
+
+    return virStrToLong_ui(str, NULL, 10, value);
 }
 
 
@@ -1058,10 +1224,27 @@ int
 virJSONValueGetNumberLong(virJSONValuePtr number,
                           long long *value)
 {
+    virJSONNumberPtr num = &number->data.number;
+    const char *str;
+
     if (number->type != VIR_JSON_TYPE_NUMBER)
         return -1;
 
-    return virStrToLong_ll(number->data.number, NULL, 10, value);
+    if (num->type == VIR_JSON_NUMBER_LONG) {
+        *value = num->val.l;
+        return 0;
+    }
+
+    if (!(str = virJSONValueNumberFormat(number)) ||
+        virStrToLong_ll(str, NULL, 10, value) < 0)
+        return -1;
+
+    if (num->type == VIR_JSON_NUMBER_NONE) {
+        num->type = VIR_JSON_NUMBER_LONG;
+        num->val.l = *value;
+    }
+
+    return 0;
 }
 
 
@@ -1069,10 +1252,29 @@ int
 virJSONValueGetNumberUlong(virJSONValuePtr number,
                            unsigned long long *value)
 {
+    virJSONNumberPtr num = &number->data.number;
+    const char *str;
+
     if (number->type != VIR_JSON_TYPE_NUMBER)
         return -1;
 
-    return virStrToLong_ull(number->data.number, NULL, 10, value);
+    if (num->type == VIR_JSON_NUMBER_ULONG) {
+        *value = num->val.ul;
+        return 0;
+    }
+
+    if (!(str = virJSONValueNumberFormat(number)) ||
+        virStrToLong_ull(str, NULL, 10, value) < 0)
+        return -1;
+
+    /* negative values wrap around and would confuse the unsigned int
+     * getter which treats them specially, so don't cache those */
+    if (num->type == VIR_JSON_NUMBER_NONE && !strchr(str, '-')) {
+        num->type = VIR_JSON_NUMBER_ULONG;
+        num->val.ul = *value;
+    }
+
+    return 0;
 }
 
 
@@ -1080,10 +1282,27 @@ int
 virJSONValueGetNumberDouble(virJSONValuePtr number,
                             double *value)
 {
+    virJSONNumberPtr num = &number->data.number;
+    const char *str;
+
     if (number->type != VIR_JSON_TYPE_NUMBER)
         return -1;
 
-    return virStrToDouble(number->data.number, NULL, value);
+    if (num->type == VIR_JSON_NUMBER_DOUBLE) {
+        *value = num->val.d;
+        return 0;
+    }
+
+    if (!(str = virJSONValueNumberFormat(number)) ||
+        virStrToDouble(str, NULL, value) < 0)
+        return -1;
+
+    if (num->type == VIR_JSON_NUMBER_NONE) {
+        num->type = VIR_JSON_NUMBER_DOUBLE;
+        num->val.d = *value;
+    }
+
+    return 0;
 }
 
 
@@ -1134,10 +1353,22 @@ virJSONValueGetArrayAsBitmap(const virJSONValue *val,
     for (i = 0; i < val->data.array.nvalues; i++) {
         elem = val->data.array.values[i];
 
-        if (elem->type != VIR_JSON_TYPE_NUMBER ||
-            virStrToLong_ullp(elem->data.number, NULL, 10, &elems[i]) < 0)
+        if (elem->type != VIR_JSON_TYPE_NUMBER)
             goto cleanup;
 
+        if (elem->data.number.type == VIR_JSON_NUMBER_ULONG) {
+            elems[i] = elem->data.number.val.ul;
+        } else if (elem->data.number.type == VIR_JSON_NUMBER_LONG &&
+                   elem->data.number.val.l >= 0) {
+            elems[i] = elem->data.number.val.l;
+        } else {
+            const char *str;
+
+            if (!(str = virJSONValueNumberFormat((virJSONValuePtr) elem)) ||
+                virStrToLong_ullp(str, NULL, 10, &elems[i]) < 0)
+                goto cleanup;
+        }
+
         if (elems[i] > maxelem)
             maxelem = elems[i];
     }
@@ -1404,7 +1635,11 @@ virJSONValueCopy(const virJSONValue *in)
         out = virJSONValueNewString(in->data.string);
         break;
     case VIR_JSON_TYPE_NUMBER:
-        out = virJSONValueNewNumber(in->data.number);
+        if (!(out = virJSONValueNewNumber(in->data.number.type)))
+            return NULL;
+        out->data.number.val = in->data.number.val;
+        if (VIR_STRDUP(out->data.number.str, in->data.number.str) < 0)
+            goto error;
         break;
     case VIR_JSON_TYPE_BOOLEAN:
         out = virJSONValueNewBoolean(in->data.boolean);
@@ -1423,6 +1658,110 @@ virJSONValueCopy(const virJSONValue *in)
 
 
 #if WITH_YAJL
+/* Decides the fate of a member found at @path. Returns 1 if it is kept
+ * along with everything it contains, 0 if it is kept but its own members
+ * are filtered too, and -1 if it is dropped. Members of the top level
+ * object which aren't mentioned by the filter at all are kept. */
+static int
+virJSONParserFilterMatch(virJSONParserPtr parser,
+                         const char *path,
+                         bool toplevel)
+{
+    const char *const *filter;
+    size_t len = strlen(path);
+    bool partial = false;
+
+    for (filter = parser->filter; *filter; filter++) {
+        if (!STRPREFIX(*filter, path))
+            continue;
+
+        if ((*filter)[len] == '\0')
+            return 1;
+        if ((*filter)[len] == '.')
+            partial = true;
+    }
+
+    if (partial)
+        return 0;
+
+    return toplevel ? 1 : -1;
+}
+
+
+/* Returns true if the current token is part of a value which is being
+ * dropped by the filter. @nest is 1 for tokens opening a container,
+ * -1 for tokens closing one and 0 otherwise. */
+static bool
+virJSONParserSkip(virJSONParserPtr parser,
+                  int nest)
+{
+    if (parser->skipDepth) {
+        parser->skipDepth += nest;
+        return true;
+    }
+
+    if (parser->skipValue) {
+        parser->skipValue = false;
+        if (nest > 0)
+            parser->skipDepth = 1;
+        return true;
+    }
+
+    return false;
+}
+
+
+/* Computes the filter path for a container which is about to be
+ * inserted into the current one. */
+static int
+virJSONParserFilterPath(virJSONParserPtr parser,
+                        char **path)
+{
+    virJSONParserStatePtr state;
+
+    *path = NULL;
+
+    if (!parser->filter || !parser->nstate)
+        return 0;
+
+    state = &parser->state[parser->nstate - 1];
+
+    if (state->value->type == VIR_JSON_TYPE_OBJECT) {
+        VIR_STEAL_PTR(*path, parser->path);
+        return 0;
+    }
+
+    /* array members share the filter of the array itself */
+    return VIR_STRDUP(*path, state->path);
+}
+
+
+static int
+virJSONParserPushState(virJSONParserPtr parser,
+                       virJSONValuePtr value,
+                       char *path)
+{
+    if (VIR_REALLOC_N(parser->state,
+                      parser->nstate + 1) < 0)
+        return -1;
+
+    parser->state[parser->nstate].value = value;
+    parser->state[parser->nstate].key = NULL;
+    parser->state[parser->nstate].path = path;
+    parser->nstate++;
+
+    return 0;
+}
+
+
+static void
+virJSONParserPopState(virJSONParserPtr parser)
+{
+    VIR_FREE(parser->state[parser->nstate - 1].path);
+    VIR_DELETE_ELEMENT(parser->state, parser->nstate - 1, parser->nstate);
+}
+
+
 static int
 virJSONParserInsertValue(virJSONParserPtr parser,
                          virJSONValuePtr value)
@@ -1451,6 +1790,7 @@ virJSONParserInsertValue(virJSONParserPtr parser,
                 return -1;
 
             VIR_FREE(state->key);
+            VIR_FREE(parser->path);
         }   break;
 
         case VIR_JSON_TYPE_ARRAY: {
@@ -1478,10 +1818,15 @@ static int
 virJSONParserHandleNull(void *ctx)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewNull();
+    virJSONValuePtr value;
 
     VIR_DEBUG("parser=%p", parser);
 
+    if (virJSONParserSkip(parser, 0))
+        return 1;
+
+    value = virJSONValueNewNull();
+
     if (!value)
         return 0;
 
@@ -1499,10 +1844,15 @@ virJSONParserHandleBoolean(void *ctx,
                            int boolean_)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewBoolean(boolean_);
+    virJSONValuePtr value;
 
     VIR_DEBUG("parser=%p boolean=%d", parser, boolean_);
 
+    if (virJSONParserSkip(parser, 0))
+        return 1;
+
+    value = virJSONValueNewBoolean(boolean_);
+
     if (!value)
         return 0;
 
@@ -1524,15 +1874,18 @@ virJSONParserHandleNumber(void *ctx,
     char *str;
     virJSONValuePtr value;
 
+    if (virJSONParserSkip(parser, 0))
+        return 1;
+
     if (VIR_STRNDUP(str, s, l) < 0)
         return -1;
-    value = virJSONValueNewNumber(str);
-    VIR_FREE(str);
 
     VIR_DEBUG("parser=%p str=%s", parser, str);
 
-    if (!value)
+    if (!(value = virJSONValueNewNumberString(str))) {
+        VIR_FREE(str);
         return 0;
+    }
 
     if (virJSONParserInsertValue(parser, value) < 0) {
         virJSONValueFree(value);
@@ -1549,11 +1902,15 @@ virJSONParserHandleString(void *ctx,
                           yajl_size_t stringLen)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewStringLen((const char *)stringVal,
-                                                     stringLen);
+    virJSONValuePtr value;
 
     VIR_DEBUG("parser=%p str=%p", parser, (const char *)stringVal);
 
+    if (virJSONParserSkip(parser, 0))
+        return 1;
+
+    value = virJSONValueNewStringLen((const char *)stringVal, stringLen);
+
     if (!value)
         return 0;
 
@@ -1573,9 +1930,14 @@ virJSONParserHandleMapKey(void *ctx,
 {
     virJSONParserPtr parser = ctx;
     virJSONParserStatePtr state;
+    bool toplevel;
+    int rc;
 
     VIR_DEBUG("parser=%p key=%p", parser, (const char *)stringVal);
 
+    if (parser->skipDepth)
+        return 1;
+
     if (!parser->nstate)
         return 0;
 
@@ -1584,6 +1946,29 @@ virJSONParserHandleMapKey(void *ctx,
         return 0;
     if (VIR_STRNDUP(state->key, (const char *)stringVal, stringLen) < 0)
         return 0;
+
+    toplevel = parser->nstate == 1 + parser->wrap;
+    if (!parser->filter || (!toplevel && !state->path))
+        return 1;
+
+    VIR_FREE(parser->path);
+    if (toplevel) {
+        if (VIR_STRDUP(parser->path, state->key) < 0)
+            return 0;
+    } else {
+        if (virAsprintf(&parser->path, "%s.%s", state->path, state->key) < 0)
+            return 0;
+    }
+
+    if ((rc = virJSONParserFilterMatch(parser, parser->path, toplevel)) == 0)
+        return 1;
+
+    VIR_FREE(parser->path);
+    if (rc < 0) {
+        VIR_FREE(state->key);
+        parser->skipValue = true;
+    }
+
     return 1;
 }
 
@@ -1592,27 +1977,33 @@ static int
 virJSONParserHandleStartMap(void *ctx)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewObject();
+    virJSONValuePtr value;
+    char *path;
 
     VIR_DEBUG("parser=%p", parser);
 
-    if (!value)
+    if (virJSONParserSkip(parser, 1))
+        return 1;
+
+    if (virJSONParserFilterPath(parser, &path) < 0)
+        return 0;
+
+    if (!(value = virJSONValueNewObject())) {
+        VIR_FREE(path);
         return 0;
+    }
 
     if (virJSONParserInsertValue(parser, value) < 0) {
         virJSONValueFree(value);
+        VIR_FREE(path);
         return 0;
     }
 
-    if (VIR_REALLOC_N(parser->state,
-                      parser->nstate + 1) < 0) {
+    if (virJSONParserPushState(parser, value, path) < 0) {
+        VIR_FREE(path);
         return 0;
     }
 
-    parser->state[parser->nstate].value = value;
-    parser->state[parser->nstate].key = NULL;
-    parser->nstate++;
-
     return 1;
 }
 
@@ -1625,6 +2016,9 @@ virJSONParserHandleEndMap(void *ctx)
 
     VIR_DEBUG("parser=%p", parser);
 
+    if (virJSONParserSkip(parser, -1))
+        return 1;
+
     if (!parser->nstate)
         return 0;
 
@@ -1634,7 +2028,7 @@ virJSONParserHandleEndMap(void *ctx)
         return 0;
     }
 
-    VIR_DELETE_ELEMENT(parser->state, parser->nstate - 1, parser->nstate);
+    virJSONParserPopState(parser);
 
     return 1;
 }
@@ -1644,25 +2038,32 @@ static int
 virJSONParserHandleStartArray(void *ctx)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewArray();
+    virJSONValuePtr value;
+    char *path;
 
     VIR_DEBUG("parser=%p", parser);
 
-    if (!value)
+    if (virJSONParserSkip(parser, 1))
+        return 1;
+
+    if (virJSONParserFilterPath(parser, &path) < 0)
         return 0;
 
+    if (!(value = virJSONValueNewArray())) {
+        VIR_FREE(path);
+        return 0;
+    }
+
     if (virJSONParserInsertValue(parser, value) < 0) {
         virJSONValueFree(value);
+        VIR_FREE(path);
         return 0;
     }
 
-    if (VIR_REALLOC_N(parser->state,
-                      parser->nstate + 1) < 0)
+    if (virJSONParserPushState(parser, value, path) < 0) {
+        VIR_FREE(path);
         return 0;
-
-    parser->state[parser->nstate].value = value;
-    parser->state[parser->nstate].key = NULL;
-    parser->nstate++;
+    }
 
     return 1;
 }
@@ -1676,6 +2077,9 @@ virJSONParserHandleEndArray(void *ctx)
 
     VIR_DEBUG("parser=%p", parser);
 
+    if (virJSONParserSkip(parser, -1))
+        return 1;
+
     if (!(parser->nstate - parser->wrap))
         return 0;
 
@@ -1685,7 +2089,7 @@ virJSONParserHandleEndArray(void *ctx)
         return 0;
     }
 
-    VIR_DELETE_ELEMENT(parser->state, parser->nstate - 1, parser->nstate);
+    virJSONParserPopState(parser);
 
     return 1;
 }
@@ -1706,12 +2110,12 @@ static const yajl_callbacks parserCallbacks = {
 };
 
 
-/* XXX add an incremental streaming parser - yajl trivially supports it */
-virJSONValuePtr
-virJSONValueFromString(const char *jsonstring)
+static virJSONValuePtr
+virJSONValueFromStringInternal(const char *jsonstring,
+                               const char *const *filter)
 {
     yajl_handle hand;
-    virJSONParser parser = { NULL, NULL, 0, 0 };
+    virJSONParser parser = { .filter = filter };
     virJSONValuePtr ret = NULL;
     int rc;
     size_t len = strlen(jsonstring);
@@ -1790,10 +2194,13 @@ virJSONValueFromString(const char *jsonstring)
 
     if (parser.nstate) {
         size_t i;
-        for (i = 0; i < parser.nstate; i++)
+        for (i = 0; i < parser.nstate; i++) {
             VIR_FREE(parser.state[i].key);
+            VIR_FREE(parser.state[i].path);
+        }
         VIR_FREE(parser.state);
     }
+    VIR_FREE(parser.path);
 
     VIR_DEBUG("result=%p", ret);
 
@@ -1801,10 +2208,42 @@ virJSONValueFromString(const char *jsonstring)
 }
 
 
+virJSONValuePtr
+virJSONValueFromString(const char *jsonstring)
+{
+    return virJSONValueFromStringInternal(jsonstring, NULL);
+}
+
+
+/**
+ * virJSONValueFromStringFiltered:
+ * @jsonstring: string to parse
+ * @filter: NULL terminated list of dot separated member paths to keep
+ *
+ * Parses @jsonstring like virJSONValueFromString, but values which are not
+ * needed by the caller are skipped while parsing and never allocated. Each
+ * path in @filter names a member which is kept together with everything it
+ * contains, and the members leading to it. Arrays are transparent, so
+ * "return.device" selects the "device" member of every object in the
+ * "return" array. Members of the top level object which aren't mentioned
+ * in @filter at all are kept whole, so that e.g. error replies or events
+ * are not affected by a filter meant for the "return" member.
+ *
+ * Returns the parsed value or NULL on error.
+ */
+virJSONValuePtr
+virJSONValueFromStringFiltered(const char *jsonstring,
+                               const char *const *filter)
+{
+    return virJSONValueFromStringInternal(jsonstring, filter);
+}
+
+
 static int
 virJSONValueToStringOne(virJSONValuePtr object,
                         yajl_gen g)
 {
+    const char *str;
     size_t i;
 
     VIR_DEBUG("object=%p type=%d gen=%p", object, object->type, g);
@@ -1843,8 +2282,9 @@ virJSONValueToStringOne(virJSONValuePtr object,
         break;
 
     case VIR_JSON_TYPE_NUMBER:
-        if (yajl_gen_number(g, object->data.number,
-                            strlen(object->data.number)) != yajl_gen_status_ok)
+        if (!(str = virJSONValueNumberFormat(object)))
+            return -1;
+        if (yajl_gen_number(g, str, strlen(str)) != yajl_gen_status_ok)
             return -1;
         break;
 
@@ -1927,6 +2367,16 @@ virJSONValueFromString(const char *jsonstring ATTRIBUTE_UNUSED)
 }
 
 
+virJSONValuePtr
+virJSONValueFromStringFiltered(const char *jsonstring ATTRIBUTE_UNUSED,
+                               const char *const *filter ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("No JSON parser implementation is available"));
+    return NULL;
+}
+
+
 char *
 virJSONValueToString(virJSONValuePtr object ATTRIBUTE_UNUSED,
                      bool pretty ATTRIBUTE_UNUSED)
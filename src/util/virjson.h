@@ -26,6 +26,7 @@
 
 # include "internal.h"
 # include "virbitmap.h"
+# include "virhash.h"
 
 # include <stdarg.h>
 
@@ -51,6 +52,9 @@ typedef virJSONObjectPair *virJSONObjectPairPtr;
 typedef struct _virJSONArray virJSONArray;
 typedef virJSONArray *virJSONArrayPtr;
 
+typedef struct _virJSONNumber virJSONNumber;
+typedef virJSONNumber *virJSONNumberPtr;
+
 
 struct _virJSONObjectPair {
     char *key;
@@ -60,6 +64,7 @@ struct _virJSONObjectPair {
 struct _virJSONObject {
     size_t npairs;
     virJSONObjectPairPtr pairs;
+    virHashTablePtr index; /* key -> position + 1, only for large objects */
 };
 
 struct _virJSONArray {
@@ -67,6 +72,23 @@ struct _virJSONArray {
     virJSONValuePtr *values;
 };
 
+typedef enum {
+    VIR_JSON_NUMBER_NONE, /* only the textual form is known */
+    VIR_JSON_NUMBER_LONG,
+    VIR_JSON_NUMBER_ULONG,
+    VIR_JSON_NUMBER_DOUBLE,
+} virJSONNumberType;
+
+struct _virJSONNumber {
+    char *str; /* textual form, formatted on demand for native numbers */
+    int type; /* enum virJSONNumberType */
+    union {
+        long long l;
+        unsigned long long ul;
+        double d;
+    } val;
+};
+
 struct _virJSONValue {
     int type; /* enum virJSONType */
     bool protect; /* prevents deletion when embedded in another object */
@@ -75,7 +97,7 @@ struct _virJSONValue {
         virJSONObject object;
         virJSONArray array;
         char *string;
-        char *number; /* int/float/etc format is context defined so we can't parse it here :-( */
+        virJSONNumber number;
         int boolean;
     } data;
 };
@@ -132,6 +154,7 @@ const char *virJSONValueObjectGetKey(virJSONValuePtr object, unsigned int n);
 virJSONValuePtr virJSONValueObjectGetValue(virJSONValuePtr object, unsigned int n);
 
 const char *virJSONValueGetString(virJSONValuePtr object);
+const char *virJSONValueGetNumberString(virJSONValuePtr number);
 int virJSONValueGetNumberInt(virJSONValuePtr object, int *value);
 int virJSONValueGetNumberUint(virJSONValuePtr object, unsigned int *value);
 int virJSONValueGetNumberLong(virJSONValuePtr object, long long *value);
@@ -171,6 +194,8 @@ int virJSONValueObjectRemoveKey(virJSONValuePtr object, const char *key,
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
 
 virJSONValuePtr virJSONValueFromString(const char *jsonstring);
+virJSONValuePtr virJSONValueFromStringFiltered(const char *jsonstring,
+                                               const char *const *filter);
 char *virJSONValueToString(virJSONValuePtr object,
                            bool pretty);
 
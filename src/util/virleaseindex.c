@@ -0,0 +1,610 @@
+/*
+ * virleaseindex.c: indexed lookup of DHCP leases
+ *
+ * Copyright (C) 2017 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The lease index is a flat file living next to the per-network
+ * *.status and *.macs files. It consists of a fixed header followed
+ * by VIR_LEASE_INDEX_LAST tables of virLeaseIndexRecord, each sorted
+ * by name, and a string table holding the NUL terminated names.
+ * Readers (the NSS module) mmap() it and binary search the table they
+ * need instead of parsing every JSON file on each lookup. Writers
+ * regenerate it from scratch whenever a lease or MAC map changes and
+ * replace it atomically, so readers always see a consistent snapshot.
+ */
+
+#include <config.h>
+
+#include "virleaseindex.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "verify.h"
+#include "viralloc.h"
+#include "virerror.h"
+#include "virfile.h"
+#include "virjson.h"
+#include "virlease.h"
+#include "virlog.h"
+#include "virmacmap.h"
+#include "virobject.h"
+#include "virsocketaddr.h"
+#include "virstring.h"
+
+#define VIR_FROM_THIS VIR_FROM_NETWORK
+
+VIR_LOG_INIT("util.leaseindex");
+
+#define VIR_LEASE_INDEX_MAGIC "LVLEASES"
+#define VIR_LEASE_INDEX_VERSION 1
+
+typedef struct _virLeaseIndexHeader virLeaseIndexHeader;
+struct _virLeaseIndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t nrecords[VIR_LEASE_INDEX_LAST];
+    uint32_t strtablen;
+};
+
+verify(sizeof(virLeaseIndexHeader) % 8 == 0);
+verify(sizeof(virLeaseIndexRecord) == 32);
+
+struct _virLeaseIndex {
+    void *map;
+    size_t maplen;
+
+    const virLeaseIndexRecord *records[VIR_LEASE_INDEX_LAST];
+    size_t nrecords[VIR_LEASE_INDEX_LAST];
+
+    const char *strtab;
+    size_t strtablen;
+};
+
+
+/* Helper structures used while rebuilding the index. Names point
+ * into the parsed JSON leases or MAC maps, which outlive them. */
+typedef struct _virLeaseIndexEntry virLeaseIndexEntry;
+typedef virLeaseIndexEntry *virLeaseIndexEntryPtr;
+struct _virLeaseIndexEntry {
+    const char *name;
+    virLeaseIndexRecord rec;
+};
+
+typedef struct _virLeaseIndexBuilder virLeaseIndexBuilder;
+typedef virLeaseIndexBuilder *virLeaseIndexBuilderPtr;
+struct _virLeaseIndexBuilder {
+    virLeaseIndexEntryPtr entries[VIR_LEASE_INDEX_LAST];
+    size_t nentries[VIR_LEASE_INDEX_LAST];
+
+    /* All leases with a MAC address, sorted by it */
+    virLeaseIndexEntryPtr bymac;
+    size_t nbymac;
+};
+
+
+static char *
+virLeaseIndexPath(const char *dir,
+                  const char *suffix)
+{
+    char *path;
+
+    ignore_value(virAsprintfQuiet(&path, "%s/%s%s",
+                                  dir, VIR_LEASE_INDEX_FILE,
+                                  suffix ? suffix : ""));
+    return path;
+}
+
+
+#ifndef LIBVIRT_NSS
+
+static int
+virLeaseIndexEntryCompare(const void *a,
+                          const void *b)
+{
+    const virLeaseIndexEntry *ea = a;
+    const virLeaseIndexEntry *eb = b;
+    int rc;
+
+    if ((rc = strcmp(ea->name, eb->name)) != 0)
+        return rc;
+    if (ea->rec.family != eb->rec.family)
+        return ea->rec.family < eb->rec.family ? -1 : 1;
+    return memcmp(ea->rec.addr, eb->rec.addr, sizeof(ea->rec.addr));
+}
+
+
+static int
+virLeaseIndexAddLeases(virLeaseIndexBuilderPtr builder,
+                       virJSONValuePtr leases)
+{
+    size_t i;
+    size_t nleases = virJSONValueArraySize(leases);
+
+    for (i = 0; i < nleases; i++) {
+        virJSONValuePtr lease = virJSONValueArrayGet(leases, i);
+        virLeaseIndexEntry entry;
+        const char *ip;
+        const char *hostname;
+        const char *mac;
+        long long expiry;
+        virSocketAddr sa;
+
+        memset(&entry, 0, sizeof(entry));
+
+        if (!(ip = virJSONValueObjectGetString(lease, "ip-address")) ||
+            virJSONValueObjectGetNumberLong(lease, "expiry-time", &expiry) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("failed to parse json"));
+            return -1;
+        }
+
+        if (virSocketAddrParse(&sa, ip, AF_UNSPEC) < 0)
+            return -1;
+
+        entry.rec.family = VIR_SOCKET_ADDR_FAMILY(&sa);
+        entry.rec.expiry = expiry;
+        if (entry.rec.family == AF_INET6)
+            memcpy(entry.rec.addr, &sa.data.inet6.sin6_addr.s6_addr, 16);
+        else
+            memcpy(entry.rec.addr, &sa.data.inet4.sin_addr.s_addr, 4);
+
+        if ((hostname = virJSONValueObjectGetString(lease, "hostname"))) {
+            entry.name = hostname;
+            if (VIR_APPEND_ELEMENT_COPY(builder->entries[VIR_LEASE_INDEX_HOSTNAME],
+                                        builder->nentries[VIR_LEASE_INDEX_HOSTNAME],
+                                        entry) < 0)
+                return -1;
+        }
+
+        if ((mac = virJSONValueObjectGetString(lease, "mac-address"))) {
+            entry.name = mac;
+            if (VIR_APPEND_ELEMENT_COPY(builder->bymac, builder->nbymac,
+                                        entry) < 0)
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static int
+virLeaseIndexAddDomain(const char *domain,
+                       const char *const *macs,
+                       void *opaque)
+{
+    virLeaseIndexBuilderPtr builder = opaque;
+    size_t i;
+
+    for (i = 0; macs[i]; i++) {
+        size_t lo = 0;
+        size_t hi = builder->nbymac;
+
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+
+            if (strcmp(builder->bymac[mid].name, macs[i]) < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        for (; lo < builder->nbymac && STREQ(builder->bymac[lo].name, macs[i]); lo++) {
+            virLeaseIndexEntry entry = builder->bymac[lo];
+
+            entry.name = domain;
+            if (VIR_APPEND_ELEMENT_COPY(builder->entries[VIR_LEASE_INDEX_DOMAIN],
+                                        builder->nentries[VIR_LEASE_INDEX_DOMAIN],
+                                        entry) < 0)
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+typedef struct _virLeaseIndexImage virLeaseIndexImage;
+struct _virLeaseIndexImage {
+    char *data;
+    size_t len;
+};
+
+
+static int
+virLeaseIndexWrite(int fd,
+                   const void *opaque)
+{
+    const virLeaseIndexImage *image = opaque;
+
+    if (safewrite(fd, image->data, image->len) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+virLeaseIndexSerialize(virLeaseIndexBuilderPtr builder,
+                       virLeaseIndexImage *image)
+{
+    virLeaseIndexHeader *header;
+    virLeaseIndexRecord *records;
+    char *strtab;
+    size_t nrecords = 0;
+    size_t strtablen = 0;
+    size_t off = 0;
+    size_t i;
+    int k;
+
+    /* Adjacent equal names share a single string table slot */
+    for (k = 0; k < VIR_LEASE_INDEX_LAST; k++) {
+        virLeaseIndexEntryPtr entries = builder->entries[k];
+
+        for (i = 0; i < builder->nentries[k]; i++) {
+            if (i == 0 || STRNEQ(entries[i].name, entries[i - 1].name))
+                strtablen += strlen(entries[i].name) + 1;
+        }
+        nrecords += builder->nentries[k];
+    }
+
+    /* Keep the string table non-empty so that readers can rely on
+     * it being NUL terminated. */
+    if (strtablen == 0)
+        strtablen = 1;
+
+    if (nrecords > UINT32_MAX || strtablen > UINT32_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("too many leases to index"));
+        return -1;
+    }
+
+    image->len = sizeof(*header) + nrecords * sizeof(*records) + strtablen;
+    if (VIR_ALLOC_N(image->data, image->len) < 0)
+        return -1;
+
+    header = (virLeaseIndexHeader *) image->data;
+    records = (virLeaseIndexRecord *) (image->data + sizeof(*header));
+    strtab = image->data + sizeof(*header) + nrecords * sizeof(*records);
+
+    memcpy(header->magic, VIR_LEASE_INDEX_MAGIC, sizeof(header->magic));
+    header->version = VIR_LEASE_INDEX_VERSION;
+    header->strtablen = strtablen;
+
+    for (k = 0; k < VIR_LEASE_INDEX_LAST; k++) {
+        virLeaseIndexEntryPtr entries = builder->entries[k];
+
+        header->nrecords[k] = builder->nentries[k];
+
+        for (i = 0; i < builder->nentries[k]; i++) {
+            if (i == 0 || STRNEQ(entries[i].name, entries[i - 1].name)) {
+                size_t len = strlen(entries[i].name) + 1;
+
+                memcpy(strtab + off, entries[i].name, len);
+                entries[i].rec.name = off;
+                off += len;
+            } else {
+                entries[i].rec.name = entries[i - 1].rec.name;
+            }
+            *records++ = entries[i].rec;
+        }
+    }
+
+    return 0;
+}
+
+
+static int
+virLeaseIndexRebuildLocked(const char *dir,
+                           const char *path)
+{
+    DIR *dh = NULL;
+    struct dirent *entry;
+    virJSONValuePtr leases = NULL;
+    virMacMapPtr *macmaps = NULL;
+    size_t nmacmaps = 0;
+    virLeaseIndexBuilder builder;
+    virLeaseIndexImage image = { NULL, 0 };
+    char *file = NULL;
+    size_t i;
+    int rc;
+    int ret = -1;
+
+    memset(&builder, 0, sizeof(builder));
+
+    if (!(leases = virJSONValueNewArray()))
+        goto cleanup;
+
+    if (virDirOpen(&dh, dir) < 0)
+        goto cleanup;
+
+    while ((rc = virDirRead(dh, &entry, dir)) > 0) {
+        bool status = virFileHasSuffix(entry->d_name, ".status");
+
+        if (!status && !virFileHasSuffix(entry->d_name, ".macs"))
+            continue;
+
+        if (!(file = virFileBuildPath(dir, entry->d_name, NULL)))
+            goto cleanup;
+
+        if (status) {
+            if (virLeaseReadCustomLeaseFile(leases, file, NULL, NULL) < 0)
+                goto cleanup;
+        } else {
+            if (VIR_EXPAND_N(macmaps, nmacmaps, 1) < 0 ||
+                !(macmaps[nmacmaps - 1] = virMacMapNew(file)))
+                goto cleanup;
+        }
+        VIR_FREE(file);
+    }
+    if (rc < 0)
+        goto cleanup;
+
+    if (virLeaseIndexAddLeases(&builder, leases) < 0)
+        goto cleanup;
+
+    if (builder.nbymac)
+        qsort(builder.bymac, builder.nbymac, sizeof(*builder.bymac),
+              virLeaseIndexEntryCompare);
+
+    for (i = 0; i < nmacmaps; i++) {
+        if (virMacMapForEach(macmaps[i], virLeaseIndexAddDomain, &builder) < 0)
+            goto cleanup;
+    }
+
+    for (i = 0; i < VIR_LEASE_INDEX_LAST; i++) {
+        if (builder.nentries[i])
+            qsort(builder.entries[i], builder.nentries[i],
+                  sizeof(*builder.entries[i]), virLeaseIndexEntryCompare);
+    }
+
+    if (virLeaseIndexSerialize(&builder, &image) < 0)
+        goto cleanup;
+
+    if (virFileRewrite(path, 0644, virLeaseIndexWrite, &image) < 0)
+        goto cleanup;
+
+    VIR_DEBUG("Indexed %zu hostnames and %zu domain addresses in %s",
+              builder.nentries[VIR_LEASE_INDEX_HOSTNAME],
+              builder.nentries[VIR_LEASE_INDEX_DOMAIN], path);
+
+    ret = 0;
+ cleanup:
+    VIR_DIR_CLOSE(dh);
+    VIR_FREE(file);
+    VIR_FREE(image.data);
+    for (i = 0; i < VIR_LEASE_INDEX_LAST; i++)
+        VIR_FREE(builder.entries[i]);
+    VIR_FREE(builder.bymac);
+    for (i = 0; i < nmacmaps; i++)
+        virObjectUnref(macmaps[i]);
+    VIR_FREE(macmaps);
+    virJSONValueFree(leases);
+    return ret;
+}
+
+
+/**
+ * virLeaseIndexRebuild:
+ * @dir: directory holding the *.status and *.macs files
+ *
+ * Regenerate the lease index in @dir from the lease and MAC map
+ * files found there. Concurrent rebuilds (e.g. by libvirtd and the
+ * leases helper spawned by dnsmasq) are serialized through a lock
+ * file so that the last one to finish always reflects the latest
+ * state of the directory. If the index cannot be regenerated it is
+ * removed, making readers fall back to parsing the files directly.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+virLeaseIndexRebuild(const char *dir)
+{
+    char *path = NULL;
+    char *lockpath = NULL;
+    int lockfd = -1;
+    int ret = -1;
+
+    if (!(path = virLeaseIndexPath(dir, NULL)) ||
+        !(lockpath = virLeaseIndexPath(dir, ".lock")))
+        goto cleanup;
+
+    if ((lockfd = open(lockpath, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0) {
+        virReportSystemError(errno, _("unable to open '%s'"), lockpath);
+        goto cleanup;
+    }
+
+    if (virFileLock(lockfd, false, 0, 1, true) < 0) {
+        virReportSystemError(errno, _("unable to lock '%s'"), lockpath);
+        goto cleanup;
+    }
+
+    if (virLeaseIndexRebuildLocked(dir, path) < 0) {
+        if (unlink(path) < 0 && errno != ENOENT)
+            VIR_WARN("Unable to remove stale lease index %s", path);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FORCE_CLOSE(lockfd);
+    VIR_FREE(lockpath);
+    VIR_FREE(path);
+    return ret;
+}
+
+
+#endif /* !LIBVIRT_NSS */
+
+
+/**
+ * virLeaseIndexOpen:
+ * @dir: directory holding the lease index
+ *
+ * Map the lease index from @dir into memory. This is called from the
+ * NSS module and therefore never reports an error; callers are
+ * expected to fall back to parsing the lease files directly.
+ *
+ * Returns the index on success, NULL with errno set otherwise.
+ */
+virLeaseIndexPtr
+virLeaseIndexOpen(const char *dir)
+{
+    virLeaseIndexPtr idx = NULL;
+    const virLeaseIndexHeader *header;
+    const char *base;
+    char *path = NULL;
+    struct stat sb;
+    size_t nrecords = 0;
+    size_t i;
+    int fd = -1;
+    int saved_errno;
+
+    if (!(path = virLeaseIndexPath(dir, NULL)))
+        goto error;
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0 ||
+        fstat(fd, &sb) < 0)
+        goto error;
+
+    if (sb.st_size < (off_t) sizeof(*header))
+        goto invalid;
+
+    if (VIR_ALLOC_QUIET(idx) < 0)
+        goto error;
+
+    idx->maplen = sb.st_size;
+    if ((idx->map = mmap(NULL, idx->maplen, PROT_READ,
+                         MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        idx->map = NULL;
+        goto error;
+    }
+
+    header = idx->map;
+    base = (const char *) idx->map + sizeof(*header);
+
+    if (memcmp(header->magic, VIR_LEASE_INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != VIR_LEASE_INDEX_VERSION)
+        goto invalid;
+
+    for (i = 0; i < VIR_LEASE_INDEX_LAST; i++) {
+        idx->records[i] = (const virLeaseIndexRecord *) base + nrecords;
+        idx->nrecords[i] = header->nrecords[i];
+        nrecords += header->nrecords[i];
+    }
+
+    idx->strtab = base + nrecords * sizeof(virLeaseIndexRecord);
+    idx->strtablen = header->strtablen;
+
+    if (idx->strtablen == 0 ||
+        sizeof(*header) + nrecords * sizeof(virLeaseIndexRecord) +
+        idx->strtablen != idx->maplen ||
+        idx->strtab[idx->strtablen - 1] != '\0')
+        goto invalid;
+
+    VIR_FORCE_CLOSE(fd);
+    VIR_FREE(path);
+    return idx;
+
+ invalid:
+    VIR_DEBUG("Ignoring malformed lease index '%s'", path);
+    errno = EINVAL;
+ error:
+    saved_errno = errno;
+    virLeaseIndexFree(idx);
+    VIR_FORCE_CLOSE(fd);
+    VIR_FREE(path);
+    errno = saved_errno;
+    return NULL;
+}
+
+
+void
+virLeaseIndexFree(virLeaseIndexPtr idx)
+{
+    if (!idx)
+        return;
+
+    if (idx->map)
+        munmap(idx->map, idx->maplen);
+    VIR_FREE(idx);
+}
+
+
+static const char *
+virLeaseIndexRecordName(virLeaseIndexPtr idx,
+                        const virLeaseIndexRecord *rec)
+{
+    if (rec->name >= idx->strtablen)
+        return NULL;
+
+    return idx->strtab + rec->name;
+}
+
+
+/**
+ * virLeaseIndexLookup:
+ * @idx: lease index
+ * @key: which table to search
+ * @name: hostname or domain name to look up
+ * @records: filled with the first matching record
+ *
+ * Find all records in table @key of @idx whose name is @name. The
+ * matching records are stored contiguously starting at @records.
+ * Expired leases are not filtered out.
+ *
+ * Returns the number of matching records.
+ */
+size_t
+virLeaseIndexLookup(virLeaseIndexPtr idx,
+                    virLeaseIndexKey key,
+                    const char *name,
+                    const virLeaseIndexRecord **records)
+{
+    const virLeaseIndexRecord *table = idx->records[key];
+    size_t lo = 0;
+    size_t hi = idx->nrecords[key];
+    size_t first;
+    const char *tmp;
+
+    *records = NULL;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (!(tmp = virLeaseIndexRecordName(idx, &table[mid])))
+            return 0;
+
+        if (strcmp(tmp, name) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    first = lo;
+    while (lo < idx->nrecords[key] &&
+           (tmp = virLeaseIndexRecordName(idx, &table[lo])) &&
+           STREQ(tmp, name))
+        lo++;
+
+    if (lo > first)
+        *records = &table[first];
+    return lo - first;
+}
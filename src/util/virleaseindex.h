@@ -0,0 +1,58 @@
+/*
+ * virleaseindex.h: indexed lookup of DHCP leases
+ *
+ * Copyright (C) 2017 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VIR_LEASE_INDEX_H__
+# define __VIR_LEASE_INDEX_H__
+
+# include "internal.h"
+
+# define VIR_LEASE_INDEX_FILE "leases.index"
+
+typedef enum {
+    VIR_LEASE_INDEX_HOSTNAME,   /* keyed by hostname reported in lease */
+    VIR_LEASE_INDEX_DOMAIN,     /* keyed by domain name owning lease MAC */
+
+    VIR_LEASE_INDEX_LAST
+} virLeaseIndexKey;
+
+typedef struct _virLeaseIndexRecord virLeaseIndexRecord;
+typedef virLeaseIndexRecord *virLeaseIndexRecordPtr;
+struct _virLeaseIndexRecord {
+    uint32_t name;              /* offset into string table */
+    uint32_t family;            /* AF_INET or AF_INET6 */
+    int64_t expiry;             /* lease expiry time, seconds since epoch */
+    unsigned char addr[16];     /* address in network byte order */
+};
+
+typedef struct _virLeaseIndex virLeaseIndex;
+typedef virLeaseIndex *virLeaseIndexPtr;
+
+int virLeaseIndexRebuild(const char *dir);
+
+virLeaseIndexPtr virLeaseIndexOpen(const char *dir);
+
+void virLeaseIndexFree(virLeaseIndexPtr idx);
+
+size_t virLeaseIndexLookup(virLeaseIndexPtr idx,
+                           virLeaseIndexKey key,
+                           const char *name,
+                           const virLeaseIndexRecord **records);
+
+#endif /* __VIR_LEASE_INDEX_H__ */
@@ -49,6 +49,7 @@
 #include "virthread.h"
 #include "virfile.h"
 #include "virtime.h"
+#include "viratomic.h"
 #include "intprops.h"
 #include "virstring.h"
 #include "configmake.h"
@@ -116,8 +117,64 @@ static size_t virLogNbOutputs;
  */
 static virLogPriority virLogDefaultPriority = VIR_LOG_DEFAULT;
 
+/*
+ * Asynchronous output: when enabled, threads queue debug and info
+ * messages into a ring of their own and a background thread passes
+ * them on to the outputs. A thread never waits for log I/O then; if
+ * its ring is full the message is dropped and accounted for.
+ */
+#define VIR_LOG_RING_SIZE 128   /* records per thread, power of two */
+#define VIR_LOG_RECORD_BUFLEN 256   /* messages longer than this are
+                                     * allocated on the heap */
+#define VIR_LOG_FLUSH_INTERVAL 100  /* ms */
+
+verify((VIR_LOG_RING_SIZE & (VIR_LOG_RING_SIZE - 1)) == 0);
+
+typedef struct _virLogRecord virLogRecord;
+typedef virLogRecord *virLogRecordPtr;
+struct _virLogRecord {
+    unsigned int seq;
+    virLogSourcePtr source;
+    virLogPriority priority;
+    const char *filename;
+    int linenr;
+    const char *funcname;
+    unsigned int flags;
+    unsigned long long thread;
+    char timestamp[VIR_TIME_STRING_BUFLEN];
+    char *str;      /* NULL if the message fits into @buf */
+    char buf[VIR_LOG_RECORD_BUFLEN];
+};
+
+typedef struct _virLogRing virLogRing;
+typedef virLogRing *virLogRingPtr;
+struct _virLogRing {
+    virLogRecord records[VIR_LOG_RING_SIZE];
+    volatile int head;      /* advanced by the owning thread only */
+    volatile int tail;      /* advanced by the flusher only */
+    volatile int dropped;   /* messages lost because the ring was full */
+    volatile int dead;      /* the owning thread has exited */
+    unsigned int end;       /* head as seen by the current flush */
+    virLogRingPtr next;
+};
+
+static virMutex virLogRingsMutex;
+static virLogRingPtr virLogRings;
+static virThreadLocal virLogRingKey;
+static volatile int virLogAsyncSeq;
+static volatile int virLogAsyncActive;
+static pid_t virLogAsyncPid;
+static bool virLogAsyncQuit;
+static virCond virLogAsyncCond;
+static virThread virLogAsyncThread;
+static unsigned long long virLogAsyncWritten;
+static unsigned long long virLogAsyncDropped;
+
+static bool virLogInitMessageStderr = true;
+
 static void virLogResetFilters(void);
 static void virLogResetOutputs(void);
+static void virLogFlushLocked(void);
 static void virLogOutputToFd(virLogSourcePtr src,
                              virLogPriority priority,
                              const char *filename,
@@ -257,12 +314,27 @@ virLogPriorityString(virLogPriority lvl)
 }
 
 
+static void
+virLogRingRelease(void *opaque)
+{
+    virLogRingPtr ring = opaque;
+
+    /* The flusher frees the ring once it has been drained */
+    virAtomicIntSet(&ring->dead, 1);
+}
+
+
 static int
 virLogOnceInit(void)
 {
     if (virMutexInit(&virLogMutex) < 0)
         return -1;
 
+    if (virMutexInit(&virLogRingsMutex) < 0 ||
+        virCondInit(&virLogAsyncCond) < 0 ||
+        virThreadLocalInit(&virLogRingKey, virLogRingRelease) < 0)
+        return -1;
+
     virLogLock();
     virLogDefaultPriority = VIR_LOG_DEFAULT;
 
@@ -291,7 +363,16 @@ virLogReset(void)
     if (virLogInitialize() < 0)
         return -1;
 
+    /* In a forked child the output thread does not exist and the
+     * messages queued by the parent must not be written twice */
+    if (virLogAsyncPid && virLogAsyncPid != getpid()) {
+        virLogAsyncActive = 0;
+        virLogAsyncPid = 0;
+        virLogRings = NULL;
+    }
+
     virLogLock();
+    virLogFlushLocked();
     virLogResetFilters();
     virLogResetOutputs();
     virLogDefaultPriority = VIR_LOG_DEFAULT;
@@ -424,6 +505,7 @@ virLogOutputListFree(virLogOutputPtr *list, int count)
 
 static int
 virLogFormatString(char **msg,
+                   unsigned long long thread,
                    int linenr,
                    const char *funcname,
                    virLogPriority priority,
@@ -440,11 +522,11 @@ virLogFormatString(char **msg,
      */
     if ((funcname != NULL)) {
         ret = virAsprintfQuiet(msg, "%llu: %s : %s:%d : %s\n",
-                               virThreadSelfID(), virLogPriorityString(priority),
+                               thread, virLogPriorityString(priority),
                                funcname, linenr, str);
     } else {
         ret = virAsprintfQuiet(msg, "%llu: %s : %s\n",
-                               virThreadSelfID(), virLogPriorityString(priority),
+                               thread, virLogPriorityString(priority),
                                str);
     }
     return ret;
@@ -456,7 +538,8 @@ virLogVersionString(const char **rawmsg,
                     char **msg)
 {
     *rawmsg = VIR_LOG_VERSION_STRING;
-    return virLogFormatString(msg, 0, NULL, VIR_LOG_INFO, VIR_LOG_VERSION_STRING);
+    return virLogFormatString(msg, virThreadSelfID(), 0, NULL, VIR_LOG_INFO,
+                              VIR_LOG_VERSION_STRING);
 }
 
 /* Similar to virGetHostname() but avoids use of error
@@ -478,7 +561,8 @@ virLogHostnameString(char **rawmsg,
     }
     VIR_FREE(hostname);
 
-    if (virLogFormatString(msg, 0, NULL, VIR_LOG_INFO, hoststr) < 0) {
+    if (virLogFormatString(msg, virThreadSelfID(), 0, NULL, VIR_LOG_INFO,
+                           hoststr) < 0) {
         VIR_FREE(hoststr);
         return -1;
     }
@@ -511,6 +595,399 @@ virLogSourceUpdate(virLogSourcePtr source)
     virLogUnlock();
 }
 
+
+/*
+ * Push the message to the outputs defined, if none exist then
+ * use stderr. Must be called with the log lock held.
+ */
+static void
+virLogOutputMessage(virLogSourcePtr source,
+                    virLogPriority priority,
+                    const char *filename,
+                    int linenr,
+                    const char *funcname,
+                    const char *timestamp,
+                    virLogMetadataPtr metadata,
+                    unsigned int filterflags,
+                    const char *str,
+                    const char *msg)
+{
+    size_t i;
+
+    for (i = 0; i < virLogNbOutputs; i++) {
+        if (priority >= virLogOutputs[i]->priority) {
+            if (virLogOutputs[i]->logInitMessage) {
+                const char *rawinitmsg;
+                char *hoststr = NULL;
+                char *initmsg = NULL;
+                if (virLogVersionString(&rawinitmsg, &initmsg) >= 0)
+                    virLogOutputs[i]->f(&virLogSelf, VIR_LOG_INFO,
+                                       __FILE__, __LINE__, __func__,
+                                       timestamp, NULL, 0, rawinitmsg, initmsg,
+                                       virLogOutputs[i]->data);
+                VIR_FREE(initmsg);
+                if (virLogHostnameString(&hoststr, &initmsg) >= 0)
+                    virLogOutputs[i]->f(&virLogSelf, VIR_LOG_INFO,
+                                       __FILE__, __LINE__, __func__,
+                                       timestamp, NULL, 0, hoststr, initmsg,
+                                       virLogOutputs[i]->data);
+                VIR_FREE(hoststr);
+                VIR_FREE(initmsg);
+                virLogOutputs[i]->logInitMessage = false;
+            }
+            virLogOutputs[i]->f(source, priority,
+                               filename, linenr, funcname,
+                               timestamp, metadata, filterflags,
+                               str, msg, virLogOutputs[i]->data);
+        }
+    }
+    if (virLogNbOutputs == 0) {
+        if (virLogInitMessageStderr) {
+            const char *rawinitmsg;
+            char *hoststr = NULL;
+            char *initmsg = NULL;
+            if (virLogVersionString(&rawinitmsg, &initmsg) >= 0)
+                virLogOutputToFd(&virLogSelf, VIR_LOG_INFO,
+                                 __FILE__, __LINE__, __func__,
+                                 timestamp, NULL, 0, rawinitmsg, initmsg,
+                                 (void *) STDERR_FILENO);
+            VIR_FREE(initmsg);
+            if (virLogHostnameString(&hoststr, &initmsg) >= 0)
+                virLogOutputToFd(&virLogSelf, VIR_LOG_INFO,
+                                 __FILE__, __LINE__, __func__,
+                                 timestamp, NULL, 0, hoststr, initmsg,
+                                 (void *) STDERR_FILENO);
+            VIR_FREE(hoststr);
+            VIR_FREE(initmsg);
+            virLogInitMessageStderr = false;
+        }
+        virLogOutputToFd(source, priority,
+                         filename, linenr, funcname,
+                         timestamp, metadata, filterflags,
+                         str, msg, (void *) STDERR_FILENO);
+    }
+}
+
+
+static void
+virLogOutputRecord(virLogRecordPtr rec)
+{
+    const char *str = rec->str ? rec->str : rec->buf;
+    char *msg = NULL;
+
+    if (virLogFormatString(&msg, rec->thread, rec->linenr, rec->funcname,
+                           rec->priority, str) >= 0)
+        virLogOutputMessage(rec->source, rec->priority,
+                            rec->filename, rec->linenr, rec->funcname,
+                            rec->timestamp, NULL, rec->flags, str, msg);
+
+    VIR_FREE(msg);
+    VIR_FREE(rec->str);
+}
+
+
+/*
+ * Pass all messages queued so far to the outputs, oldest first,
+ * and release rings of threads which have exited. Must be called
+ * with the log lock held.
+ */
+static void
+virLogFlushLocked(void)
+{
+    virLogRingPtr ring;
+    virLogRingPtr *next;
+    unsigned int dropped = 0;
+
+    /* Nothing was ever queued, or this is a forked child which
+     * must not replay the parent's messages */
+    if (!virLogRings)
+        return;
+
+    virMutexLock(&virLogRingsMutex);
+
+    for (ring = virLogRings; ring; ring = ring->next) {
+        int d = virAtomicIntGet(&ring->dropped);
+
+        if (d) {
+            virAtomicIntAdd(&ring->dropped, -d);
+            dropped += d;
+        }
+        ring->end = virAtomicIntGet(&ring->head);
+    }
+
+    /* Each ring is ordered already, merge them by sequence number */
+    while (true) {
+        virLogRingPtr oldest = NULL;
+        virLogRecordPtr rec = NULL;
+
+        for (ring = virLogRings; ring; ring = ring->next) {
+            virLogRecordPtr cur;
+
+            if ((unsigned int) ring->tail == ring->end)
+                continue;
+
+            cur = &ring->records[ring->tail & (VIR_LOG_RING_SIZE - 1)];
+            if (!rec || (int) (cur->seq - rec->seq) < 0) {
+                oldest = ring;
+                rec = cur;
+            }
+        }
+
+        if (!oldest)
+            break;
+
+        virLogOutputRecord(rec);
+        virAtomicIntSet(&oldest->tail,
+                        (int) ((unsigned int) oldest->tail + 1));
+        virLogAsyncWritten++;
+    }
+
+    next = &virLogRings;
+    while ((ring = *next)) {
+        if (virAtomicIntGet(&ring->dead) &&
+            ring->tail == virAtomicIntGet(&ring->head)) {
+            *next = ring->next;
+            VIR_FREE(ring);
+        } else {
+            next = &ring->next;
+        }
+    }
+
+    virMutexUnlock(&virLogRingsMutex);
+
+    if (dropped) {
+        char timestamp[VIR_TIME_STRING_BUFLEN];
+        char *str = NULL;
+        char *msg = NULL;
+
+        virLogAsyncDropped += dropped;
+
+        if (virTimeStringNowRaw(timestamp) < 0)
+            timestamp[0] = '\0';
+
+        if (virAsprintfQuiet(&str, "%u log messages dropped", dropped) >= 0 &&
+            virLogFormatString(&msg, virThreadSelfID(), __LINE__, __func__,
+                               VIR_LOG_WARN, str) >= 0)
+            virLogOutputMessage(&virLogSelf, VIR_LOG_WARN,
+                                __FILE__, __LINE__, __func__,
+                                timestamp, NULL, 0, str, msg);
+        VIR_FREE(str);
+        VIR_FREE(msg);
+    }
+}
+
+
+/**
+ * virLogFlush:
+ *
+ * Pass all messages queued for asynchronous output so far to the
+ * outputs. This is a no-op unless virLogSetAsync() was used.
+ */
+void
+virLogFlush(void)
+{
+    if (virLogInitialize() < 0)
+        return;
+
+    virLogLock();
+    virLogFlushLocked();
+    virLogUnlock();
+}
+
+
+static void
+virLogAsyncWorker(void *opaque ATTRIBUTE_UNUSED)
+{
+    unsigned long long now;
+
+    virMutexLock(&virLogRingsMutex);
+    while (!virLogAsyncQuit) {
+        if (virTimeMillisNowRaw(&now) < 0 ||
+            virCondWaitUntil(&virLogAsyncCond, &virLogRingsMutex,
+                             now + VIR_LOG_FLUSH_INTERVAL) < 0) {
+            if (errno != ETIMEDOUT)
+                break;
+        }
+
+        if (virLogAsyncQuit)
+            break;
+
+        virMutexUnlock(&virLogRingsMutex);
+        virLogFlush();
+        virMutexLock(&virLogRingsMutex);
+    }
+    virMutexUnlock(&virLogRingsMutex);
+
+    virLogFlush();
+}
+
+
+/**
+ * virLogSetAsync:
+ * @async: whether messages should be written asynchronously
+ *
+ * When @async is true, debug and info messages are queued by the
+ * calling thread and written to the outputs from a background
+ * thread. Warnings and errors are still written synchronously, after
+ * everything queued before them. When @async is false, the background
+ * thread is stopped once all queued messages are written.
+ *
+ * Must not be called before the process forks into the background.
+ *
+ * Returns 0 if successful, -1 in case of error.
+ */
+int
+virLogSetAsync(bool async)
+{
+    if (virLogInitialize() < 0)
+        return -1;
+
+    if (async == !!virAtomicIntGet(&virLogAsyncActive))
+        return 0;
+
+    if (async) {
+        virLogAsyncQuit = false;
+        virLogAsyncPid = getpid();
+        virAtomicIntSet(&virLogAsyncActive, 1);
+
+        if (virThreadCreate(&virLogAsyncThread, true,
+                            virLogAsyncWorker, NULL) < 0) {
+            virAtomicIntSet(&virLogAsyncActive, 0);
+            virReportSystemError(errno, "%s",
+                                 _("Unable to create log output thread"));
+            return -1;
+        }
+    } else {
+        virAtomicIntSet(&virLogAsyncActive, 0);
+
+        virMutexLock(&virLogRingsMutex);
+        virLogAsyncQuit = true;
+        virCondSignal(&virLogAsyncCond);
+        virMutexUnlock(&virLogRingsMutex);
+
+        virThreadJoin(&virLogAsyncThread);
+    }
+
+    return 0;
+}
+
+
+/**
+ * virLogGetAsyncStats:
+ * @written: filled with the number of asynchronously written messages
+ * @dropped: filled with the number of messages dropped as their
+ *           thread's queue was full
+ */
+void
+virLogGetAsyncStats(unsigned long long *written,
+                    unsigned long long *dropped)
+{
+    *written = *dropped = 0;
+
+    if (virLogInitialize() < 0)
+        return;
+
+    virLogLock();
+    *written = virLogAsyncWritten;
+    *dropped = virLogAsyncDropped;
+    virLogUnlock();
+}
+
+
+static virLogRingPtr
+virLogRingGet(void)
+{
+    virLogRingPtr ring = virThreadLocalGet(&virLogRingKey);
+
+    if (ring)
+        return ring;
+
+    if (VIR_ALLOC_QUIET(ring) < 0)
+        return NULL;
+
+    if (virThreadLocalSet(&virLogRingKey, ring) < 0) {
+        VIR_FREE(ring);
+        return NULL;
+    }
+
+    virMutexLock(&virLogRingsMutex);
+    ring->next = virLogRings;
+    virLogRings = ring;
+    virMutexUnlock(&virLogRingsMutex);
+
+    return ring;
+}
+
+
+/*
+ * Queue the message into the calling thread's ring. Returns 0 if
+ * the message was queued or dropped, -1 if it has to be written
+ * synchronously instead.
+ */
+static int
+virLogQueueMessage(virLogSourcePtr source,
+                   virLogPriority priority,
+                   const char *filename,
+                   int linenr,
+                   const char *funcname,
+                   unsigned int filterflags,
+                   const char *fmt,
+                   va_list vargs)
+{
+    virLogRingPtr ring;
+    virLogRecordPtr rec;
+    unsigned int head;
+    unsigned int tail;
+    va_list ap;
+    int len;
+
+    if (!(ring = virLogRingGet()))
+        return -1;
+
+    head = ring->head;
+    tail = virAtomicIntGet(&ring->tail);
+
+    if (head - tail >= VIR_LOG_RING_SIZE) {
+        virAtomicIntInc(&ring->dropped);
+        virCondSignal(&virLogAsyncCond);
+        return 0;
+    }
+
+    rec = &ring->records[head & (VIR_LOG_RING_SIZE - 1)];
+
+    va_copy(ap, vargs);
+    len = vsnprintf(rec->buf, sizeof(rec->buf), fmt, ap);
+    va_end(ap);
+
+    rec->str = NULL;
+    if (len < 0 ||
+        ((size_t) len >= sizeof(rec->buf) &&
+         virVasprintfQuiet(&rec->str, fmt, vargs) < 0)) {
+        virAtomicIntInc(&ring->dropped);
+        return 0;
+    }
+
+    if (virTimeStringNowRaw(rec->timestamp) < 0)
+        rec->timestamp[0] = '\0';
+
+    rec->source = source;
+    rec->priority = priority;
+    rec->filename = filename;
+    rec->linenr = linenr;
+    rec->funcname = funcname;
+    rec->flags = filterflags;
+    rec->thread = virThreadSelfID();
+    rec->seq = virAtomicIntInc(&virLogAsyncSeq);
+
+    virAtomicIntSet(&ring->head, (int) (head + 1));
+
+    /* Wake the flusher early rather than risk dropping messages */
+    if (head + 1 - tail == VIR_LOG_RING_SIZE / 2)
+        virCondSignal(&virLogAsyncCond);
+
+    return 0;
+}
+
 /**
  * virLogMessage:
  * @source: where is that message coming from
@@ -567,12 +1044,10 @@ virLogVMessage(virLogSourcePtr source,
                const char *fmt,
                va_list vargs)
 {
-    static bool logInitMessageStderr = true;
     char *str = NULL;
     char *msg = NULL;
     char timestamp[VIR_TIME_STRING_BUFLEN];
     int ret;
-    size_t i;
     int saved_errno = errno;
     unsigned int filterflags = 0;
 
@@ -596,13 +1071,26 @@ virLogVMessage(virLogSourcePtr source,
         goto cleanup;
     filterflags = source->flags;
 
+    /*
+     * Messages carrying metadata or asking for a stack trace need
+     * the caller's context, so they are never queued.
+     */
+    if (priority < VIR_LOG_WARN &&
+        !metadata &&
+        !(filterflags & VIR_LOG_STACK_TRACE) &&
+        virAtomicIntGet(&virLogAsyncActive) &&
+        virLogQueueMessage(source, priority, filename, linenr, funcname,
+                           filterflags, fmt, vargs) == 0)
+        goto cleanup;
+
     /*
      * serialize the error message, add level and timestamp
      */
     if (virVasprintfQuiet(&str, fmt, vargs) < 0)
         goto cleanup;
 
-    ret = virLogFormatString(&msg, linenr, funcname, priority, str);
+    ret = virLogFormatString(&msg, virThreadSelfID(),
+                             linenr, funcname, priority, str);
     if (ret < 0)
         goto cleanup;
 
@@ -611,62 +1099,14 @@ virLogVMessage(virLogSourcePtr source,
 
     virLogLock();
 
-    /*
-     * Push the message to the outputs defined, if none exist then
-     * use stderr.
-     */
-    for (i = 0; i < virLogNbOutputs; i++) {
-        if (priority >= virLogOutputs[i]->priority) {
-            if (virLogOutputs[i]->logInitMessage) {
-                const char *rawinitmsg;
-                char *hoststr = NULL;
-                char *initmsg = NULL;
-                if (virLogVersionString(&rawinitmsg, &initmsg) >= 0)
-                    virLogOutputs[i]->f(&virLogSelf, VIR_LOG_INFO,
-                                       __FILE__, __LINE__, __func__,
-                                       timestamp, NULL, 0, rawinitmsg, initmsg,
-                                       virLogOutputs[i]->data);
-                VIR_FREE(initmsg);
-                if (virLogHostnameString(&hoststr, &initmsg) >= 0)
-                    virLogOutputs[i]->f(&virLogSelf, VIR_LOG_INFO,
-                                       __FILE__, __LINE__, __func__,
-                                       timestamp, NULL, 0, hoststr, initmsg,
-                                       virLogOutputs[i]->data);
-                VIR_FREE(hoststr);
-                VIR_FREE(initmsg);
-                virLogOutputs[i]->logInitMessage = false;
-            }
-            virLogOutputs[i]->f(source, priority,
-                               filename, linenr, funcname,
-                               timestamp, metadata, filterflags,
-                               str, msg, virLogOutputs[i]->data);
-        }
-    }
-    if (virLogNbOutputs == 0) {
-        if (logInitMessageStderr) {
-            const char *rawinitmsg;
-            char *hoststr = NULL;
-            char *initmsg = NULL;
-            if (virLogVersionString(&rawinitmsg, &initmsg) >= 0)
-                virLogOutputToFd(&virLogSelf, VIR_LOG_INFO,
-                                 __FILE__, __LINE__, __func__,
-                                 timestamp, NULL, 0, rawinitmsg, initmsg,
-                                 (void *) STDERR_FILENO);
-            VIR_FREE(initmsg);
-            if (virLogHostnameString(&hoststr, &initmsg) >= 0)
-                virLogOutputToFd(&virLogSelf, VIR_LOG_INFO,
-                                 __FILE__, __LINE__, __func__,
-                                 timestamp, NULL, 0, hoststr, initmsg,
-                                 (void *) STDERR_FILENO);
-            VIR_FREE(hoststr);
-            VIR_FREE(initmsg);
-            logInitMessageStderr = false;
-        }
-        virLogOutputToFd(source, priority,
-                         filename, linenr, funcname,
-                         timestamp, metadata, filterflags,
-                         str, msg, (void *) STDERR_FILENO);
-    }
+    /* Keep the output in order with anything queued before */
+    virLogFlushLocked();
+
+    virLogOutputMessage(source, priority,
+                        filename, linenr, funcname,
+                        timestamp, metadata, filterflags,
+                        str, msg);
+
     virLogUnlock();
 
  cleanup:
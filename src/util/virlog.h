@@ -199,6 +199,10 @@ int virLogSetDefaultOutput(const char *fname, bool godaemon, bool privileged);
 void virLogLock(void);
 void virLogUnlock(void);
 int virLogReset(void);
+int virLogSetAsync(bool async);
+void virLogFlush(void);
+void virLogGetAsyncStats(unsigned long long *written,
+                         unsigned long long *dropped);
 int virLogParseDefaultPriority(const char *priority);
 int virLogPriorityFromSyslog(int priority);
 void virLogMessage(virLogSourcePtr source,
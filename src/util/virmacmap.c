@@ -378,6 +378,50 @@ virMacMapLookup(virMacMapPtr mgr,
 }
 
 
+struct virMacMapForEachData {
+    virMacMapIterator iter;
+    void *opaque;
+};
+
+
+static int
+virMacMapForEachHelper(void *payload,
+                       const void *name,
+                       void *data)
+{
+    struct virMacMapForEachData *d = data;
+
+    return d->iter(name, payload, d->opaque);
+}
+
+
+/**
+ * virMacMapForEach:
+ * @mgr: mac map
+ * @iter: callback
+ * @opaque: data passed to @iter
+ *
+ * Call @iter for each domain in @mgr together with the NULL
+ * terminated list of its MAC addresses. Iteration stops as soon
+ * as @iter returns a negative value.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+virMacMapForEach(virMacMapPtr mgr,
+                 virMacMapIterator iter,
+                 void *opaque)
+{
+    struct virMacMapForEachData data = { .iter = iter, .opaque = opaque };
+    int ret;
+
+    virObjectLock(mgr);
+    ret = virHashForEach(mgr->macs, virMacMapForEachHelper, &data);
+    virObjectUnlock(mgr);
+    return ret;
+}
+
+
 int
 virMacMapWriteFile(virMacMapPtr mgr,
                    const char *filename)
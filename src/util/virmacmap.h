@@ -44,6 +44,14 @@ int virMacMapRemove(virMacMapPtr mgr,
 const char *const *virMacMapLookup(virMacMapPtr mgr,
                                    const char *domain);
 
+typedef int (*virMacMapIterator)(const char *domain,
+                                 const char *const *macs,
+                                 void *opaque);
+
+int virMacMapForEach(virMacMapPtr mgr,
+                     virMacMapIterator iter,
+                     void *opaque);
+
 int virMacMapWriteFile(virMacMapPtr mgr,
                        const char *filename);
 
@@ -147,6 +147,7 @@ virQEMUBuildCommandLineJSONRecurse(const char *key,
 {
     struct virQEMUCommandLineJSONIteratorData data = { key, buf, arrayFunc };
     virJSONValuePtr elem;
+    const char *number;
     size_t i;
 
     if (!key && value->type != VIR_JSON_TYPE_OBJECT) {
@@ -163,7 +164,9 @@ virQEMUBuildCommandLineJSONRecurse(const char *key,
         break;
 
     case VIR_JSON_TYPE_NUMBER:
-        virBufferAsprintf(buf, "%s=%s,", key, value->data.number);
+        if (!(number = virJSONValueGetNumberString(value)))
+            return -1;
+        virBufferAsprintf(buf, "%s=%s,", key, number);
         break;
 
     case VIR_JSON_TYPE_BOOLEAN:
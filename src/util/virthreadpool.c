@@ -28,18 +28,23 @@
 
 #include "virthreadpool.h"
 #include "viralloc.h"
+#include "viratomic.h"
 #include "virthread.h"
 #include "virerror.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
+/* Number of finished jobs kept around for reuse by each job list */
+#define VIR_THREAD_POOL_FREE_JOBS_MAX 64
+
 typedef struct _virThreadPoolJob virThreadPoolJob;
 typedef virThreadPoolJob *virThreadPoolJobPtr;
 
 struct _virThreadPoolJob {
-    virThreadPoolJobPtr prev;
     virThreadPoolJobPtr next;
     unsigned int priority;
+    unsigned long long queued;
 
     void *data;
 };
@@ -50,18 +55,38 @@ typedef virThreadPoolJobList *virThreadPoolJobListPtr;
 struct _virThreadPoolJobList {
     virThreadPoolJobPtr head;
     virThreadPoolJobPtr tail;
-    virThreadPoolJobPtr firstPrio;
+};
+
+/* A queue of normal priority jobs served primarily by the workers
+ * attached to it. Workers whose queue runs dry steal from the others. */
+typedef struct _virThreadPoolQueue virThreadPoolQueue;
+typedef virThreadPoolQueue *virThreadPoolQueuePtr;
+
+struct _virThreadPoolQueue {
+    virMutex lock;
+    virThreadPoolJobList jobList;
+    virThreadPoolJobPtr freeJobs;
+    size_t nfreeJobs;
+    virThreadPoolStats stats;
+
+    /* accessed atomically */
+    int depth;
+    int nworkers;
+    int nbusy;
 };
 
 
 struct _virThreadPool {
-    bool quit;
+    int quit;
 
     virThreadPoolJobFunc jobFunc;
     const char *jobFuncName;
     void *jobOpaque;
-    virThreadPoolJobList jobList;
-    size_t jobQueueDepth;
+    virThreadPoolJobList jobList[VIR_THREAD_POOL_PRIORITY_LAST];
+    int jobQueueDepth;
+    virThreadPoolJobPtr freeJobs;
+    size_t nfreeJobs;
+    virThreadPoolStats stats;
 
     virMutex mutex;
     virCond cond;
@@ -77,14 +102,240 @@ struct _virThreadPool {
     size_t nPrioWorkers;
     virThreadPtr prioWorkers;
     virCond prioCond;
+
+    /* VIR_THREAD_POOL_PER_WORKER_QUEUES only */
+    virThreadPoolQueuePtr queues;
+    size_t nqueues;
+    size_t nextWorker;
+    int nextQueue;
+    int npending;
+    int nidle;
+    int resize;
 };
 
 struct virThreadPoolWorkerData {
     virThreadPoolPtr pool;
     virCondPtr cond;
     bool priority;
+    virThreadPoolQueuePtr queue;
 };
 
+static const unsigned long long virThreadPoolLatencyBounds[] = {
+    1, 10, 100, 1000, 10000,
+};
+verify(ARRAY_CARDINALITY(virThreadPoolLatencyBounds) ==
+       VIR_THREAD_POOL_LATENCY_BUCKETS - 1);
+
+
+static void
+virThreadPoolJobListAppend(virThreadPoolJobListPtr list,
+                           virThreadPoolJobPtr job)
+{
+    job->next = NULL;
+    if (list->tail)
+        list->tail->next = job;
+    else
+        list->head = job;
+    list->tail = job;
+}
+
+
+static virThreadPoolJobPtr
+virThreadPoolJobListPop(virThreadPoolJobListPtr list)
+{
+    virThreadPoolJobPtr job = list->head;
+
+    if (!job)
+        return NULL;
+
+    list->head = job->next;
+    if (!list->head)
+        list->tail = NULL;
+    job->next = NULL;
+
+    return job;
+}
+
+
+static void
+virThreadPoolJobListClear(virThreadPoolJobPtr *head)
+{
+    virThreadPoolJobPtr job;
+
+    while ((job = *head)) {
+        *head = job->next;
+        VIR_FREE(job);
+    }
+}
+
+
+/* Takes a job structure from the @freeJobs list or allocates a new one */
+static virThreadPoolJobPtr
+virThreadPoolJobNew(virThreadPoolJobPtr *freeJobs,
+                    size_t *nfreeJobs)
+{
+    virThreadPoolJobPtr job;
+
+    if ((job = *freeJobs)) {
+        *freeJobs = job->next;
+        (*nfreeJobs)--;
+        job->next = NULL;
+        return job;
+    }
+
+    ignore_value(VIR_ALLOC(job));
+    return job;
+}
+
+
+static void
+virThreadPoolJobRelease(virThreadPoolJobPtr *freeJobs,
+                        size_t *nfreeJobs,
+                        virThreadPoolJobPtr job)
+{
+    if (*nfreeJobs >= VIR_THREAD_POOL_FREE_JOBS_MAX) {
+        VIR_FREE(job);
+        return;
+    }
+
+    job->data = NULL;
+    job->next = *freeJobs;
+    *freeJobs = job;
+    (*nfreeJobs)++;
+}
+
+
+/* Accounts the time @job spent waiting in a queue in @stats */
+static void
+virThreadPoolStatsRecord(virThreadPoolStatsPtr stats,
+                         virThreadPoolJobPtr job)
+{
+    unsigned long long now;
+    unsigned long long latency = 0;
+    size_t i;
+
+    if (virTimeMillisNowRaw(&now) == 0 && now > job->queued)
+        latency = now - job->queued;
+
+    for (i = 0; i < ARRAY_CARDINALITY(virThreadPoolLatencyBounds); i++) {
+        if (latency < virThreadPoolLatencyBounds[i])
+            break;
+    }
+
+    stats->jobs++;
+    stats->latencySum += latency;
+    stats->latency[i]++;
+}
+
+
+static void
+virThreadPoolStatsAdd(virThreadPoolStatsPtr dst,
+                      virThreadPoolStatsPtr src)
+{
+    size_t i;
+
+    dst->jobs += src->jobs;
+    dst->latencySum += src->latencySum;
+    for (i = 0; i < VIR_THREAD_POOL_LATENCY_BUCKETS; i++)
+        dst->latency[i] += src->latency[i];
+}
+
+
+/* Takes the most urgent job from the shared lists, priority workers
+ * only look at jobs above normal priority. Must be called with the pool
+ * mutex held. */
+static virThreadPoolJobPtr
+virThreadPoolJobTakeShared(virThreadPoolPtr pool,
+                           bool priority)
+{
+    int lowest = priority ? VIR_THREAD_POOL_PRIORITY_HIGH :
+                            VIR_THREAD_POOL_PRIORITY_NORMAL;
+    virThreadPoolJobPtr job;
+    int i;
+
+    for (i = VIR_THREAD_POOL_PRIORITY_LAST - 1; i >= lowest; i--) {
+        if ((job = virThreadPoolJobListPop(&pool->jobList[i]))) {
+            ignore_value(virAtomicIntDecAndTest(&pool->jobQueueDepth));
+            virThreadPoolStatsRecord(&pool->stats, job);
+            return job;
+        }
+    }
+
+    return NULL;
+}
+
+
+static virThreadPoolJobPtr
+virThreadPoolQueueTake(virThreadPoolPtr pool,
+                       virThreadPoolQueuePtr queue)
+{
+    virThreadPoolJobPtr job;
+
+    virMutexLock(&queue->lock);
+    if ((job = virThreadPoolJobListPop(&queue->jobList))) {
+        ignore_value(virAtomicIntDecAndTest(&queue->depth));
+        ignore_value(virAtomicIntDecAndTest(&pool->npending));
+        virThreadPoolStatsRecord(&queue->stats, job);
+    }
+    virMutexUnlock(&queue->lock);
+
+    return job;
+}
+
+
+/* Finds a job for a worker attached to @own. Jobs waiting in a queue
+ * whose workers are all busy are taken first so that they don't get
+ * stuck behind a long running job, then the worker's own queue is
+ * served and finally it steals from whichever queue has some jobs. */
+static virThreadPoolJobPtr
+virThreadPoolQueueTakeAny(virThreadPoolPtr pool,
+                          virThreadPoolQueuePtr own)
+{
+    size_t start = own - pool->queues;
+    virThreadPoolQueuePtr queue;
+    virThreadPoolJobPtr job;
+    size_t i;
+
+    if (virAtomicIntGet(&pool->npending) == 0)
+        return NULL;
+
+    for (i = 1; i < pool->nqueues; i++) {
+        queue = &pool->queues[(start + i) % pool->nqueues];
+        if (virAtomicIntGet(&queue->depth) > 0 &&
+            virAtomicIntGet(&queue->nbusy) >= virAtomicIntGet(&queue->nworkers) &&
+            (job = virThreadPoolQueueTake(pool, queue)))
+            return job;
+    }
+
+    for (i = 0; i < pool->nqueues; i++) {
+        queue = &pool->queues[(start + i) % pool->nqueues];
+        if (virAtomicIntGet(&queue->depth) > 0 &&
+            (job = virThreadPoolQueueTake(pool, queue)))
+            return job;
+    }
+
+    return NULL;
+}
+
+
+/* Picks a queue for a new job, preferring the ones with an idle worker */
+static virThreadPoolQueuePtr
+virThreadPoolQueuePick(virThreadPoolPtr pool)
+{
+    size_t start = (unsigned int) virAtomicIntInc(&pool->nextQueue);
+    virThreadPoolQueuePtr queue;
+    size_t i;
+
+    for (i = 0; i < pool->nqueues; i++) {
+        queue = &pool->queues[(start + i) % pool->nqueues];
+        if (virAtomicIntGet(&queue->nbusy) < virAtomicIntGet(&queue->nworkers))
+            return queue;
+    }
+
+    return &pool->queues[start % pool->nqueues];
+}
+
+
 /* Test whether the worker needs to quit if the current number of workers @count
  * is greater than @limit actually allows.
  */
@@ -93,18 +344,97 @@ static inline bool virThreadPoolWorkerQuitHelper(size_t count, size_t limit)
     return count > limit;
 }
 
+
+/* Main loop of an ordinary worker attached to @queue. The pool mutex is
+ * only taken when there are jobs in the shared lists, when the worker
+ * runs out of jobs or when the pool is being resized. Returns with the
+ * pool mutex held once the worker is supposed to quit. */
+static void
+virThreadPoolQueueWorker(virThreadPoolPtr pool,
+                         virThreadPoolQueuePtr queue)
+{
+    virThreadPoolJobPtr job;
+    int rc;
+
+    while (1) {
+        job = NULL;
+
+        if (virAtomicIntGet(&pool->jobQueueDepth) > 0) {
+            virMutexLock(&pool->mutex);
+            job = virThreadPoolJobTakeShared(pool, false);
+            virMutexUnlock(&pool->mutex);
+        }
+
+        if (!job)
+            job = virThreadPoolQueueTakeAny(pool, queue);
+
+        if (!job) {
+            virMutexLock(&pool->mutex);
+            if (pool->quit ||
+                virThreadPoolWorkerQuitHelper(pool->nWorkers, pool->maxWorkers))
+                return;
+
+            pool->freeWorkers++;
+            virAtomicIntInc(&pool->nidle);
+
+            /* Queues are filled without holding the pool mutex, look at
+             * them again now that senders know there's an idle worker to
+             * wake up, otherwise a job queued meanwhile could get stuck */
+            if (virAtomicIntGet(&pool->npending) > 0 ||
+                virAtomicIntGet(&pool->jobQueueDepth) > 0)
+                rc = 0;
+            else
+                rc = virCondWait(&pool->cond, &pool->mutex);
+
+            ignore_value(virAtomicIntDecAndTest(&pool->nidle));
+            pool->freeWorkers--;
+
+            if (rc < 0 || pool->quit ||
+                virThreadPoolWorkerQuitHelper(pool->nWorkers, pool->maxWorkers))
+                return;
+            virMutexUnlock(&pool->mutex);
+            continue;
+        }
+
+        virAtomicIntInc(&queue->nbusy);
+        (pool->jobFunc)(job->data, pool->jobOpaque);
+        ignore_value(virAtomicIntDecAndTest(&queue->nbusy));
+
+        virMutexLock(&queue->lock);
+        virThreadPoolJobRelease(&queue->freeJobs, &queue->nfreeJobs, job);
+        virMutexUnlock(&queue->lock);
+
+        if (virAtomicIntGet(&pool->quit) || virAtomicIntGet(&pool->resize)) {
+            virMutexLock(&pool->mutex);
+            if (pool->quit ||
+                virThreadPoolWorkerQuitHelper(pool->nWorkers, pool->maxWorkers))
+                return;
+            virAtomicIntSet(&pool->resize, 0);
+            virMutexUnlock(&pool->mutex);
+        }
+    }
+}
+
+
 static void virThreadPoolWorker(void *opaque)
 {
     struct virThreadPoolWorkerData *data = opaque;
     virThreadPoolPtr pool = data->pool;
     virCondPtr cond = data->cond;
     bool priority = data->priority;
+    virThreadPoolQueuePtr queue = data->queue;
     size_t *curWorkers = priority ? &pool->nPrioWorkers : &pool->nWorkers;
     size_t *maxLimit = priority ? &pool->maxPrioWorkers : &pool->maxWorkers;
     virThreadPoolJobPtr job = NULL;
 
     VIR_FREE(data);
 
+    if (queue) {
+        virThreadPoolQueueWorker(pool, queue);
+        ignore_value(virAtomicIntDecAndTest(&queue->nworkers));
+        goto out;
+    }
+
     virMutexLock(&pool->mutex);
 
     while (1) {
@@ -117,8 +447,7 @@ static void virThreadPoolWorker(void *opaque)
         if (virThreadPoolWorkerQuitHelper(*curWorkers, *maxLimit))
             goto out;
         while (!pool->quit &&
-               ((!priority && !pool->jobList.head) ||
-                (priority && !pool->jobList.firstPrio))) {
+               !(job = virThreadPoolJobTakeShared(pool, priority))) {
             if (!priority)
                 pool->freeWorkers++;
             if (virCondWait(cond, &pool->mutex) < 0) {
@@ -136,37 +465,10 @@ static void virThreadPoolWorker(void *opaque)
         if (pool->quit)
             break;
 
-        if (priority) {
-            job = pool->jobList.firstPrio;
-        } else {
-            job = pool->jobList.head;
-        }
-
-        if (job == pool->jobList.firstPrio) {
-            virThreadPoolJobPtr tmp = job->next;
-            while (tmp) {
-                if (tmp->priority)
-                    break;
-                tmp = tmp->next;
-            }
-            pool->jobList.firstPrio = tmp;
-        }
-
-        if (job->prev)
-            job->prev->next = job->next;
-        else
-            pool->jobList.head = job->next;
-        if (job->next)
-            job->next->prev = job->prev;
-        else
-            pool->jobList.tail = job->prev;
-
-        pool->jobQueueDepth--;
-
         virMutexUnlock(&pool->mutex);
         (pool->jobFunc)(job->data, pool->jobOpaque);
-        VIR_FREE(job);
         virMutexLock(&pool->mutex);
+        virThreadPoolJobRelease(&pool->freeJobs, &pool->nfreeJobs, job);
     }
 
  out:
@@ -197,6 +499,10 @@ virThreadPoolExpand(virThreadPoolPtr pool, size_t gain, bool priority)
         data->pool = pool;
         data->cond = priority ? &pool->prioCond : &pool->cond;
         data->priority = priority;
+        if (pool->nqueues && !priority) {
+            data->queue = &pool->queues[pool->nextWorker++ % pool->nqueues];
+            virAtomicIntInc(&data->queue->nworkers);
+        }
 
         if (virThreadCreateFull(&(*workers)[i],
                                 false,
@@ -204,6 +510,8 @@ virThreadPoolExpand(virThreadPoolPtr pool, size_t gain, bool priority)
                                 pool->jobFuncName,
                                 true,
                                 data) < 0) {
+            if (data->queue)
+                ignore_value(virAtomicIntDecAndTest(&data->queue->nworkers));
             VIR_FREE(data);
             virReportSystemError(errno, "%s", _("Failed to create thread"));
             goto error;
@@ -223,9 +531,13 @@ virThreadPoolNewFull(size_t minWorkers,
                      size_t prioWorkers,
                      virThreadPoolJobFunc func,
                      const char *funcName,
-                     void *opaque)
+                     void *opaque,
+                     unsigned int flags)
 {
     virThreadPoolPtr pool;
+    size_t nqueues;
+
+    virCheckFlags(VIR_THREAD_POOL_PER_WORKER_QUEUES, NULL);
 
     if (minWorkers > maxWorkers)
         minWorkers = maxWorkers;
@@ -233,8 +545,6 @@ virThreadPoolNewFull(size_t minWorkers,
     if (VIR_ALLOC(pool) < 0)
         return NULL;
 
-    pool->jobList.tail = pool->jobList.head = NULL;
-
     pool->jobFunc = func;
     pool->jobFuncName = funcName;
     pool->jobOpaque = opaque;
@@ -246,6 +556,22 @@ virThreadPoolNewFull(size_t minWorkers,
     if (virCondInit(&pool->quit_cond) < 0)
         goto error;
 
+    if (flags & VIR_THREAD_POOL_PER_WORKER_QUEUES) {
+        /* The pool may grow later on, workers above this limit share
+         * queues with the others */
+        nqueues = maxWorkers ? maxWorkers : 1;
+        if (VIR_ALLOC_N(pool->queues, nqueues) < 0)
+            goto error;
+
+        for (; pool->nqueues < nqueues; pool->nqueues++) {
+            if (virMutexInit(&pool->queues[pool->nqueues].lock) < 0) {
+                virReportSystemError(errno, "%s",
+                                     _("Unable to initialize mutex"));
+                goto error;
+            }
+        }
+    }
+
     pool->minWorkers = minWorkers;
     pool->maxWorkers = maxWorkers;
     pool->maxPrioWorkers = prioWorkers;
@@ -271,14 +597,14 @@ virThreadPoolNewFull(size_t minWorkers,
 
 void virThreadPoolFree(virThreadPoolPtr pool)
 {
-    virThreadPoolJobPtr job;
     bool priority = false;
+    size_t i;
 
     if (!pool)
         return;
 
     virMutexLock(&pool->mutex);
-    pool->quit = true;
+    virAtomicIntSet(&pool->quit, 1);
     if (pool->nWorkers > 0)
         virCondBroadcast(&pool->cond);
     if (pool->nPrioWorkers > 0) {
@@ -289,10 +615,16 @@ void virThreadPoolFree(virThreadPoolPtr pool)
     while (pool->nWorkers > 0 || pool->nPrioWorkers > 0)
         ignore_value(virCondWait(&pool->quit_cond, &pool->mutex));
 
-    while ((job = pool->jobList.head)) {
-        pool->jobList.head = pool->jobList.head->next;
-        VIR_FREE(job);
+    for (i = 0; i < VIR_THREAD_POOL_PRIORITY_LAST; i++)
+        virThreadPoolJobListClear(&pool->jobList[i].head);
+    virThreadPoolJobListClear(&pool->freeJobs);
+
+    for (i = 0; i < pool->nqueues; i++) {
+        virThreadPoolJobListClear(&pool->queues[i].jobList.head);
+        virThreadPoolJobListClear(&pool->queues[i].freeJobs);
+        virMutexDestroy(&pool->queues[i].lock);
     }
+    VIR_FREE(pool->queues);
 
     VIR_FREE(pool->workers);
     virMutexUnlock(&pool->mutex);
@@ -364,17 +696,91 @@ size_t virThreadPoolGetFreeWorkers(virThreadPoolPtr pool)
 
 size_t virThreadPoolGetJobQueueDepth(virThreadPoolPtr pool)
 {
-    size_t ret;
+    return virAtomicIntGet(&pool->jobQueueDepth) +
+           virAtomicIntGet(&pool->npending);
+}
+
+/**
+ * virThreadPoolGetStats:
+ * @pool: thread pool
+ * @stats: filled with statistics of @pool
+ *
+ * Collects the number of jobs taken from the queues of @pool so far and
+ * a histogram of the time they spent waiting for a worker.
+ */
+void
+virThreadPoolGetStats(virThreadPoolPtr pool,
+                      virThreadPoolStatsPtr stats)
+{
+    size_t i;
+
+    memset(stats, 0, sizeof(*stats));
 
     virMutexLock(&pool->mutex);
-    ret = pool->jobQueueDepth;
+    virThreadPoolStatsAdd(stats, &pool->stats);
+    for (i = 0; i < pool->nqueues; i++) {
+        virMutexLock(&pool->queues[i].lock);
+        virThreadPoolStatsAdd(stats, &pool->queues[i].stats);
+        virMutexUnlock(&pool->queues[i].lock);
+    }
     virMutexUnlock(&pool->mutex);
+}
 
-    return ret;
+
+/* Queues a normal priority job in one of the per-worker queues. Unless
+ * there are no idle workers, the pool mutex is not touched at all. */
+static int
+virThreadPoolSendQueuedJob(virThreadPoolPtr pool,
+                           void *jobData)
+{
+    virThreadPoolQueuePtr queue;
+    virThreadPoolJobPtr job;
+    unsigned long long now = 0;
+
+    if (virAtomicIntGet(&pool->quit))
+        return -1;
+
+    if (virAtomicIntGet(&pool->nidle) == 0) {
+        virMutexLock(&pool->mutex);
+        if (pool->quit ||
+            (pool->nWorkers < pool->maxWorkers &&
+             virThreadPoolExpand(pool, 1, false) < 0)) {
+            virMutexUnlock(&pool->mutex);
+            return -1;
+        }
+        virMutexUnlock(&pool->mutex);
+    }
+
+    ignore_value(virTimeMillisNowRaw(&now));
+    queue = virThreadPoolQueuePick(pool);
+
+    virMutexLock(&queue->lock);
+    if (!(job = virThreadPoolJobNew(&queue->freeJobs, &queue->nfreeJobs))) {
+        virMutexUnlock(&queue->lock);
+        return -1;
+    }
+
+    job->data = jobData;
+    job->priority = VIR_THREAD_POOL_PRIORITY_NORMAL;
+    job->queued = now;
+    virThreadPoolJobListAppend(&queue->jobList, job);
+    virAtomicIntInc(&queue->depth);
+    virMutexUnlock(&queue->lock);
+
+    /* Pairs with the check idle workers do before going to sleep */
+    virAtomicIntInc(&pool->npending);
+    if (virAtomicIntGet(&pool->nidle) > 0) {
+        virMutexLock(&pool->mutex);
+        virCondSignal(&pool->cond);
+        virMutexUnlock(&pool->mutex);
+    }
+
+    return 0;
 }
 
 /*
- * @priority - job priority
+ * @priority - job priority, one of virThreadPoolPriority, larger
+ *             values are treated as the most urgent class
  * Return: 0 on success, -1 otherwise
  */
 int virThreadPoolSendJob(virThreadPoolPtr pool,
@@ -383,33 +789,31 @@ int virThreadPoolSendJob(virThreadPoolPtr pool,
 {
     virThreadPoolJobPtr job;
 
+    if (priority >= VIR_THREAD_POOL_PRIORITY_LAST)
+        priority = VIR_THREAD_POOL_PRIORITY_LAST - 1;
+
+    if (pool->nqueues && priority == VIR_THREAD_POOL_PRIORITY_NORMAL)
+        return virThreadPoolSendQueuedJob(pool, jobData);
+
     virMutexLock(&pool->mutex);
     if (pool->quit)
         goto error;
 
-    if (pool->freeWorkers - pool->jobQueueDepth <= 0 &&
+    if (pool->freeWorkers <= (size_t) pool->jobQueueDepth &&
         pool->nWorkers < pool->maxWorkers &&
         virThreadPoolExpand(pool, 1, false) < 0)
         goto error;
 
-    if (VIR_ALLOC(job) < 0)
+    if (!(job = virThreadPoolJobNew(&pool->freeJobs, &pool->nfreeJobs)))
         goto error;
 
     job->data = jobData;
     job->priority = priority;
+    if (virTimeMillisNowRaw(&job->queued) < 0)
+        job->queued = 0;
 
-    job->prev = pool->jobList.tail;
-    if (pool->jobList.tail)
-        pool->jobList.tail->next = job;
-    pool->jobList.tail = job;
-
-    if (!pool->jobList.head)
-        pool->jobList.head = job;
-
-    if (priority && !pool->jobList.firstPrio)
-        pool->jobList.firstPrio = job;
-
-    pool->jobQueueDepth++;
+    virThreadPoolJobListAppend(&pool->jobList[priority], job);
+    virAtomicIntInc(&pool->jobQueueDepth);
 
     virCondSignal(&pool->cond);
     if (priority)
@@ -452,6 +856,7 @@ virThreadPoolSetParameters(virThreadPoolPtr pool,
 
     if (maxWorkers >= 0) {
         pool->maxWorkers = maxWorkers;
+        virAtomicIntSet(&pool->resize, 1);
         virCondBroadcast(&pool->cond);
     }
 
@@ -473,3 +878,124 @@ virThreadPoolSetParameters(virThreadPoolPtr pool,
     virMutexUnlock(&pool->mutex);
     return -1;
 }
+
+
+struct virThreadMapParallelData {
+    virMutex lock;
+    size_t next;
+    size_t njobs;
+    bool failed;
+    virErrorPtr error;
+
+    virThreadMapParallelFunc func;
+    void *opaque;
+};
+
+
+static void
+virThreadMapParallelWorker(void *opaque)
+{
+    struct virThreadMapParallelData *data = opaque;
+
+    virMutexLock(&data->lock);
+
+    while (!data->failed && data->next < data->njobs) {
+        size_t idx = data->next++;
+        int rc;
+
+        virMutexUnlock(&data->lock);
+        rc = (data->func)(idx, data->opaque);
+        virMutexLock(&data->lock);
+
+        if (rc < 0 && !data->failed) {
+            data->failed = true;
+            data->error = virSaveLastError();
+        }
+    }
+
+    virMutexUnlock(&data->lock);
+}
+
+
+/**
+ * virThreadMapParallelFull:
+ * @maxWorkers: maximum number of threads to run @func in
+ * @njobs: number of jobs
+ * @func: job callback
+ * @funcName: name of the job callback
+ * @opaque: data passed to @func
+ *
+ * Calls @func for every index from 0 to @njobs - 1 using at most
+ * @maxWorkers threads, the calling thread being one of them, and waits
+ * for all of them to finish. Jobs are started in order of their index,
+ * but may finish in any order. Once a job fails no more jobs are started
+ * and the error reported by the failed job is set in the calling thread.
+ *
+ * Unlike virThreadPool, no threads are kept around: up to @maxWorkers - 1
+ * threads are created on every call and joined before it returns. That
+ * costs a clone() and an exit per helper thread, which is negligible
+ * compared to jobs blocking on I/O or a monitor, but makes this a poor
+ * fit for short CPU bound jobs called often.
+ *
+ * Returns 0 if all jobs succeeded, -1 otherwise.
+ */
+int
+virThreadMapParallelFull(size_t maxWorkers,
+                         size_t njobs,
+                         virThreadMapParallelFunc func,
+                         const char *funcName,
+                         void *opaque)
+{
+    struct virThreadMapParallelData data = {
+        .njobs = njobs, .func = func, .opaque = opaque,
+    };
+    virThreadPtr workers = NULL;
+    size_t nworkers = 0;
+    size_t i;
+
+    if (maxWorkers > njobs)
+        maxWorkers = njobs;
+
+    if (maxWorkers <= 1) {
+        for (i = 0; i < njobs; i++) {
+            if (func(i, opaque) < 0)
+                return -1;
+        }
+        return 0;
+    }
+
+    if (virMutexInit(&data.lock) < 0) {
+        virReportSystemError(errno, "%s", _("Unable to initialize mutex"));
+        return -1;
+    }
+
+    /* Failing to spawn helpers only makes things slower, the calling
+     * thread processes all remaining jobs in the worst case */
+    if (VIR_ALLOC_N_QUIET(workers, maxWorkers - 1) == 0) {
+        for (i = 0; i < maxWorkers - 1; i++) {
+            if (virThreadCreateFull(&workers[nworkers], true,
+                                    virThreadMapParallelWorker, funcName,
+                                    false, &data) < 0)
+                break;
+            nworkers++;
+        }
+    }
+
+    virThreadMapParallelWorker(&data);
+
+    for (i = 0; i < nworkers; i++)
+        virThreadJoin(&workers[i]);
+
+    VIR_FREE(workers);
+    virMutexDestroy(&data.lock);
+
+    if (data.failed) {
+        if (data.error) {
+            virSetError(data.error);
+            virFreeError(data.error);
+        }
+        return -1;
+    }
+
+    return 0;
+}
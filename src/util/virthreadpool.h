@@ -33,15 +33,45 @@ typedef virThreadPool *virThreadPoolPtr;
 
 typedef void (*virThreadPoolJobFunc)(void *jobdata, void *opaque);
 
+typedef enum {
+    VIR_THREAD_POOL_PRIORITY_NORMAL = 0, /* handled by ordinary workers */
+    VIR_THREAD_POOL_PRIORITY_HIGH,       /* priority workers help too */
+    VIR_THREAD_POOL_PRIORITY_URGENT,     /* as HIGH, but ahead of it */
+
+    VIR_THREAD_POOL_PRIORITY_LAST
+} virThreadPoolPriority;
+
+typedef enum {
+    /* Give each ordinary worker its own queue of normal priority jobs
+     * and let idle workers steal from the others. Submitting such jobs
+     * then mostly avoids the pool-wide mutex. */
+    VIR_THREAD_POOL_PER_WORKER_QUEUES = (1 << 0),
+} virThreadPoolFlags;
+
+/* Jobs waiting less than 1ms, 10ms, 100ms, 1s, 10s and longer */
+# define VIR_THREAD_POOL_LATENCY_BUCKETS 6
+
+typedef struct _virThreadPoolStats virThreadPoolStats;
+typedef virThreadPoolStats *virThreadPoolStatsPtr;
+struct _virThreadPoolStats {
+    unsigned long long jobs;        /* jobs taken from the queue */
+    unsigned long long latencySum;  /* total time spent queued in ms */
+    unsigned long long latency[VIR_THREAD_POOL_LATENCY_BUCKETS];
+};
+
 # define virThreadPoolNew(min, max, prio, func, opaque) \
-    virThreadPoolNewFull(min, max, prio, func, #func, opaque)
+    virThreadPoolNewFull(min, max, prio, func, #func, opaque, 0)
+
+# define virThreadPoolNewFlags(min, max, prio, func, opaque, flags) \
+    virThreadPoolNewFull(min, max, prio, func, #func, opaque, flags)
 
 virThreadPoolPtr virThreadPoolNewFull(size_t minWorkers,
                                       size_t maxWorkers,
                                       size_t prioWorkers,
                                       virThreadPoolJobFunc func,
                                       const char *funcName,
-                                      void *opaque) ATTRIBUTE_NONNULL(4);
+                                      void *opaque,
+                                      unsigned int flags) ATTRIBUTE_NONNULL(4);
 
 size_t virThreadPoolGetMinWorkers(virThreadPoolPtr pool);
 size_t virThreadPoolGetMaxWorkers(virThreadPoolPtr pool);
@@ -49,6 +79,8 @@ size_t virThreadPoolGetPriorityWorkers(virThreadPoolPtr pool);
 size_t virThreadPoolGetCurrentWorkers(virThreadPoolPtr pool);
 size_t virThreadPoolGetFreeWorkers(virThreadPoolPtr pool);
 size_t virThreadPoolGetJobQueueDepth(virThreadPoolPtr pool);
+void virThreadPoolGetStats(virThreadPoolPtr pool,
+                           virThreadPoolStatsPtr stats);
 
 void virThreadPoolFree(virThreadPoolPtr pool);
 
@@ -62,4 +94,15 @@ int virThreadPoolSetParameters(virThreadPoolPtr pool,
                                long long int maxWorkers,
                                long long int prioWorkers);
 
+typedef int (*virThreadMapParallelFunc)(size_t idx, void *opaque);
+
+# define virThreadMapParallel(maxWorkers, njobs, func, opaque) \
+    virThreadMapParallelFull(maxWorkers, njobs, func, #func, opaque)
+
+int virThreadMapParallelFull(size_t maxWorkers,
+                             size_t njobs,
+                             virThreadMapParallelFunc func,
+                             const char *funcName,
+                             void *opaque) ATTRIBUTE_NONNULL(3);
+
 #endif
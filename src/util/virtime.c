@@ -82,6 +82,38 @@ int virTimeMillisNowRaw(unsigned long long *now)
 }
 
 
+/**
+ * virTimeMicrosNowRaw:
+ * @now: filled with current time in microseconds
+ *
+ * Retrieves the current system time, in microseconds since the
+ * epoch. Meant for measuring short intervals where the precision
+ * of virTimeMillisNowRaw is not enough.
+ *
+ * Returns 0 on success, -1 on error with errno set
+ */
+int virTimeMicrosNowRaw(unsigned long long *now)
+{
+#ifdef HAVE_CLOCK_GETTIME
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_REALTIME, &ts) < 0)
+        return -1;
+
+    *now = (ts.tv_sec * 1000ull * 1000ull) + (ts.tv_nsec / 1000ull);
+#else
+    struct timeval tv;
+
+    if (gettimeofday(&tv, NULL) < 0)
+        return -1;
+
+    *now = (tv.tv_sec * 1000ull * 1000ull) + tv.tv_usec;
+#endif
+
+    return 0;
+}
+
+
 /**
  * virTimeFieldsNowRaw:
  * @fields: filled with current time fields
@@ -134,6 +134,7 @@ vmwareLoadDomains(struct vmware_driver *driver)
     char *str;
     char *saveptr = NULL;
     virCommandPtr cmd;
+    int pid;
 
     ctx.parseFileName = vmwareCopyVMXFileName;
     ctx.formatFileName = NULL;
@@ -174,8 +175,9 @@ vmwareLoadDomains(struct vmware_driver *driver)
 
         vmwareDomainConfigDisplay(pDomain, vmdef);
 
-        if ((vm->def->id = vmwareExtractPid(vmxPath)) < 0)
+        if ((pid = vmwareExtractPid(vmxPath)) < 0)
             goto cleanup;
+        virDomainObjListSetID(driver->domains, vm, pid);
         /* vmrun list only reports running vms */
         virDomainObjSetState(vm, VIR_DOMAIN_RUNNING,
                              VIR_DOMAIN_RUNNING_UNKNOWN);
@@ -291,7 +291,7 @@ vmwareUpdateVMStatus(struct vmware_driver *driver, virDomainObjPtr vm)
     }
 
     if (!found) {
-        vm->def->id = -1;
+        virDomainObjListSetID(driver->domains, vm, -1);
         newState = VIR_DOMAIN_SHUTOFF;
     }
 
@@ -322,7 +322,7 @@ vmwareStopVM(struct vmware_driver *driver,
     if (virRun(cmd, NULL) < 0)
         return -1;
 
-    vm->def->id = -1;
+    virDomainObjListSetID(driver->domains, vm, -1);
     virDomainObjSetState(vm, VIR_DOMAIN_SHUTOFF, reason);
 
     return 0;
@@ -336,6 +336,7 @@ vmwareStartVM(struct vmware_driver *driver, virDomainObjPtr vm)
         PROGRAM_SENTINEL, PROGRAM_SENTINEL, NULL
     };
     const char *vmxPath = ((vmwareDomainPtr) vm->privateData)->vmxPath;
+    int pid;
 
     if (virDomainObjGetState(vm, NULL) != VIR_DOMAIN_SHUTOFF) {
         virReportError(VIR_ERR_OPERATION_INVALID, "%s",
@@ -353,7 +354,9 @@ vmwareStartVM(struct vmware_driver *driver, virDomainObjPtr vm)
     if (virRun(cmd, NULL) < 0)
         return -1;
 
-    if ((vm->def->id = vmwareExtractPid(vmxPath)) < 0) {
+    pid = vmwareExtractPid(vmxPath);
+    virDomainObjListSetID(driver->domains, vm, pid);
+    if (pid < 0) {
         vmwareStopVM(driver, vm, VIR_DOMAIN_SHUTOFF_FAILED);
         return -1;
     }
@@ -1394,16 +1394,19 @@ prlsdkAddVNCInfo(PRL_HANDLE sdkdom, virDomainDefPtr def)
 }
 
 static void
-prlsdkConvertDomainState(VIRTUAL_MACHINE_STATE domainState,
+prlsdkConvertDomainState(vzDriverPtr driver,
+                         VIRTUAL_MACHINE_STATE domainState,
                          PRL_UINT32 envId,
                          virDomainObjPtr dom)
 {
+    int id;
+
     switch (domainState) {
     case VMS_STOPPED:
     case VMS_MOUNTED:
         virDomainObjSetState(dom, VIR_DOMAIN_SHUTOFF,
                              VIR_DOMAIN_SHUTOFF_SHUTDOWN);
-        dom->def->id = -1;
+        id = -1;
         break;
     case VMS_STARTING:
     case VMS_COMPACTING:
@@ -1413,62 +1416,64 @@ prlsdkConvertDomainState(VIRTUAL_MACHINE_STATE domainState,
     case VMS_RUNNING:
         virDomainObjSetState(dom, VIR_DOMAIN_RUNNING,
                              VIR_DOMAIN_RUNNING_BOOTED);
-        dom->def->id = envId;
+        id = envId;
         break;
     case VMS_PAUSED:
         virDomainObjSetState(dom, VIR_DOMAIN_PAUSED,
                              VIR_DOMAIN_PAUSED_USER);
-        dom->def->id = envId;
+        id = envId;
         break;
     case VMS_SUSPENDED:
     case VMS_DELETING_STATE:
     case VMS_SUSPENDING_SYNC:
         virDomainObjSetState(dom, VIR_DOMAIN_SHUTOFF,
                              VIR_DOMAIN_SHUTOFF_SAVED);
-        dom->def->id = -1;
+        id = -1;
         break;
     case VMS_STOPPING:
         virDomainObjSetState(dom, VIR_DOMAIN_SHUTDOWN,
                              VIR_DOMAIN_SHUTDOWN_USER);
-        dom->def->id = envId;
+        id = envId;
         break;
     case VMS_SNAPSHOTING:
         virDomainObjSetState(dom, VIR_DOMAIN_PAUSED,
                              VIR_DOMAIN_PAUSED_SNAPSHOT);
-        dom->def->id = envId;
+        id = envId;
         break;
     case VMS_MIGRATING:
         virDomainObjSetState(dom, VIR_DOMAIN_PAUSED,
                              VIR_DOMAIN_PAUSED_MIGRATION);
-        dom->def->id = envId;
+        id = envId;
         break;
     case VMS_SUSPENDING:
         virDomainObjSetState(dom, VIR_DOMAIN_PAUSED,
                              VIR_DOMAIN_PAUSED_SAVE);
-        dom->def->id = envId;
+        id = envId;
         break;
     case VMS_RESTORING:
         virDomainObjSetState(dom, VIR_DOMAIN_RUNNING,
                              VIR_DOMAIN_RUNNING_RESTORED);
-        dom->def->id = envId;
+        id = envId;
         break;
     case VMS_CONTINUING:
         virDomainObjSetState(dom, VIR_DOMAIN_RUNNING,
                              VIR_DOMAIN_RUNNING_UNPAUSED);
-        dom->def->id = envId;
+        id = envId;
         break;
     case VMS_RESUMING:
         virDomainObjSetState(dom, VIR_DOMAIN_RUNNING,
                              VIR_DOMAIN_RUNNING_RESTORED);
-        dom->def->id = envId;
+        id = envId;
         break;
     case VMS_UNKNOWN:
     default:
         virDomainObjSetState(dom, VIR_DOMAIN_NOSTATE,
                              VIR_DOMAIN_NOSTATE_UNKNOWN);
-        dom->def->id = -1;
+        id = -1;
         break;
     }
+
+    virDomainObjListSetID(driver->domains, dom, id);
 }
 
 static int
@@ -1979,6 +1984,7 @@ prlsdkLoadDomain(vzDriverPtr driver,
         /* assign new virDomainDef without any checks
          * we can't use virDomainObjAssignDef, because it checks
          * for state and domain name */
+        virDomainObjListSetID(driver->domains, dom, -1);
         virDomainDefFree(dom->def);
         dom->def = def;
     }
@@ -1986,7 +1992,7 @@ prlsdkLoadDomain(vzDriverPtr driver,
     pdom = dom->privateData;
     pdom->id = envId;
 
-    prlsdkConvertDomainState(domainState, envId, dom);
+    prlsdkConvertDomainState(driver, domainState, envId, dom);
 
     if (autostart == PAO_VM_START_ON_LOAD)
         dom->autostart = 1;
@@ -2157,7 +2163,7 @@ prlsdkHandleVmStateEvent(vzDriverPtr driver,
 
     pdom = dom->privateData;
 
-    prlsdkConvertDomainState(domainState, pdom->id, dom);
+    prlsdkConvertDomainState(driver, domainState, pdom->id, dom);
 
     prlsdkNewStateToEvent(domainState,
                           &lvEventType,
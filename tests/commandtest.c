@@ -1133,6 +1133,94 @@ static int test25(const void *unused ATTRIBUTE_UNUSED)
 }
 
 
+static int
+test26Hook(void *opaque ATTRIBUTE_UNUSED)
+{
+    return 0;
+}
+
+/*
+ * Run commandhelper with an extra environment variable while the parent
+ * has lots of inheritable FDs open, both without fork() and, because a
+ * hook needs our own code to run in the child, with it. Neither may
+ * leak the FDs. Then check the exit status of a failing binary is
+ * reported the same way as with fork().
+ */
+static int test26(const void *unused ATTRIBUTE_UNUSED)
+{
+    const size_t nfds = 64;
+    virCommandPtr cmd = NULL;
+    char *binary = NULL;
+    int *fds = NULL;
+    int status = -1;
+    size_t i;
+    int ret = -1;
+
+    if (VIR_ALLOC_N(fds, nfds) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nfds; i++)
+        fds[i] = -1;
+
+    /* Deliberately inheritable, the child must close them */
+    for (i = 0; i < nfds; i++) {
+        if ((fds[i] = open("/dev/null", O_RDONLY)) < 0) {
+            printf("Cannot open /dev/null\n");
+            goto cleanup;
+        }
+    }
+
+    for (i = 0; i < 2; i++) {
+        cmd = virCommandNew(abs_builddir "/commandhelper");
+        virCommandAddEnvPassCommon(cmd);
+        virCommandAddEnvPair(cmd, "TEST26", "spawn");
+        if (i == 1)
+            virCommandSetPreExecHook(cmd, test26Hook, NULL);
+
+        if (virCommandRun(cmd, &status) < 0) {
+            printf("Cannot run child %s\n", virGetLastErrorMessage());
+            goto cleanup;
+        }
+        virCommandFree(cmd);
+        cmd = NULL;
+
+        if (status != 0) {
+            printf("Unexpected exit status %d\n", status);
+            goto cleanup;
+        }
+
+        if (checkoutput("test26", NULL) < 0)
+            goto cleanup;
+    }
+
+    if (!(binary = virFindFileInPath("false"))) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    cmd = virCommandNew(binary);
+    if (virCommandRun(cmd, &status) < 0) {
+        printf("Cannot run child %s\n", virGetLastErrorMessage());
+        goto cleanup;
+    }
+
+    if (status != EXIT_FAILURE) {
+        printf("Expected exit status %d, got %d\n", EXIT_FAILURE, status);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virCommandFree(cmd);
+    for (i = 0; fds && i < nfds; i++)
+        VIR_FORCE_CLOSE(fds[i]);
+    VIR_FREE(fds);
+    VIR_FREE(binary);
+    return ret;
+}
+
+
 static void virCommandThreadWorker(void *opaque)
 {
     virCommandTestDataPtr test = opaque;
@@ -1286,6 +1374,7 @@ mymain(void)
     DO_TEST(test23);
     DO_TEST(test24);
     DO_TEST(test25);
+    DO_TEST(test26);
 
     virMutexLock(&test->lock);
     if (test->running) {
@@ -23,7 +23,10 @@
 #include "testutils.h"
 #include "virerror.h"
 #include "viralloc.h"
+#include "virbuffer.h"
 #include "virlog.h"
+#include "virstring.h"
+#include "virtime.h"
 
 #include "domain_conf.h"
 
@@ -79,6 +82,164 @@ static int testGetFilesystem(const void *opaque)
     return ret;
 }
 
+/* virDomainDefCopy goes through XML, so the copy must format exactly
+ * like the definition it was taken from */
+static int
+testDomainDefCopyCompare(virDomainDefPtr def)
+{
+    virDomainDefPtr copy = NULL;
+    char *expect = NULL;
+    char *actual = NULL;
+    int ret = -1;
+
+    if (!(copy = virDomainDefCopy(def, caps, xmlopt, NULL, false)))
+        goto cleanup;
+
+    if (!(expect = virDomainDefFormat(def, caps,
+                                      VIR_DOMAIN_DEF_FORMAT_SECURE)) ||
+        !(actual = virDomainDefFormat(copy, caps,
+                                      VIR_DOMAIN_DEF_FORMAT_SECURE)))
+        goto cleanup;
+
+    if (STRNEQ(expect, actual)) {
+        virTestDifference(stderr, expect, actual);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(expect);
+    VIR_FREE(actual);
+    virDomainDefFree(copy);
+    return ret;
+}
+
+
+static int
+testDomainDefCopy(const void *opaque)
+{
+    const char *name = opaque;
+    virDomainDefPtr def = NULL;
+    char *filename = NULL;
+    int ret = -1;
+
+    if (virAsprintf(&filename, "%s/genericxml2xmlindata/%s.xml",
+                    abs_srcdir, name) < 0)
+        goto cleanup;
+
+    if (!(def = virDomainDefParseFile(filename, caps, xmlopt, NULL,
+                                      VIR_DOMAIN_DEF_PARSE_INACTIVE)))
+        goto cleanup;
+
+    ret = testDomainDefCopyCompare(def);
+
+ cleanup:
+    virDomainDefFree(def);
+    VIR_FREE(filename);
+    return ret;
+}
+
+
+/* A guest with a few hundred devices, roughly what big storage and
+ * console heavy deployments use */
+static char *
+testDomainDefCopyLargeXML(size_t ndisks)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    size_t i;
+
+    virBufferAddLit(&buf, "<domain type='qemu'>\n");
+    virBufferAddLit(&buf, "  <name>large</name>\n");
+    virBufferAddLit(&buf, "  <uuid>c7a5fdbd-edaf-9455-926a-d65c16db1809</uuid>\n");
+    virBufferAddLit(&buf, "  <memory unit='KiB'>8388608</memory>\n");
+    virBufferAddLit(&buf, "  <vcpu placement='static'>16</vcpu>\n");
+    virBufferAddLit(&buf, "  <os>\n    <type arch='x86_64' machine='pc'>hvm</type>\n  </os>\n");
+    virBufferAddLit(&buf, "  <devices>\n");
+    virBufferAddLit(&buf, "    <emulator>/usr/bin/qemu-system-x86_64</emulator>\n");
+
+    for (i = 0; i < ndisks; i++) {
+        virBufferAddLit(&buf, "    <disk type='file' device='disk'>\n");
+        virBufferAddLit(&buf, "      <driver name='qemu' type='qcow2' cache='none'/>\n");
+        virBufferAsprintf(&buf, "      <source file='/var/lib/libvirt/images/disk%zu.qcow2'/>\n", i);
+        virBufferAsprintf(&buf, "      <target dev='vd%c%c' bus='virtio'/>\n",
+                          (char) ('a' + i / 26), (char) ('a' + i % 26));
+        virBufferAsprintf(&buf, "      <serial>serial-%zu</serial>\n", i);
+        virBufferAsprintf(&buf, "      <address type='pci' domain='0x0000' bus='0x%02zx' slot='0x%02zx' function='0x0'/>\n",
+                          i / 31 + 1, i % 31 + 1);
+        virBufferAddLit(&buf, "    </disk>\n");
+    }
+
+    for (i = 0; i <= ndisks / 31 + 1; i++) {
+        virBufferAsprintf(&buf, "    <controller type='pci' index='%zu' model='%s'/>\n",
+                          i, i ? "pci-bridge" : "pci-root");
+    }
+
+    for (i = 0; i < ndisks / 8; i++) {
+        virBufferAddLit(&buf, "    <serial type='tcp'>\n");
+        virBufferAsprintf(&buf, "      <source mode='bind' host='127.0.0.1' service='%zu'/>\n",
+                          4000 + i);
+        virBufferAddLit(&buf, "      <protocol type='raw'/>\n");
+        virBufferAsprintf(&buf, "      <target port='%zu'/>\n", i);
+        virBufferAddLit(&buf, "    </serial>\n");
+    }
+
+    virBufferAddLit(&buf, "    <graphics type='vnc' port='-1' autoport='yes' listen='0.0.0.0'/>\n");
+    virBufferAddLit(&buf, "    <video>\n      <model type='cirrus' vram='16384' heads='1'/>\n    </video>\n");
+    virBufferAddLit(&buf, "    <memballoon model='virtio'/>\n");
+    virBufferAddLit(&buf, "  </devices>\n");
+    virBufferAddLit(&buf, "</domain>\n");
+
+    if (virBufferCheckError(&buf) < 0)
+        return NULL;
+
+    return virBufferContentAndReset(&buf);
+}
+
+
+static int
+testDomainDefCopyBench(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virDomainDefPtr def = NULL;
+    virDomainDefPtr copy = NULL;
+    unsigned long long start;
+    unsigned long long end;
+    size_t ndisks = virTestGetExpensive() ? 500 : 100;
+    size_t iterations = virTestGetExpensive() ? 100 : 10;
+    char *xml = NULL;
+    size_t i;
+    int ret = -1;
+
+    if (!(xml = testDomainDefCopyLargeXML(ndisks)) ||
+        !(def = virDomainDefParseString(xml, caps, xmlopt, NULL,
+                                        VIR_DOMAIN_DEF_PARSE_INACTIVE)))
+        goto cleanup;
+
+    if (testDomainDefCopyCompare(def) < 0)
+        goto cleanup;
+
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+
+    for (i = 0; i < iterations; i++) {
+        if (!(copy = virDomainDefCopy(def, caps, xmlopt, NULL, false)))
+            goto cleanup;
+        virDomainDefFree(copy);
+    }
+
+    if (virTimeMillisNow(&end) < 0)
+        goto cleanup;
+
+    VIR_TEST_DEBUG("%zu copies of a guest with %zu disks took %llu ms\n",
+                   iterations, ndisks, end - start);
+
+    ret = 0;
+ cleanup:
+    virDomainDefFree(def);
+    VIR_FREE(xml);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -106,6 +267,25 @@ mymain(void)
     DO_TEST_GET_FS("/dev/pts", false);
     DO_TEST_GET_FS("/doesnotexist", false);
 
+#define DO_TEST_COPY(name) \
+    do { \
+        if (virTestRun("Copy " name, testDomainDefCopy, name) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST_COPY("generic-chardev-reconnect");
+    DO_TEST_COPY("generic-chardev-tcp");
+    DO_TEST_COPY("generic-chardev-udp");
+    DO_TEST_COPY("generic-cpu-cache-disable");
+    DO_TEST_COPY("generic-disk-network-http");
+    DO_TEST_COPY("generic-disk-virtio");
+    DO_TEST_COPY("generic-graphics-vnc-manual-port");
+    DO_TEST_COPY("generic-perf");
+    DO_TEST_COPY("generic-vcpus-individual");
+
+    if (virTestRun("Copy benchmark", testDomainDefCopyBench, NULL) < 0)
+        ret = -1;
+
     virObjectUnref(caps);
     virObjectUnref(xmlopt);
 
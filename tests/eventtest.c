@@ -25,6 +25,7 @@
 #include <stdlib.h>
 #include <signal.h>
 #include <time.h>
+#include <sys/resource.h>
 
 #if HAVE_MACH_CLOCK_ROUTINES
 # include <mach/clock.h>
@@ -37,12 +38,17 @@
 #include "virthread.h"
 #include "virlog.h"
 #include "virutil.h"
+#include "virtime.h"
 #include "vireventpoll.h"
 
+#define VIR_FROM_THIS VIR_FROM_NONE
+
 VIR_LOG_INIT("tests.eventtest");
 
 #define NUM_FDS 31
 #define NUM_TIME 31
+#define NUM_IDLE_FDS 10000
+#define NUM_IDLE_ITERATIONS 1000
 
 static struct handleInfo {
     int pipeFD[2];
@@ -296,6 +302,202 @@ finishJob(const char *name, int handle, int timer)
     return EXIT_SUCCESS;
 }
 
+static void
+testIdleCallback(int watch ATTRIBUTE_UNUSED,
+                 int fd ATTRIBUTE_UNUSED,
+                 int events ATTRIBUTE_UNUSED,
+                 void *data)
+{
+    int *fired = data;
+
+    *fired = 1;
+}
+
+/* Dispatching a single active handle should not get
+ * considerably slower with lots of idle ones registered */
+static int
+testIdleHandles(int active)
+{
+    struct rlimit limit;
+    int idlePipe[2] = { -1, -1 };
+    int *fds = NULL;
+    int *watches = NULL;
+    size_t nfds = NUM_IDLE_FDS;
+    int idleFired = 0;
+    unsigned long long start, end;
+    char one = '1';
+    size_t i;
+    int ret = EXIT_FAILURE;
+
+    /* Every idle handle is a duplicate of the same empty pipe,
+     * use as many as the FD limit allows */
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        if (limit.rlim_cur < limit.rlim_max) {
+            limit.rlim_cur = limit.rlim_max;
+            ignore_value(setrlimit(RLIMIT_NOFILE, &limit));
+            ignore_value(getrlimit(RLIMIT_NOFILE, &limit));
+        }
+        if (limit.rlim_cur != RLIM_INFINITY &&
+            limit.rlim_cur < NUM_IDLE_FDS + 128)
+            nfds = limit.rlim_cur > 256 ? limit.rlim_cur - 128 : 128;
+    }
+
+    if (pipe(idlePipe) < 0) {
+        fprintf(stderr, "Cannot create pipe: %d", errno);
+        goto cleanup;
+    }
+
+    if (VIR_ALLOC_N(fds, nfds) < 0 ||
+        VIR_ALLOC_N(watches, nfds) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nfds; i++) {
+        fds[i] = -1;
+        watches[i] = -1;
+    }
+
+    for (i = 0; i < nfds; i++) {
+        if ((fds[i] = dup(idlePipe[0])) < 0) {
+            fprintf(stderr, "Cannot dup pipe: %d", errno);
+            goto cleanup;
+        }
+        if ((watches[i] = virEventPollAddHandle(fds[i],
+                                                VIR_EVENT_HANDLE_READABLE,
+                                                testIdleCallback,
+                                                &idleFired, NULL)) < 0)
+            goto cleanup;
+    }
+
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+
+    for (i = 0; i < NUM_IDLE_ITERATIONS; i++) {
+        handles[active].fired = 0;
+        if (safewrite(handles[active].pipeFD[1], &one, 1) != 1 ||
+            virEventPollRunOnce() < 0)
+            goto cleanup;
+        if (!handles[active].fired ||
+            handles[active].error != EV_ERROR_NONE || idleFired) {
+            fprintf(stderr, "Unexpected dispatch with %zu idle handles\n",
+                    nfds);
+            goto cleanup;
+        }
+    }
+
+    if (virTimeMillisNow(&end) < 0)
+        goto cleanup;
+
+    VIR_TEST_DEBUG("%d iterations with %zu idle handles took %llu ms\n",
+                   NUM_IDLE_ITERATIONS, nfds, end - start);
+
+    ret = EXIT_SUCCESS;
+ cleanup:
+    for (i = 0; fds && watches && i < nfds; i++) {
+        if (watches[i] > 0)
+            virEventPollRemoveHandle(watches[i]);
+        VIR_FORCE_CLOSE(fds[i]);
+    }
+    /* Let the loop purge the removed handles */
+    if (safewrite(handles[active].pipeFD[1], &one, 1) == 1)
+        ignore_value(virEventPollRunOnce());
+    VIR_FORCE_CLOSE(idlePipe[0]);
+    VIR_FORCE_CLOSE(idlePipe[1]);
+    VIR_FREE(fds);
+    VIR_FREE(watches);
+    testEventReport("Idle handles", ret != EXIT_SUCCESS, NULL);
+    return ret;
+}
+
+static void
+testStaleTimer(int timer ATTRIBUTE_UNUSED,
+               void *data ATTRIBUTE_UNUSED)
+{
+}
+
+/* A handle whose FD was closed before removing it may still be
+ * reported by epoll if the FD was dup()-ed. Such events must not
+ * reach the removed handle nor a new one reusing the FD number. */
+static int
+testStaleHandle(void)
+{
+    int stalePipe[2] = { -1, -1 };
+    int newPipe[2] = { -1, -1 };
+    int dupfd = -1;
+    int staleWatch = -1;
+    int newWatch = -1;
+    int timer = -1;
+    int staleFired = 0;
+    int newFired = 0;
+    char one = '1';
+    size_t i;
+    int ret = EXIT_FAILURE;
+
+    /* Keeps every iteration from blocking */
+    if ((timer = virEventPollAddTimeout(0, testStaleTimer, NULL, NULL)) < 0)
+        goto cleanup;
+
+    if (pipe(stalePipe) < 0 ||
+        (dupfd = dup(stalePipe[0])) < 0 ||
+        safewrite(stalePipe[1], &one, 1) != 1)
+        goto cleanup;
+
+    if ((staleWatch = virEventPollAddHandle(stalePipe[0],
+                                            VIR_EVENT_HANDLE_READABLE,
+                                            testIdleCallback,
+                                            &staleFired, NULL)) < 0)
+        goto cleanup;
+
+    VIR_FORCE_CLOSE(stalePipe[0]);
+    virEventPollRemoveHandle(staleWatch);
+    staleWatch = -1;
+
+    /* The lowest free FD number is the one just closed */
+    if (pipe(newPipe) < 0)
+        goto cleanup;
+
+    if ((newWatch = virEventPollAddHandle(newPipe[0],
+                                          VIR_EVENT_HANDLE_READABLE,
+                                          testIdleCallback,
+                                          &newFired, NULL)) < 0)
+        goto cleanup;
+
+    for (i = 0; i < 4; i++) {
+        if (virEventPollRunOnce() < 0)
+            goto cleanup;
+    }
+
+    if (staleFired || newFired) {
+        fprintf(stderr, "Event dispatched for stale FD\n");
+        goto cleanup;
+    }
+
+    if (safewrite(newPipe[1], &one, 1) != 1 ||
+        virEventPollRunOnce() < 0)
+        goto cleanup;
+
+    if (!newFired) {
+        fprintf(stderr, "Event not dispatched for reused FD\n");
+        goto cleanup;
+    }
+
+    ret = EXIT_SUCCESS;
+ cleanup:
+    if (newWatch > 0)
+        virEventPollRemoveHandle(newWatch);
+    if (timer > 0)
+        virEventPollRemoveTimeout(timer);
+    VIR_FORCE_CLOSE(dupfd);
+    VIR_FORCE_CLOSE(stalePipe[0]);
+    VIR_FORCE_CLOSE(stalePipe[1]);
+    VIR_FORCE_CLOSE(newPipe[0]);
+    VIR_FORCE_CLOSE(newPipe[1]);
+    /* Let the loop purge the removed handles */
+    if (safewrite(handles[1].pipeFD[1], &one, 1) == 1)
+        ignore_value(virEventPollRunOnce());
+    testEventReport("Stale handle", ret != EXIT_SUCCESS, NULL);
+    return ret;
+}
+
 static void
 resetAll(void)
 {
@@ -523,6 +725,17 @@ mymain(void)
     if (finishJob("Write duplicate", 1, -1) != EXIT_SUCCESS)
         return EXIT_FAILURE;
 
+    resetAll();
+
+    /* The event thread is idle now, so we can drive the
+     * loop directly */
+    virEventPollRemoveHandle(handles[0].watch);
+    if (testIdleHandles(1) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
+    if (testStaleHandle() != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
     /* pthread_kill(eventThread, SIGTERM); */
 
     return EXIT_SUCCESS;
@@ -33,6 +33,7 @@
 #include "virstring.h"
 #include "virfile.h"
 #include "virutil.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -316,12 +317,255 @@ static int testFDStreamWriteNonblock(const void *data)
     return testFDStreamWriteCommon(data, false);
 }
 
+#define BENCH_CHUNK (256 * 1024)
+
+struct testFDStreamBenchData {
+    const char *scratchdir;
+    bool sparse;
+};
+
+
+static int
+testFDStreamBenchPrepare(const char *scratchdir,
+                         char **file,
+                         size_t *len)
+{
+    char *chunk = NULL;
+    size_t i;
+    int fd = -1;
+    int ret = -1;
+
+    *len = (virTestGetExpensive() ? 256 : 16) * 1024 * 1024;
+
+    if (VIR_ALLOC_N(chunk, BENCH_CHUNK) < 0 ||
+        virAsprintf(file, "%s/bench.data", scratchdir) < 0)
+        goto cleanup;
+
+    for (i = 0; i < BENCH_CHUNK; i++)
+        chunk[i] = i % 251;
+
+    if ((fd = open(*file, O_CREAT|O_WRONLY|O_TRUNC, 0600)) < 0)
+        goto cleanup;
+
+    for (i = 0; i < *len / BENCH_CHUNK; i++) {
+        if (safewrite(fd, chunk, BENCH_CHUNK) != BENCH_CHUNK)
+            goto cleanup;
+    }
+
+    if (VIR_CLOSE(fd) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    VIR_FORCE_CLOSE(fd);
+    VIR_FREE(chunk);
+    return ret;
+}
+
+
+static double
+testFDStreamBenchRate(size_t len,
+                      unsigned long long start,
+                      unsigned long long end)
+{
+    if (end <= start)
+        end = start + 1;
+
+    return (double) len / (1024 * 1024 * 1024) * 1000 / (end - start);
+}
+
+
+/* Pulls a file through the helper thread of a non-blocking stream. The
+ * non-sparse variant moves the data through the pipe, possibly without
+ * copying it, while the sparse one goes via the message queue. */
+static int
+testFDStreamBenchRead(const void *opaque)
+{
+    const struct testFDStreamBenchData *data = opaque;
+    virConnectPtr conn = NULL;
+    virStreamPtr st = NULL;
+    char *file = NULL;
+    char *buf = NULL;
+    unsigned long long start;
+    unsigned long long end;
+    size_t total = 0;
+    size_t len;
+    int ret = -1;
+
+    if (testFDStreamBenchPrepare(data->scratchdir, &file, &len) < 0 ||
+        VIR_ALLOC_N(buf, BENCH_CHUNK) < 0)
+        goto cleanup;
+
+    if (!(conn = virConnectOpen("test:///default")) ||
+        !(st = virStreamNew(conn, VIR_STREAM_NONBLOCK)))
+        goto cleanup;
+
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+
+    if (virFDStreamOpenBlockDevice(st, file, 0, 0, data->sparse, O_RDONLY) < 0)
+        goto cleanup;
+
+    while (1) {
+        int got = st->driver->streamRecv(st, buf, BENCH_CHUNK);
+        size_t i;
+
+        if (got == -2) {
+            usleep(100);
+            continue;
+        }
+
+        if (got < 0) {
+            virFilePrintf(stderr, "Failed to read stream: %s\n",
+                          virGetLastErrorMessage());
+            goto cleanup;
+        }
+
+        if (got == 0)
+            break;
+
+        for (i = 0; i < (size_t) got; i++) {
+            if (buf[i] != (char) ((total + i) % BENCH_CHUNK % 251)) {
+                virFilePrintf(stderr, "Mismatched data at offset %zu\n",
+                              total + i);
+                goto cleanup;
+            }
+        }
+
+        total += got;
+    }
+
+    if (st->driver->streamFinish(st) != 0)
+        goto cleanup;
+
+    if (virTimeMillisNow(&end) < 0)
+        goto cleanup;
+
+    if (total != len) {
+        virFilePrintf(stderr, "Expected %zu bytes, got %zu\n", len, total);
+        goto cleanup;
+    }
+
+    VIR_TEST_DEBUG("%s stream: %zu MiB in %llu ms, %.2f GB/s\n",
+                   data->sparse ? "sparse" : "non-sparse",
+                   len / (1024 * 1024), end - start,
+                   testFDStreamBenchRate(len, start, end));
+
+    ret = 0;
+ cleanup:
+    if (st)
+        virStreamFree(st);
+    if (conn)
+        virConnectClose(conn);
+    if (file)
+        unlink(file);
+    VIR_FREE(file);
+    VIR_FREE(buf);
+    return ret;
+}
+
+
+/* Compares the kernel copy against the buffered loop iohelper falls
+ * back to */
+static int
+testFDStreamBenchCopy(const void *opaque)
+{
+    const char *scratchdir = opaque;
+    char *file = NULL;
+    char *copy = NULL;
+    char *buf = NULL;
+    size_t len;
+    size_t pass;
+    int fdin = -1;
+    int fdout = -1;
+    int ret = -1;
+
+    if (testFDStreamBenchPrepare(scratchdir, &file, &len) < 0 ||
+        virAsprintf(&copy, "%s/bench.copy", scratchdir) < 0 ||
+        VIR_ALLOC_N(buf, BENCH_CHUNK) < 0)
+        goto cleanup;
+
+    for (pass = 0; pass < 2; pass++) {
+        bool zerocopy = pass == 0;
+        unsigned long long start;
+        unsigned long long end;
+        size_t total = 0;
+        struct stat sb;
+
+        if ((fdin = open(file, O_RDONLY)) < 0 ||
+            (fdout = open(copy, O_CREAT|O_WRONLY|O_TRUNC, 0600)) < 0)
+            goto cleanup;
+
+        if (virTimeMillisNow(&start) < 0)
+            goto cleanup;
+
+        while (1) {
+            ssize_t got = -2;
+
+            if (zerocopy &&
+                (got = virFileZeroCopy(fdin, fdout, BENCH_CHUNK)) == -2) {
+                VIR_TEST_DEBUG("zero copy not supported\n");
+                zerocopy = false;
+            }
+
+            if (got == -2 &&
+                (got = saferead(fdin, buf, BENCH_CHUNK)) > 0 &&
+                safewrite(fdout, buf, got) < 0)
+                got = -1;
+
+            if (got < 0) {
+                virFilePrintf(stderr, "Failed to copy: %s\n",
+                              strerror(errno));
+                goto cleanup;
+            }
+
+            if (got == 0)
+                break;
+
+            total += got;
+        }
+
+        if (VIR_CLOSE(fdout) < 0 ||
+            virTimeMillisNow(&end) < 0 ||
+            stat(copy, &sb) < 0)
+            goto cleanup;
+
+        if (total != len || sb.st_size != len) {
+            virFilePrintf(stderr, "Expected %zu bytes, copied %zu\n",
+                          len, total);
+            goto cleanup;
+        }
+
+        VIR_TEST_DEBUG("%s copy: %zu MiB in %llu ms, %.2f GB/s\n",
+                       pass == 0 ? "kernel" : "buffered",
+                       len / (1024 * 1024), end - start,
+                       testFDStreamBenchRate(len, start, end));
+
+        VIR_FORCE_CLOSE(fdin);
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FORCE_CLOSE(fdin);
+    VIR_FORCE_CLOSE(fdout);
+    if (file)
+        unlink(file);
+    if (copy)
+        unlink(copy);
+    VIR_FREE(file);
+    VIR_FREE(copy);
+    VIR_FREE(buf);
+    return ret;
+}
+
+
 #define SCRATCHDIRTEMPLATE abs_builddir "/fdstreamdir-XXXXXX"
 
 static int
 mymain(void)
 {
     char scratchdir[] = SCRATCHDIRTEMPLATE;
+    struct testFDStreamBenchData bench = { scratchdir, false };
     int ret = 0;
 
     if (!mkdtemp(scratchdir)) {
@@ -338,6 +582,17 @@ mymain(void)
     if (virTestRun("Stream write non-blocking ", testFDStreamWriteNonblock, scratchdir) < 0)
         ret = -1;
 
+    if (virTestRun("Stream read throughput", testFDStreamBenchRead,
+                   &bench) < 0)
+        ret = -1;
+    bench.sparse = true;
+    if (virTestRun("Sparse stream read throughput", testFDStreamBenchRead,
+                   &bench) < 0)
+        ret = -1;
+    if (virTestRun("File copy throughput", testFDStreamBenchCopy,
+                   scratchdir) < 0)
+        ret = -1;
+
     if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
         virFileDeleteTree(scratchdir);
 
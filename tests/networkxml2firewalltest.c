@@ -25,6 +25,7 @@
 
 #if defined (__linux__)
 
+# include "testutilsfirewall.h"
 # include "network/bridge_driver_platform.h"
 # include "virbuffer.h"
 
@@ -108,6 +109,35 @@ testCompareXMLToIPTablesHelper(const void *data)
     return result;
 }
 
+static int
+testApplyNetworkRules(void *opaque)
+{
+    return networkAddFirewallRules(opaque);
+}
+
+static int
+testCompareXMLToRestoreHelper(const void *data)
+{
+    int result = -1;
+    const struct testInfo *info = data;
+    char *xml = NULL;
+    virNetworkDefPtr def = NULL;
+
+    if (virAsprintf(&xml, "%s/networkxml2firewalldata/%s.xml",
+                    abs_srcdir, info->name) < 0)
+        goto cleanup;
+
+    if (!(def = virNetworkDefParseFile(xml)))
+        goto cleanup;
+
+    result = testFirewallCompareRestore(testApplyNetworkRules, def);
+
+ cleanup:
+    VIR_FREE(xml);
+    virNetworkDefFree(def);
+    return result;
+}
+
 static bool
 hasNetfilterTools(void)
 {
@@ -121,6 +151,7 @@ static int
 mymain(void)
 {
     int ret = 0;
+    bool hasRestore;
 
     abs_top_srcdir = getenv("abs_top_srcdir");
     if (!abs_top_srcdir)
@@ -134,6 +165,10 @@ mymain(void)
         if (virTestRun("Network XML-2-iptables " name,                  \
                        testCompareXMLToIPTablesHelper, &info) < 0)      \
             ret = -1;                                                   \
+        if (hasRestore &&                                               \
+            virTestRun("Network XML-2-iptables-restore " name,          \
+                       testCompareXMLToRestoreHelper, &info) < 0)       \
+            ret = -1;                                                   \
     } while (0)
 
     virFirewallSetLockOverride(true);
@@ -148,6 +183,8 @@ mymain(void)
         goto cleanup;
     }
 
+    hasRestore = testFirewallHasRestoreTools();
+
     DO_TEST("nat-default");
     DO_TEST("nat-tftp");
     DO_TEST("nat-many-ips");
@@ -24,6 +24,7 @@
 #if defined (__linux__)
 
 # include "testutils.h"
+# include "testutilsfirewall.h"
 # include "nwfilter/nwfilter_ebiptables_driver.h"
 # include "virbuffer.h"
 
@@ -418,6 +419,35 @@ static int testCompareXMLToArgvFiles(const char *xml,
     return ret;
 }
 
+static int
+testApplyNWFilterRules(void *opaque)
+{
+    const char *xml = opaque;
+    virNWFilterHashTablePtr vars = virNWFilterHashTableCreate(0);
+    virNWFilterInst inst;
+    int ret = -1;
+
+    memset(&inst, 0, sizeof(inst));
+
+    if (!vars)
+        goto cleanup;
+
+    if (testSetDefaultParameters(vars) < 0)
+        goto cleanup;
+
+    if (virNWFilterDefToInst(xml,
+                             vars,
+                             &inst) < 0)
+        goto cleanup;
+
+    ret = ebiptables_driver.applyNewRules("vnet0", inst.rules, inst.nrules);
+
+ cleanup:
+    virNWFilterInstReset(&inst);
+    virNWFilterHashTableFree(vars);
+    return ret;
+}
+
 struct testInfo {
     const char *name;
 };
@@ -445,6 +475,24 @@ testCompareXMLToIPTablesHelper(const void *data)
     return result;
 }
 
+static int
+testCompareXMLToRestoreHelper(const void *data)
+{
+    int result = -1;
+    const struct testInfo *info = data;
+    char *xml = NULL;
+
+    if (virAsprintf(&xml, "%s/nwfilterxml2firewalldata/%s.xml",
+                    abs_srcdir, info->name) < 0)
+        goto cleanup;
+
+    result = testFirewallCompareRestore(testApplyNWFilterRules, xml);
+
+ cleanup:
+    VIR_FREE(xml);
+    return result;
+}
+
 static bool
 hasNetfilterTools(void)
 {
@@ -458,6 +506,7 @@ static int
 mymain(void)
 {
     int ret = 0;
+    bool hasRestore;
 
     abs_top_srcdir = getenv("abs_top_srcdir");
     if (!abs_top_srcdir)
@@ -471,6 +520,10 @@ mymain(void)
         if (virTestRun("NWFilter XML-2-firewall " name,                 \
                        testCompareXMLToIPTablesHelper, &info) < 0)      \
             ret = -1;                                                   \
+        if (hasRestore &&                                               \
+            virTestRun("NWFilter XML-2-firewall-restore " name,         \
+                       testCompareXMLToRestoreHelper, &info) < 0)       \
+            ret = -1;                                                   \
     } while (0)
 
     virFirewallSetLockOverride(true);
@@ -484,6 +537,8 @@ mymain(void)
         goto cleanup;
     }
 
+    hasRestore = testFirewallHasRestoreTools();
+
     DO_TEST("ah");
     DO_TEST("ah-ipv6");
     DO_TEST("all");
@@ -23,7 +23,10 @@
 
 #include "testutils.h"
 
+#include "viralloc.h"
 #include "virerror.h"
+#include "virstring.h"
+#include "virtime.h"
 #include "virxml.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
@@ -72,6 +75,19 @@ static const char nodeDeviceDef[] =
 "  </capability>\n"
 "</device>\n";
 
+static const char scaleDomainDef[] =
+"<domain type='test'>"
+"  <name>scale-domain-%zu</name>"
+"  <memory>8388608</memory>"
+"  <vcpu>2</vcpu>"
+"  <os>"
+"    <type>hvm</type>"
+"  </os>"
+"</domain>";
+
+#define SCALE_NDOMAINS 500
+#define SCALE_NLOOPS 100
+
 typedef struct {
     int startEvents;
     int stopEvents;
@@ -194,6 +210,44 @@ nodeDeviceLifecycleCb(virConnectPtr conn ATTRIBUTE_UNUSED,
         counter->deletedEvents++;
 }
 
+static int
+domainEventCountCb(virConnectPtr conn ATTRIBUTE_UNUSED,
+                   virDomainPtr dom ATTRIBUTE_UNUSED,
+                   int event ATTRIBUTE_UNUSED,
+                   int detail ATTRIBUTE_UNUSED,
+                   void *opaque)
+{
+    size_t *counter = opaque;
+
+    (*counter)++;
+    return 0;
+}
+
+static void
+domainTunableCb(virConnectPtr conn ATTRIBUTE_UNUSED,
+                virDomainPtr dom ATTRIBUTE_UNUSED,
+                virTypedParameterPtr params ATTRIBUTE_UNUSED,
+                int nparams ATTRIBUTE_UNUSED,
+                void *opaque)
+{
+    size_t *counter = opaque;
+
+    (*counter)++;
+}
+
+static void
+domainBlockJobCb(virConnectPtr conn ATTRIBUTE_UNUSED,
+                 virDomainPtr dom ATTRIBUTE_UNUSED,
+                 const char *disk ATTRIBUTE_UNUSED,
+                 int type ATTRIBUTE_UNUSED,
+                 int status ATTRIBUTE_UNUSED,
+                 void *opaque)
+{
+    size_t *counter = opaque;
+
+    (*counter)++;
+}
+
 static int
 testDomainCreateXMLOld(const void *data)
 {
@@ -468,6 +522,139 @@ testDomainStartStopEvent(const void *data)
     return ret;
 }
 
+/* Registers lifecycle, tunable and block job callbacks for every domain
+ * like a crowd of management clients would do and measures the cost of
+ * dispatching events of a single domain as the population grows. */
+static int
+testDomainEventScaling(const void *data)
+{
+    const objecteventTest *test = data;
+    const size_t populations[] = { 10, 100, SCALE_NDOMAINS };
+    virDomainPtr doms[SCALE_NDOMAINS] = { NULL };
+    size_t counts[SCALE_NDOMAINS] = { 0 };
+    int *ids = NULL;
+    size_t nids = 0;
+    size_t globalCount = 0;
+    size_t unexpected = 0;
+    size_t ndoms = 0;
+    size_t target;
+    char *xml = NULL;
+    size_t i;
+    size_t j;
+    int id;
+    int ret = -1;
+
+    for (ndoms = 0; ndoms < SCALE_NDOMAINS; ndoms++) {
+        if (virAsprintf(&xml, scaleDomainDef, ndoms) < 0 ||
+            !(doms[ndoms] = virDomainCreateXML(test->conn, xml, 0)))
+            goto cleanup;
+        VIR_FREE(xml);
+    }
+
+    if ((id = virConnectDomainEventRegisterAny(test->conn, NULL,
+                                               VIR_DOMAIN_EVENT_ID_LIFECYCLE,
+                                               VIR_DOMAIN_EVENT_CALLBACK(&domainEventCountCb),
+                                               &globalCount, NULL)) < 0 ||
+        VIR_APPEND_ELEMENT(ids, nids, id) < 0)
+        goto cleanup;
+
+    for (i = 0, j = 0; i < ARRAY_CARDINALITY(populations); i++) {
+        unsigned long long start;
+        unsigned long long end;
+        size_t loop;
+
+        for (; j < populations[i]; j++) {
+            if ((id = virConnectDomainEventRegisterAny(test->conn, doms[j],
+                                                       VIR_DOMAIN_EVENT_ID_LIFECYCLE,
+                                                       VIR_DOMAIN_EVENT_CALLBACK(&domainEventCountCb),
+                                                       &counts[j], NULL)) < 0 ||
+                VIR_APPEND_ELEMENT(ids, nids, id) < 0)
+                goto cleanup;
+
+            if ((id = virConnectDomainEventRegisterAny(test->conn, doms[j],
+                                                       VIR_DOMAIN_EVENT_ID_TUNABLE,
+                                                       VIR_DOMAIN_EVENT_CALLBACK(&domainTunableCb),
+                                                       &unexpected, NULL)) < 0 ||
+                VIR_APPEND_ELEMENT(ids, nids, id) < 0)
+                goto cleanup;
+
+            if ((id = virConnectDomainEventRegisterAny(test->conn, doms[j],
+                                                       VIR_DOMAIN_EVENT_ID_BLOCK_JOB_2,
+                                                       VIR_DOMAIN_EVENT_CALLBACK(&domainBlockJobCb),
+                                                       &unexpected, NULL)) < 0 ||
+                VIR_APPEND_ELEMENT(ids, nids, id) < 0)
+                goto cleanup;
+        }
+
+        target = populations[i] / 2;
+        memset(counts, 0, sizeof(counts));
+        globalCount = 0;
+
+        if (virTimeMillisNow(&start) < 0)
+            goto cleanup;
+
+        for (loop = 0; loop < SCALE_NLOOPS; loop++) {
+            if (virDomainSuspend(doms[target]) < 0 ||
+                virDomainResume(doms[target]) < 0 ||
+                virEventRunDefaultImpl() < 0)
+                goto cleanup;
+        }
+
+        if (virTimeMillisNow(&end) < 0)
+            goto cleanup;
+
+        VIR_TEST_DEBUG("%d events with %zu callbacks registered: %llu ms\n",
+                       SCALE_NLOOPS * 2, nids, end - start);
+
+        /* Only the callback of the domain and the global one may fire */
+        for (loop = 0; loop < SCALE_NDOMAINS; loop++) {
+            if (counts[loop] != (loop == target ? SCALE_NLOOPS * 2 : 0)) {
+                fprintf(stderr, "domain %zu got %zu events\n",
+                        loop, counts[loop]);
+                goto cleanup;
+            }
+        }
+
+        if (globalCount != SCALE_NLOOPS * 2 || unexpected) {
+            fprintf(stderr, "global callback got %zu events, %zu unexpected\n",
+                    globalCount, unexpected);
+            goto cleanup;
+        }
+    }
+
+    /* Deregistered callbacks must not be reached through the index */
+    if (virConnectDomainEventDeregisterAny(test->conn, ids[target * 3 + 1]) < 0)
+        goto cleanup;
+    ids[target * 3 + 1] = -1;
+    counts[target] = 0;
+    globalCount = 0;
+
+    if (virDomainSuspend(doms[target]) < 0 ||
+        virDomainResume(doms[target]) < 0 ||
+        virEventRunDefaultImpl() < 0)
+        goto cleanup;
+
+    if (counts[target] != 0 || globalCount != 2) {
+        fprintf(stderr, "deregistered callback got %zu events\n",
+                counts[target]);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(xml);
+    for (i = 0; i < nids; i++) {
+        if (ids[i] >= 0)
+            virConnectDomainEventDeregisterAny(test->conn, ids[i]);
+    }
+    VIR_FREE(ids);
+    for (i = 0; i < ndoms; i++) {
+        virDomainDestroy(doms[i]);
+        virDomainFree(doms[i]);
+    }
+    return ret;
+}
+
 static int
 testNetworkCreateXML(const void *data)
 {
@@ -797,6 +984,8 @@ mymain(void)
         ret = EXIT_FAILURE;
     if (virTestRun("Domain start stop events", testDomainStartStopEvent, &test) < 0)
         ret = EXIT_FAILURE;
+    if (virTestRun("Domain event scaling", testDomainEventScaling, &test) < 0)
+        ret = EXIT_FAILURE;
 
     /* Network event tests */
     /* Tests requiring the test network not to be set up*/
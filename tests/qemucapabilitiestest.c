@@ -22,6 +22,8 @@
 #include "testutils.h"
 #include "testutilsqemu.h"
 #include "qemumonitortestutils.h"
+#include "virfile.h"
+#include "virtime.h"
 #define __QEMU_CAPSPRIV_H_ALLOW__
 #include "qemu/qemu_capspriv.h"
 
@@ -33,6 +35,7 @@ struct _testQemuData {
     virDomainXMLOptionPtr xmlopt;
     const char *archName;
     const char *base;
+    const char *tmpdir;
 };
 
 
@@ -46,6 +49,8 @@ testQemuCaps(const void *opaque)
     qemuMonitorTestPtr mon = NULL;
     virQEMUCapsPtr capsActual = NULL;
     char *actual = NULL;
+    unsigned long long start;
+    unsigned long long end;
 
     if (virAsprintf(&repliesFile, "%s/qemucapabilitiesdata/%s.%s.replies",
                     abs_srcdir, data->base, data->archName) < 0 ||
@@ -56,6 +61,9 @@ testQemuCaps(const void *opaque)
     if (!(mon = qemuMonitorTestNewFromFile(repliesFile, data->xmlopt, false)))
         goto cleanup;
 
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+
     if (!(capsActual = virQEMUCapsNew()) ||
         virQEMUCapsInitQMPMonitor(capsActual,
                                   qemuMonitorTestGetMonitor(mon)) < 0)
@@ -66,6 +74,11 @@ testQemuCaps(const void *opaque)
                                      qemuMonitorTestGetMonitor(mon)) < 0)
         goto cleanup;
 
+    if (virTimeMillisNow(&end) < 0)
+        goto cleanup;
+
+    VIR_TEST_DEBUG("probing %s took %llu ms\n", data->base, end - start);
+
     if (!(actual = virQEMUCapsFormatCache(capsActual)))
         goto cleanup;
 
@@ -126,12 +139,118 @@ testQemuCapsCopy(const void *opaque)
 }
 
 
+#define CACHE_STAMP_ITERATIONS 10
+
+static int
+testQemuCapsCacheStamp(const void *opaque)
+{
+    int ret = -1;
+    const testQemuData *data = opaque;
+    char *capsFile = NULL;
+    char *cacheFile = NULL;
+    virCapsPtr caps = NULL;
+    virQEMUCapsPtr orig = NULL;
+    virQEMUCapsPtr loaded = NULL;
+    char *xml = NULL;
+    unsigned long long start;
+    unsigned long long mid;
+    unsigned long long end;
+    size_t i;
+
+    if (virAsprintf(&capsFile, "%s/qemucapabilitiesdata/%s.%s.xml",
+                    abs_srcdir, data->base, data->archName) < 0 ||
+        virAsprintf(&cacheFile, "%s/%s.%s.xml",
+                    data->tmpdir, data->base, data->archName) < 0)
+        goto cleanup;
+
+    if (!(caps = virCapabilitiesNew(virArchFromString(data->archName),
+                                    false, false)))
+        goto cleanup;
+
+    if (!(orig = qemuTestParseCapabilities(caps, capsFile)))
+        goto cleanup;
+
+    if (!(xml = virQEMUCapsFormatCache(orig)) ||
+        virFileWriteStr(cacheFile, xml, 0600) < 0 ||
+        virQEMUCapsSaveCacheStamp(orig, cacheFile) < 0)
+        goto cleanup;
+
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+
+    for (i = 0; i < CACHE_STAMP_ITERATIONS; i++) {
+        virObjectUnref(loaded);
+        if (!(loaded = virQEMUCapsNew()))
+            goto cleanup;
+
+        if (virQEMUCapsLoadCacheStamp(loaded, cacheFile) != 1) {
+            VIR_TEST_VERBOSE("failed to load cache stamp\n");
+            goto cleanup;
+        }
+    }
+
+    if (virTimeMillisNow(&mid) < 0)
+        goto cleanup;
+
+    for (i = 0; i < CACHE_STAMP_ITERATIONS; i++) {
+        virObjectUnref(loaded);
+        if (!(loaded = qemuTestParseCapabilities(caps, cacheFile)))
+            goto cleanup;
+    }
+
+    if (virTimeMillisNow(&end) < 0)
+        goto cleanup;
+
+    VIR_TEST_DEBUG("%d stamp loads took %llu ms, %d XML loads took %llu ms\n",
+                   CACHE_STAMP_ITERATIONS, mid - start,
+                   CACHE_STAMP_ITERATIONS, end - mid);
+
+    virObjectUnref(loaded);
+    if (!(loaded = virQEMUCapsNew()) ||
+        virQEMUCapsLoadCacheStamp(loaded, cacheFile) != 1)
+        goto cleanup;
+
+    if (virQEMUCapsGet(loaded, QEMU_CAPS_KVM) !=
+        virQEMUCapsGet(orig, QEMU_CAPS_KVM) ||
+        virQEMUCapsGet(loaded, QEMU_CAPS_ENABLE_KVM) !=
+        virQEMUCapsGet(orig, QEMU_CAPS_ENABLE_KVM)) {
+        VIR_TEST_VERBOSE("KVM flags differ after loading cache stamp\n");
+        goto cleanup;
+    }
+
+    /* a stamp must not be used once the XML changes */
+    if (virFileWriteStr(cacheFile, "<qemuCaps/>\n", 0600) < 0)
+        goto cleanup;
+
+    virObjectUnref(loaded);
+    if (!(loaded = virQEMUCapsNew()))
+        goto cleanup;
+
+    if (virQEMUCapsLoadCacheStamp(loaded, cacheFile) != 0) {
+        VIR_TEST_VERBOSE("stale cache stamp was accepted\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(capsFile);
+    VIR_FREE(cacheFile);
+    VIR_FREE(xml);
+    virObjectUnref(caps);
+    virObjectUnref(orig);
+    virObjectUnref(loaded);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
     int ret = 0;
     virQEMUDriver driver;
     testQemuData data;
+    char tmpdir[] = abs_builddir "/qemucapabilitiesdir-XXXXXX";
 
 #if !WITH_YAJL
     fputs("libvirt not compiled with yajl, skipping this test\n", stderr);
@@ -144,7 +263,14 @@ mymain(void)
 
     virEventRegisterDefaultImpl();
 
+    if (!mkdtemp(tmpdir)) {
+        fprintf(stderr, "Cannot create %s\n", tmpdir);
+        qemuTestDriverFree(&driver);
+        return EXIT_FAILURE;
+    }
+
     data.xmlopt = driver.xmlopt;
+    data.tmpdir = tmpdir;
 
 #define DO_TEST(arch, name)                                             \
     do {                                                                \
@@ -155,6 +281,9 @@ mymain(void)
         if (virTestRun("copy " name "(" arch ")",                       \
                        testQemuCapsCopy, &data) < 0)                    \
             ret = -1;                                                   \
+        if (virTestRun("stamp " name "(" arch ")",                      \
+                       testQemuCapsCacheStamp, &data) < 0)              \
+            ret = -1;                                                   \
     } while (0)
 
     DO_TEST("x86_64", "caps_1.2.2");
@@ -183,6 +312,9 @@ mymain(void)
      * to generate updated or new *.replies data files.
      */
 
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(tmpdir);
+
     qemuTestDriverFree(&driver);
 
     return (ret == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
@@ -2564,6 +2564,208 @@ testQemuMonitorJSONGetIOThreads(const void *data)
     return ret;
 }
 
+static int
+testQemuMonitorJSONBatchQuery(const void *data)
+{
+    virDomainXMLOptionPtr xmlopt = (virDomainXMLOptionPtr)data;
+    qemuMonitorTestPtr test = qemuMonitorTestNewSimple(true, xmlopt);
+    qemuMonitorPtr mon;
+    const char *queries[] = { "query-cpus", "query-iothreads", NULL };
+    const char *cpus[] = { "query-cpus", NULL };
+    const char *blocks[] = { "query-block", NULL };
+    struct qemuMonitorQueryCpusEntry *cpudata = NULL;
+    struct qemuDomainDiskInfo *diskinfo;
+    virHashTablePtr blockinfo = NULL;
+    virHashTablePtr blockstats = NULL;
+    size_t ncpudata = 0;
+    qemuMonitorIOThreadInfoPtr *info = NULL;
+    int ninfo = 0;
+    int ret = -1;
+    size_t i;
+    const char *querycpus =
+        "{"
+        "    \"return\": ["
+        "        {"
+        "            \"current\": true,"
+        "            \"CPU\": 0,"
+        "            \"qom_path\": \"/machine/unattached/device[0]\","
+        "            \"pc\": -2130530478,"
+        "            \"halted\": true,"
+        "            \"thread_id\": 17622"
+        "        }"
+        "    ]"
+        "}";
+
+    if (!test)
+        return -1;
+
+    mon = qemuMonitorTestGetMonitor(test);
+
+    /* both replies are requested at once, further queries must not reach
+     * the monitor as there's nothing to reply to them */
+    if (qemuMonitorTestAddItem(test, "query-cpus", querycpus) < 0 ||
+        qemuMonitorTestAddItem(test, "query-iothreads",
+                               "{"
+                               "  \"return\": ["
+                               "   {"
+                               "     \"id\": \"iothread1\","
+                               "     \"thread-id\": 30992"
+                               "   }"
+                               "  ]"
+                               "}") < 0)
+        goto cleanup;
+
+    if (qemuMonitorJSONBatchQuery(mon, queries) < 0)
+        goto cleanup;
+
+    if ((ninfo = qemuMonitorJSONGetIOThreads(mon, &info)) != 1 ||
+        info[0]->thread_id != 30992) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "unexpected IOThread info from batched reply");
+        goto cleanup;
+    }
+
+    if (qemuMonitorJSONQueryCPUs(mon, &cpudata, &ncpudata, false) < 0 ||
+        ncpudata != 1 || cpudata[0].tid != 17622) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "unexpected vcpu info from batched reply");
+        goto cleanup;
+    }
+    qemuMonitorQueryCpusFree(cpudata, ncpudata);
+    cpudata = NULL;
+    ncpudata = 0;
+
+    /* commands changing the state of the guest make replies fetched ahead
+     * useless so they must be asked for again */
+    if (qemuMonitorTestAddItem(test, "query-cpus", querycpus) < 0 ||
+        qemuMonitorTestAddItem(test, "stop", "{\"return\": {}}") < 0 ||
+        qemuMonitorTestAddItem(test, "query-cpus", querycpus) < 0)
+        goto cleanup;
+
+    if (qemuMonitorJSONBatchQuery(mon, cpus) < 0 ||
+        qemuMonitorJSONStopCPUs(mon) < 0 ||
+        qemuMonitorJSONQueryCPUs(mon, &cpudata, &ncpudata, false) < 0)
+        goto cleanup;
+
+    /* a batched query-block is filtered for the block stats code, so
+     * qemuMonitorJSONGetBlockInfo which needs other members must ask
+     * again while the stats code uses the batched reply */
+    if (!(blockinfo = virHashCreate(32, virHashValueFree)) ||
+        !(blockstats = virHashCreate(32, virHashValueFree)))
+        goto cleanup;
+
+    if (qemuMonitorTestAddItem(test, "query-block", queryBlockReply) < 0 ||
+        qemuMonitorTestAddItem(test, "query-block", queryBlockReply) < 0)
+        goto cleanup;
+
+    if (qemuMonitorJSONBatchQuery(mon, blocks) < 0 ||
+        qemuMonitorJSONGetBlockInfo(mon, blockinfo) < 0)
+        goto cleanup;
+
+    if (!(diskinfo = virHashLookup(blockinfo, "ide0-1-0")) ||
+        !diskinfo->removable) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "block info was parsed from a filtered reply");
+        goto cleanup;
+    }
+
+    if (qemuMonitorJSONBlockStatsUpdateCapacity(mon, blockstats, 0) < 0)
+        goto cleanup;
+
+    /* only queries can be batched */
+    if (qemuMonitorJSONBatchQuery(mon, (const char *[]) { "stop", NULL }) == 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "batching of 'stop' wasn't rejected");
+        goto cleanup;
+    }
+    virResetLastError();
+
+    ret = 0;
+
+ cleanup:
+    qemuMonitorTestFree(test);
+    qemuMonitorQueryCpusFree(cpudata, ncpudata);
+    virHashFree(blockinfo);
+    virHashFree(blockstats);
+    for (i = 0; i < ninfo; i++)
+        VIR_FREE(info[i]);
+    VIR_FREE(info);
+    return ret;
+}
+
+
+static int
+testQemuMonitorJSONBlockStatsUpdateCapacityDepth(const void *data)
+{
+    virDomainXMLOptionPtr xmlopt = (virDomainXMLOptionPtr)data;
+    qemuMonitorTestPtr test = qemuMonitorTestNewSimple(true, xmlopt);
+    virHashTablePtr blockstats = NULL;
+    qemuBlockStatsPtr stats;
+    int ret = -1;
+    const char *reply =
+        "{"
+        "    \"return\": ["
+        "        {"
+        "            \"device\": \"drive-virtio-disk0\","
+        "            \"inserted\": {"
+        "                \"image\": {"
+        "                    \"filename\": \"/tmp/top.qcow2\","
+        "                    \"virtual-size\": 1000,"
+        "                    \"actual-size\": 100,"
+        "                    \"backing-image\": {"
+        "                        \"filename\": \"/tmp/mid.qcow2\","
+        "                        \"virtual-size\": 2000,"
+        "                        \"actual-size\": 200,"
+        "                        \"backing-image\": {"
+        "                            \"filename\": \"/tmp/base.qcow2\","
+        "                            \"virtual-size\": 3000,"
+        "                            \"actual-size\": 300"
+        "                        }"
+        "                    }"
+        "                }"
+        "            }"
+        "        }"
+        "    ]"
+        "}";
+
+    if (!test)
+        return -1;
+
+    if (!(blockstats = virHashCreate(10, virHashValueFree)))
+        goto cleanup;
+
+    if (qemuMonitorTestAddItem(test, "query-block", reply) < 0)
+        goto cleanup;
+
+    /* images below the requested depth are cut from the reply */
+    if (qemuMonitorJSONBlockStatsUpdateCapacity(qemuMonitorTestGetMonitor(test),
+                                                blockstats, 1) < 0)
+        goto cleanup;
+
+    if (!(stats = virHashLookup(blockstats, "virtio-disk0")) ||
+        stats->capacity != 1000 || stats->physical != 100 ||
+        !(stats = virHashLookup(blockstats, "virtio-disk0.1")) ||
+        stats->capacity != 2000 || stats->physical != 200) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "unexpected capacity of the backing chain");
+        goto cleanup;
+    }
+
+    if (virHashLookup(blockstats, "virtio-disk0.2")) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "image below the requested depth was not filtered");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    qemuMonitorTestFree(test);
+    virHashFree(blockstats);
+    return ret;
+}
+
+
 struct testCPUInfoData {
     const char *name;
     size_t maxvcpus;
@@ -2851,6 +3053,8 @@ mymain(void)
     DO_TEST(CPU);
     DO_TEST(GetNonExistingCPUData);
     DO_TEST(GetIOThreads);
+    DO_TEST(BatchQuery);
+    DO_TEST(BlockStatsUpdateCapacityDepth);
     DO_TEST_SIMPLE("qmp_capabilities", qemuMonitorJSONSetCapabilities);
     DO_TEST_SIMPLE("system_powerdown", qemuMonitorJSONSystemPowerdown);
     DO_TEST_SIMPLE("system_reset", qemuMonitorJSONSystemReset);
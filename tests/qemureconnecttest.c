@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2017 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include <unistd.h>
+
+#include "qemu/qemu_conf.h"
+#include "qemu/qemu_domain.h"
+#include "qemu/qemu_processpriv.h"
+#include "testutils.h"
+#include "testutilsqemu.h"
+#include "virerror.h"
+#include "virstring.h"
+#include "virthread.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+static virQEMUDriver driver;
+
+/* How long the jobs started by the tests may wait, in milliseconds */
+#define QEMU_RECONNECT_TEST_WAIT_TIME 100
+
+struct qemuReconnectTestJobData {
+    virDomainObjPtr vm;
+    bool done;
+    int rc;
+};
+
+
+static void
+qemuReconnectTestJobThread(void *opaque)
+{
+    struct qemuReconnectTestJobData *data = opaque;
+
+    virObjectLock(data->vm);
+    data->rc = qemuDomainObjBeginJob(&driver, data->vm, QEMU_JOB_QUERY);
+    if (data->rc == 0)
+        qemuDomainObjEndJob(&driver, data->vm);
+    data->done = true;
+    virObjectUnlock(data->vm);
+}
+
+
+static virDomainObjPtr
+qemuReconnectTestDomainNew(void)
+{
+    virDomainObjPtr vm;
+    virDomainDefPtr def;
+
+    if (!(def = virDomainDefNew()))
+        return NULL;
+
+    if (VIR_STRDUP(def->name, "reconnect") < 0 ||
+        !(vm = virDomainObjNew(driver.xmlopt))) {
+        virDomainDefFree(def);
+        return NULL;
+    }
+
+    vm->def = def;
+    return vm;
+}
+
+
+/* A domain waiting to be reconnected must not time out the jobs
+ * queued on it and has to let them run once it is reconnected. */
+static int
+testQemuReconnectWait(const void *opaque ATTRIBUTE_UNUSED)
+{
+    struct qemuReconnectTestJobData data = {0};
+    virThread thread;
+    bool running = false;
+    bool done;
+    int ret = -1;
+
+    if (!(data.vm = qemuReconnectTestDomainNew()))
+        return -1;
+
+    virObjectLock(data.vm);
+    qemuProcessReconnectMark(data.vm);
+    virObjectUnlock(data.vm);
+
+    if (virThreadCreate(&thread, true, qemuReconnectTestJobThread, &data) < 0)
+        goto cleanup;
+    running = true;
+
+    usleep(3 * QEMU_RECONNECT_TEST_WAIT_TIME * 1000);
+
+    virObjectLock(data.vm);
+    done = data.done;
+    qemuProcessReconnectUnmark(data.vm);
+    virObjectUnlock(data.vm);
+
+    if (done) {
+        fprintf(stderr, "job did not wait for the reconnect (rc=%d)\n",
+                data.rc);
+        goto cleanup;
+    }
+
+    virThreadJoin(&thread);
+    running = false;
+
+    if (data.rc != 0) {
+        fprintf(stderr, "job failed after the reconnect (rc=%d)\n", data.rc);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (running) {
+        virObjectLock(data.vm);
+        qemuProcessReconnectUnmark(data.vm);
+        virObjectUnlock(data.vm);
+        virThreadJoin(&thread);
+    }
+    virObjectUnref(data.vm);
+    return ret;
+}
+
+
+/* A job held by someone else still times out once the domain is
+ * reconnected. */
+static int
+testQemuReconnectJobTimeout(const void *opaque ATTRIBUTE_UNUSED)
+{
+    struct qemuReconnectTestJobData data = {0};
+    virThread thread;
+    bool jobStarted = false;
+    int ret = -1;
+
+    if (!(data.vm = qemuReconnectTestDomainNew()))
+        return -1;
+
+    virObjectLock(data.vm);
+    if (qemuDomainObjBeginJob(&driver, data.vm, QEMU_JOB_MODIFY) < 0) {
+        virObjectUnlock(data.vm);
+        goto cleanup;
+    }
+    jobStarted = true;
+    virObjectUnlock(data.vm);
+
+    if (virThreadCreate(&thread, true, qemuReconnectTestJobThread, &data) < 0)
+        goto cleanup;
+    virThreadJoin(&thread);
+
+    if (data.rc != -2) {
+        fprintf(stderr, "expected the job to time out, got rc=%d\n", data.rc);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (jobStarted) {
+        virObjectLock(data.vm);
+        qemuDomainObjEndJob(&driver, data.vm);
+        virObjectUnlock(data.vm);
+    }
+    virResetLastError();
+    virObjectUnref(data.vm);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (virThreadInitialize() < 0 ||
+        qemuTestDriverInit(&driver) < 0)
+        return EXIT_FAILURE;
+
+    qemuDomainJobWaitTime = QEMU_RECONNECT_TEST_WAIT_TIME;
+
+    if (virTestRun("wait for reconnect", testQemuReconnectWait, NULL) < 0)
+        ret = -1;
+    if (virTestRun("job timeout", testQemuReconnectJobTimeout, NULL) < 0)
+        ret = -1;
+
+    qemuTestDriverFree(&driver);
+    return (ret == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
@@ -0,0 +1,223 @@
+#include <config.h>
+
+#include "testutils.h"
+#include "testutilsfirewall.h"
+#include "virbuffer.h"
+#include "virfile.h"
+#include "virstring.h"
+
+#define __VIR_FIREWALL_PRIV_H_ALLOW__
+#include "virfirewallpriv.h"
+
+#define __VIR_COMMAND_PRIV_H_ALLOW__
+#include "vircommandpriv.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+/*
+ * The rules of each layer in the order they were applied, each
+ * as "table: arg arg ...", regardless of whether they were applied
+ * one by one or batched via *-restore.
+ */
+struct testFirewallRules {
+    virBuffer layers[VIR_FIREWALL_LAYER_LAST];
+    size_t ncommands;
+};
+
+
+bool
+testFirewallHasRestoreTools(void)
+{
+    return virFileIsExecutable(IPTABLES_RESTORE_PATH) &&
+        virFileIsExecutable(IP6TABLES_RESTORE_PATH) &&
+        virFileIsExecutable(EBTABLES_RESTORE_PATH);
+}
+
+
+static void
+testFirewallAddDirectRule(virBufferPtr buf,
+                          const char *const*args)
+{
+    const char *table = "filter";
+    size_t i;
+
+    for (i = 1; args[i] && args[i + 1]; i++) {
+        if (STREQ(args[i], "-t") || STREQ(args[i], "--table"))
+            table = args[i + 1];
+    }
+
+    virBufferAsprintf(buf, "%s:", table);
+    for (i = 1; args[i]; i++) {
+        if (STREQ(args[i], "-w") || STREQ(args[i], "--concurrent"))
+            continue;
+        if ((STREQ(args[i], "-t") || STREQ(args[i], "--table")) && args[i + 1]) {
+            i++;
+            continue;
+        }
+        virBufferAsprintf(buf, " %s", args[i]);
+    }
+    virBufferAddChar(buf, '\n');
+}
+
+
+static void
+testFirewallAddRestoreRules(virBufferPtr buf,
+                            const char *input)
+{
+    char **lines = virStringSplit(input, "\n", 0);
+    const char *table = "filter";
+    size_t i;
+
+    for (i = 0; lines && lines[i]; i++) {
+        const char *line = lines[i];
+        bool quoted = false;
+        bool inArg = false;
+
+        if (STREQ(line, "") || STREQ(line, "COMMIT"))
+            continue;
+
+        if (line[0] == '*') {
+            table = line + 1;
+            continue;
+        }
+
+        virBufferAsprintf(buf, "%s:", table);
+        for (; *line; line++) {
+            if (!quoted && *line == ' ') {
+                inArg = false;
+                continue;
+            }
+            if (!inArg) {
+                virBufferAddChar(buf, ' ');
+                inArg = true;
+            }
+            if (*line == '"') {
+                quoted = !quoted;
+                continue;
+            }
+            if (quoted && *line == '\\' && line[1] == '"')
+                line++;
+            virBufferAddChar(buf, *line);
+        }
+        virBufferAddChar(buf, '\n');
+    }
+
+    virStringListFree(lines);
+}
+
+
+static void
+testFirewallCollectRules(const char *const*args,
+                         const char *const*env ATTRIBUTE_UNUSED,
+                         const char *input,
+                         char **output ATTRIBUTE_UNUSED,
+                         char **error ATTRIBUTE_UNUSED,
+                         int *status ATTRIBUTE_UNUSED,
+                         void *opaque)
+{
+    struct testFirewallRules *rules = opaque;
+    const char *bin = strrchr(args[0], '/');
+    virFirewallLayer layer;
+
+    bin = bin ? bin + 1 : args[0];
+
+    if (STRPREFIX(bin, "ebtables"))
+        layer = VIR_FIREWALL_LAYER_ETHERNET;
+    else if (STRPREFIX(bin, "ip6tables"))
+        layer = VIR_FIREWALL_LAYER_IPV6;
+    else
+        layer = VIR_FIREWALL_LAYER_IPV4;
+
+    rules->ncommands++;
+
+    if (virFileHasSuffix(bin, "-restore"))
+        testFirewallAddRestoreRules(&rules->layers[layer], input);
+    else
+        testFirewallAddDirectRule(&rules->layers[layer], args);
+}
+
+
+static int
+testFirewallCollect(virFirewallBackend backend,
+                    testFirewallApplyFunc func,
+                    void *opaque,
+                    struct testFirewallRules *rules)
+{
+    int ret = -1;
+
+    if (virFirewallSetBackend(backend) < 0)
+        return -1;
+
+    virCommandSetDryRun(NULL, testFirewallCollectRules, rules);
+
+    if (func(opaque) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virCommandSetDryRun(NULL, NULL, NULL);
+    return ret;
+}
+
+
+/*
+ * testFirewallCompareRestore:
+ * @func: callback applying the rules under test
+ * @opaque: data passed to @func
+ *
+ * Run @func with the direct backend and with the restore backend
+ * and check that both apply the same rules in the same order for
+ * each layer, while the restore backend runs fewer commands. The
+ * direct backend is left selected afterwards.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+int
+testFirewallCompareRestore(testFirewallApplyFunc func,
+                           void *opaque)
+{
+    struct testFirewallRules direct;
+    struct testFirewallRules restore;
+    size_t i;
+    int ret = -1;
+
+    memset(&direct, 0, sizeof(direct));
+    memset(&restore, 0, sizeof(restore));
+
+    if (testFirewallCollect(VIR_FIREWALL_BACKEND_DIRECT, func, opaque,
+                            &direct) < 0 ||
+        testFirewallCollect(VIR_FIREWALL_BACKEND_RESTORE, func, opaque,
+                            &restore) < 0)
+        goto cleanup;
+
+    for (i = 0; i < VIR_FIREWALL_LAYER_LAST; i++) {
+        const char *expect = virBufferCurrentContent(&direct.layers[i]);
+        const char *actual = virBufferCurrentContent(&restore.layers[i]);
+
+        if (virBufferError(&direct.layers[i]) ||
+            virBufferError(&restore.layers[i]))
+            goto cleanup;
+
+        if (STRNEQ_NULLABLE(expect, actual)) {
+            virTestDifference(stderr, expect, actual);
+            goto cleanup;
+        }
+    }
+
+    VIR_TEST_DEBUG("%zu commands with direct backend, %zu with restore\n",
+                   direct.ncommands, restore.ncommands);
+
+    if (restore.ncommands > direct.ncommands) {
+        VIR_TEST_DEBUG("restore backend ran more commands than direct\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    ignore_value(virFirewallSetBackend(VIR_FIREWALL_BACKEND_DIRECT));
+    for (i = 0; i < VIR_FIREWALL_LAYER_LAST; i++) {
+        virBufferFreeAndReset(&direct.layers[i]);
+        virBufferFreeAndReset(&restore.layers[i]);
+    }
+    return ret;
+}
@@ -0,0 +1,13 @@
+#ifndef _TESTUTILSFIREWALL_H_
+# define _TESTUTILSFIREWALL_H_
+
+# include <stdbool.h>
+
+typedef int (*testFirewallApplyFunc)(void *opaque);
+
+bool testFirewallHasRestoreTools(void);
+
+int testFirewallCompareRestore(testFirewallApplyFunc func,
+                               void *opaque);
+
+#endif /* _TESTUTILSFIREWALL_H_ */
@@ -57,6 +57,10 @@ char *fakesysfscgroupdir;
 const char *fakedevicedir0 = FAKEDEVDIR0;
 const char *fakedevicedir1 = FAKEDEVDIR1;
 
+/* Number of files opened within the fake cgroup hierarchy,
+ * looked up by vircgrouptest using dlsym() */
+unsigned long long virCgroupMockOpenCount;
+
 
 # define SYSFS_CGROUP_PREFIX "/not/really/sys/fs/cgroup/"
 # define SYSFS_CPU_PRESENT "/sys/devices/system/cpu/present"
@@ -726,6 +730,7 @@ int open(const char *path, int flags, ...)
             errno = ENOMEM;
             return -1;
         }
+        virCgroupMockOpenCount++;
     }
     if (flags & O_CREAT) {
         va_list ap;
@@ -25,6 +25,7 @@
 #ifdef __linux__
 
 # include <stdlib.h>
+# include <dlfcn.h>
 
 # define __VIR_CGROUP_ALLOW_INCLUDE_PRIV_H__
 # include "vircgrouppriv.h"
@@ -852,6 +853,160 @@ static int testCgroupGetBlkioIoDeviceServiced(const void *args ATTRIBUTE_UNUSED)
 
 # define FAKEROOTDIRTEMPLATE abs_builddir "/fakerootdir-XXXXXX"
 
+/* Reads the statistics gathered for each domain the way a stats scrape
+ * does, counting the files opened in the cgroup hierarchy */
+static int
+testCgroupStatsScrape(virCgroupPtr cgroup)
+{
+    unsigned long long usage;
+    unsigned long long user;
+    unsigned long long sys;
+    unsigned long kb;
+    long long bytes_read;
+    long long bytes_write;
+    long long requests_read;
+    long long requests_write;
+    char *percpu = NULL;
+
+    if (virCgroupGetCpuacctUsage(cgroup, &usage) < 0 ||
+        virCgroupGetCpuacctStat(cgroup, &user, &sys) < 0 ||
+        virCgroupGetCpuacctPercpuUsage(cgroup, &percpu) < 0 ||
+        virCgroupGetMemoryUsage(cgroup, &kb) < 0 ||
+        virCgroupGetBlkioIoServiced(cgroup, &bytes_read, &bytes_write,
+                                    &requests_read, &requests_write) < 0)
+        return -1;
+
+    VIR_FREE(percpu);
+    return 0;
+}
+
+
+static int testCgroupGetStatsCached(const void *args ATTRIBUTE_UNUSED)
+{
+    virCgroupPtr cgroup = NULL;
+    unsigned long long *opens;
+    unsigned long long opensFirst;
+    unsigned long long opensRest;
+    unsigned long long usage;
+    char *path = NULL;
+    int rv, ret = -1;
+
+    if (!(opens = dlsym(RTLD_DEFAULT, "virCgroupMockOpenCount"))) {
+        fprintf(stderr, "Cannot find open counter of the mock\n");
+        return -1;
+    }
+
+    if ((rv = virCgroupNewPartition("/virtualmachines", true,
+                                    (1 << VIR_CGROUP_CONTROLLER_CPU) |
+                                    (1 << VIR_CGROUP_CONTROLLER_CPUACCT) |
+                                    (1 << VIR_CGROUP_CONTROLLER_MEMORY) |
+                                    (1 << VIR_CGROUP_CONTROLLER_BLKIO),
+                                    &cgroup)) < 0) {
+        fprintf(stderr, "Could not create /virtualmachines cgroup: %d\n", -rv);
+        goto cleanup;
+    }
+
+    opensFirst = *opens;
+    if (testCgroupStatsScrape(cgroup) < 0)
+        goto cleanup;
+    opensFirst = *opens - opensFirst;
+
+    opensRest = *opens;
+    if (testCgroupStatsScrape(cgroup) < 0 ||
+        testCgroupStatsScrape(cgroup) < 0)
+        goto cleanup;
+    opensRest = *opens - opensRest;
+
+    if (opensFirst == 0 || opensRest != 0) {
+        fprintf(stderr, "Expected files to be opened by the first scrape "
+                "only, got %llu and %llu\n", opensFirst, opensRest);
+        goto cleanup;
+    }
+
+    if (cgroup->nfiles > VIR_CGROUP_MAX_VALUE_FILES) {
+        fprintf(stderr, "Kept %zu files open\n", cgroup->nfiles);
+        goto cleanup;
+    }
+
+    /* the files kept open must still provide current values */
+    if (virCgroupPathOfController(cgroup, VIR_CGROUP_CONTROLLER_CPUACCT,
+                                  "cpuacct.usage", &path) < 0 ||
+        virFileWriteStr(path, "12345\n", 0) < 0 ||
+        virCgroupGetCpuacctUsage(cgroup, &usage) < 0)
+        goto cleanup;
+
+    if (usage != 12345) {
+        fprintf(stderr, "Expected updated cpuacct.usage, got %llu\n", usage);
+        goto cleanup;
+    }
+
+    if (virFileWriteStr(path, "2787788855799582\n", 0) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(path);
+    virCgroupFree(&cgroup);
+    return ret;
+}
+
+
+static int testCgroupGetValues(const void *args ATTRIBUTE_UNUSED)
+{
+    virCgroupPtr cgroup = NULL;
+    virCgroupValue values[] = {
+        { VIR_CGROUP_CONTROLLER_CPUACCT, "cpuacct.usage", NULL },
+        { VIR_CGROUP_CONTROLLER_MEMORY, "memory.usage_in_bytes", NULL },
+        { VIR_CGROUP_CONTROLLER_BLKIO, "blkio.throttle.io_serviced", NULL },
+    };
+    virCgroupValue missing[] = {
+        { VIR_CGROUP_CONTROLLER_CPUACCT, "cpuacct.usage", NULL },
+        { VIR_CGROUP_CONTROLLER_MEMORY, "memory.nonexistent", NULL },
+    };
+    size_t i;
+    int rv, ret = -1;
+
+    if ((rv = virCgroupNewPartition("/virtualmachines", true,
+                                    (1 << VIR_CGROUP_CONTROLLER_CPUACCT) |
+                                    (1 << VIR_CGROUP_CONTROLLER_MEMORY) |
+                                    (1 << VIR_CGROUP_CONTROLLER_BLKIO),
+                                    &cgroup)) < 0) {
+        fprintf(stderr, "Could not create /virtualmachines cgroup: %d\n", -rv);
+        goto cleanup;
+    }
+
+    if (virCgroupGetValues(cgroup, values, ARRAY_CARDINALITY(values)) < 0)
+        goto cleanup;
+
+    if (STRNEQ_NULLABLE(values[0].value, "2787788855799582") ||
+        STRNEQ_NULLABLE(values[1].value, "1455321088") ||
+        !values[2].value ||
+        !STRPREFIX(values[2].value, "8:0 Read ")) {
+        fprintf(stderr, "Unexpected values '%s', '%s', '%s'\n",
+                NULLSTR(values[0].value), NULLSTR(values[1].value),
+                NULLSTR(values[2].value));
+        goto cleanup;
+    }
+
+    if (virCgroupGetValues(cgroup, missing, ARRAY_CARDINALITY(missing)) == 0 ||
+        missing[0].value || missing[1].value) {
+        fprintf(stderr, "Reading a missing value should fail\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < ARRAY_CARDINALITY(values); i++)
+        VIR_FREE(values[i].value);
+    for (i = 0; i < ARRAY_CARDINALITY(missing); i++)
+        VIR_FREE(missing[i].value);
+    virCgroupFree(&cgroup);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -926,6 +1081,12 @@ mymain(void)
     if (virTestRun("virCgroupGetPercpuStats works", testCgroupGetPercpuStats, NULL) < 0)
         ret = -1;
 
+    if (virTestRun("virCgroupGetValues works", testCgroupGetValues, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("Cgroup statistics keep files open", testCgroupGetStatsCached, NULL) < 0)
+        ret = -1;
+
     setenv("VIR_CGROUP_MOCK_MODE", "allinone", 1);
     if (virTestRun("New cgroup for self (allinone)", testCgroupNewForSelfAllInOne, NULL) < 0)
         ret = -1;
@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2017 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "virerror.h"
+#include "viralloc.h"
+#include "virlog.h"
+#include "virstring.h"
+#include "virtime.h"
+
+#include "virdomainobjlist.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("tests.virdomainobjlisttest");
+
+#define NDOMAINS 10000
+
+static virDomainXMLOptionPtr xmlopt;
+
+
+static virDomainObjListPtr
+testDomainObjListPopulate(size_t ndomains)
+{
+    virDomainObjListPtr doms;
+    size_t i;
+
+    if (!(doms = virDomainObjListNew()))
+        return NULL;
+
+    for (i = 0; i < ndomains; i++) {
+        unsigned char uuid[VIR_UUID_BUFLEN] = { 0 };
+        char *name = NULL;
+        virDomainDefPtr def;
+        virDomainObjPtr vm;
+
+        memcpy(uuid, &i, sizeof(i));
+        if (virAsprintf(&name, "dom%zu", i) < 0)
+            goto error;
+
+        def = virDomainDefNewFull(name, uuid, i);
+        VIR_FREE(name);
+        if (!def)
+            goto error;
+
+        if (!(vm = virDomainObjListAdd(doms, def, xmlopt,
+                                       VIR_DOMAIN_OBJ_LIST_ADD_LIVE,
+                                       NULL))) {
+            virDomainDefFree(def);
+            goto error;
+        }
+        virObjectUnlock(vm);
+    }
+
+    return doms;
+
+ error:
+    virObjectUnref(doms);
+    return NULL;
+}
+
+
+static int
+testDomainObjListCheckID(virDomainObjListPtr doms,
+                         int id,
+                         const char *expect)
+{
+    virDomainObjPtr vm;
+    int ret = -1;
+
+    vm = virDomainObjListFindByID(doms, id);
+
+    if (!expect) {
+        if (vm) {
+            fprintf(stderr, "Unexpected domain '%s' for ID %d\n",
+                    vm->def->name, id);
+            goto cleanup;
+        }
+    } else {
+        if (!vm) {
+            fprintf(stderr, "Missing domain '%s' for ID %d\n", expect, id);
+            goto cleanup;
+        }
+        if (STRNEQ(vm->def->name, expect)) {
+            fprintf(stderr, "Expected domain '%s' for ID %d, got '%s'\n",
+                    expect, id, vm->def->name);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+ cleanup:
+    if (vm)
+        virObjectUnlock(vm);
+    return ret;
+}
+
+
+static int
+testFindByID(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virDomainObjListPtr doms;
+    unsigned long long start;
+    unsigned long long end;
+    char name[32];
+    size_t i;
+    int ret = -1;
+
+    if (!(doms = testDomainObjListPopulate(NDOMAINS)))
+        return -1;
+
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+
+    for (i = 0; i < NDOMAINS; i++) {
+        snprintf(name, sizeof(name), "dom%zu", i);
+        if (testDomainObjListCheckID(doms, i, name) < 0)
+            goto cleanup;
+    }
+
+    if (virTimeMillisNow(&end) < 0)
+        goto cleanup;
+
+    VIR_TEST_DEBUG("%d lookups by ID among %d domains took %llu ms\n",
+                   NDOMAINS, NDOMAINS, end - start);
+
+    if (testDomainObjListCheckID(doms, NDOMAINS, NULL) < 0 ||
+        testDomainObjListCheckID(doms, -1, NULL) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virObjectUnref(doms);
+    return ret;
+}
+
+
+static int
+testFindByIDReuse(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virDomainObjListPtr doms;
+    virDomainObjPtr vm = NULL;
+    int ret = -1;
+
+    if (!(doms = testDomainObjListPopulate(3)))
+        return -1;
+
+    /* Stop dom1 and hand its ID over to dom2 like drivers do on
+     * stop and start. */
+    if (!(vm = virDomainObjListFindByName(doms, "dom1")))
+        goto cleanup;
+    virDomainObjListSetID(doms, vm, -1);
+    virDomainObjEndAPI(&vm);
+
+    if (testDomainObjListCheckID(doms, 1, NULL) < 0)
+        goto cleanup;
+
+    if (!(vm = virDomainObjListFindByName(doms, "dom2")))
+        goto cleanup;
+    virDomainObjListSetID(doms, vm, 1);
+    virDomainObjEndAPI(&vm);
+
+    if (testDomainObjListCheckID(doms, 1, "dom2") < 0 ||
+        testDomainObjListCheckID(doms, 2, NULL) < 0)
+        goto cleanup;
+
+    /* Taking over an ID which is still in use must not drop the new
+     * owner once the old one goes away */
+    if (!(vm = virDomainObjListFindByName(doms, "dom0")))
+        goto cleanup;
+    virDomainObjListSetID(doms, vm, 1);
+    virDomainObjEndAPI(&vm);
+
+    if (!(vm = virDomainObjListFindByName(doms, "dom2")))
+        goto cleanup;
+    virDomainObjListSetID(doms, vm, -1);
+    virDomainObjEndAPI(&vm);
+
+    if (testDomainObjListCheckID(doms, 0, NULL) < 0 ||
+        testDomainObjListCheckID(doms, 1, "dom0") < 0)
+        goto cleanup;
+
+    if (!(vm = virDomainObjListFindByName(doms, "dom2")))
+        goto cleanup;
+    virDomainObjListSetID(doms, vm, 2);
+    virDomainObjEndAPI(&vm);
+
+    /* Removed domains must not be reachable via the index */
+    if (!(vm = virDomainObjListFindByName(doms, "dom2")))
+        goto cleanup;
+    virDomainObjListRemove(doms, vm);
+    virObjectUnref(vm);
+    vm = NULL;
+
+    if (testDomainObjListCheckID(doms, 2, NULL) < 0 ||
+        testDomainObjListCheckID(doms, 1, "dom0") < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    virObjectUnref(doms);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (!(xmlopt = virTestGenericDomainXMLConfInit()))
+        return EXIT_FAILURE;
+
+    if (virTestRun("Find by ID", testFindByID, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Find by reused ID", testFindByIDReuse, NULL) < 0)
+        ret = -1;
+
+    virObjectUnref(xmlopt);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
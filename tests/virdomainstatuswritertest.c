@@ -0,0 +1,294 @@
+/*
+ * Copyright (C) 2017 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <unistd.h>
+
+#include "testutils.h"
+#include "virerror.h"
+#include "viralloc.h"
+#include "virfile.h"
+#include "virlog.h"
+#include "virstring.h"
+#include "virtime.h"
+
+#include "virdomainstatuswriter.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("tests.virdomainstatuswritertest");
+
+#define NCHANGES 1000
+
+static virCapsPtr caps;
+static virDomainXMLOptionPtr xmlopt;
+
+static const char domainDef[] =
+"<domain type='test'>"
+"  <name>%s</name>"
+"  <memory>8388608</memory>"
+"  <vcpu>2</vcpu>"
+"  <os>"
+"    <type>hvm</type>"
+"  </os>"
+"</domain>";
+
+
+static virDomainObjPtr
+testDomainObjNew(const char *name)
+{
+    virDomainObjPtr vm;
+    char *xml = NULL;
+
+    if (!(vm = virDomainObjNew(xmlopt)))
+        return NULL;
+
+    if (virAsprintf(&xml, domainDef, name) < 0 ||
+        !(vm->def = virDomainDefParseString(xml, caps, xmlopt, NULL, 0))) {
+        virObjectUnlock(vm);
+        virObjectUnref(vm);
+        vm = NULL;
+        goto cleanup;
+    }
+
+    vm->def->id = 1;
+    virDomainObjSetState(vm, VIR_DOMAIN_RUNNING, VIR_DOMAIN_RUNNING_BOOTED);
+
+ cleanup:
+    VIR_FREE(xml);
+    return vm;
+}
+
+
+static int
+testStatusFileCheck(const char *dir,
+                    const char *name,
+                    bool expect)
+{
+    char *file = NULL;
+    char *xml = NULL;
+    int ret = -1;
+
+    if (!(file = virDomainConfigFile(dir, name)))
+        return -1;
+
+    if (!expect) {
+        if (virFileExists(file)) {
+            fprintf(stderr, "unexpected status file '%s'\n", file);
+            goto cleanup;
+        }
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (virFileReadAll(file, 1024 * 1024, &xml) < 0)
+        goto cleanup;
+
+    if (!strstr(xml, "<domstatus state='running'")) {
+        fprintf(stderr, "unexpected status XML in '%s'\n", file);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(file);
+    VIR_FREE(xml);
+    return ret;
+}
+
+
+static int
+testCoalesce(const void *opaque)
+{
+    const char *dir = opaque;
+    virDomainStatusWriterPtr writer;
+    virDomainObjPtr vm = NULL;
+    unsigned long long requests;
+    unsigned long long writes = 0;
+    unsigned long long start;
+    unsigned long long end;
+    size_t i;
+    int ret = -1;
+
+    if (!(writer = virDomainStatusWriterNew(xmlopt, dir, 50)))
+        return -1;
+
+    if (!(vm = testDomainObjNew("coalesce")))
+        goto cleanup;
+
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+
+    for (i = 0; i < NCHANGES; i++) {
+        if (virDomainStatusWriterMarkDirty(writer, vm, caps) < 0)
+            goto cleanup;
+    }
+
+    if (virTimeMillisNow(&end) < 0)
+        goto cleanup;
+
+    VIR_TEST_DEBUG("%d status changes marked in %llu ms\n",
+                   NCHANGES, end - start);
+
+    /* the writer thread needs the domain unlocked */
+    virObjectUnlock(vm);
+    for (i = 0; i < 500 && !writes; i++) {
+        usleep(10 * 1000);
+        virDomainStatusWriterGetStats(writer, &requests, &writes);
+    }
+    virObjectLock(vm);
+
+    if (writes != 1) {
+        fprintf(stderr, "expected 1 write, got %llu\n", writes);
+        goto cleanup;
+    }
+
+    if (testStatusFileCheck(dir, "coalesce", true) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    if (vm) {
+        virObjectUnlock(vm);
+        virObjectUnref(vm);
+    }
+    virObjectUnref(writer);
+    return ret;
+}
+
+
+static int
+testCoalesceStats(const void *opaque)
+{
+    const char *dir = opaque;
+    virDomainStatusWriterPtr writer;
+    virDomainObjPtr vm = NULL;
+    unsigned long long requests;
+    unsigned long long writes;
+    size_t i;
+    int ret = -1;
+
+    if (!(writer = virDomainStatusWriterNew(xmlopt, dir, 50)))
+        return -1;
+
+    if (!(vm = testDomainObjNew("stats")))
+        goto cleanup;
+
+    for (i = 0; i < NCHANGES; i++) {
+        if (virDomainStatusWriterMarkDirty(writer, vm, caps) < 0)
+            goto cleanup;
+    }
+
+    /* a forced flush covers all the changes marked before */
+    if (virDomainStatusWriterFlush(writer, vm, caps) < 0 ||
+        testStatusFileCheck(dir, "stats", true) < 0)
+        goto cleanup;
+
+    virDomainStatusWriterGetStats(writer, &requests, &writes);
+    if (requests != NCHANGES + 1 || writes != 1) {
+        fprintf(stderr, "expected %d requests and 1 write, got %llu and %llu\n",
+                NCHANGES + 1, requests, writes);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    if (vm) {
+        virObjectUnlock(vm);
+        virObjectUnref(vm);
+    }
+    virObjectUnref(writer);
+    return ret;
+}
+
+
+static int
+testDiscard(const void *opaque)
+{
+    const char *dir = opaque;
+    virDomainStatusWriterPtr writer;
+    virDomainObjPtr vm = NULL;
+    int ret = -1;
+
+    if (!(writer = virDomainStatusWriterNew(xmlopt, dir, 60 * 1000)))
+        return -1;
+
+    if (!(vm = testDomainObjNew("discard")))
+        goto cleanup;
+
+    if (virDomainStatusWriterMarkDirty(writer, vm, caps) < 0)
+        goto cleanup;
+
+    virDomainStatusWriterDiscard(writer, vm);
+    virObjectUnlock(vm);
+
+    /* releasing the writer would write out pending changes */
+    virObjectUnref(writer);
+    writer = NULL;
+    virObjectLock(vm);
+
+    if (testStatusFileCheck(dir, "discard", false) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    if (vm) {
+        virObjectUnlock(vm);
+        virObjectUnref(vm);
+    }
+    virObjectUnref(writer);
+    return ret;
+}
+
+
+#define SCRATCHDIRTEMPLATE abs_builddir "/statuswriterdir-XXXXXX"
+
+static int
+mymain(void)
+{
+    char scratchdir[] = SCRATCHDIRTEMPLATE;
+    int ret = 0;
+
+    if (!mkdtemp(scratchdir)) {
+        virFilePrintf(stderr, "Cannot create statuswriterdir");
+        abort();
+    }
+
+    if (!(caps = virTestGenericCapsInit()) ||
+        !(xmlopt = virTestGenericDomainXMLConfInit()))
+        return EXIT_FAILURE;
+
+    if (virTestRun("Coalesce changes", testCoalesce, scratchdir) < 0)
+        ret = -1;
+    if (virTestRun("Coalesce changes before flush", testCoalesceStats,
+                   scratchdir) < 0)
+        ret = -1;
+    if (virTestRun("Discard changes", testDiscard, scratchdir) < 0)
+        ret = -1;
+
+    virObjectUnref(caps);
+    virObjectUnref(xmlopt);
+
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(scratchdir);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
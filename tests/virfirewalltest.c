@@ -1123,6 +1123,145 @@ testFirewallQuery(const void *opaque ATTRIBUTE_UNUSED)
     return ret;
 }
 
+static void
+testFirewallRestoreHook(const char *const*args ATTRIBUTE_UNUSED,
+                        const char *const*env ATTRIBUTE_UNUSED,
+                        const char *input,
+                        char **output ATTRIBUTE_UNUSED,
+                        char **error ATTRIBUTE_UNUSED,
+                        int *status,
+                        void *opaque)
+{
+    virBufferPtr buf = opaque;
+
+    if (!input)
+        return;
+
+    virBufferAdd(buf, input, -1);
+
+    /* Fake failure of the transaction with this IP addr */
+    if (strstr(input, "192.168.122.255"))
+        *status = 1;
+}
+
+static int
+testFirewallRestoreRollback(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virBuffer cmdbuf = VIR_BUFFER_INITIALIZER;
+    virFirewallPtr fw = NULL;
+    int ret = -1;
+    const char *actual = NULL;
+    const char *expected =
+        IPTABLES_RESTORE_PATH " --noflush\n"
+        "*filter\n"
+        "-A INPUT --source-host 192.168.122.1 --jump ACCEPT\n"
+        "-A INPUT --source-host 192.168.122.127 --jump ACCEPT\n"
+        "COMMIT\n"
+        IPTABLES_PATH " -D INPUT --jump DROP\n"
+        IPTABLES_RESTORE_PATH " --noflush\n"
+        "*filter\n"
+        "-A OUTPUT --source-host 192.168.122.1 --jump ACCEPT\n"
+        "COMMIT\n"
+        "*nat\n"
+        "-A POSTROUTING --source 192.168.122.255 --jump MASQUERADE\n"
+        "COMMIT\n"
+        IPTABLES_PATH " -D INPUT --source-host 192.168.122.1 --jump ACCEPT\n"
+        IPTABLES_PATH " -D INPUT --source-host 192.168.122.127 --jump ACCEPT\n"
+        IPTABLES_PATH " -D OUTPUT --source-host 192.168.122.1 --jump ACCEPT\n"
+        IPTABLES_PATH " --table nat -D POSTROUTING --source 192.168.122.255 "
+        "--jump MASQUERADE\n";
+
+    fwDisabled = true;
+    if (virFirewallSetBackend(VIR_FIREWALL_BACKEND_RESTORE) < 0)
+        goto cleanup;
+
+    virCommandSetDryRun(&cmdbuf, testFirewallRestoreHook, &cmdbuf);
+
+    fw = virFirewallNew();
+
+    virFirewallStartTransaction(fw, 0);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-A", "INPUT",
+                       "--source-host", "192.168.122.1",
+                       "--jump", "ACCEPT", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-A", "INPUT",
+                       "--source-host", "192.168.122.127",
+                       "--jump", "ACCEPT", NULL);
+
+    virFirewallStartRollback(fw, 0);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-D", "INPUT",
+                       "--source-host", "192.168.122.1",
+                       "--jump", "ACCEPT", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-D", "INPUT",
+                       "--source-host", "192.168.122.127",
+                       "--jump", "ACCEPT", NULL);
+
+    virFirewallStartTransaction(fw, 0);
+
+    /* Must be applied on its own, after the rules batched before */
+    virFirewallAddRuleFull(fw, VIR_FIREWALL_LAYER_IPV4,
+                           true, NULL, NULL,
+                           "-D", "INPUT",
+                           "--jump", "DROP", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-A", "OUTPUT",
+                       "--source-host", "192.168.122.1",
+                       "--jump", "ACCEPT", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "--table", "nat",
+                       "-A", "POSTROUTING",
+                       "--source", "192.168.122.255",
+                       "--jump", "MASQUERADE", NULL);
+
+    virFirewallStartRollback(fw, VIR_FIREWALL_ROLLBACK_INHERIT_PREVIOUS);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-D", "OUTPUT",
+                       "--source-host", "192.168.122.1",
+                       "--jump", "ACCEPT", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "--table", "nat",
+                       "-D", "POSTROUTING",
+                       "--source", "192.168.122.255",
+                       "--jump", "MASQUERADE", NULL);
+
+    if (virFirewallApply(fw) == 0) {
+        fprintf(stderr, "Firewall apply unexpectedly worked\n");
+        goto cleanup;
+    }
+
+    if (virTestOOMActive())
+        goto cleanup;
+
+    if (virBufferError(&cmdbuf))
+        goto cleanup;
+
+    actual = virBufferCurrentContent(&cmdbuf);
+
+    if (STRNEQ_NULLABLE(expected, actual)) {
+        fprintf(stderr, "Unexected command execution\n");
+        virTestDifference(stderr, expected, actual);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virBufferFreeAndReset(&cmdbuf);
+    virCommandSetDryRun(NULL, NULL, NULL);
+    virFirewallFree(fw);
+    return ret;
+}
+
 static bool
 hasNetfilterTools(void)
 {
@@ -1131,6 +1270,14 @@ hasNetfilterTools(void)
         virFileIsExecutable(EBTABLES_PATH);
 }
 
+static bool
+hasNetfilterRestoreTools(void)
+{
+    return virFileIsExecutable(IPTABLES_RESTORE_PATH) &&
+        virFileIsExecutable(IP6TABLES_RESTORE_PATH) &&
+        virFileIsExecutable(EBTABLES_RESTORE_PATH);
+}
+
 static int
 mymain(void)
 {
@@ -1193,6 +1340,10 @@ mymain(void)
     RUN_TEST("chained rollback", testFirewallChainedRollback);
     RUN_TEST("query transaction", testFirewallQuery);
 
+    if (hasNetfilterRestoreTools() &&
+        virTestRun("restore rollback", testFirewallRestoreRollback, NULL) < 0)
+        ret = -1;
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -8,6 +8,7 @@
 #include "testutils.h"
 #include "internal.h"
 #include "virhostcpupriv.h"
+#include "virhoststats.h"
 #include "virfile.h"
 #include "virstring.h"
 #include "virfilewrapper.h"
@@ -156,6 +157,65 @@ linuxCPUStatsCompareFiles(const char *cpustatfile,
 }
 
 
+static int
+linuxCPUStatsSnapshotCompareFiles(const char *cpustatfile,
+                                  size_t ncpus,
+                                  const char *outfile)
+{
+    int ret = -1;
+    char *actualData = NULL;
+    FILE *cpustat = NULL;
+    virHostStatsSnapshotPtr snapshot = NULL;
+    virNodeCPUStats params[LINUX_NB_CPU_STATS];
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    int nparams = LINUX_NB_CPU_STATS;
+    size_t i;
+
+    if (!(cpustat = fopen(cpustatfile, "r"))) {
+        virReportSystemError(errno, "failed to open '%s': ", cpustatfile);
+        goto fail;
+    }
+
+    if (!(snapshot = virHostStatsSnapshotNew(cpustat, NULL, NULL, 0, NULL, 0)))
+        goto fail;
+
+    /* The stats must be exactly the same as those read directly */
+    if (virHostStatsSnapshotGetCPU(snapshot, VIR_NODE_CPU_STATS_ALL_CPUS,
+                                   params, &nparams) != 1)
+        goto fail;
+
+    linuxCPUStatsToBuf(&buf, VIR_NODE_CPU_STATS_ALL_CPUS, params, nparams);
+
+    for (i = 0; i < ncpus; i++) {
+        if (virHostStatsSnapshotGetCPU(snapshot, i, params, &nparams) != 1)
+            goto fail;
+        linuxCPUStatsToBuf(&buf, i, params, nparams);
+    }
+
+    if (virHostStatsSnapshotGetCPU(snapshot, ncpus, params, &nparams) != 0) {
+        VIR_TEST_VERBOSE("unexpected stats for CPU %zu\n", ncpus);
+        goto fail;
+    }
+
+    if (!(actualData = virBufferContentAndReset(&buf))) {
+        virReportOOMError();
+        goto fail;
+    }
+
+    if (virTestCompareToFile(actualData, outfile) < 0)
+        goto fail;
+
+    ret = 0;
+
+ fail:
+    virBufferFreeAndReset(&buf);
+    VIR_FORCE_FCLOSE(cpustat);
+    VIR_FREE(actualData);
+    virObjectUnref(snapshot);
+    return ret;
+}
+
+
 struct linuxTestHostCPUData {
     const char *testName;
     virArch arch;
@@ -221,6 +281,191 @@ linuxTestNodeCPUStats(const void *data)
 }
 
 
+static int
+linuxTestNodeCPUStatsSnapshot(const void *data)
+{
+    const struct nodeCPUStatsData *testData = data;
+    int result = -1;
+    char *cpustatfile = NULL;
+    char *outfile = NULL;
+
+    if (virAsprintf(&cpustatfile, "%s/virhostcpudata/linux-cpustat-%s.stat",
+                    abs_srcdir, testData->name) < 0 ||
+        virAsprintf(&outfile, "%s/virhostcpudata/linux-cpustat-%s.out",
+                    abs_srcdir, testData->name) < 0)
+        goto fail;
+
+    result = linuxCPUStatsSnapshotCompareFiles(cpustatfile,
+                                               testData->ncpus,
+                                               outfile);
+ fail:
+    VIR_FREE(cpustatfile);
+    VIR_FREE(outfile);
+    return result;
+}
+
+
+/* The snapshot must report the same number of parameters as the direct
+ * path, since callers size their arrays by asking either of them */
+static int
+linuxTestNodeCPUStatsNparams(const void *data ATTRIBUTE_UNUSED)
+{
+    const char *procstat =
+        "cpu  100 0 100 800 0 0 0 0 0 0\n"
+        "cpu0 50 0 50 400 0 0 0 0 0 0\n";
+    virHostStatsSnapshotPtr snapshot = NULL;
+    virNodeCPUStats params[LINUX_NB_CPU_STATS + 1];
+    FILE *fp = NULL;
+    int direct = 0;
+    int nparams = 0;
+    int ret = -1;
+
+    if (!(fp = fmemopen((void *)procstat, strlen(procstat), "r")) ||
+        !(snapshot = virHostStatsSnapshotNew(fp, NULL, NULL, 0, NULL, 0)))
+        goto cleanup;
+
+    if (virHostCPUGetStatsLinux(NULL, 0, NULL, &direct) < 0 ||
+        virHostStatsSnapshotGetCPU(snapshot, 0, NULL, &nparams) != 1)
+        goto cleanup;
+
+    if (nparams != direct) {
+        VIR_TEST_VERBOSE("expected %d parameters, got %d\n", direct, nparams);
+        goto cleanup;
+    }
+
+    /* Asking for more than the direct path supports must fail too */
+    nparams = LINUX_NB_CPU_STATS + 1;
+    if (virHostStatsSnapshotGetCPU(snapshot, 0, params, &nparams) >= 0) {
+        VIR_TEST_VERBOSE("accepted %d parameters\n", nparams);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FORCE_FCLOSE(fp);
+    virObjectUnref(snapshot);
+    return ret;
+}
+
+
+static virHostStatsSnapshotPtr
+linuxCPUStatsSnapshotFromString(const char *procstat,
+                                virHostStatsSnapshotPtr prev,
+                                unsigned long long timestamp)
+{
+    virHostStatsSnapshotPtr snapshot;
+    FILE *fp;
+
+    if (!(fp = fmemopen((void *)procstat, strlen(procstat), "r")))
+        return NULL;
+
+    snapshot = virHostStatsSnapshotNew(fp, NULL, NULL, 0, prev, timestamp);
+    VIR_FORCE_FCLOSE(fp);
+    return snapshot;
+}
+
+
+static int
+linuxTestNodeCPUStatsRates(const void *data ATTRIBUTE_UNUSED)
+{
+    const char *first =
+        "cpu  100 0 100 800 0 0 0 0 0 0\n"
+        "cpu0 50 0 50 400 0 0 0 0 0 0\n"
+        "cpu1 50 0 50 400 0 0 0 0 0 0\n";
+    const char *second =
+        "cpu  250 0 250 900 0 0 0 0 0 0\n"
+        "cpu0 200 0 200 400 0 0 0 0 0 0\n"
+        "cpu1 50 0 50 500 0 0 0 0 0 0\n";
+    const struct {
+        int cpuNum;
+        unsigned int utilization;
+    } expected[] = {
+        { VIR_NODE_CPU_STATS_ALL_CPUS, 75 },
+        { 0, 100 },
+        { 1, 0 },
+    };
+    virHostStatsSnapshotPtr prev = NULL;
+    virHostStatsSnapshotPtr snapshot = NULL;
+    virNodeCPUStats before[LINUX_NB_CPU_STATS];
+    virNodeCPUStats after[LINUX_NB_CPU_STATS];
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    int maxparams = 0;
+    int ncounters;
+    char *name = NULL;
+    size_t i;
+    size_t j;
+    int ret = -1;
+
+    /* Two snapshots taken a second apart, so the rates are equal to the
+     * differences of the counters */
+    if (!(prev = linuxCPUStatsSnapshotFromString(first, NULL, 1000)) ||
+        !(snapshot = linuxCPUStatsSnapshotFromString(second, prev, 2000)))
+        goto cleanup;
+
+    /* Rates are unknown without a previous snapshot */
+    if (virHostStatsSnapshotGetCPURates(prev, 0, &params,
+                                        &nparams, &maxparams) != 0 ||
+        nparams != 0) {
+        VIR_TEST_VERBOSE("rates reported for the first snapshot\n");
+        goto cleanup;
+    }
+
+    for (i = 0; i < ARRAY_CARDINALITY(expected); i++) {
+        unsigned int utilization;
+        unsigned long long rate;
+
+        ncounters = LINUX_NB_CPU_STATS;
+        if (virHostStatsSnapshotGetCPU(prev, expected[i].cpuNum,
+                                       before, &ncounters) != 1 ||
+            virHostStatsSnapshotGetCPU(snapshot, expected[i].cpuNum,
+                                       after, &ncounters) != 1)
+            goto cleanup;
+
+        virTypedParamsFree(params, nparams);
+        params = NULL;
+        nparams = maxparams = 0;
+
+        if (virHostStatsSnapshotGetCPURates(snapshot, expected[i].cpuNum,
+                                            &params, &nparams,
+                                            &maxparams) != 1)
+            goto cleanup;
+
+        for (j = 0; j < LINUX_NB_CPU_STATS; j++) {
+            if (virAsprintf(&name, "%s.rate", after[j].field) < 0)
+                goto cleanup;
+
+            if (virTypedParamsGetULLong(params, nparams, name, &rate) != 1 ||
+                rate != after[j].value - before[j].value) {
+                VIR_TEST_VERBOSE("CPU %d: unexpected %s\n",
+                                 expected[i].cpuNum, name);
+                goto cleanup;
+            }
+            VIR_FREE(name);
+        }
+
+        if (virTypedParamsGetUInt(params, nparams,
+                                  VIR_NODE_CPU_STATS_UTILIZATION,
+                                  &utilization) != 1 ||
+            utilization != expected[i].utilization) {
+            VIR_TEST_VERBOSE("CPU %d: expected utilization %u\n",
+                             expected[i].cpuNum, expected[i].utilization);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(name);
+    virTypedParamsFree(params, nparams);
+    virObjectUnref(prev);
+    virObjectUnref(snapshot);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -260,10 +505,19 @@ mymain(void)
         static struct nodeCPUStatsData data = { name, ncpus }; \
         if (virTestRun("CPU stats " name, linuxTestNodeCPUStats, &data) < 0) \
             ret = -1; \
+        if (virTestRun("CPU stats snapshot " name, \
+                       linuxTestNodeCPUStatsSnapshot, &data) < 0) \
+            ret = -1; \
     } while (0)
 
     DO_TEST_CPU_STATS("24cpu", 24);
 
+    if (virTestRun("CPU stats nparams", linuxTestNodeCPUStatsNparams, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("CPU stats rates", linuxTestNodeCPUStatsRates, NULL) < 0)
+        ret = -1;
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -6,7 +6,10 @@
 #include <time.h>
 
 #include "internal.h"
+#include "virbuffer.h"
 #include "virjson.h"
+#include "virstring.h"
+#include "virtime.h"
 #include "testutils.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
@@ -15,6 +18,7 @@ struct testInfo {
     const char *doc;
     const char *expect;
     bool pass;
+    const char *const *filter;
 };
 
 
@@ -429,6 +433,390 @@ testJSONEscapeObj(const void *data ATTRIBUTE_UNUSED)
 }
 
 
+static int
+testJSONFromStringFiltered(const void *data)
+{
+    const struct testInfo *info = data;
+    virJSONValuePtr json;
+    char *formatted = NULL;
+    int ret = -1;
+
+    if (!(json = virJSONValueFromStringFiltered(info->doc, info->filter))) {
+        VIR_TEST_VERBOSE("Fail to parse %s\n", info->doc);
+        goto cleanup;
+    }
+
+    if (!(formatted = virJSONValueToString(json, false))) {
+        VIR_TEST_VERBOSE("Failed to format json data\n");
+        goto cleanup;
+    }
+
+    if (STRNEQ(info->expect, formatted)) {
+        virTestDifference(stderr, info->expect, formatted);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(formatted);
+    virJSONValueFree(json);
+    return ret;
+}
+
+
+#define FILTER_DEVICES 500
+#define FILTER_CHAIN 8
+
+/* Mimics a query-block reply on a guest with many disks, each of them
+ * having a long backing chain */
+static char *
+testJSONBuildBlockReply(void)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    size_t i;
+    size_t j;
+
+    virBufferAddLit(&buf, "{\"return\": [");
+    for (i = 0; i < FILTER_DEVICES; i++) {
+        virBufferAsprintf(&buf, "%s{\"device\": \"drive-virtio-disk%zu\", "
+                          "\"locked\": false, \"removable\": false, "
+                          "\"type\": \"unknown\", \"io-status\": \"ok\", "
+                          "\"inserted\": {\"node-name\": \"#block%zu\", "
+                          "\"bps\": 0, \"iops\": 0, \"ro\": false, "
+                          "\"drv\": \"qcow2\", \"encrypted\": false, "
+                          "\"file\": \"/var/lib/libvirt/images/disk%zu.qcow2\", "
+                          "\"image\": ", i ? ", " : "", i, i, i);
+        for (j = 0; j < FILTER_CHAIN; j++)
+            virBufferAsprintf(&buf, "{\"virtual-size\": 10737418240, "
+                              "\"filename\": \"/var/lib/libvirt/images/disk%zu.%zu\", "
+                              "\"cluster-size\": 65536, \"format\": \"qcow2\", "
+                              "\"actual-size\": 200704, \"dirty-flag\": false, "
+                              "\"format-specific\": {\"type\": \"qcow2\", "
+                              "\"data\": {\"compat\": \"1.1\", "
+                              "\"lazy-refcounts\": false, "
+                              "\"refcount-bits\": 16, \"corrupt\": false}}%s",
+                              i, j, j + 1 < FILTER_CHAIN ? ", \"backing-image\": " : "");
+        for (j = 0; j < FILTER_CHAIN; j++)
+            virBufferAddChar(&buf, '}');
+        virBufferAddLit(&buf, "}}");
+    }
+    virBufferAddLit(&buf, "], \"id\": \"libvirt-42\"}");
+
+    if (virBufferCheckError(&buf) < 0)
+        return NULL;
+
+    return virBufferContentAndReset(&buf);
+}
+
+
+static int
+testJSONFilterBenchmark(const void *data ATTRIBUTE_UNUSED)
+{
+    const char *filter[] = { "return.device", "return.io-status",
+                             "return.inserted.node-name", NULL };
+    virJSONValuePtr full = NULL;
+    virJSONValuePtr filtered = NULL;
+    virJSONValuePtr devices;
+    char *reply = NULL;
+    unsigned long long start;
+    unsigned long long mid;
+    unsigned long long end;
+    size_t i;
+    int ret = -1;
+
+    if (!(reply = testJSONBuildBlockReply()))
+        goto cleanup;
+
+    if (virTimeMillisNow(&start) < 0 ||
+        !(full = virJSONValueFromString(reply)) ||
+        virTimeMillisNow(&mid) < 0 ||
+        !(filtered = virJSONValueFromStringFiltered(reply, filter)) ||
+        virTimeMillisNow(&end) < 0)
+        goto cleanup;
+
+    VIR_TEST_DEBUG("%zu byte reply parsed in %llu ms, filtered in %llu ms\n",
+                   strlen(reply), mid - start, end - mid);
+
+    if (!(devices = virJSONValueObjectGetArray(filtered, "return")) ||
+        virJSONValueArraySize(devices) != FILTER_DEVICES ||
+        !virJSONValueObjectHasKey(filtered, "id"))
+        goto cleanup;
+
+    for (i = 0; i < FILTER_DEVICES; i++) {
+        virJSONValuePtr dev = virJSONValueArrayGet(devices, i);
+        virJSONValuePtr inserted = virJSONValueObjectGetObject(dev, "inserted");
+
+        if (virJSONValueObjectKeysNumber(dev) != 3 ||
+            !virJSONValueObjectGetString(dev, "device") ||
+            !inserted ||
+            virJSONValueObjectKeysNumber(inserted) != 1 ||
+            !virJSONValueObjectGetString(inserted, "node-name")) {
+            VIR_TEST_VERBOSE("unexpected members of device %zu\n", i);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    virJSONValueFree(full);
+    virJSONValueFree(filtered);
+    VIR_FREE(reply);
+    return ret;
+}
+
+
+static int
+testJSONNumbers(const void *data ATTRIBUTE_UNUSED)
+{
+    virJSONValuePtr json = NULL;
+    virJSONValuePtr tmp = NULL;
+    virJSONValuePtr copy = NULL;
+    char *str = NULL;
+    unsigned long long ul;
+    unsigned int ui;
+    long long l;
+    double d;
+    int i;
+    size_t n;
+    int ret = -1;
+
+    if (!(json = virJSONValueFromString("[-1, 4294967296, 1.5, 42]")))
+        goto cleanup;
+
+    /* every getter runs twice so that the cached value gets used too */
+    for (n = 0; n < 2; n++) {
+        tmp = virJSONValueArrayGet(json, 0);
+        if (virJSONValueGetNumberUlong(tmp, &ul) < 0 || ul != ULLONG_MAX ||
+            virJSONValueGetNumberUint(tmp, &ui) < 0 || ui != UINT_MAX ||
+            virJSONValueGetNumberLong(tmp, &l) < 0 || l != -1 ||
+            virJSONValueGetNumberInt(tmp, &i) < 0 || i != -1) {
+            VIR_TEST_VERBOSE("unexpected conversion of -1\n");
+            goto cleanup;
+        }
+
+        tmp = virJSONValueArrayGet(json, 1);
+        if (virJSONValueGetNumberInt(tmp, &i) == 0 ||
+            virJSONValueGetNumberUint(tmp, &ui) == 0 ||
+            virJSONValueGetNumberUlong(tmp, &ul) < 0 || ul != 4294967296ULL) {
+            VIR_TEST_VERBOSE("unexpected conversion of 4294967296\n");
+            goto cleanup;
+        }
+
+        tmp = virJSONValueArrayGet(json, 2);
+        if (virJSONValueGetNumberLong(tmp, &l) == 0 ||
+            virJSONValueGetNumberDouble(tmp, &d) < 0 || d != 1.5) {
+            VIR_TEST_VERBOSE("unexpected conversion of 1.5\n");
+            goto cleanup;
+        }
+    }
+
+    /* native numbers are formatted only when needed */
+    if (virJSONValueArrayAppend(json, virJSONValueNewNumberLong(-7)) < 0 ||
+        virJSONValueArrayAppend(json, virJSONValueNewNumberUlong(ULLONG_MAX)) < 0 ||
+        virJSONValueArrayAppend(json, virJSONValueNewNumberDouble(0.5)) < 0)
+        goto cleanup;
+
+    if (virJSONValueGetNumberUint(virJSONValueArrayGet(json, 4), &ui) < 0 ||
+        ui != UINT_MAX - 6) {
+        VIR_TEST_VERBOSE("unexpected conversion of -7\n");
+        goto cleanup;
+    }
+
+    if (!(copy = virJSONValueCopy(json)) ||
+        !(str = virJSONValueToString(copy, false)))
+        goto cleanup;
+
+    if (STRNEQ(str, "[-1,4294967296,1.5,42,-7,18446744073709551615,0.500000]")) {
+        virTestDifference(stderr,
+                          "[-1,4294967296,1.5,42,-7,18446744073709551615,0.500000]",
+                          str);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(str);
+    virJSONValueFree(json);
+    virJSONValueFree(copy);
+    return ret;
+}
+
+
+#define LARGE_OBJECT_KEYS 10000
+
+static int
+testJSONLargeObject(const void *data ATTRIBUTE_UNUSED)
+{
+    virJSONValuePtr json = NULL;
+    unsigned long long start;
+    unsigned long long end;
+    unsigned long long val;
+    char key[32];
+    bool b;
+    size_t i;
+    int ret = -1;
+
+    if (!(json = virJSONValueNewObject()))
+        goto cleanup;
+
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+
+    for (i = 0; i < LARGE_OBJECT_KEYS; i++) {
+        snprintf(key, sizeof(key), "key%zu", i);
+        if (virJSONValueObjectAppendNumberUlong(json, key, i) < 0)
+            goto cleanup;
+    }
+
+    for (i = 0; i < LARGE_OBJECT_KEYS; i++) {
+        snprintf(key, sizeof(key), "key%zu", i);
+        if (virJSONValueObjectGetNumberUlong(json, key, &val) < 0 ||
+            val != i) {
+            VIR_TEST_VERBOSE("lookup of '%s' failed\n", key);
+            goto cleanup;
+        }
+    }
+
+    if (virTimeMillisNow(&end) < 0)
+        goto cleanup;
+
+    VIR_TEST_DEBUG("%d appends and lookups took %llu ms\n",
+                   LARGE_OBJECT_KEYS, end - start);
+
+    /* removal shifts the remaining keys */
+    if (virJSONValueObjectRemoveKey(json, "key0", NULL) != 1 ||
+        virJSONValueObjectRemoveKey(json, "key0", NULL) != 0 ||
+        virJSONValueObjectAppendBoolean(json, "key0", true) < 0 ||
+        virJSONValueObjectAppendBoolean(json, "key1", true) == 0 ||
+        virJSONValueObjectGetNumberUlong(json, "key5000", &val) < 0 ||
+        val != 5000 ||
+        virJSONValueObjectGetBoolean(json, "key0", &b) < 0 || !b) {
+        VIR_TEST_VERBOSE("unexpected result after key removal\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virJSONValueFree(json);
+    return ret;
+}
+
+
+static int
+testJSONWalk(virJSONValuePtr json,
+             size_t *nvalues)
+{
+    unsigned long long ul;
+    size_t i;
+
+    (*nvalues)++;
+
+    switch ((virJSONType) json->type) {
+    case VIR_JSON_TYPE_OBJECT:
+        for (i = 0; i < virJSONValueObjectKeysNumber(json); i++) {
+            const char *key = virJSONValueObjectGetKey(json, i);
+
+            if (virJSONValueObjectGet(json, key) !=
+                virJSONValueObjectGetValue(json, i))
+                return -1;
+
+            if (testJSONWalk(virJSONValueObjectGetValue(json, i), nvalues) < 0)
+                return -1;
+        }
+        break;
+
+    case VIR_JSON_TYPE_ARRAY:
+        for (i = 0; i < virJSONValueArraySize(json); i++) {
+            if (testJSONWalk(virJSONValueArrayGet(json, i), nvalues) < 0)
+                return -1;
+        }
+        break;
+
+    case VIR_JSON_TYPE_NUMBER:
+        ignore_value(virJSONValueGetNumberUlong(json, &ul));
+        ignore_value(virJSONValueGetNumberUlong(json, &ul));
+        break;
+
+    case VIR_JSON_TYPE_STRING:
+    case VIR_JSON_TYPE_BOOLEAN:
+    case VIR_JSON_TYPE_NULL:
+        break;
+    }
+
+    return 0;
+}
+
+
+static int
+testJSONReplies(const void *data)
+{
+    const struct testInfo *info = data;
+    virJSONValuePtr json = NULL;
+    char *file = NULL;
+    char *replies = NULL;
+    char *reply;
+    char *next;
+    char *str = NULL;
+    size_t nreplies = 0;
+    size_t nvalues = 0;
+    unsigned long long start;
+    unsigned long long end;
+    int ret = -1;
+
+    if (virAsprintf(&file, "%s/qemucapabilitiesdata/%s.replies",
+                    abs_srcdir, info->doc) < 0)
+        goto cleanup;
+
+    if (virTestLoadFile(file, &replies) < 0)
+        goto cleanup;
+
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+
+    for (reply = replies; reply && *reply; reply = next) {
+        if ((next = strstr(reply, "\n\n"))) {
+            *next = '\0';
+            next += 2;
+        }
+
+        if (!(json = virJSONValueFromString(reply)))
+            goto cleanup;
+
+        if (testJSONWalk(json, &nvalues) < 0) {
+            VIR_TEST_VERBOSE("inconsistent object in reply %zu\n", nreplies);
+            goto cleanup;
+        }
+
+        if (!(str = virJSONValueToString(json, false)))
+            goto cleanup;
+
+        VIR_FREE(str);
+        virJSONValueFree(json);
+        json = NULL;
+        nreplies++;
+    }
+
+    if (virTimeMillisNow(&end) < 0)
+        goto cleanup;
+
+    VIR_TEST_DEBUG("%zu replies with %zu values parsed, walked and "
+                   "formatted in %llu ms\n", nreplies, nvalues, end - start);
+
+    ret = 0;
+
+ cleanup:
+    virJSONValueFree(json);
+    VIR_FREE(str);
+    VIR_FREE(replies);
+    VIR_FREE(file);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -436,7 +824,7 @@ mymain(void)
 
 #define DO_TEST_FULL(name, cmd, doc, expect, pass)                  \
     do {                                                            \
-        struct testInfo info = { doc, expect, pass };               \
+        struct testInfo info = { doc, expect, pass, NULL };         \
         if (virTestRun(name, testJSON ## cmd, &info) < 0)           \
             ret = -1;                                               \
     } while (0)
@@ -603,6 +991,39 @@ mymain(void)
     DO_TEST_DEFLATTEN("concat-double-key", false);
     DO_TEST_DEFLATTEN("qemu-sheepdog", true);
 
+#define DO_TEST_FILTER(name, doc, expect, ...)                      \
+    do {                                                            \
+        const char *filter[] = { __VA_ARGS__, NULL };               \
+        struct testInfo info = { doc, expect, true, filter };       \
+        if (virTestRun(name, testJSONFromStringFiltered, &info) < 0) \
+            ret = -1;                                               \
+    } while (0)
+
+    DO_TEST_FILTER("filter array members",
+                   "{\"return\": [{\"a\": 1, \"b\": {\"c\": [2], \"d\": 3}},"
+                   " {\"a\": 4, \"e\": null}], \"id\": \"libvirt-1\"}",
+                   "{\"return\":[{\"a\":1,\"b\":{\"d\":3}},{\"a\":4}],"
+                   "\"id\":\"libvirt-1\"}",
+                   "return.a", "return.b.d");
+    DO_TEST_FILTER("filter keeps whole subtree",
+                   "{\"return\": {\"x\": {\"y\": [1, {\"z\": true}]}, \"w\": 1}}",
+                   "{\"return\":{\"x\":{\"y\":[1,{\"z\":true}]}}}",
+                   "return.x");
+    DO_TEST_FILTER("filter leaves other replies alone",
+                   "{\"error\": {\"class\": \"GenericError\", \"desc\": \"x\"}}",
+                   "{\"error\":{\"class\":\"GenericError\",\"desc\":\"x\"}}",
+                   "return.device");
+    DO_TEST_FILTER("filter on events",
+                   "{\"event\": \"STOP\", \"data\": {\"reason\": \"x\"}}",
+                   "{\"event\":\"STOP\",\"data\":{\"reason\":\"x\"}}",
+                   "return.device");
+    DO_TEST_FULL("filter benchmark", FilterBenchmark, NULL, NULL, true);
+
+    DO_TEST_FULL("numbers", Numbers, NULL, NULL, true);
+    DO_TEST_FULL("large object", LargeObject, NULL, NULL, true);
+    DO_TEST_FULL("qemu 2.9.0 replies", Replies,
+                 "caps_2.9.0.x86_64", NULL, true);
+
     return (ret == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) 2017 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <arpa/inet.h>
+
+#include "testutils.h"
+#include "virbuffer.h"
+#include "virfile.h"
+#include "virleaseindex.h"
+#include "virstring.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+static const char *virbr0Status =
+    "[\n"
+    "  {\n"
+    "    \"ip-address\": \"192.168.122.10\",\n"
+    "    \"mac-address\": \"aa:bb:cc:dd:ee:ff\",\n"
+    "    \"hostname\": \"guest1\",\n"
+    "    \"expiry-time\": 4102444800\n"
+    "  },\n"
+    "  {\n"
+    "    \"ip-address\": \"192.168.122.11\",\n"
+    "    \"mac-address\": \"00:11:22:33:44:55\",\n"
+    "    \"hostname\": \"guest2\",\n"
+    "    \"expiry-time\": 1000\n"
+    "  }\n"
+    "]\n";
+
+static const char *virbr1Status =
+    "[\n"
+    "  {\n"
+    "    \"ip-address\": \"fd00::10\",\n"
+    "    \"mac-address\": \"a1:b2:c3:d4:e5:f6\",\n"
+    "    \"hostname\": \"guest1\",\n"
+    "    \"expiry-time\": 4102444800\n"
+    "  },\n"
+    "  {\n"
+    "    \"ip-address\": \"10.0.0.5\",\n"
+    "    \"mac-address\": \"aa:bb:cc:dd:ee:ff\",\n"
+    "    \"expiry-time\": 4102444800\n"
+    "  }\n"
+    "]\n";
+
+static const char *virbr0Macs =
+    "[\n"
+    "  {\n"
+    "    \"domain\": \"f24\",\n"
+    "    \"macs\": [\n"
+    "      \"aa:bb:cc:dd:ee:ff\",\n"
+    "      \"a1:b2:c3:d4:e5:f6\"\n"
+    "    ]\n"
+    "  },\n"
+    "  {\n"
+    "    \"domain\": \"f25\",\n"
+    "    \"macs\": [\n"
+    "      \"00:11:22:33:44:55\"\n"
+    "    ]\n"
+    "  }\n"
+    "]\n";
+
+
+struct testLookupData {
+    const char *dir;
+    virLeaseIndexKey key;
+    const char *name;
+    const char *expect;
+};
+
+
+static int
+testLookup(const void *opaque)
+{
+    const struct testLookupData *data = opaque;
+    virLeaseIndexPtr idx = NULL;
+    const virLeaseIndexRecord *records;
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    char *actual = NULL;
+    size_t nrecords;
+    size_t i;
+    int ret = -1;
+
+    if (!(idx = virLeaseIndexOpen(data->dir)))
+        goto cleanup;
+
+    nrecords = virLeaseIndexLookup(idx, data->key, data->name, &records);
+
+    for (i = 0; i < nrecords; i++) {
+        char addr[INET6_ADDRSTRLEN];
+
+        if (!inet_ntop(records[i].family, records[i].addr,
+                       addr, sizeof(addr)))
+            goto cleanup;
+
+        virBufferAsprintf(&buf, "%s%s", i ? "," : "", addr);
+    }
+
+    if (virBufferCheckError(&buf) < 0)
+        goto cleanup;
+
+    actual = virBufferContentAndReset(&buf);
+
+    if (STRNEQ(actual ? actual : "", data->expect)) {
+        virFilePrintf(stderr, "Expected '%s', got '%s'\n",
+                      data->expect, actual ? actual : "");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virBufferFreeAndReset(&buf);
+    VIR_FREE(actual);
+    virLeaseIndexFree(idx);
+    return ret;
+}
+
+
+static int
+testCorrupt(const void *opaque)
+{
+    const char *dir = opaque;
+    virLeaseIndexPtr idx = NULL;
+    char *path = NULL;
+    int ret = -1;
+
+    if (virAsprintf(&path, "%s/%s", dir, VIR_LEASE_INDEX_FILE) < 0)
+        goto cleanup;
+
+    if (truncate(path, 20) < 0)
+        goto cleanup;
+
+    if ((idx = virLeaseIndexOpen(dir))) {
+        virFilePrintf(stderr, "Truncated index was accepted\n");
+        goto cleanup;
+    }
+
+    if (unlink(path) < 0)
+        goto cleanup;
+
+    if ((idx = virLeaseIndexOpen(dir))) {
+        virFilePrintf(stderr, "Missing index was opened\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virLeaseIndexFree(idx);
+    VIR_FREE(path);
+    return ret;
+}
+
+
+static int
+testWriteFile(const char *dir,
+              const char *name,
+              const char *content)
+{
+    char *path = NULL;
+    int ret;
+
+    if (virAsprintf(&path, "%s/%s", dir, name) < 0)
+        return -1;
+
+    ret = virFileWriteStr(path, content, 0644);
+    VIR_FREE(path);
+    return ret;
+}
+
+
+#define SCRATCHDIRTEMPLATE abs_builddir "/virleaseindexdir-XXXXXX"
+
+static int
+mymain(void)
+{
+    char scratchdir[] = SCRATCHDIRTEMPLATE;
+    int ret = 0;
+
+    if (!mkdtemp(scratchdir)) {
+        virFilePrintf(stderr, "Cannot create virleaseindexdir");
+        abort();
+    }
+
+    if (testWriteFile(scratchdir, "virbr0.status", virbr0Status) < 0 ||
+        testWriteFile(scratchdir, "virbr1.status", virbr1Status) < 0 ||
+        testWriteFile(scratchdir, "virbr0.macs", virbr0Macs) < 0 ||
+        virLeaseIndexRebuild(scratchdir) < 0) {
+        ret = -1;
+        goto cleanup;
+    }
+
+#define DO_TEST(key, name, expect)                                      \
+    do {                                                                \
+        struct testLookupData data = { scratchdir, key, name, expect }; \
+        if (virTestRun("lookup " #key " " name,                         \
+                       testLookup, &data) < 0)                          \
+            ret = -1;                                                   \
+    } while (0)
+
+    DO_TEST(VIR_LEASE_INDEX_HOSTNAME, "guest1", "192.168.122.10,fd00::10");
+    DO_TEST(VIR_LEASE_INDEX_HOSTNAME, "guest2", "192.168.122.11");
+    DO_TEST(VIR_LEASE_INDEX_HOSTNAME, "guest3", "");
+    DO_TEST(VIR_LEASE_INDEX_HOSTNAME, "f24", "");
+    DO_TEST(VIR_LEASE_INDEX_DOMAIN, "f24", "10.0.0.5,192.168.122.10,fd00::10");
+    DO_TEST(VIR_LEASE_INDEX_DOMAIN, "f25", "192.168.122.11");
+    DO_TEST(VIR_LEASE_INDEX_DOMAIN, "guest1", "");
+
+    /* Removing a network's leases must be reflected on rebuild */
+    if (testWriteFile(scratchdir, "virbr1.status", "") < 0 ||
+        virLeaseIndexRebuild(scratchdir) < 0) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    DO_TEST(VIR_LEASE_INDEX_HOSTNAME, "guest1", "192.168.122.10");
+    DO_TEST(VIR_LEASE_INDEX_DOMAIN, "f24", "192.168.122.10");
+
+#undef DO_TEST
+
+    if (virTestRun("corrupt index", testCorrupt, scratchdir) < 0)
+        ret = -1;
+
+ cleanup:
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(scratchdir);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
@@ -19,9 +19,18 @@
 
 #include <config.h>
 
+#include <fcntl.h>
+
 #include "testutils.h"
 
 #include "virlog.h"
+#include "virfile.h"
+#include "virthread.h"
+#include "virtime.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("tests.virlogtest");
 
 struct testLogData {
     const char *str;
@@ -107,6 +116,140 @@ testLogParseFilters(const void *opaque)
     return ret;
 }
 
+#define TEST_LOG_THREADS 8
+#define TEST_LOG_MESSAGES 20000
+
+struct testLogOutputData {
+    size_t messages;
+    int fd;
+};
+
+static void
+testLogOutput(virLogSourcePtr source,
+              virLogPriority priority ATTRIBUTE_UNUSED,
+              const char *filename ATTRIBUTE_UNUSED,
+              int lineno ATTRIBUTE_UNUSED,
+              const char *funcname ATTRIBUTE_UNUSED,
+              const char *timestamp ATTRIBUTE_UNUSED,
+              virLogMetadataPtr metadata ATTRIBUTE_UNUSED,
+              unsigned int flags ATTRIBUTE_UNUSED,
+              const char *rawstr ATTRIBUTE_UNUSED,
+              const char *str,
+              void *data)
+{
+    struct testLogOutputData *output = data;
+
+    /* Skip the init and dropped messages logged by virlog itself */
+    if (source != &virLogSelf)
+        return;
+
+    output->messages++;
+    ignore_value(safewrite(output->fd, str, strlen(str)));
+}
+
+static void
+testLogThroughputWorker(void *opaque)
+{
+    size_t id = *(size_t *) opaque;
+    size_t i;
+
+    for (i = 0; i < TEST_LOG_MESSAGES; i++)
+        VIR_INFO("message %zu of thread %zu", i, id);
+}
+
+static int
+testLogThroughput(const void *opaque)
+{
+    bool async = *(const bool *) opaque;
+    struct testLogOutputData data = { 0, -1 };
+    virLogOutputPtr output = NULL;
+    virLogOutputPtr *outputs = NULL;
+    virThread threads[TEST_LOG_THREADS];
+    size_t ids[TEST_LOG_THREADS];
+    unsigned long long written;
+    unsigned long long dropped;
+    unsigned long long olddropped;
+    unsigned long long start;
+    unsigned long long queued;
+    unsigned long long end;
+    size_t nthreads = 0;
+    size_t i;
+    int ret = -1;
+
+    if ((data.fd = open("/dev/null", O_WRONLY)) < 0)
+        return -1;
+
+    if (!(output = virLogOutputNew(testLogOutput, NULL, &data,
+                                   VIR_LOG_INFO, VIR_LOG_TO_STDERR, NULL)) ||
+        VIR_ALLOC_N(outputs, 1) < 0) {
+        virLogOutputFree(output);
+        goto cleanup;
+    }
+    outputs[0] = output;
+
+    if (virLogDefineOutputs(outputs, 1) < 0) {
+        virLogOutputListFree(outputs, 1);
+        goto cleanup;
+    }
+
+    if (virLogDefineFilters(NULL, 0) < 0 ||
+        virLogSetDefaultPriority(VIR_LOG_INFO) < 0)
+        goto cleanup;
+
+    if (virLogSetAsync(async) < 0)
+        goto cleanup;
+
+    virLogGetAsyncStats(&written, &olddropped);
+
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+
+    for (i = 0; i < TEST_LOG_THREADS; i++) {
+        ids[i] = i;
+        if (virThreadCreate(&threads[i], true,
+                            testLogThroughputWorker, &ids[i]) < 0)
+            break;
+        nthreads++;
+    }
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+
+    if (nthreads != TEST_LOG_THREADS)
+        goto cleanup;
+
+    if (virTimeMillisNow(&queued) < 0)
+        goto cleanup;
+
+    if (virLogSetAsync(false) < 0 ||
+        virTimeMillisNow(&end) < 0)
+        goto cleanup;
+
+    virLogGetAsyncStats(&written, &dropped);
+    dropped -= olddropped;
+
+    VIR_TEST_DEBUG("%zu messages from %d threads took %llu ms "
+                   "(%llu ms until written), %zu written, %llu dropped\n",
+                   (size_t) TEST_LOG_THREADS * TEST_LOG_MESSAGES,
+                   TEST_LOG_THREADS, queued - start, end - start,
+                   data.messages, dropped);
+
+    /* Every message must either be written or accounted as dropped */
+    if (data.messages + dropped != (size_t) TEST_LOG_THREADS * TEST_LOG_MESSAGES) {
+        VIR_TEST_DEBUG("Expected %zu messages, got %zu written and "
+                       "%llu dropped\n",
+                       (size_t) TEST_LOG_THREADS * TEST_LOG_MESSAGES,
+                       data.messages, dropped);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    ignore_value(virLogSetAsync(false));
+    virLogReset();
+    VIR_FORCE_CLOSE(data.fd);
+    return ret;
+}
+
 static int
 mymain(void)
 {
@@ -151,6 +294,17 @@ mymain(void)
     TEST_PARSE_FILTERS_FAIL(":foo", 1);
     TEST_PARSE_FILTERS_FAIL("1:+", 1);
 
+#define TEST_THROUGHPUT(name, async)                                        \
+    do {                                                                    \
+        bool data = async;                                                  \
+        if (virTestRun("testLogThroughput " name,                           \
+                       testLogThroughput, &data) < 0)                       \
+            ret = -1;                                                       \
+    } while (0)
+
+    TEST_THROUGHPUT("sync", false);
+    TEST_THROUGHPUT("async", true);
+
     return ret;
 }
 
@@ -22,13 +22,18 @@
 
 #include <stdlib.h>
 #include <signal.h>
+#include <poll.h>
+#include <sys/socket.h>
 
 #include "testutils.h"
 #include "virerror.h"
 #include "viralloc.h"
 #include "virlog.h"
 #include "virstring.h"
+#include "virthread.h"
+#include "virtime.h"
 #include "rpc/virnetmessage.h"
+#include "rpc/virnetsocket.h"
 
 #define VIR_FROM_THIS VIR_FROM_RPC
 
@@ -521,11 +526,312 @@ static int testMessagePayloadStreamEncode(const void *args ATTRIBUTE_UNUSED)
     return ret;
 }
 
+/* Writes out all of @msg, waiting for the socket to drain */
+static int testMessageWrite(virNetSocketPtr sock,
+                            virNetMessagePtr msg)
+{
+    struct pollfd pfd = { .fd = virNetSocketGetFD(sock), .events = POLLOUT };
+
+    while (msg->bufferOffset < msg->bufferLength) {
+        ssize_t got = virNetSocketWriteMessage(sock, msg);
+
+        if (got < 0)
+            return -1;
+
+        if (got == 0 &&
+            poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+            virReportSystemError(errno, "%s", "poll failed");
+            return -1;
+        }
+
+        msg->bufferOffset += got;
+    }
+
+    return 0;
+}
+
+
+static int testMessagePayloadStreamEncodeRef(const void *args ATTRIBUTE_UNUSED)
+{
+    char stream[] = "The quick brown fox jumps over the lazy dog";
+    virNetMessagePtr msg = virNetMessageNew(true);
+    static const char expect[] = {
+        0x00, 0x00, 0x00, 0x47,  /* Length */
+        0x11, 0x22, 0x33, 0x44,  /* Program */
+        0x00, 0x00, 0x00, 0x01,  /* Version */
+        0x00, 0x00, 0x06, 0x66,  /* Procedure */
+        0x00, 0x00, 0x00, 0x03,  /* Type */
+        0x00, 0x00, 0x00, 0x99,  /* Serial */
+        0x00, 0x00, 0x00, 0x02,  /* Status */
+
+        'T', 'h', 'e', ' ',
+        'q', 'u', 'i', 'c',
+        'k', ' ', 'b', 'r',
+        'o', 'w', 'n', ' ',
+        'f', 'o', 'x', ' ',
+        'j', 'u', 'm', 'p',
+        's', ' ', 'o', 'v',
+        'e', 'r', ' ', 't',
+        'h', 'e', ' ', 'l',
+        'a', 'z', 'y', ' ',
+        'd', 'o', 'g',
+    };
+    char got[sizeof(expect)];
+    virNetSocketPtr sock = NULL;
+    int fds[2] = { -1, -1 };
+    int ret = -1;
+
+    if (!msg)
+        return -1;
+
+    msg->header.prog = 0x11223344;
+    msg->header.vers = 0x01;
+    msg->header.proc = 0x666;
+    msg->header.type = VIR_NET_STREAM;
+    msg->header.serial = 0x99;
+    msg->header.status = VIR_NET_CONTINUE;
+
+    if (virNetMessageEncodeHeader(msg) < 0)
+        goto cleanup;
+
+    if (virNetMessageEncodePayloadRef(msg, stream, strlen(stream)) < 0)
+        goto cleanup;
+
+    if (ARRAY_CARDINALITY(expect) != msg->bufferLength) {
+        VIR_DEBUG("Expect message length %zu got %zu",
+                  sizeof(expect), msg->bufferLength);
+        goto cleanup;
+    }
+
+    if (msg->payload != stream) {
+        VIR_DEBUG("Expect payload not to be copied");
+        goto cleanup;
+    }
+
+    /* The header is in the buffer, the payload goes out right after it */
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0 ||
+        virNetSocketNewConnectSockFD(fds[0], &sock) < 0)
+        goto cleanup;
+    fds[0] = -1;
+
+    if (testMessageWrite(sock, msg) < 0)
+        goto cleanup;
+
+    if (saferead(fds[1], got, sizeof(got)) != sizeof(got)) {
+        VIR_DEBUG("Short read of message");
+        goto cleanup;
+    }
+
+    if (memcmp(expect, got, sizeof(expect)) != 0) {
+        virTestDifferenceBin(stderr, expect, got, sizeof(expect));
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virObjectUnref(sock);
+    VIR_FORCE_CLOSE(fds[0]);
+    VIR_FORCE_CLOSE(fds[1]);
+    virNetMessageFree(msg);
+    return ret;
+}
+
+
+static int testMessagePayloadEncodeBench(const void *args ATTRIBUTE_UNUSED)
+{
+    virNetMessageError err;
+    virNetMessagePtr msg = NULL;
+    size_t len = 3 * 1024 * 1024;
+    size_t niters = virTestGetExpensive() ? 200 : 20;
+    unsigned long long start;
+    unsigned long long end;
+    size_t i;
+    int ret = -1;
+
+    memset(&err, 0, sizeof(err));
+    err.code = VIR_ERR_INTERNAL_ERROR;
+    err.domain = VIR_FROM_RPC;
+    err.level = VIR_ERR_ERROR;
+
+    /* A reply which needs a buffer far bigger than the initial one,
+     * e.g. a list of thousands of domains */
+    if (VIR_ALLOC(err.message) < 0 ||
+        VIR_ALLOC_N(*err.message, len + 1) < 0)
+        goto cleanup;
+    memset(*err.message, 'x', len);
+
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+
+    for (i = 0; i < niters; i++) {
+        if (!(msg = virNetMessageNew(true)))
+            goto cleanup;
+
+        msg->header.type = VIR_NET_MESSAGE;
+        msg->header.status = VIR_NET_ERROR;
+
+        if (virNetMessageEncodeHeader(msg) < 0 ||
+            virNetMessageEncodePayload(msg, (xdrproc_t)xdr_virNetMessageError,
+                                       &err) < 0)
+            goto cleanup;
+
+        if (msg->bufferLength < len) {
+            VIR_DEBUG("Message of %zu bytes is too short", msg->bufferLength);
+            goto cleanup;
+        }
+
+        virNetMessageFree(msg);
+        msg = NULL;
+    }
+
+    if (virTimeMillisNow(&end) < 0)
+        goto cleanup;
+
+    VIR_TEST_DEBUG("%zu encodes of %zu MiB replies: %llu ms, %.1f MiB/s\n",
+                   niters, len / (1024 * 1024), end - start,
+                   (double) niters * len / (1024 * 1024) * 1000 /
+                   MAX(end - start, 1));
+
+    ret = 0;
+ cleanup:
+    if (err.message)
+        VIR_FREE(*err.message);
+    VIR_FREE(err.message);
+    virNetMessageFree(msg);
+    return ret;
+}
+
+
+struct testStreamReader {
+    int fd;
+    size_t want;
+    size_t got;
+};
+
+
+static void testStreamReaderThread(void *opaque)
+{
+    struct testStreamReader *data = opaque;
+    char buf[64 * 1024];
+
+    while (data->got < data->want) {
+        ssize_t got = read(data->fd, buf, sizeof(buf));
+
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            break;
+        data->got += got;
+    }
+}
+
+
+/* Pushes stream data through a socket the way the daemon does, either
+ * copying each chunk into the message or sending it from a pooled
+ * buffer along with the header */
+static int testMessageStreamBench(const void *args)
+{
+    const bool *pooled = args;
+    size_t chunk = VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX;
+    size_t nchunks = virTestGetExpensive() ? 4096 : 256;
+    struct testStreamReader reader = { .fd = -1 };
+    virNetMessagePtr msg = NULL;
+    virNetSocketPtr sock = NULL;
+    virThread thread;
+    bool threadRunning = false;
+    char *buf = NULL;
+    int fds[2] = { -1, -1 };
+    unsigned long long start;
+    unsigned long long end;
+    size_t i;
+    int ret = -1;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0 ||
+        virNetSocketNewConnectSockFD(fds[0], &sock) < 0)
+        goto cleanup;
+    fds[0] = -1;
+
+    reader.fd = fds[1];
+    if (virThreadCreate(&thread, true, testStreamReaderThread, &reader) < 0)
+        goto cleanup;
+    threadRunning = true;
+
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nchunks; i++) {
+        if (!(msg = virNetMessageNew(false)))
+            goto cleanup;
+
+        msg->header.type = VIR_NET_STREAM;
+        msg->header.status = VIR_NET_CONTINUE;
+
+        if (*pooled) {
+            if (!(buf = virNetMessagePayloadAlloc()))
+                goto cleanup;
+            memset(buf, i, chunk);
+
+            if (virNetMessageEncodeHeader(msg) < 0 ||
+                virNetMessageEncodePayloadPooled(msg, &buf, chunk) < 0)
+                goto cleanup;
+        } else {
+            if (VIR_ALLOC_N(buf, chunk) < 0)
+                goto cleanup;
+            memset(buf, i, chunk);
+
+            if (virNetMessageEncodeHeader(msg) < 0 ||
+                virNetMessageEncodePayloadRaw(msg, buf, chunk) < 0)
+                goto cleanup;
+            VIR_FREE(buf);
+        }
+
+        reader.want += msg->bufferLength;
+
+        if (testMessageWrite(sock, msg) < 0)
+            goto cleanup;
+
+        virNetMessageFree(msg);
+        msg = NULL;
+    }
+
+    virThreadJoin(&thread);
+    threadRunning = false;
+
+    if (virTimeMillisNow(&end) < 0)
+        goto cleanup;
+
+    if (reader.got != reader.want) {
+        VIR_DEBUG("Sent %zu bytes, received %zu", reader.want, reader.got);
+        goto cleanup;
+    }
+
+    VIR_TEST_DEBUG("%s: %zu MiB of stream data in %llu ms, %.2f GB/s\n",
+                   *pooled ? "pooled" : "copied",
+                   nchunks * chunk / (1024 * 1024), end - start,
+                   (double) nchunks * chunk / (1024 * 1024 * 1024) * 1000 /
+                   MAX(end - start, 1));
+
+    ret = 0;
+ cleanup:
+    virObjectUnref(sock);
+    if (threadRunning)
+        virThreadJoin(&thread);
+    VIR_FORCE_CLOSE(fds[1]);
+    if (*pooled)
+        virNetMessagePayloadFree(buf);
+    else
+        VIR_FREE(buf);
+    virNetMessageFree(msg);
+    return ret;
+}
+
 
 static int
 mymain(void)
 {
     int ret = 0;
+    bool copied = false;
+    bool pooled = true;
 
     signal(SIGPIPE, SIG_IGN);
 
@@ -544,6 +850,18 @@ mymain(void)
     if (virTestRun("Message Payload Stream Encode", testMessagePayloadStreamEncode, NULL) < 0)
         ret = -1;
 
+    if (virTestRun("Message Payload Stream Encode Ref", testMessagePayloadStreamEncodeRef, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("Message Payload Encode Bench", testMessagePayloadEncodeBench, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("Message Stream Bench Copied", testMessageStreamBench, &copied) < 0)
+        ret = -1;
+
+    if (virTestRun("Message Stream Bench Pooled", testMessageStreamBench, &pooled) < 0)
+        ret = -1;
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -23,6 +23,8 @@
 #include "testutils.h"
 #include "virerror.h"
 #include "rpc/virnetserverclient.h"
+#include "rpc/virnetserverprogram.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_RPC
 
@@ -137,6 +139,148 @@ static int testIdentity(const void *opaque ATTRIBUTE_UNUSED)
 }
 
 
+# define TEST_PROGRAM 0x11223344
+# define TEST_PROC_NOOP 1
+
+static int
+testDispatchNoop(virNetServerPtr server ATTRIBUTE_UNUSED,
+                 virNetServerClientPtr client ATTRIBUTE_UNUSED,
+                 virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                 virNetMessageErrorPtr rerr ATTRIBUTE_UNUSED,
+                 void *args ATTRIBUTE_UNUSED,
+                 void *ret ATTRIBUTE_UNUSED)
+{
+    return 0;
+}
+
+static virNetServerProgramProc testProcs[] = {
+    { NULL, 0, (xdrproc_t)xdr_void, 0, (xdrproc_t)xdr_void, true, 0, NULL },
+    { testDispatchNoop, 0, (xdrproc_t)xdr_void, 0, (xdrproc_t)xdr_void,
+      false, 0, "test.Noop" },
+};
+
+static int testRPCStats(const void *opaque ATTRIBUTE_UNUSED)
+{
+    int sv[2];
+    int ret = -1;
+    virNetSocketPtr sock = NULL;
+    virNetServerClientPtr client = NULL;
+    virNetServerProgramPtr prog = NULL;
+    virNetMessagePtr msg = NULL;
+    virNetServerProgramProcStats stats;
+    unsigned long long now;
+    unsigned long long count;
+    const char *name;
+    size_t i;
+    size_t j;
+
+    if (socketpair(PF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        virReportSystemError(errno, "%s",
+                             "Cannot create socket pair");
+        return -1;
+    }
+
+    if (virNetSocketNewConnectSockFD(sv[0], &sock) < 0) {
+        virDispatchError(NULL);
+        goto cleanup;
+    }
+    sv[0] = -1;
+
+    if (!(client = virNetServerClientNew(1, sock, 0, false, 1,
+# ifdef WITH_GNUTLS
+                                         NULL,
+# endif
+                                         NULL, NULL, NULL, NULL))) {
+        virDispatchError(NULL);
+        goto cleanup;
+    }
+
+    if (!(prog = virNetServerProgramNew(TEST_PROGRAM, 1, testProcs,
+                                        ARRAY_CARDINALITY(testProcs))))
+        goto cleanup;
+
+    if (!(msg = virNetMessageNew(true)))
+        goto cleanup;
+
+    msg->header.prog = TEST_PROGRAM;
+    msg->header.vers = 1;
+    msg->header.proc = TEST_PROC_NOOP;
+    msg->header.type = VIR_NET_CALL;
+    msg->header.serial = 1;
+    msg->header.status = VIR_NET_OK;
+
+    if (virNetMessageEncodeHeader(msg) < 0)
+        goto cleanup;
+
+    /* Pretend the call waited for a worker for 2ms */
+    if (virTimeMicrosNowRaw(&now) < 0)
+        goto cleanup;
+    msg->received = now - 2000;
+
+    if (virNetServerProgramDispatch(prog, NULL, client, msg) < 0) {
+        virDispatchError(NULL);
+        goto cleanup;
+    }
+    /* The reply is owned by the client's tx queue now */
+    msg = NULL;
+
+    if (virNetServerProgramGetProcStats(prog, 0, &stats)) {
+        fprintf(stderr, "Expected no stats for a missing procedure\n");
+        goto cleanup;
+    }
+
+    if (!(name = virNetServerProgramGetProcStats(prog, TEST_PROC_NOOP,
+                                                 &stats))) {
+        fprintf(stderr, "Missing stats for procedure %d\n", TEST_PROC_NOOP);
+        goto cleanup;
+    }
+
+    if (STRNEQ(name, "test.Noop")) {
+        fprintf(stderr, "Expected name 'test.Noop', got '%s'\n", name);
+        goto cleanup;
+    }
+
+    if (stats.calls != 1) {
+        fprintf(stderr, "Expected 1 call, got %llu\n", stats.calls);
+        goto cleanup;
+    }
+
+    if (stats.time[VIR_NET_SERVER_PROGRAM_PHASE_QUEUE] < 2000 ||
+        stats.latency[VIR_NET_SERVER_PROGRAM_PHASE_QUEUE][0] ||
+        stats.latency[VIR_NET_SERVER_PROGRAM_PHASE_QUEUE][1]) {
+        fprintf(stderr, "Queue time %lluus is not accounted correctly\n",
+                stats.time[VIR_NET_SERVER_PROGRAM_PHASE_QUEUE]);
+        goto cleanup;
+    }
+
+    /* The reply was not sent yet, so every other phase has exactly
+     * one sample and the reply phase has none */
+    for (i = 0; i < VIR_NET_SERVER_PROGRAM_PHASE_LAST; i++) {
+        count = 0;
+        for (j = 0; j < VIR_NET_SERVER_PROGRAM_LATENCY_BUCKETS; j++)
+            count += stats.latency[i][j];
+
+        if (count != (i == VIR_NET_SERVER_PROGRAM_PHASE_REPLY ? 0 : 1)) {
+            fprintf(stderr, "Unexpected %llu samples in phase %zu\n",
+                    count, i);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+ cleanup:
+    virNetMessageFree(msg);
+    if (client)
+        virNetServerClientClose(client);
+    virObjectUnref(client);
+    virObjectUnref(prog);
+    virObjectUnref(sock);
+    VIR_FORCE_CLOSE(sv[0]);
+    VIR_FORCE_CLOSE(sv[1]);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -147,6 +291,10 @@ mymain(void)
                    testIdentity, NULL) < 0)
         ret = -1;
 
+    if (virTestRun("RPC stats",
+                   testRPCStats, NULL) < 0)
+        ret = -1;
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 VIR_TEST_MAIN_PRELOAD(mymain, abs_builddir "/.libs/virnetserverclientmock.so")
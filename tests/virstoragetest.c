@@ -21,6 +21,7 @@
 #include <config.h>
 
 #include <stdlib.h>
+#include <sys/time.h>
 
 #include "testutils.h"
 #include "vircommand.h"
@@ -717,6 +718,114 @@ testBackingParse(const void *args)
 }
 
 
+static int
+testMetadataCacheProbe(const char *path,
+                       int format,
+                       unsigned long long expHits,
+                       unsigned long long expMisses)
+{
+    virStorageSourcePtr chain = NULL;
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long oldHits;
+    unsigned long long oldMisses;
+    int ret = -1;
+
+    virStorageFileMetadataCacheGetStats(&oldHits, &oldMisses);
+
+    if (!(chain = testStorageFileGetMetadata(path, format, -1, -1, false)))
+        goto cleanup;
+
+    virStorageFileMetadataCacheGetStats(&hits, &misses);
+
+    if (hits - oldHits != expHits || misses - oldMisses != expMisses) {
+        fprintf(stderr, "expected %llu hits and %llu misses, "
+                "got %llu hits and %llu misses\n", expHits, expMisses,
+                hits - oldHits, misses - oldMisses);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virStorageSourceFree(chain);
+    return ret;
+}
+
+
+static int
+testMetadataCacheSetTime(const char *path,
+                         time_t when)
+{
+    struct timeval times[2] = { { when, 0 }, { when, 0 } };
+
+    if (utimes(path, times) < 0) {
+        fprintf(stderr, "cannot set timestamps of %s\n", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testMetadataCache(const void *args ATTRIBUTE_UNUSED)
+{
+    virStorageSourcePtr raw = NULL;
+    int ret = -1;
+
+    /* Files modified just now are never cached, make them look old */
+    if (testMetadataCacheSetTime(absqed, time(NULL) - 60) < 0 ||
+        testMetadataCacheSetTime(absraw, time(NULL) - 60) < 0)
+        goto cleanup;
+
+    /* The first probe reads both images, the second one none */
+    if (testMetadataCacheProbe(absqed, VIR_STORAGE_FILE_QED, 0, 2) < 0 ||
+        testMetadataCacheProbe(absqed, VIR_STORAGE_FILE_QED, 2, 0) < 0)
+        goto cleanup;
+
+    /* A file with a different timestamp is a different file */
+    if (testMetadataCacheSetTime(absraw, time(NULL) - 30) < 0 ||
+        testMetadataCacheProbe(absqed, VIR_STORAGE_FILE_QED, 1, 1) < 0)
+        goto cleanup;
+
+    /* Invalidated images are read again */
+    if (!(raw = testStorageFileGetMetadata(absraw, VIR_STORAGE_FILE_RAW,
+                                           -1, -1, false)))
+        goto cleanup;
+    virStorageFileMetadataCacheInvalidate(raw);
+
+    if (testMetadataCacheProbe(absqed, VIR_STORAGE_FILE_QED, 1, 1) < 0)
+        goto cleanup;
+
+    /* Cached headers are not handed out to callers that cannot read
+     * the image themselves. Root can read anything, so only check
+     * this as an unprivileged user. */
+    if (geteuid() != 0) {
+        struct stat sb;
+
+        if (stat(absraw, &sb) < 0 || chmod(absraw, 0) < 0) {
+            fprintf(stderr, "cannot change mode of %s\n", absraw);
+            goto cleanup;
+        }
+
+        if (testMetadataCacheProbe(absqed, VIR_STORAGE_FILE_QED, 1, 1) < 0) {
+            ignore_value(chmod(absraw, sb.st_mode & 07777));
+            goto cleanup;
+        }
+
+        if (chmod(absraw, sb.st_mode & 07777) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virStorageSourceFree(raw);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -1099,6 +1208,10 @@ mymain(void)
     if (virCommandRun(cmd, NULL) < 0)
         ret = -1;
 
+    if (virTestRun("Backing chain metadata cache",
+                   testMetadataCache, NULL) < 0)
+        ret = -1;
+
     /* Test behavior of chain lookups, absolute backing from relative start */
     chain = testStorageFileGetMetadata("wrap", VIR_STORAGE_FILE_QCOW2,
                                        -1, -1, false);
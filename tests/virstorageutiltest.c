@@ -17,12 +17,14 @@
 #include <config.h>
 
 #include <stdlib.h>
+#include <fcntl.h>
 
 #include "testutils.h"
 #include "virerror.h"
 #include "virfile.h"
 #include "virlog.h"
 #include "virstring.h"
+#include "virtime.h"
 
 #include "storage/storage_util.h"
 
@@ -74,11 +76,294 @@ testGlusterExtractPoolSources(const void *opaque)
 }
 
 
+#define COPY_CHUNK (1024 * 1024)
+
+struct testCopyToFDData {
+    const char *scratchdir;
+    bool sparse;
+};
+
+
+/* Creates a mostly sparse image with a few chunks of data and one chunk
+ * of explicitly written zeroes */
+static int
+testCopyToFDPrepare(const char *file,
+                    size_t len)
+{
+    char *chunk = NULL;
+    size_t data[] = { 0, 16, 40, 63 };
+    size_t i;
+    int fd = -1;
+    int ret = -1;
+
+    if (VIR_ALLOC_N(chunk, COPY_CHUNK) < 0)
+        goto cleanup;
+
+    if ((fd = open(file, O_CREAT|O_WRONLY|O_TRUNC, 0600)) < 0 ||
+        ftruncate(fd, len) < 0)
+        goto cleanup;
+
+    if (lseek(fd, 8 * COPY_CHUNK, SEEK_SET) < 0 ||
+        safewrite(fd, chunk, COPY_CHUNK) != COPY_CHUNK)
+        goto cleanup;
+
+    for (i = 0; i < COPY_CHUNK; i++)
+        chunk[i] = i % 251 + 1;
+
+    for (i = 0; i < ARRAY_CARDINALITY(data); i++) {
+        if (lseek(fd, data[i] * COPY_CHUNK, SEEK_SET) < 0 ||
+            safewrite(fd, chunk, COPY_CHUNK) != COPY_CHUNK)
+            goto cleanup;
+    }
+
+    if (VIR_CLOSE(fd) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    VIR_FORCE_CLOSE(fd);
+    VIR_FREE(chunk);
+    return ret;
+}
+
+
+static int
+testCopyToFDCompare(const char *file1,
+                    const char *file2)
+{
+    char *buf1 = NULL;
+    char *buf2 = NULL;
+    int fd1 = -1;
+    int fd2 = -1;
+    int ret = -1;
+
+    if (VIR_ALLOC_N(buf1, COPY_CHUNK) < 0 ||
+        VIR_ALLOC_N(buf2, COPY_CHUNK) < 0)
+        goto cleanup;
+
+    if ((fd1 = open(file1, O_RDONLY)) < 0 ||
+        (fd2 = open(file2, O_RDONLY)) < 0)
+        goto cleanup;
+
+    while (1) {
+        ssize_t got1 = saferead(fd1, buf1, COPY_CHUNK);
+        ssize_t got2 = saferead(fd2, buf2, COPY_CHUNK);
+
+        if (got1 < 0 || got2 < 0)
+            goto cleanup;
+
+        if (got1 != got2 || memcmp(buf1, buf2, got1) != 0) {
+            virFilePrintf(stderr, "Copy of '%s' differs\n", file1);
+            goto cleanup;
+        }
+
+        if (got1 == 0)
+            break;
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FORCE_CLOSE(fd1);
+    VIR_FORCE_CLOSE(fd2);
+    VIR_FREE(buf1);
+    VIR_FREE(buf2);
+    return ret;
+}
+
+
+/* Clones a sparse image the way virStorageVolCreateXMLFrom does and
+ * reports how much of it had to go through userspace */
+static int
+testCopyToFD(const void *opaque)
+{
+    const struct testCopyToFDData *data = opaque;
+    virStorageVolDef vol;
+    virStorageVolDef inputvol;
+    virStorageBackendCopyStats stats;
+    size_t len = (virTestGetExpensive() ? 1024 : 64) * COPY_CHUNK;
+    unsigned long long remain = len;
+    unsigned long long start;
+    unsigned long long end;
+    char *src = NULL;
+    char *dst = NULL;
+    int fd = -1;
+    int ret = -1;
+
+    memset(&vol, 0, sizeof(vol));
+    memset(&inputvol, 0, sizeof(inputvol));
+
+    if (virAsprintf(&src, "%s/copy-src.img", data->scratchdir) < 0 ||
+        virAsprintf(&dst, "%s/copy-dst.img", data->scratchdir) < 0)
+        goto cleanup;
+
+    if (testCopyToFDPrepare(src, len) < 0)
+        goto cleanup;
+
+    if ((fd = open(dst, O_CREAT|O_RDWR|O_TRUNC, 0600)) < 0 ||
+        ftruncate(fd, len) < 0)
+        goto cleanup;
+
+    inputvol.target.path = src;
+    vol.target.path = dst;
+
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+
+    if (virStorageBackendCopyToFD(&vol, &inputvol, fd, &remain,
+                                  data->sparse, false, &stats) < 0)
+        goto cleanup;
+
+    if (virTimeMillisNow(&end) < 0)
+        goto cleanup;
+
+    VIR_TEST_DEBUG("%s copy of %zu MiB in %llu ms: read %llu, written %llu, "
+                   "copied %llu, skipped %llu bytes\n",
+                   data->sparse ? "sparse" : "non-sparse",
+                   len / COPY_CHUNK, end - start, stats.read,
+                   stats.written, stats.copied, stats.skipped);
+
+    if (remain != 0 ||
+        stats.written + stats.copied + stats.skipped != len) {
+        virFilePrintf(stderr, "Copied %llu of %zu bytes\n",
+                      stats.written + stats.copied + stats.skipped, len);
+        goto cleanup;
+    }
+
+    if (!data->sparse && stats.skipped + stats.copied != 0) {
+        virFilePrintf(stderr, "Skipped %llu and let the kernel copy %llu "
+                      "bytes of a non-sparse copy\n",
+                      stats.skipped, stats.copied);
+        goto cleanup;
+    }
+
+    if (VIR_CLOSE(fd) < 0 ||
+        testCopyToFDCompare(src, dst) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    VIR_FORCE_CLOSE(fd);
+    if (src)
+        unlink(src);
+    if (dst)
+        unlink(dst);
+    VIR_FREE(src);
+    VIR_FREE(dst);
+    return ret;
+}
+
+
+/* Zero-wipes a fully written image, checks it reads back as zeroes and
+ * that the progress published in the allocation is replaced by the real
+ * allocation once done */
+static int
+testWipeLocal(const void *opaque)
+{
+    const char *scratchdir = opaque;
+    virStoragePoolObj pool;
+    virStorageVolDefPtr vol = NULL;
+    size_t len = (virTestGetExpensive() ? 1024 : 64) * COPY_CHUNK;
+    char *chunk = NULL;
+    char *path = NULL;
+    struct stat st;
+    size_t i;
+    int fd = -1;
+    int ret = -1;
+
+    memset(&pool, 0, sizeof(pool));
+    if (virMutexInit(&pool.lock) < 0)
+        return -1;
+
+    if (VIR_ALLOC(vol) < 0 ||
+        VIR_ALLOC_N(chunk, COPY_CHUNK) < 0 ||
+        virAsprintf(&path, "%s/wipe.img", scratchdir) < 0 ||
+        VIR_STRDUP(vol->target.path, path) < 0)
+        goto cleanup;
+
+    memset(chunk, 0xaa, COPY_CHUNK);
+
+    if ((fd = open(path, O_CREAT|O_WRONLY|O_TRUNC, 0600)) < 0)
+        goto cleanup;
+
+    for (i = 0; i < len / COPY_CHUNK; i++) {
+        if (safewrite(fd, chunk, COPY_CHUNK) != COPY_CHUNK)
+            goto cleanup;
+    }
+
+    if (VIR_CLOSE(fd) < 0)
+        goto cleanup;
+
+    vol->type = VIR_STORAGE_VOL_FILE;
+    vol->target.allocation = len;
+
+    if (virStorageBackendVolWipeLocal(NULL, &pool, vol,
+                                      VIR_STORAGE_VOL_WIPE_ALG_ZERO, 0) < 0)
+        goto cleanup;
+
+    if (!vol->wiping || vol->target.allocation != len) {
+        virFilePrintf(stderr, "Expected progress of %zu bytes, got %llu%s\n",
+                      len, vol->target.allocation,
+                      vol->wiping ? "" : " without wiping being set");
+        goto cleanup;
+    }
+
+    if (virStorageBackendVolWipeDone(vol) < 0)
+        goto cleanup;
+
+    if (stat(path, &st) < 0 || st.st_size != (off_t) len) {
+        virFilePrintf(stderr, "Wiped image changed its size\n");
+        goto cleanup;
+    }
+
+    if (vol->wiping ||
+        vol->target.allocation != (unsigned long long) st.st_blocks * DEV_BSIZE) {
+        virFilePrintf(stderr, "Expected allocation %llu after the wipe, "
+                      "got %llu\n",
+                      (unsigned long long) st.st_blocks * DEV_BSIZE,
+                      vol->target.allocation);
+        goto cleanup;
+    }
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        goto cleanup;
+
+    for (i = 0; i < len / COPY_CHUNK; i++) {
+        if (saferead(fd, chunk, COPY_CHUNK) != COPY_CHUNK)
+            goto cleanup;
+
+        if (chunk[0] != 0 || memcmp(chunk, chunk + 1, COPY_CHUNK - 1) != 0) {
+            virFilePrintf(stderr, "Data left in chunk %zu\n", i);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FORCE_CLOSE(fd);
+    if (path)
+        unlink(path);
+    VIR_FREE(path);
+    VIR_FREE(chunk);
+    virStorageVolDefFree(vol);
+    virMutexDestroy(&pool.lock);
+    return ret;
+}
+
+
+#define SCRATCHDIRTEMPLATE abs_builddir "/virstorageutildir-XXXXXX"
+
 static int
 mymain(void)
 {
+    char scratchdir[] = SCRATCHDIRTEMPLATE;
+    struct testCopyToFDData copy = { scratchdir, false };
     int ret = 0;
 
+    if (!mkdtemp(scratchdir)) {
+        virFilePrintf(stderr, "Cannot create virstorageutildir");
+        abort();
+    }
+
 #define DO_TEST_GLUSTER_EXTRACT_POOL_SOURCES_FULL(testname, sffx, pooltype)    \
     do {                                                                       \
         struct testGlusterExtractPoolSourcesData data;                         \
@@ -108,6 +393,17 @@ mymain(void)
 #undef DO_TEST_GLUSTER_EXTRACT_POOL_SOURCES_NETFS
 #undef DO_TEST_GLUSTER_EXTRACT_POOL_SOURCES_FULL
 
+    if (virTestRun("copy to fd", testCopyToFD, &copy) < 0)
+        ret = -1;
+    copy.sparse = true;
+    if (virTestRun("sparse copy to fd", testCopyToFD, &copy) < 0)
+        ret = -1;
+    if (virTestRun("zero wipe", testWipeLocal, scratchdir) < 0)
+        ret = -1;
+
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(scratchdir);
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
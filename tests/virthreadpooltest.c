@@ -0,0 +1,530 @@
+/*
+ * Copyright (C) 2017 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <unistd.h>
+
+#include "testutils.h"
+#include "viralloc.h"
+#include "virerror.h"
+#include "virstring.h"
+#include "virthread.h"
+#include "virthreadpool.h"
+#include "virtime.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#define NJOBS 1000
+#define NDOMAINS 200
+
+struct testMapData {
+    virMutex lock;
+    size_t calls[NJOBS];
+    size_t fail;
+};
+
+
+static int
+testMapJob(size_t idx,
+           void *opaque)
+{
+    struct testMapData *data = opaque;
+
+    virMutexLock(&data->lock);
+    data->calls[idx]++;
+    virMutexUnlock(&data->lock);
+
+    if (idx == data->fail) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "job %zu failed", idx);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testMap(const void *opaque)
+{
+    const size_t *workers = opaque;
+    struct testMapData data = { .fail = NJOBS };
+    size_t i;
+    int ret = -1;
+
+    if (virMutexInit(&data.lock) < 0)
+        return -1;
+
+    if (virThreadMapParallel(*workers, NJOBS, testMapJob, &data) < 0)
+        goto cleanup;
+
+    for (i = 0; i < NJOBS; i++) {
+        if (data.calls[i] != 1) {
+            fprintf(stderr, "job %zu called %zu times\n", i, data.calls[i]);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+ cleanup:
+    virMutexDestroy(&data.lock);
+    return ret;
+}
+
+
+static int
+testMapError(const void *opaque)
+{
+    const size_t *workers = opaque;
+    struct testMapData data = { .fail = NJOBS / 2 };
+    virErrorPtr err;
+    size_t i;
+    int ret = -1;
+
+    if (virMutexInit(&data.lock) < 0)
+        return -1;
+
+    virResetLastError();
+
+    if (virThreadMapParallel(*workers, NJOBS, testMapJob, &data) == 0) {
+        fprintf(stderr, "failure of a job wasn't reported\n");
+        goto cleanup;
+    }
+
+    /* the error is raised in one of the workers */
+    if (!(err = virGetLastError()) ||
+        !err->message || !strstr(err->message, "job 500 failed")) {
+        fprintf(stderr, "unexpected error '%s'\n",
+                err && err->message ? err->message : "");
+        goto cleanup;
+    }
+
+    for (i = 0; i < NJOBS; i++) {
+        if (data.calls[i] > 1) {
+            fprintf(stderr, "job %zu called %zu times\n", i, data.calls[i]);
+            goto cleanup;
+        }
+    }
+
+    if (data.calls[NJOBS - 1] && *workers == 1) {
+        fprintf(stderr, "jobs were started after a failure\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virResetLastError();
+    virMutexDestroy(&data.lock);
+    return ret;
+}
+
+
+struct testPoolData {
+    virMutex lock;
+    virCond cond;
+    bool blocked;
+    bool release;
+    size_t ndone;
+    size_t order[8];
+    size_t norder;
+};
+
+
+/* Job 0 blocks the worker until released, others record their ID */
+static void
+testPoolJob(void *jobdata,
+            void *opaque)
+{
+    struct testPoolData *data = opaque;
+    size_t id = *(size_t *)jobdata;
+
+    virMutexLock(&data->lock);
+    if (id == 0) {
+        data->blocked = true;
+        virCondBroadcast(&data->cond);
+        while (!data->release)
+            ignore_value(virCondWait(&data->cond, &data->lock));
+    } else if (data->norder < ARRAY_CARDINALITY(data->order)) {
+        data->order[data->norder++] = id;
+    }
+    data->ndone++;
+    virCondBroadcast(&data->cond);
+    virMutexUnlock(&data->lock);
+}
+
+
+/* Waits until the blocking job runs and @ndone other jobs finished */
+static int
+testPoolWait(struct testPoolData *data,
+             size_t ndone)
+{
+    unsigned long long deadline;
+    int ret = 0;
+
+    if (virTimeMillisNow(&deadline) < 0)
+        return -1;
+    deadline += 10 * 1000;
+
+    virMutexLock(&data->lock);
+    while (!data->blocked || data->ndone < ndone) {
+        if (virCondWaitUntil(&data->cond, &data->lock, deadline) < 0) {
+            fprintf(stderr, "timed out waiting for %zu jobs, %zu done\n",
+                    ndone, data->ndone);
+            ret = -1;
+            break;
+        }
+    }
+    virMutexUnlock(&data->lock);
+
+    return ret;
+}
+
+
+static void
+testPoolRelease(struct testPoolData *data)
+{
+    virMutexLock(&data->lock);
+    data->release = true;
+    virCondBroadcast(&data->cond);
+    virMutexUnlock(&data->lock);
+}
+
+
+static int
+testPoolDataInit(struct testPoolData *data)
+{
+    memset(data, 0, sizeof(*data));
+
+    if (virMutexInit(&data->lock) < 0)
+        return -1;
+    if (virCondInit(&data->cond) < 0) {
+        virMutexDestroy(&data->lock);
+        return -1;
+    }
+    return 0;
+}
+
+
+static void
+testPoolDataClear(struct testPoolData *data)
+{
+    virCondDestroy(&data->cond);
+    virMutexDestroy(&data->lock);
+}
+
+
+static int
+testPriority(const void *opaque)
+{
+    const unsigned int *flags = opaque;
+    const size_t ids[] = { 0, 1, 2, 3, 4, 5 };
+    const unsigned int prios[] = {
+        VIR_THREAD_POOL_PRIORITY_NORMAL,
+        VIR_THREAD_POOL_PRIORITY_NORMAL,
+        VIR_THREAD_POOL_PRIORITY_HIGH,
+        VIR_THREAD_POOL_PRIORITY_URGENT,
+        VIR_THREAD_POOL_PRIORITY_NORMAL,
+        VIR_THREAD_POOL_PRIORITY_LAST + 10,
+    };
+    const size_t expect[] = { 3, 5, 2, 1, 4 };
+    struct testPoolData data;
+    virThreadPoolPtr pool = NULL;
+    size_t i;
+    int ret = -1;
+
+    if (testPoolDataInit(&data) < 0)
+        return -1;
+
+    if (!(pool = virThreadPoolNewFlags(1, 1, 0, testPoolJob, &data, *flags)))
+        goto cleanup;
+
+    /* Occupy the only worker so that all the other jobs get queued */
+    if (virThreadPoolSendJob(pool, prios[0], (void *) &ids[0]) < 0 ||
+        testPoolWait(&data, 0) < 0)
+        goto cleanup;
+
+    for (i = 1; i < ARRAY_CARDINALITY(ids); i++) {
+        if (virThreadPoolSendJob(pool, prios[i], (void *) &ids[i]) < 0)
+            goto cleanup;
+    }
+
+    if (virThreadPoolGetJobQueueDepth(pool) != ARRAY_CARDINALITY(ids) - 1) {
+        fprintf(stderr, "unexpected queue depth %zu\n",
+                virThreadPoolGetJobQueueDepth(pool));
+        goto cleanup;
+    }
+
+    testPoolRelease(&data);
+    if (testPoolWait(&data, ARRAY_CARDINALITY(ids)) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ARRAY_CARDINALITY(expect); i++) {
+        if (data.order[i] != expect[i]) {
+            fprintf(stderr, "job %zu ran as %zu., expected %zu\n",
+                    data.order[i], i, expect[i]);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+ cleanup:
+    testPoolRelease(&data);
+    virThreadPoolFree(pool);
+    testPoolDataClear(&data);
+    return ret;
+}
+
+
+static int
+testStealing(const void *opaque ATTRIBUTE_UNUSED)
+{
+    const size_t gate = 0;
+    const size_t job = 1;
+    struct testPoolData data;
+    virThreadPoolPtr pool = NULL;
+    size_t i;
+    int ret = -1;
+
+    if (testPoolDataInit(&data) < 0)
+        return -1;
+
+    if (!(pool = virThreadPoolNewFlags(2, 2, 0, testPoolJob, &data,
+                                       VIR_THREAD_POOL_PER_WORKER_QUEUES)))
+        goto cleanup;
+
+    /* Jobs queued behind the blocked one have to be stolen by the other
+     * worker, otherwise they'd never finish */
+    if (virThreadPoolSendJob(pool, 0, (void *) &gate) < 0)
+        goto cleanup;
+    for (i = 0; i < 100; i++) {
+        if (virThreadPoolSendJob(pool, 0, (void *) &job) < 0)
+            goto cleanup;
+    }
+
+    if (testPoolWait(&data, 100) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    testPoolRelease(&data);
+    virThreadPoolFree(pool);
+    testPoolDataClear(&data);
+    return ret;
+}
+
+
+static int
+testQueueLatency(const void *opaque)
+{
+    const unsigned int *flags = opaque;
+    const size_t job = 1;
+    const size_t njobs = NJOBS * 10;
+    struct testPoolData data;
+    virThreadPoolPtr pool = NULL;
+    virThreadPoolStats stats;
+    unsigned long long start;
+    unsigned long long end;
+    unsigned long long sum = 0;
+    size_t i;
+    int ret = -1;
+
+    if (testPoolDataInit(&data) < 0)
+        return -1;
+    data.blocked = true;
+    data.release = true;
+
+    if (!(pool = virThreadPoolNewFlags(0, 8, 0, testPoolJob, &data, *flags)))
+        goto cleanup;
+
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+
+    for (i = 0; i < njobs; i++) {
+        if (virThreadPoolSendJob(pool, 0, (void *) &job) < 0)
+            goto cleanup;
+    }
+
+    if (testPoolWait(&data, njobs) < 0 ||
+        virTimeMillisNow(&end) < 0)
+        goto cleanup;
+
+    VIR_TEST_DEBUG("%zu jobs with flags 0x%x: %llu ms\n",
+                   njobs, *flags, end - start);
+
+    virThreadPoolGetStats(pool, &stats);
+
+    for (i = 0; i < VIR_THREAD_POOL_LATENCY_BUCKETS; i++)
+        sum += stats.latency[i];
+
+    if (stats.jobs != njobs || sum != njobs) {
+        fprintf(stderr, "expected %zu jobs, got %llu in total and %llu "
+                "in the histogram\n", njobs, stats.jobs, sum);
+        goto cleanup;
+    }
+
+    if (virThreadPoolGetJobQueueDepth(pool) != 0) {
+        fprintf(stderr, "queue not empty\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virThreadPoolFree(pool);
+    testPoolDataClear(&data);
+    return ret;
+}
+
+
+static const char domainDef[] =
+"<domain type='test'>"
+"  <name>test-domain-%zu</name>"
+"  <memory>8388608</memory>"
+"  <vcpu>2</vcpu>"
+"  <os>"
+"    <type>hvm</type>"
+"  </os>"
+"</domain>";
+
+struct testStatsData {
+    virDomainPtr *doms;
+    char **names;
+};
+
+
+/* Simulates gathering stats of one domain: apart from asking the driver
+ * a few questions each domain costs a monitor round trip */
+static int
+testStatsJob(size_t idx,
+             void *opaque)
+{
+    struct testStatsData *data = opaque;
+    virDomainInfo info;
+    char *xml;
+
+    if (virDomainGetInfo(data->doms[idx], &info) < 0 ||
+        !(xml = virDomainGetXMLDesc(data->doms[idx], 0)))
+        return -1;
+    VIR_FREE(xml);
+
+    usleep(1000);
+
+    return VIR_STRDUP(data->names[idx], virDomainGetName(data->doms[idx]));
+}
+
+
+static int
+testStatsScaling(const void *opaque ATTRIBUTE_UNUSED)
+{
+    const size_t workers[] = { 1, 4, 16 };
+    struct testStatsData data = { NULL, NULL };
+    virConnectPtr conn;
+    virDomainPtr dom;
+    char *xml = NULL;
+    int ndoms = 0;
+    size_t i;
+    size_t j;
+    int ret = -1;
+
+    if (!(conn = virConnectOpen("test:///default")))
+        return -1;
+
+    for (i = 0; i < NDOMAINS; i++) {
+        if (virAsprintf(&xml, domainDef, i) < 0 ||
+            !(dom = virDomainCreateXML(conn, xml, 0)))
+            goto cleanup;
+        virDomainFree(dom);
+        VIR_FREE(xml);
+    }
+
+    if ((ndoms = virConnectListAllDomains(conn, &data.doms, 0)) < 0 ||
+        VIR_ALLOC_N(data.names, ndoms) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ARRAY_CARDINALITY(workers); i++) {
+        unsigned long long start;
+        unsigned long long end;
+
+        if (virTimeMillisNow(&start) < 0 ||
+            virThreadMapParallel(workers[i], ndoms, testStatsJob, &data) < 0 ||
+            virTimeMillisNow(&end) < 0)
+            goto cleanup;
+
+        VIR_TEST_DEBUG("%d domains with %zu workers: %llu ms\n",
+                       ndoms, workers[i], end - start);
+
+        /* records must be in the order of domains */
+        for (j = 0; j < ndoms; j++) {
+            if (STRNEQ_NULLABLE(data.names[j],
+                                virDomainGetName(data.doms[j]))) {
+                fprintf(stderr, "record %zu out of order\n", j);
+                goto cleanup;
+            }
+            VIR_FREE(data.names[j]);
+        }
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(xml);
+    for (j = 0; data.names && j < ndoms; j++)
+        VIR_FREE(data.names[j]);
+    VIR_FREE(data.names);
+    for (j = 0; data.doms && j < ndoms; j++)
+        virDomainFree(data.doms[j]);
+    VIR_FREE(data.doms);
+    virConnectClose(conn);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+    size_t one = 1;
+    size_t eight = 8;
+    unsigned int shared = 0;
+    unsigned int perWorker = VIR_THREAD_POOL_PER_WORKER_QUEUES;
+
+    if (virTestRun("Map serially", testMap, &one) < 0)
+        ret = -1;
+    if (virTestRun("Map with 8 workers", testMap, &eight) < 0)
+        ret = -1;
+    if (virTestRun("Map error serially", testMapError, &one) < 0)
+        ret = -1;
+    if (virTestRun("Map error with 8 workers", testMapError, &eight) < 0)
+        ret = -1;
+    if (virTestRun("Stats scaling on test driver", testStatsScaling, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Priority classes", testPriority, &shared) < 0)
+        ret = -1;
+    if (virTestRun("Priority classes with per-worker queues",
+                   testPriority, &perWorker) < 0)
+        ret = -1;
+    if (virTestRun("Work stealing", testStealing, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Queue latency", testQueueLatency, &shared) < 0)
+        ret = -1;
+    if (virTestRun("Queue latency with per-worker queues",
+                   testQueueLatency, &perWorker) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
@@ -40,6 +40,7 @@
 #endif
 
 #include "virlease.h"
+#include "virleaseindex.h"
 #include "viralloc.h"
 #include "virfile.h"
 #include "virtime.h"
@@ -82,64 +83,126 @@ typedef struct {
 } leaseAddress;
 
 
+static int
+appendAddrRaw(leaseAddress **tmpAddress,
+              size_t *ntmpAddress,
+              int family,
+              const void *addr,
+              int af)
+{
+    size_t i;
+
+    if (af != AF_UNSPEC && af != family) {
+        DEBUG("Skipping address which family is %d, %d requested", family, af);
+        return 0;
+    }
+
+    for (i = 0; i < *ntmpAddress; i++) {
+        if ((*tmpAddress)[i].af == family &&
+            memcmp((*tmpAddress)[i].addr, addr,
+                   FAMILY_ADDRESS_SIZE(family)) == 0) {
+            DEBUG("IP address already in the list");
+            return 0;
+        }
+    }
+
+    if (VIR_REALLOC_N_QUIET(*tmpAddress, *ntmpAddress + 1) < 0) {
+        ERROR("Out of memory");
+        return -1;
+    }
+
+    (*tmpAddress)[*ntmpAddress].af = family;
+    memcpy((*tmpAddress)[*ntmpAddress].addr, addr,
+           FAMILY_ADDRESS_SIZE(family));
+    (*ntmpAddress)++;
+    return 0;
+}
+
+
 static int
 appendAddr(leaseAddress **tmpAddress,
            size_t *ntmpAddress,
            virJSONValuePtr lease,
            int af)
 {
-    int ret = -1;
     const char *ipAddr;
     virSocketAddr sa;
     int family;
-    size_t i;
 
     if (!(ipAddr = virJSONValueObjectGetString(lease, "ip-address"))) {
         ERROR("ip-address field missing for %s", name);
-        goto cleanup;
+        return -1;
     }
 
     DEBUG("IP address: %s", ipAddr);
 
     if (virSocketAddrParse(&sa, ipAddr, AF_UNSPEC) < 0) {
         ERROR("Unable to parse %s", ipAddr);
-        goto cleanup;
+        return -1;
     }
 
     family = VIR_SOCKET_ADDR_FAMILY(&sa);
-    if (af != AF_UNSPEC && af != family) {
-        DEBUG("Skipping address which family is %d, %d requested", family, af);
-        ret = 0;
-        goto cleanup;
+    return appendAddrRaw(tmpAddress, ntmpAddress, family,
+                         (family == AF_INET ?
+                          (void *) &sa.data.inet4.sin_addr.s_addr :
+                          (void *) &sa.data.inet6.sin6_addr.s6_addr),
+                         af);
+}
+
+
+/**
+ * findLeaseInIndex:
+ *
+ * Look @name up in the lease index maintained by libvirtd. This
+ * is a binary search over a mmap()-ed file and therefore doesn't
+ * depend on the number of networks and leases on the host.
+ */
+static int
+findLeaseInIndex(virLeaseIndexPtr idx,
+                 leaseAddress **tmpAddress,
+                 size_t *ntmpAddress,
+                 const char *name,
+                 int af,
+                 bool *found)
+{
+    const virLeaseIndexRecord *records;
+    size_t nrecords;
+    size_t i;
+    time_t currtime;
+
+    if ((currtime = time(NULL)) == (time_t) - 1) {
+        ERROR("Failed to get current system time");
+        return -1;
     }
 
-    for (i = 0; i < *ntmpAddress; i++) {
-        if (memcmp((*tmpAddress)[i].addr,
-                   (family == AF_INET ?
-                    (void *) &sa.data.inet4.sin_addr.s_addr :
-                    (void *) &sa.data.inet6.sin6_addr.s6_addr),
-                   FAMILY_ADDRESS_SIZE(family)) == 0) {
-            DEBUG("IP address already in the list");
-            ret = 0;
-            goto cleanup;
+#if !defined(LIBVIRT_NSS_GUEST)
+    nrecords = virLeaseIndexLookup(idx, VIR_LEASE_INDEX_HOSTNAME,
+                                   name, &records);
+#else /* defined(LIBVIRT_NSS_GUEST) */
+    nrecords = virLeaseIndexLookup(idx, VIR_LEASE_INDEX_DOMAIN,
+                                   name, &records);
+#endif /* defined(LIBVIRT_NSS_GUEST) */
+
+    for (i = 0; i < nrecords; i++) {
+        /* Do not report expired lease */
+        if (records[i].expiry < (long long) currtime) {
+            DEBUG("Skipping expired lease for %s", name);
+            continue;
         }
-    }
 
-    if (VIR_REALLOC_N_QUIET(*tmpAddress, *ntmpAddress + 1) < 0) {
-        ERROR("Out of memory");
-        goto cleanup;
+        if (records[i].family != AF_INET &&
+            records[i].family != AF_INET6)
+            continue;
+
+        DEBUG("Found record for %s", name);
+        *found = true;
+
+        if (appendAddrRaw(tmpAddress, ntmpAddress, records[i].family,
+                          records[i].addr, af) < 0)
+            return -1;
     }
 
-    (*tmpAddress)[*ntmpAddress].af = family;
-    memcpy((*tmpAddress)[*ntmpAddress].addr,
-           (family == AF_INET ?
-            (void *) &sa.data.inet4.sin_addr.s_addr :
-            (void *) &sa.data.inet6.sin6_addr.s6_addr),
-           FAMILY_ADDRESS_SIZE(family));
-    (*ntmpAddress)++;
-    ret = 0;
- cleanup:
-    return ret;
+    return 0;
 }
 
 
@@ -253,6 +316,7 @@ findLease(const char *name,
     size_t ntmpAddress = 0;
     virMacMapPtr *macmaps = NULL;
     size_t nMacmaps = 0;
+    virLeaseIndexPtr idx = NULL;
 
     *address = NULL;
     *naddress = 0;
@@ -263,6 +327,16 @@ findLease(const char *name,
         goto cleanup;
     }
 
+    /* Prefer the index, fall back to parsing the files directly if
+     * it is missing or unusable. */
+    if ((idx = virLeaseIndexOpen(leaseDir))) {
+        DEBUG("Using lease index in %s", leaseDir);
+        if (findLeaseInIndex(idx, &tmpAddress, &ntmpAddress,
+                             name, af, found) < 0)
+            goto cleanup;
+        goto done;
+    }
+
     if (virDirOpenQuiet(&dir, leaseDir) < 0) {
         ERROR("Failed to open dir '%s'", leaseDir);
         goto cleanup;
@@ -336,6 +410,7 @@ findLease(const char *name,
 
 #endif /* defined(LIBVIRT_NSS_GUEST) */
 
+ done:
     *address = tmpAddress;
     *naddress = ntmpAddress;
     tmpAddress = NULL;
@@ -346,6 +421,7 @@ findLease(const char *name,
  cleanup:
     *errnop = errno;
     VIR_FREE(tmpAddress);
+    virLeaseIndexFree(idx);
     virJSONValueFree(leases_array);
     VIR_DIR_CLOSE(dir);
     while (nMacmaps)
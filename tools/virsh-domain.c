@@ -6145,6 +6145,16 @@ cmdDomjobinfo(vshControl *ctl, const vshCmd *cmd)
         vshPrint(ctl, "%-17s %-13d\n", _("Auto converge throttle:"), ivalue);
     }
 
+    if ((rc = virTypedParamsGetULLong(params, nparams,
+                                      VIR_DOMAIN_JOB_IMAGE_BPS,
+                                      &value)) < 0) {
+        goto save_error;
+    } else if (rc && value) {
+        val = vshPrettyCapacity(value, &unit);
+        vshPrint(ctl, "%-17s %-.3lf %s/s\n",
+                 _("Image bandwidth:"), val, unit);
+    }
+
     ret = true;
 
  cleanup:
@@ -457,8 +457,11 @@ cmdSrvThreadpoolInfo(vshControl *ctl, const vshCmd *cmd)
         goto cleanup;
     }
 
-    for (i = 0; i < nparams; i++)
-        vshPrint(ctl, "%-15s: %u\n", params[i].field, params[i].value.ui);
+    for (i = 0; i < nparams; i++) {
+        char *str = vshGetTypedParamValue(ctl, &params[i]);
+        vshPrint(ctl, "%-21s: %s\n", params[i].field, str);
+        VIR_FREE(str);
+    }
 
     ret = true;
 
@@ -867,6 +870,65 @@ cmdSrvClientsInfo(vshControl *ctl, const vshCmd *cmd)
     return ret;
 }
 
+/* -----------------------
+ * Command srv-rpc-stats
+ * -----------------------
+ */
+
+static const vshCmdInfo info_srv_rpc_stats[] = {
+    {.name = "help",
+     .data = N_("get server's per-procedure RPC statistics")
+    },
+    {.name = "desc",
+     .data = N_("Retrieve the number of calls and latency histograms of "
+                "each RPC procedure the server has dispatched.")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_srv_rpc_stats[] = {
+    {.name = "server",
+     .type = VSH_OT_DATA,
+     .flags = VSH_OFLAG_REQ,
+     .help = N_("Server to retrieve the RPC statistics from."),
+    },
+    {.name = NULL}
+};
+
+static bool
+cmdSrvRPCStats(vshControl *ctl, const vshCmd *cmd)
+{
+    bool ret = false;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    size_t i;
+    const char *srvname = NULL;
+    virAdmServerPtr srv = NULL;
+    vshAdmControlPtr priv = ctl->privData;
+
+    if (vshCommandOptStringReq(ctl, cmd, "server", &srvname) < 0)
+        return false;
+
+    if (!(srv = virAdmConnectLookupServer(priv->conn, srvname, 0)))
+        goto cleanup;
+
+    if (virAdmServerGetRPCStats(srv, &params, &nparams, 0) < 0) {
+        vshError(ctl, "%s", _("Unable to retrieve RPC statistics "
+                              "from the server"));
+        goto cleanup;
+    }
+
+    for (i = 0; i < nparams; i++)
+        vshPrint(ctl, "%-40s: %llu\n", params[i].field, params[i].value.ul);
+
+    ret = true;
+
+ cleanup:
+    virTypedParamsFree(params, nparams);
+    virAdmServerFree(srv);
+    return ret;
+}
+
 /* -----------------------
  * Command srv-clients-set
  * -----------------------
@@ -1079,6 +1141,61 @@ cmdDaemonLogOutputs(vshControl *ctl, const vshCmd *cmd)
     return true;
 }
 
+/* -----------------------------
+ * Command daemon-host-cpu-rates
+ * -----------------------------
+ */
+static const vshCmdInfo info_daemon_host_cpu_rates[] = {
+    {.name = "help",
+     .data = N_("get host CPU rates sampled by daemon")
+    },
+    {.name = "desc",
+     .data = N_("Retrieve the rates of the host CPU time counters computed "
+                "by daemon from its last two samples of host statistics.")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_daemon_host_cpu_rates[] = {
+    {.name = "cpu",
+     .type = VSH_OT_INT,
+     .help = N_("prints specified cpu rates only.")
+    },
+    {.name = NULL}
+};
+
+static bool
+cmdDaemonHostCPURates(vshControl *ctl, const vshCmd *cmd)
+{
+    bool ret = false;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    int cpuNum = -1;
+    size_t i;
+    vshAdmControlPtr priv = ctl->privData;
+
+    if (vshCommandOptInt(ctl, cmd, "cpu", &cpuNum) < 0)
+        return false;
+
+    if (virAdmConnectGetHostCPURates(priv->conn, cpuNum,
+                                     &params, &nparams, 0) < 0) {
+        vshError(ctl, "%s", _("Unable to get host CPU rates"));
+        goto cleanup;
+    }
+
+    for (i = 0; i < nparams; i++) {
+        char *str = vshGetTypedParamValue(ctl, &params[i]);
+        vshPrint(ctl, "%-15s: %s\n", params[i].field, str);
+        VIR_FREE(str);
+    }
+
+    ret = true;
+
+ cleanup:
+    virTypedParamsFree(params, nparams);
+    return ret;
+}
+
 static void *
 vshAdmConnectionHandler(vshControl *ctl)
 {
@@ -1419,6 +1536,22 @@ static const vshCmdDef monitoringCmds[] = {
      .info = info_srv_clients_info,
      .flags = 0
     },
+    {.name = "srv-rpc-stats",
+     .flags = VSH_CMD_FLAG_ALIAS,
+     .alias = "server-rpc-stats"
+    },
+    {.name = "server-rpc-stats",
+     .handler = cmdSrvRPCStats,
+     .opts = opts_srv_rpc_stats,
+     .info = info_srv_rpc_stats,
+     .flags = 0
+    },
+    {.name = "daemon-host-cpu-rates",
+     .handler = cmdDaemonHostCPURates,
+     .opts = opts_daemon_host_cpu_rates,
+     .info = info_daemon_host_cpu_rates,
+     .flags = 0
+    },
     {.name = NULL}
 };
 